@@ -0,0 +1,282 @@
+#pragma once
+#include <list>
+#include <mutex>
+#include <future>
+#include <memory>
+#include <string>
+#include <filesystem>
+#include <unordered_map>
+
+#include "ZipArchive.h"
+
+
+namespace ZipExtractor
+{
+
+    /// <summary>
+    /// A process-wide cache of opened zip files.
+    /// Keeps up to a maximum number of parsed ZipArchives (and their mappings) open and closes the least recently used ones when the limit is reached.
+    /// Concurrent requests for a zip that is still being opened wait for that single open instead of opening the zip again
+    /// </summary>
+    class ArchiveHandleCache
+    {
+
+    public:
+
+        // The default maximum number of zip files that the process-wide cache keeps open
+        static constexpr size_t DEFAULT_MAX_OPEN_ARCHIVES = 256;
+
+
+    private:
+
+        // A single opened zip file
+        struct CacheNode
+        {
+            std::string archivePath;
+
+            // The archive path and the password, the same zip opened with another password is a different archive
+            std::string cacheKey;
+
+            std::shared_ptr<const ZipArchive> archive;
+        };
+
+
+    private:
+
+        std::mutex _lock;
+
+        // The opened zip files ordered from the most recently used to the least recently used
+        std::list<CacheNode> _lruList;
+
+        // A lookup table into _lruList
+        std::unordered_map<std::string, std::list<CacheNode>::iterator> _lookup;
+
+        // Zip files that are currently being opened
+        std::unordered_map<std::string, std::shared_future<std::shared_ptr<const ZipArchive>>> _pendingOpens;
+
+        // The maximum number of zip files that are kept open
+        size_t _maxOpenArchives;
+
+
+    public:
+
+        /// <summary>
+        /// Creates a cache
+        /// </summary>
+        /// <param name="maxOpenArchives"> The maximum number of zip files that are kept open </param>
+        explicit ArchiveHandleCache(size_t maxOpenArchives) :
+            _maxOpenArchives(maxOpenArchives)
+        {
+        };
+
+        ArchiveHandleCache(const ArchiveHandleCache&) = delete;
+        ArchiveHandleCache& operator = (const ArchiveHandleCache&) = delete;
+
+
+        /// <summary>
+        /// Get the process-wide cache
+        /// </summary>
+        static ArchiveHandleCache& GetInstance()
+        {
+            static ArchiveHandleCache instance(DEFAULT_MAX_OPEN_ARCHIVES);
+
+            return instance;
+        };
+
+
+    public:
+
+        /// <summary>
+        /// Get an opened zip file, the zip is opened and parsed only if it isn't already inside the cache.
+        /// The returned archive stays valid even if the cache closes it's own reference in the meantime
+        /// </summary>
+        /// <param name="zipFilepath"> A filepath to the zip </param>
+        /// <param name="password"> The password of the zip's encrypted entries, if there are any </param>
+        /// <returns></returns>
+        std::shared_ptr<const ZipArchive> Acquire(const std::string& zipFilepath, const std::string& password = std::string())
+        {
+            // Different spellings of the same path should share a single open archive
+            const std::string archivePath = NormalizePath(zipFilepath);
+            const std::string cacheKey = MakeCacheKey(archivePath, password);
+
+            std::promise<std::shared_ptr<const ZipArchive>> openPromise;
+
+            {
+                std::unique_lock<std::mutex> guard(_lock);
+
+                auto lookupIterator = _lookup.find(cacheKey);
+
+                if (lookupIterator != _lookup.end())
+                {
+                    // Mark the archive as the most recently used
+                    _lruList.splice(_lruList.begin(), _lruList, lookupIterator->second);
+
+                    return lookupIterator->second->archive;
+                };
+
+                auto pendingIterator = _pendingOpens.find(cacheKey);
+
+                // If someone else is already opening this zip wait for them to finish
+                if (pendingIterator != _pendingOpens.end())
+                {
+                    std::shared_future<std::shared_ptr<const ZipArchive>> pendingOpen = pendingIterator->second;
+
+                    guard.unlock();
+
+                    // Rethrows if the other open failed
+                    return pendingOpen.get();
+                };
+
+                _pendingOpens.emplace(cacheKey, openPromise.get_future().share());
+            };
+
+
+            std::shared_ptr<const ZipArchive> archive;
+
+            // Open and parse the zip outside of the lock so other zips can be acquired in the meantime
+            try
+            {
+                archive = ZipArchive::Open(archivePath, HugePageMode::None, password);
+            }
+            catch (...)
+            {
+                {
+                    std::lock_guard<std::mutex> guard(_lock);
+                    _pendingOpens.erase(cacheKey);
+                };
+
+                openPromise.set_exception(std::current_exception());
+                throw;
+            };
+
+
+            // Evicted archives are unmapped after the lock is released
+            std::list<CacheNode> evictedArchives;
+
+            {
+                std::lock_guard<std::mutex> guard(_lock);
+
+                _pendingOpens.erase(cacheKey);
+
+                _lruList.push_front(CacheNode { archivePath, cacheKey, archive });
+                _lookup.emplace(cacheKey, _lruList.begin());
+
+                EvictExcessArchives(evictedArchives);
+            };
+
+            openPromise.set_value(archive);
+
+            return archive;
+        };
+
+
+        /// <summary>
+        /// Remove a zip from the cache, useful if the zip was changed on disk.
+        /// Removes the zip opened with every password
+        /// </summary>
+        /// <param name="zipFilepath"> A filepath to the zip </param>
+        void Evict(const std::string& zipFilepath)
+        {
+            const std::string archivePath = NormalizePath(zipFilepath);
+
+            std::lock_guard<std::mutex> guard(_lock);
+
+            for (auto nodeIterator = _lruList.begin(); nodeIterator != _lruList.end();)
+            {
+                if (nodeIterator->archivePath != archivePath)
+                {
+                    nodeIterator++;
+                    continue;
+                };
+
+                _lookup.erase(nodeIterator->cacheKey);
+                nodeIterator = _lruList.erase(nodeIterator);
+            };
+        };
+
+
+        /// <summary>
+        /// Close every zip inside the cache
+        /// </summary>
+        void Clear()
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+
+            _lookup.clear();
+            _lruList.clear();
+        };
+
+
+        /// <summary>
+        /// Change the maximum number of zip files that are kept open, closing the least recently used ones if needed
+        /// </summary>
+        /// <param name="maxOpenArchives"> The maximum number of zip files that are kept open </param>
+        void SetMaxOpenArchives(size_t maxOpenArchives)
+        {
+            std::list<CacheNode> evictedArchives;
+
+            std::lock_guard<std::mutex> guard(_lock);
+
+            _maxOpenArchives = maxOpenArchives;
+
+            EvictExcessArchives(evictedArchives);
+        };
+
+
+        size_t GetMaxOpenArchives()
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+
+            return _maxOpenArchives;
+        };
+
+        /// <summary>
+        /// Get the number of zip files currently held by the cache
+        /// </summary>
+        size_t GetOpenArchiveCount()
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+
+            return _lruList.size();
+        };
+
+
+    private:
+
+        /// <summary>
+        /// Close the least recently used zip files until the cache is within it's limit.
+        /// Must be called while holding _lock
+        /// </summary>
+        /// <param name="evictedArchivesOut"> An output list that will take over the closed zip files, so they can be released outside of the lock </param>
+        void EvictExcessArchives(std::list<CacheNode>& evictedArchivesOut)
+        {
+            while (_lruList.size() > _maxOpenArchives)
+            {
+                _lookup.erase(_lruList.back().cacheKey);
+                evictedArchivesOut.splice(evictedArchivesOut.begin(), _lruList, std::prev(_lruList.end()));
+            };
+        };
+
+
+        static std::string NormalizePath(const std::string& zipFilepath)
+        {
+            return std::filesystem::absolute(zipFilepath).lexically_normal().string();
+        };
+
+
+        /// <summary>
+        /// Combines a normalized path and a password into a lookup key, paths can't contain a null character so the two can't run into each other
+        /// </summary>
+        static std::string MakeCacheKey(const std::string& archivePath, const std::string& password)
+        {
+            std::string cacheKey = archivePath;
+
+            cacheKey.push_back('\0');
+            cacheKey.append(password);
+
+            return cacheKey;
+        };
+
+    };
+
+};
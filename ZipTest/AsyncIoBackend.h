@@ -0,0 +1,241 @@
+#pragma once
+#include <span>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <exception>
+#include <functional>
+#include <coroutine>
+
+#include "ThreadPool.h"
+#include "AsyncTask.h"
+
+
+namespace ZipExtractor
+{
+
+    // A single read from a zip file
+    struct AsyncReadRequest
+    {
+        // The path to the zip, for backends that read through their own file handles
+        const std::string* archivePath = nullptr;
+
+        // The zip's memory mapping, for backends that read from memory
+        const uint8_t* mappedData = nullptr;
+
+        // The size of the zip file
+        uint64_t archiveSize = 0;
+
+        // An offset inside the zip file to read from
+        uint64_t offset = 0;
+
+        // A buffer that will contain the read bytes, it's size is the number of bytes to read
+        std::span<uint8_t> destination;
+    };
+
+
+    // Called once an asynchronous operation is done, with the error it failed with or nullptr
+    using AsyncCompletion = std::function<void(std::exception_ptr)>;
+
+
+    /// <summary>
+    /// The interface that the asynchronous zip operations use for their I/O.
+    /// Implementations must never block the calling thread, and call the completion exactly once from any thread
+    /// </summary>
+    class IAsyncIoBackend
+    {
+
+    public:
+
+        virtual ~IAsyncIoBackend() = default;
+
+
+    public:
+
+        /// <summary>
+        /// Read a range of the zip file
+        /// </summary>
+        /// <param name="request"> What to read and where to </param>
+        /// <param name="completion"> Called once the read is done </param>
+        virtual void ReadAsync(const AsyncReadRequest& request, AsyncCompletion completion) = 0;
+
+        /// <summary>
+        /// Write an entire file onto disk
+        /// </summary>
+        /// <param name="filepath"> The path of the file that will be written </param>
+        /// <param name="data"> The file's contents, must stay alive until the completion is called </param>
+        /// <param name="completion"> Called once the write is done </param>
+        virtual void WriteFileAsync(const std::string& filepath, std::span<const uint8_t> data, AsyncCompletion completion) = 0;
+
+    };
+
+
+
+    /// <summary>
+    /// The default backend, reads are copies out of the zip's memory mapping and writes go through std::ofstream.
+    /// Both run on a small dedicated I/O pool, so page faults and disk writes block the pool's threads instead of the caller's
+    /// </summary>
+    class ThreadPoolIoBackend : public IAsyncIoBackend
+    {
+
+    private:
+
+        ThreadPool& _ioPool;
+
+
+    public:
+
+        /// <summary>
+        /// Creates a backend
+        /// </summary>
+        /// <param name="ioPool"> The pool that runs the blocking I/O, must outlive the backend </param>
+        explicit ThreadPoolIoBackend(ThreadPool& ioPool) :
+            _ioPool(ioPool)
+        {
+        };
+
+
+    public:
+
+        void ReadAsync(const AsyncReadRequest& request, AsyncCompletion completion) override
+        {
+            _ioPool.Submit([request, completion = std::move(completion)]()
+            {
+                if ((request.offset + request.destination.size()) > request.archiveSize)
+                {
+                    completion(std::make_exception_ptr(std::exception("Reading invalid data")));
+                    return;
+                };
+
+                memcpy(request.destination.data(), &request.mappedData[request.offset], request.destination.size());
+
+                completion(nullptr);
+            });
+        };
+
+
+        void WriteFileAsync(const std::string& filepath, std::span<const uint8_t> data, AsyncCompletion completion) override
+        {
+            _ioPool.Submit([filepath, data, completion = std::move(completion)]()
+            {
+                std::ofstream output(filepath, std::ios::binary);
+
+                output.write(reinterpret_cast<const char*>(data.data()), data.size());
+                output.close();
+
+                if (output.fail() == true)
+                    completion(std::make_exception_ptr(std::exception("Error writing output file")));
+                else
+                    completion(nullptr);
+            });
+        };
+
+    };
+
+
+
+    // Everything the asynchronous zip operations run on
+    struct AsyncContext
+    {
+        // Runs the reads and writes
+        IAsyncIoBackend& ioBackend;
+
+        // Runs decompression and crc checks
+        ThreadPool& computePool;
+
+
+        /// <summary>
+        /// Get a process-wide context, with a 4 thread I/O pool and a compute pool with a thread per hardware thread
+        /// </summary>
+        static AsyncContext& GetDefault()
+        {
+            static ThreadPool ioPool(4);
+            static ThreadPool computePool;
+            static ThreadPoolIoBackend ioBackend(ioPool);
+
+            static AsyncContext context { ioBackend, computePool };
+
+            return context;
+        };
+    };
+
+
+
+    namespace Details
+    {
+
+        // Suspends the awaiting coroutine while a backend operation runs, and resumes it from the backend's completion
+        struct AsyncIoAwaiter
+        {
+            // Starts the operation with the given completion
+            std::function<void(AsyncCompletion)> startOperation;
+
+            std::exception_ptr error = nullptr;
+
+
+            bool await_ready() const noexcept
+            {
+                return false;
+            };
+
+            void await_suspend(std::coroutine_handle<> awaitingCoroutine)
+            {
+                // The coroutine, and this awaiter with it, can be resumed and destroyed before the start function returns
+                const std::function<void(AsyncCompletion)> start = std::move(startOperation);
+
+                start([this, awaitingCoroutine](std::exception_ptr operationError)
+                {
+                    error = operationError;
+                    awaitingCoroutine.resume();
+                });
+            };
+
+            void await_resume() const
+            {
+                if (error != nullptr)
+                    std::rethrow_exception(error);
+            };
+        };
+
+    };
+
+
+
+    /// <summary>
+    /// Read a range of a zip file through the context's backend
+    /// </summary>
+    /// <param name="context"> The context to read with </param>
+    /// <param name="request"> What to read and where to </param>
+    /// <returns></returns>
+    inline Details::AsyncIoAwaiter ReadAsync(AsyncContext& context, const AsyncReadRequest& request)
+    {
+        return Details::AsyncIoAwaiter
+        {
+            [&context, request](AsyncCompletion completion)
+            {
+                context.ioBackend.ReadAsync(request, std::move(completion));
+            }
+        };
+    };
+
+
+    /// <summary>
+    /// Write an entire file through the context's backend
+    /// </summary>
+    /// <param name="context"> The context to write with </param>
+    /// <param name="filepath"> The path of the file that will be written </param>
+    /// <param name="data"> The file's contents </param>
+    /// <returns></returns>
+    inline Details::AsyncIoAwaiter WriteFileAsync(AsyncContext& context, const std::string& filepath, std::span<const uint8_t> data)
+    {
+        return Details::AsyncIoAwaiter
+        {
+            [&context, filepath, data](AsyncCompletion completion)
+            {
+                context.ioBackend.WriteFileAsync(filepath, data, std::move(completion));
+            }
+        };
+    };
+
+};
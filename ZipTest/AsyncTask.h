@@ -0,0 +1,340 @@
+#pragma once
+#include <mutex>
+#include <utility>
+#include <optional>
+#include <exception>
+#include <coroutine>
+#include <type_traits>
+#include <condition_variable>
+
+#include "ThreadPool.h"
+
+
+namespace ZipExtractor
+{
+
+    template<typename T>
+    class Task;
+
+
+    namespace Details
+    {
+
+        // The parts of a Task's promise that don't depend on the result type
+        struct TaskPromiseBase
+        {
+            // The coroutine that is awaiting this task, resumed once the task finishes
+            std::coroutine_handle<> continuation = std::noop_coroutine();
+
+            std::exception_ptr error;
+
+
+            // Resumes the awaiting coroutine straight from the finished task, without growing the stack
+            struct FinalAwaiter
+            {
+                bool await_ready() const noexcept
+                {
+                    return false;
+                };
+
+                template<typename Promise>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> finishedCoroutine) noexcept
+                {
+                    return finishedCoroutine.promise().continuation;
+                };
+
+                void await_resume() const noexcept
+                {
+                };
+            };
+
+
+            // Tasks are lazy, they only start running once they are awaited
+            std::suspend_always initial_suspend() const noexcept
+            {
+                return { };
+            };
+
+            FinalAwaiter final_suspend() const noexcept
+            {
+                return { };
+            };
+
+            void unhandled_exception() noexcept
+            {
+                error = std::current_exception();
+            };
+        };
+
+
+        template<typename T>
+        struct TaskPromise : public TaskPromiseBase
+        {
+            std::optional<T> value;
+
+
+            Task<T> get_return_object() noexcept;
+
+            void return_value(T result)
+            {
+                value.emplace(std::move(result));
+            };
+
+            T TakeResult()
+            {
+                if (error != nullptr)
+                    std::rethrow_exception(error);
+
+                return std::move(*value);
+            };
+        };
+
+
+        template<>
+        struct TaskPromise<void> : public TaskPromiseBase
+        {
+            Task<void> get_return_object() noexcept;
+
+            void return_void() const noexcept
+            {
+            };
+
+            void TakeResult()
+            {
+                if (error != nullptr)
+                    std::rethrow_exception(error);
+            };
+        };
+
+
+        // A coroutine that starts right away and destroys itself when it's done, used to drive a Task from non-coroutine code
+        struct DetachedCoroutine
+        {
+            struct promise_type
+            {
+                DetachedCoroutine get_return_object() const noexcept
+                {
+                    return { };
+                };
+
+                std::suspend_never initial_suspend() const noexcept
+                {
+                    return { };
+                };
+
+                std::suspend_never final_suspend() const noexcept
+                {
+                    return { };
+                };
+
+                void return_void() const noexcept
+                {
+                };
+
+                void unhandled_exception() const noexcept
+                {
+                    std::terminate();
+                };
+            };
+        };
+
+    };
+
+
+
+    /// <summary>
+    /// A lazily started coroutine that produces a T.
+    /// The task runs once it's co_awaited, and the awaiting coroutine is resumed on whichever thread the task finishes on
+    /// </summary>
+    template<typename T>
+    class Task
+    {
+
+    public:
+
+        using promise_type = Details::TaskPromise<T>;
+
+
+    private:
+
+        std::coroutine_handle<promise_type> _coroutine;
+
+
+    public:
+
+        explicit Task(std::coroutine_handle<promise_type> coroutine) :
+            _coroutine(coroutine)
+        {
+        };
+
+        Task(Task&& other) noexcept :
+            _coroutine(std::exchange(other._coroutine, nullptr))
+        {
+        };
+
+        Task& operator = (Task&& other) noexcept
+        {
+            if (this != &other)
+            {
+                if (_coroutine)
+                    _coroutine.destroy();
+
+                _coroutine = std::exchange(other._coroutine, nullptr);
+            };
+
+            return *this;
+        };
+
+        ~Task()
+        {
+            if (_coroutine)
+                _coroutine.destroy();
+        };
+
+        Task(const Task&) = delete;
+        Task& operator = (const Task&) = delete;
+
+
+    public:
+
+        auto operator co_await () && noexcept
+        {
+            struct TaskAwaiter
+            {
+                std::coroutine_handle<promise_type> coroutine;
+
+                bool await_ready() const noexcept
+                {
+                    return (!coroutine) || (coroutine.done());
+                };
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaitingCoroutine) noexcept
+                {
+                    coroutine.promise().continuation = awaitingCoroutine;
+
+                    // Start the task
+                    return coroutine;
+                };
+
+                T await_resume()
+                {
+                    return coroutine.promise().TakeResult();
+                };
+            };
+
+            return TaskAwaiter { _coroutine };
+        };
+
+    };
+
+
+    namespace Details
+    {
+
+        template<typename T>
+        Task<T> TaskPromise<T>::get_return_object() noexcept
+        {
+            return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+        };
+
+        inline Task<void> TaskPromise<void>::get_return_object() noexcept
+        {
+            return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+        };
+
+    };
+
+
+
+    /// <summary>
+    /// An awaitable that moves the awaiting coroutine onto one of the pool's threads
+    /// </summary>
+    /// <param name="threadPool"> The pool to continue on </param>
+    /// <returns></returns>
+    inline auto ScheduleOn(ThreadPool& threadPool)
+    {
+        struct ScheduleAwaiter
+        {
+            ThreadPool& threadPool;
+
+            bool await_ready() const noexcept
+            {
+                return false;
+            };
+
+            void await_suspend(std::coroutine_handle<> awaitingCoroutine)
+            {
+                threadPool.Submit([awaitingCoroutine]()
+                {
+                    awaitingCoroutine.resume();
+                });
+            };
+
+            void await_resume() const noexcept
+            {
+            };
+        };
+
+        return ScheduleAwaiter { threadPool };
+    };
+
+
+
+    /// <summary>
+    /// Runs a task and blocks the calling thread until it's done, for callers that aren't coroutines themselves
+    /// </summary>
+    /// <param name="task"> The task to run </param>
+    /// <returns> The task's result </returns>
+    template<typename T>
+    T SyncWait(Task<T> task)
+    {
+        std::optional<std::conditional_t<std::is_void_v<T>, bool, T>> result;
+        std::exception_ptr error;
+
+        // The waiting thread can only return after the task released the lock, so the task never touches a destroyed condition variable
+        std::mutex doneLock;
+        std::condition_variable doneSignal;
+        bool isDone = false;
+
+        auto runTask = [&]() -> Details::DetachedCoroutine
+        {
+            try
+            {
+                if constexpr (std::is_void_v<T>)
+                {
+                    co_await std::move(task);
+                    result.emplace(true);
+                }
+                else
+                    result.emplace(co_await std::move(task));
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            };
+
+            std::lock_guard<std::mutex> guard(doneLock);
+
+            isDone = true;
+            doneSignal.notify_one();
+        };
+
+        runTask();
+
+        {
+            std::unique_lock<std::mutex> guard(doneLock);
+
+            doneSignal.wait(guard, [&]()
+            {
+                return isDone;
+            });
+        };
+
+        if (error != nullptr)
+            std::rethrow_exception(error);
+
+        if constexpr (std::is_void_v<T> == false)
+            return std::move(*result);
+    };
+
+};
@@ -0,0 +1,709 @@
+#pragma once
+#include <mutex>
+#include <queue>
+#include <deque>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <fstream>
+#include <cstdint>
+#include <algorithm>
+#include <filesystem>
+#include <condition_variable>
+
+#include "ZipArchive.h"
+#include "ConcurrencyController.h"
+#include "MemoryBudget.h"
+
+
+namespace ZipExtractor
+{
+
+    // A single zip to extract as part of a batch
+    struct BatchArchiveJob
+    {
+        // A filepath to the zip
+        std::string archivePath;
+
+        // An output path to which the zip's entries will be extracted
+        std::string outputFolder;
+
+        // The password of the zip's encrypted entries, if there are any
+        std::string password;
+    };
+
+
+    // A zip that failed to extract, the rest of the batch still runs
+    struct BatchArchiveError
+    {
+        std::string archivePath;
+
+        std::string message;
+    };
+
+
+    // The outcome of a batch extraction
+    struct BatchExtractionResult
+    {
+        // The number of zips that were extracted without errors
+        size_t extractedArchives = 0;
+
+        // The number of files that were written, across every zip
+        size_t extractedEntries = 0;
+
+        // The number of decompressed bytes that were written, across every zip
+        uint64_t extractedBytes = 0;
+
+        std::vector<BatchArchiveError> errors;
+
+
+        // Wall time of the entire batch
+        double elapsedSeconds = 0.0;
+
+        // Decompressed bytes written per second of wall time
+        double throughputBytesPerSecond = 0.0;
+
+        // Time spent decompressing, summed over every worker
+        double inflateSeconds = 0.0;
+
+        // Time spent waiting for a write slot, summed over every worker
+        double writeStallSeconds = 0.0;
+
+        // Time spent writing, summed over every worker
+        double writeSeconds = 0.0;
+
+        // The number of active workers and concurrent writes the batch ended with
+        size_t finalWorkerLimit = 0;
+        size_t finalWriteLimit = 0;
+
+        // How many times the concurrency controller changed a limit
+        size_t concurrencyAdjustments = 0;
+
+        // True if the batch was stopped through it's ExtractionProgress
+        bool cancelled = false;
+    };
+
+
+
+    /// <summary>
+    /// Extracts many zips at once.
+    /// Instead of running one zip after another (or one zip per thread), the files of every open zip share a single work queue
+    /// that is served largest file first, so a single big zip is spread across every thread instead of becoming the tail of the batch.
+    /// Inside a zip, every folder is created before any of it's files are queued.
+    /// Decompression runs on every thread, but only a limited number of threads write to the disk at the same time.
+    /// By default a ConcurrencyController adjusts the number of active workers and concurrent writes while the batch runs,
+    /// depending on whether decompression or the disk is the bottleneck.
+    /// With a MemoryBudget every file reserves the memory it's about to use before it's extracted, and waits while the budget is used up
+    /// </summary>
+    class BatchExtractor
+    {
+
+    public:
+
+        // The default number of threads that may write to the disk at the same time
+        static constexpr size_t DEFAULT_MAX_CONCURRENT_WRITES = 4;
+
+        // The default number of zips that are mapped and queued at the same time
+        static constexpr size_t DEFAULT_MAX_OPEN_ARCHIVES = 64;
+
+        // Files up to this size (and up to half of the memory budget) are decompressed into memory before they wait for a write slot,
+        // bigger files are streamed through the ExtractionPipeline while holding the slot
+        static constexpr uint64_t BUFFERED_ENTRY_LIMIT = 64ULL * 1024 * 1024;
+
+
+    private:
+
+        // A zip that is currently open, shared by all of it's queued files
+        struct OpenArchive
+        {
+            const BatchArchiveJob* job = nullptr;
+
+            std::shared_ptr<const ZipArchive> archive;
+
+            // The number of files that are either queued or being extracted
+            size_t remainingEntries = 0;
+
+            // Set once any of the zip's files failed, the rest of it's files are skipped
+            bool failed = false;
+        };
+
+
+        // How a single file went, and where it's time went
+        struct EntryOutcome
+        {
+            // An error message, or an empty string if the file was extracted
+            std::string error;
+
+            double inflateSeconds = 0.0;
+
+            double writeStallSeconds = 0.0;
+
+            double writeSeconds = 0.0;
+        };
+
+
+        // A single file waiting in the global queue
+        struct EntryWork
+        {
+            OpenArchive* openArchive = nullptr;
+
+            const EntryInfo* entry = nullptr;
+
+
+            // The priority queue pops the biggest file first
+            bool operator < (const EntryWork& other) const
+            {
+                return entry->uncompressedSize < other.entry->uncompressedSize;
+            };
+        };
+
+
+    private:
+
+        const size_t _threadCount;
+
+        const size_t _maxOpenArchives;
+
+        // Optional, limits the memory used by buffered and streamed files
+        MemoryBudget* _memoryBudget = nullptr;
+
+        // Used instead of the default pool while there's a memory budget, it doesn't keep returned buffers so freed memory really is free
+        BufferPool _uncachedBufferPool { 0 };
+
+
+        // Everything below is only used during Extract, and is guarded by _lock
+
+        std::mutex _lock;
+
+        // Signaled when work is queued, when a zip is closed, when a worker goes idle and when the limits change
+        std::condition_variable _stateChanged;
+
+        // Signaled when a write slot is released or the write limit changes
+        std::condition_variable _writeSlotReleased;
+
+        // Decides how many workers may be busy and how many of them may write at the same time
+        ConcurrencyController _controller;
+
+        // The number of workers that are currently writing
+        size_t _activeWrites = 0;
+
+        const std::vector<BatchArchiveJob>* _jobs = nullptr;
+
+        // Optional, shared by every worker
+        ExtractionProgress* _progress = nullptr;
+
+        // The index of the next zip to open
+        size_t _nextJobIndex = 0;
+
+        std::deque<OpenArchive> _openArchives;
+
+        size_t _openArchiveCount = 0;
+
+        std::priority_queue<EntryWork> _queuedEntries;
+
+        // The number of workers that are opening a zip or extracting a file
+        size_t _busyWorkers = 0;
+
+        BatchExtractionResult _result;
+
+
+    public:
+
+        /// <summary>
+        /// Creates an extractor
+        /// </summary>
+        /// <param name="threadCount"> The number of worker threads, 0 uses the number of hardware threads </param>
+        /// <param name="maxConcurrentWrites"> The number of threads that may write to the disk at the same time, the starting point when adapting </param>
+        /// <param name="maxOpenArchives"> The number of zips that are mapped and queued at the same time </param>
+        /// <param name="adaptiveConcurrency"> Adjust the active workers and concurrent writes while running, false keeps them fixed </param>
+        explicit BatchExtractor(size_t threadCount = 0,
+                                size_t maxConcurrentWrites = DEFAULT_MAX_CONCURRENT_WRITES,
+                                size_t maxOpenArchives = DEFAULT_MAX_OPEN_ARCHIVES,
+                                bool adaptiveConcurrency = true) :
+            _threadCount((threadCount == 0) ? std::max<size_t>(std::thread::hardware_concurrency(), 1) : threadCount),
+            _maxOpenArchives(std::max<size_t>(maxOpenArchives, 1)),
+            _controller(_threadCount, maxConcurrentWrites, adaptiveConcurrency)
+        {
+        };
+
+        BatchExtractor(const BatchExtractor&) = delete;
+        BatchExtractor& operator = (const BatchExtractor&) = delete;
+
+
+    public:
+
+        /// <summary>
+        /// Caps the memory used by in-flight files. A buffered file reserves it's decompressed size, a streamed file reserves the pipeline's buffers,
+        /// and a worker whose reservation doesn't fit waits for the budget instead of failing.
+        /// Zips are memory mapped and their pages aren't counted, neither is zlib's per-thread state of about 40 KiB.
+        /// Must not be called while Extract is running
+        /// </summary>
+        /// <param name="memoryBudget"> The budget to reserve from, or nullptr to remove it. Must outlive every Extract call that uses it </param>
+        void SetMemoryBudget(MemoryBudget* memoryBudget)
+        {
+            _memoryBudget = memoryBudget;
+        };
+
+
+    public:
+
+        /// <summary>
+        /// Extracts every zip in the batch and blocks until all of them are done.
+        /// A zip that fails to open or extract is reported in the result, and doesn't stop the rest of the batch.
+        /// Cancelling through the progress stops every worker at it's next chunk, the zips that weren't finished don't count as extracted
+        /// </summary>
+        /// <param name="jobs"> The zips to extract </param>
+        /// <param name="progress"> Optional, receives the batch's progress as zips are opened and files are written </param>
+        /// <returns></returns>
+        BatchExtractionResult Extract(const std::vector<BatchArchiveJob>& jobs, ExtractionProgress* progress = nullptr)
+        {
+            {
+                std::lock_guard<std::mutex> guard(_lock);
+
+                _jobs = &jobs;
+                _progress = progress;
+                _nextJobIndex = 0;
+                _openArchives.clear();
+                _openArchiveCount = 0;
+                _queuedEntries = { };
+                _busyWorkers = 0;
+                _activeWrites = 0;
+                _result = { };
+
+                _controller.Restart(ConcurrencyController::Clock::now());
+            };
+
+            std::vector<std::thread> workers;
+            workers.reserve(_threadCount);
+
+            for (size_t threadIndex = 0; threadIndex < _threadCount; threadIndex++)
+                workers.emplace_back(&BatchExtractor::WorkerLoop, this);
+
+            for (std::thread& worker : workers)
+                worker.join();
+
+            std::lock_guard<std::mutex> guard(_lock);
+
+            _result.cancelled = IsCancelled();
+
+            _jobs = nullptr;
+            _progress = nullptr;
+            _openArchives.clear();
+
+            _result.elapsedSeconds = _controller.GetElapsedSeconds(ConcurrencyController::Clock::now());
+            _result.throughputBytesPerSecond = (_result.elapsedSeconds > 0.0) ? (_controller.GetTotalBytes() / _result.elapsedSeconds) : 0.0;
+            _result.inflateSeconds = _controller.GetTotalInflateSeconds();
+            _result.writeStallSeconds = _controller.GetTotalWriteStallSeconds();
+            _result.writeSeconds = _controller.GetTotalWriteSeconds();
+            _result.finalWorkerLimit = _controller.GetWorkerLimit();
+            _result.finalWriteLimit = _controller.GetWriteLimit();
+            _result.concurrencyAdjustments = _controller.GetAdjustmentCount();
+
+            return std::move(_result);
+        };
+
+
+    private:
+
+        void WorkerLoop()
+        {
+            std::unique_lock<std::mutex> guard(_lock);
+
+            while (true)
+            {
+                // Workers above the controller's limit stay parked until the limit grows or the batch is done
+                _stateChanged.wait(guard, [this]()
+                {
+                    return ((HasWorkerSlot() == true) && ((CanOpenArchive() == true) || (_queuedEntries.empty() == false))) ||
+                           (IsBatchDone() == true);
+                });
+
+                if (IsBatchDone() == true)
+                    return;
+
+                // Keep the window of open zips full, so the queue always has every open zip's files to choose from
+                if ((HasWorkerSlot() == true) && (CanOpenArchive() == true))
+                {
+                    const BatchArchiveJob& job = (*_jobs)[_nextJobIndex];
+                    _nextJobIndex++;
+
+                    _openArchiveCount++;
+                    _busyWorkers++;
+
+                    guard.unlock();
+                    OpenArchive* openArchive = OpenJob(job);
+                    guard.lock();
+
+                    _busyWorkers--;
+
+                    if (openArchive != nullptr)
+                        QueueEntries(*openArchive);
+                    else
+                        _openArchiveCount--;
+
+                    _stateChanged.notify_all();
+                    continue;
+                };
+
+                if ((HasWorkerSlot() == true) && (_queuedEntries.empty() == false))
+                {
+                    const EntryWork work = _queuedEntries.top();
+                    _queuedEntries.pop();
+
+                    _busyWorkers++;
+
+                    // The rest of a failed or cancelled zip is only counted down
+                    if (IsCancelled() == true)
+                        work.openArchive->failed = true;
+
+                    const bool skip = work.openArchive->failed;
+
+                    guard.unlock();
+                    const EntryOutcome outcome = (skip == true) ? EntryOutcome() : ExtractFile(*work.openArchive, *work.entry);
+                    guard.lock();
+
+                    _busyWorkers--;
+
+                    FinishEntry(*work.openArchive, *work.entry, skip, outcome);
+
+                    // Let the controller react to the finished file, parked workers and writers re-check the new limits
+                    if (_controller.Update(ConcurrencyController::Clock::now()) == true)
+                        _writeSlotReleased.notify_all();
+
+                    _stateChanged.notify_all();
+                    continue;
+                };
+            };
+        };
+
+
+        /// <summary>
+        /// Opens a zip and creates all of it's folders, called without holding the lock
+        /// </summary>
+        /// <param name="job"> The zip to open </param>
+        /// <returns> The opened zip, or nullptr if it failed </returns>
+        OpenArchive* OpenJob(const BatchArchiveJob& job)
+        {
+            try
+            {
+                std::shared_ptr<const ZipArchive> archive = ZipArchive::Open(job.archivePath, HugePageMode::None, job.password);
+
+                // The folder that couldn't be created, and why
+                std::string folderError;
+
+                // Folders are created before any file is queued, so the files of a zip never race it's folders
+                for (const EntryInfo& entry : archive->GetEntries())
+                {
+                    if (entry.isDirectory == false)
+                        continue;
+
+                    try
+                    {
+                        std::filesystem::create_directories(Utilities::GetOutputPath(job.outputFolder, entry.filename));
+                    }
+                    catch (const std::exception& exception)
+                    {
+                        folderError = entry.filename + ": " + exception.what();
+                        break;
+                    };
+                };
+
+                std::lock_guard<std::mutex> guard(_lock);
+
+                OpenArchive& openArchive = _openArchives.emplace_back();
+                openArchive.job = &job;
+                openArchive.archive = std::move(archive);
+
+                // Failed like a file that failed, the zip's files are skipped
+                if (folderError.empty() == false)
+                {
+                    openArchive.failed = true;
+                    _result.errors.push_back({ job.archivePath, folderError });
+                };
+
+                return &openArchive;
+            }
+            catch (const std::exception& exception)
+            {
+                std::lock_guard<std::mutex> guard(_lock);
+                _result.errors.push_back({ job.archivePath, exception.what() });
+
+                return nullptr;
+            };
+        };
+
+
+        /// <summary>
+        /// Pushes all of a zip's files into the global queue, called while holding the lock
+        /// </summary>
+        void QueueEntries(OpenArchive& openArchive)
+        {
+            uint64_t queuedBytes = 0;
+
+            for (const EntryInfo& entry : openArchive.archive->GetEntries())
+            {
+                if (entry.isDirectory == true)
+                    continue;
+
+                _queuedEntries.push({ &openArchive, &entry });
+                openArchive.remainingEntries++;
+
+                queuedBytes += entry.uncompressedSize;
+            };
+
+            if (_progress != nullptr)
+                _progress->AddTotal(openArchive.remainingEntries, queuedBytes);
+
+            // A zip with only folders is already done
+            if (openArchive.remainingEntries == 0)
+                CloseArchive(openArchive);
+        };
+
+
+        /// <summary>
+        /// Extracts a single file, called without holding the lock
+        /// </summary>
+        /// <returns> The error the file failed with, and how long each stage took </returns>
+        EntryOutcome ExtractFile(const OpenArchive& openArchive, const EntryInfo& entry)
+        {
+            EntryOutcome outcome;
+
+            try
+            {
+                const ZipArchive& archive = *openArchive.archive;
+
+                if (ShouldBuffer(entry) == false)
+                {
+                    // Reserve memory before taking a write slot, so a slot is never held while waiting for the budget
+                    MemoryReservation reservation(_memoryBudget, ExtractionPipeline::MEMORY_SIZE);
+
+                    WriteSlot slot(*this, outcome);
+
+                    // Decompression and writing overlap inside the pipeline, the whole time counts as writing
+                    const auto writeStart = ConcurrencyController::Clock::now();
+
+                    try
+                    {
+                        archive.ExtractEntry(entry, openArchive.job->outputFolder, _progress);
+                    }
+                    catch (...)
+                    {
+                        ReleasePipelineBuffers();
+                        throw;
+                    };
+
+                    ReleasePipelineBuffers();
+
+                    outcome.writeSeconds = SecondsSince(writeStart);
+
+                    return outcome;
+                };
+
+                // The leased buffer is rounded up to a size class, reserve what is actually allocated
+                MemoryReservation reservation(_memoryBudget, BufferPool::GetLeaseCapacity(static_cast<size_t>(entry.uncompressedSize)));
+
+                // Decompress without holding a write slot, so the disk only waits on the actual writes
+                const auto inflateStart = ConcurrencyController::Clock::now();
+
+                // Leased buffers aren't zero filled, and reused ones are already faulted in
+                BufferPool& bufferPool = (_memoryBudget == nullptr) ? BufferPool::GetDefault() : _uncachedBufferPool;
+
+                const PooledBuffer fileData = archive.ReadEntry(entry, bufferPool);
+
+                outcome.inflateSeconds = SecondsSince(inflateStart);
+
+                // Throws for names that would end up outside of the output folder
+                const std::filesystem::path outputPath = Utilities::GetOutputPath(openArchive.job->outputFolder, entry.filename);
+
+                // Zips don't have to contain an entry for every folder
+                if (outputPath.has_parent_path() == true)
+                    std::filesystem::create_directories(outputPath.parent_path());
+
+                WriteSlot slot(*this, outcome);
+
+                const auto writeStart = ConcurrencyController::Clock::now();
+
+                std::ofstream output(outputPath, std::ios::binary);
+
+                if (output.is_open() == false)
+                    throw std::exception("Failed to create output file");
+
+                // Written in pipeline sized chunks, so progress and cancellation have the same granularity as streamed files
+                for (size_t offset = 0; offset < fileData.size(); offset += ExtractionPipeline::CHUNK_SIZE)
+                {
+                    const size_t chunkSize = std::min(ExtractionPipeline::CHUNK_SIZE, fileData.size() - offset);
+
+                    output.write(reinterpret_cast<const char*>(&fileData[offset]), chunkSize);
+
+                    // Stop at the first failed write instead of writing the rest of the file into a broken stream
+                    if (output.good() == false)
+                        throw std::exception("Error writing output file");
+
+                    if (_progress != nullptr)
+                    {
+                        _progress->AddBytes(chunkSize);
+                        _progress->ThrowIfCancelled();
+                    };
+                };
+
+                output.close();
+
+                outcome.writeSeconds = SecondsSince(writeStart);
+
+                if (output.fail() == true)
+                    throw std::exception("Error writing output file");
+
+                if (_progress != nullptr)
+                    _progress->FinishEntry(entry.filename, entry.uncompressedSize);
+            }
+            catch (const std::exception& exception)
+            {
+                outcome.error = exception.what();
+            };
+
+            return outcome;
+        };
+
+
+        /// <summary>
+        /// Records a finished file, and closes it's zip once all of the zip's files are done. Called while holding the lock
+        /// </summary>
+        void FinishEntry(OpenArchive& openArchive, const EntryInfo& entry, bool skipped, const EntryOutcome& outcome)
+        {
+            if (skipped == false)
+            {
+                if (outcome.error.empty() == true)
+                {
+                    _result.extractedEntries++;
+                    _result.extractedBytes += entry.uncompressedSize;
+
+                    _controller.AddSample(entry.uncompressedSize, outcome.inflateSeconds, outcome.writeStallSeconds, outcome.writeSeconds);
+                }
+                // A cancelled file isn't an error
+                else if (IsCancelled() == true)
+                    openArchive.failed = true;
+                else if (openArchive.failed == false)
+                {
+                    openArchive.failed = true;
+                    _result.errors.push_back({ openArchive.job->archivePath, entry.filename + ": " + outcome.error });
+                };
+            };
+
+            openArchive.remainingEntries--;
+
+            if (openArchive.remainingEntries == 0)
+                CloseArchive(openArchive);
+        };
+
+
+        /// <summary>
+        /// Unmaps a finished zip and makes room for the next one, called while holding the lock
+        /// </summary>
+        void CloseArchive(OpenArchive& openArchive)
+        {
+            if (openArchive.failed == false)
+                _result.extractedArchives++;
+
+            openArchive.archive.reset();
+            _openArchiveCount--;
+
+            // Closed zips are only removed from the front, so the pointers held by queued files stay valid
+            while ((_openArchives.empty() == false) && (_openArchives.front().archive == nullptr))
+                _openArchives.pop_front();
+        };
+
+
+        bool ShouldBuffer(const EntryInfo& entry) const
+        {
+            if (entry.uncompressedSize > BUFFERED_ENTRY_LIMIT)
+                return false;
+
+            return (_memoryBudget == nullptr) || (BufferPool::GetLeaseCapacity(static_cast<size_t>(entry.uncompressedSize)) <= _memoryBudget->GetCapacity() / 2);
+        };
+
+        /// <summary>
+        /// With a budget the pipeline's buffers are only reserved while a file streams through them, so they are freed right after
+        /// </summary>
+        void ReleasePipelineBuffers()
+        {
+            if (_memoryBudget != nullptr)
+                ExtractionPipeline::GetThreadPipeline().ReleaseBuffers();
+        };
+
+        bool HasWorkerSlot() const
+        {
+            return _busyWorkers < _controller.GetWorkerLimit();
+        };
+
+        bool CanOpenArchive() const
+        {
+            return (_nextJobIndex < _jobs->size()) && (_openArchiveCount < _maxOpenArchives) && (IsCancelled() == false);
+        };
+
+        bool IsBatchDone() const
+        {
+            return ((_nextJobIndex == _jobs->size()) || (IsCancelled() == true)) && (_queuedEntries.empty() == true) && (_busyWorkers == 0);
+        };
+
+        bool IsCancelled() const
+        {
+            return (_progress != nullptr) && (_progress->IsCancelled() == true);
+        };
+
+
+        static double SecondsSince(ConcurrencyController::Clock::time_point start)
+        {
+            return std::chrono::duration<double>(ConcurrencyController::Clock::now() - start).count();
+        };
+
+
+    private:
+
+        // Holds one of the write slots for as long as it's alive, and records how long it waited for it
+        class WriteSlot
+        {
+
+        private:
+
+            BatchExtractor& _extractor;
+
+
+        public:
+
+            WriteSlot(BatchExtractor& extractor, EntryOutcome& outcome) :
+                _extractor(extractor)
+            {
+                const auto waitStart = ConcurrencyController::Clock::now();
+
+                std::unique_lock<std::mutex> guard(_extractor._lock);
+
+                _extractor._writeSlotReleased.wait(guard, [this]()
+                {
+                    return _extractor._activeWrites < _extractor._controller.GetWriteLimit();
+                });
+
+                _extractor._activeWrites++;
+
+                outcome.writeStallSeconds = SecondsSince(waitStart);
+            };
+
+            ~WriteSlot()
+            {
+                {
+                    std::lock_guard<std::mutex> guard(_extractor._lock);
+                    _extractor._activeWrites--;
+                };
+
+                _extractor._writeSlotReleased.notify_one();
+            };
+
+            WriteSlot(const WriteSlot&) = delete;
+            WriteSlot& operator = (const WriteSlot&) = delete;
+
+        };
+
+    };
+
+};
@@ -0,0 +1,466 @@
+#pragma once
+#include <new>
+#include <span>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+
+#include "HugePages.h"
+
+
+namespace ZipExtractor
+{
+
+    class BufferPool;
+
+
+    /// <summary>
+    /// A buffer leased from a BufferPool, returned to the pool when it's destroyed.
+    /// The contents are uninitialized, callers are expected to overwrite all of it
+    /// </summary>
+    class PooledBuffer
+    {
+
+    private:
+
+        BufferPool* _pool = nullptr;
+
+        uint8_t* _data = nullptr;
+
+        // The number of bytes the caller asked for
+        size_t _size = 0;
+
+        // The size of the underlying allocation
+        size_t _capacity = 0;
+
+
+    public:
+
+        PooledBuffer() = default;
+
+        PooledBuffer(BufferPool* pool, uint8_t* data, size_t size, size_t capacity) :
+            _pool(pool),
+            _data(data),
+            _size(size),
+            _capacity(capacity)
+        {
+        };
+
+        PooledBuffer(PooledBuffer&& other) noexcept :
+            _pool(std::exchange(other._pool, nullptr)),
+            _data(std::exchange(other._data, nullptr)),
+            _size(std::exchange(other._size, 0)),
+            _capacity(std::exchange(other._capacity, 0))
+        {
+        };
+
+        PooledBuffer& operator = (PooledBuffer&& other) noexcept
+        {
+            if (this != &other)
+            {
+                Release();
+
+                _pool = std::exchange(other._pool, nullptr);
+                _data = std::exchange(other._data, nullptr);
+                _size = std::exchange(other._size, 0);
+                _capacity = std::exchange(other._capacity, 0);
+            };
+
+            return *this;
+        };
+
+        ~PooledBuffer()
+        {
+            Release();
+        };
+
+        PooledBuffer(const PooledBuffer&) = delete;
+        PooledBuffer& operator = (const PooledBuffer&) = delete;
+
+
+    public:
+
+        /// <summary>
+        /// Return the buffer to it's pool early
+        /// </summary>
+        inline void Release();
+
+
+        uint8_t* data()
+        {
+            return _data;
+        };
+
+        const uint8_t* data() const
+        {
+            return _data;
+        };
+
+        size_t size() const
+        {
+            return _size;
+        };
+
+        size_t GetCapacity() const
+        {
+            return _capacity;
+        };
+
+        uint8_t* begin()
+        {
+            return _data;
+        };
+
+        uint8_t* end()
+        {
+            return _data + _size;
+        };
+
+        const uint8_t* begin() const
+        {
+            return _data;
+        };
+
+        const uint8_t* end() const
+        {
+            return _data + _size;
+        };
+
+        uint8_t& operator [] (size_t index)
+        {
+            return _data[index];
+        };
+
+        const uint8_t& operator [] (size_t index) const
+        {
+            return _data[index];
+        };
+
+        operator std::span<uint8_t> ()
+        {
+            return std::span<uint8_t>(_data, _size);
+        };
+
+        operator std::span<const uint8_t> () const
+        {
+            return std::span<const uint8_t>(_data, _size);
+        };
+
+    };
+
+
+
+    // Counters of a BufferPool
+    struct BufferPoolStatistics
+    {
+        // The number of buffers that were leased
+        uint64_t leaseCount = 0;
+
+        // The number of leases that were served from a cached buffer
+        uint64_t reuseCount = 0;
+
+        // The number of buffers that were allocated from the heap
+        uint64_t allocationCount = 0;
+
+        // The bytes of returned buffers that are kept for reuse
+        uint64_t cachedBytes = 0;
+
+        // The number of allocations that were backed by huge pages
+        uint64_t hugePageAllocationCount = 0;
+    };
+
+
+
+    /// <summary>
+    /// A pool of reusable, uninitialized buffers, in power of two size classes.
+    /// Unlike new uint8_t[n] { 0 } or std::vector::resize, leasing a buffer never zero fills it, and a reused buffer's pages
+    /// are already faulted in, so big decompression targets don't pay for page faults and zeroing on every file.
+    /// Buffers bigger than MAX_CLASS_SIZE are allocated and freed directly.
+    /// A pool can back buffers of at least a huge page with huge pages, those are allocated straight from the OS in whole huge pages.
+    /// Thread-safe, every size class has it's own lock
+    /// </summary>
+    class BufferPool
+    {
+
+    public:
+
+        // The smallest size class, smaller leases are rounded up to it
+        static constexpr size_t MIN_CLASS_SIZE = 4 * 1024;
+
+        // The biggest size class that is cached
+        static constexpr size_t MAX_CLASS_SIZE = 1024ULL * 1024 * 1024;
+
+        // The alignment of every buffer
+        static constexpr size_t BUFFER_ALIGNMENT = 64;
+
+        // The default number of bytes a pool keeps cached
+        static constexpr size_t DEFAULT_MAX_CACHED_BYTES = 256ULL * 1024 * 1024;
+
+
+    private:
+
+        // The number of size classes, MIN_CLASS_SIZE * 2^i for every i up to MAX_CLASS_SIZE
+        static constexpr size_t SIZE_CLASS_COUNT = 19;
+
+        static_assert((MIN_CLASS_SIZE << (SIZE_CLASS_COUNT - 1)) == MAX_CLASS_SIZE);
+
+
+        // Cached buffers of a single size
+        struct SizeClass
+        {
+            std::mutex lock;
+
+            std::vector<uint8_t*> freeBuffers;
+        };
+
+
+    private:
+
+        std::array<SizeClass, SIZE_CLASS_COUNT> _sizeClasses;
+
+        const size_t _maxCachedBytes;
+
+        const HugePageMode _hugePages;
+
+        // Buffers at least this big are backed by huge pages, if the pool uses them
+        const size_t _hugePageThreshold;
+
+        std::atomic<uint64_t> _cachedBytes { 0 };
+
+        std::atomic<uint64_t> _leaseCount { 0 };
+        std::atomic<uint64_t> _reuseCount { 0 };
+        std::atomic<uint64_t> _allocationCount { 0 };
+        std::atomic<uint64_t> _hugePageAllocationCount { 0 };
+
+
+    public:
+
+        /// <summary>
+        /// Creates a pool
+        /// </summary>
+        /// <param name="maxCachedBytes"> The most bytes of returned buffers the pool keeps, buffers returned beyond this are freed </param>
+        /// <param name="hugePages"> The huge page backing to try for buffers of at least a huge page </param>
+        explicit BufferPool(size_t maxCachedBytes = DEFAULT_MAX_CACHED_BYTES, HugePageMode hugePages = HugePageMode::None) :
+            _maxCachedBytes(maxCachedBytes),
+            _hugePages(hugePages),
+            _hugePageThreshold(Utilities::GetHugePageSize())
+        {
+        };
+
+        ~BufferPool()
+        {
+            Trim();
+        };
+
+        BufferPool(const BufferPool&) = delete;
+        BufferPool& operator = (const BufferPool&) = delete;
+
+
+        /// <summary>
+        /// Get the process-wide pool
+        /// </summary>
+        static BufferPool& GetDefault()
+        {
+            static BufferPool pool;
+
+            return pool;
+        };
+
+
+    public:
+
+        /// <summary>
+        /// Lease an uninitialized buffer
+        /// </summary>
+        /// <param name="size"> The number of bytes needed </param>
+        /// <returns> A buffer of at least size bytes, returned to the pool when it's destroyed </returns>
+        PooledBuffer Lease(size_t size)
+        {
+            _leaseCount.fetch_add(1, std::memory_order_relaxed);
+
+            if (size > MAX_CLASS_SIZE)
+            {
+                _allocationCount.fetch_add(1, std::memory_order_relaxed);
+                return PooledBuffer(this, AllocateMemory(size), size, size);
+            };
+
+            const size_t classIndex = GetClassIndex(size);
+            const size_t classSize = MIN_CLASS_SIZE << classIndex;
+
+            SizeClass& sizeClass = _sizeClasses[classIndex];
+
+            {
+                std::lock_guard<std::mutex> guard(sizeClass.lock);
+
+                if (sizeClass.freeBuffers.empty() == false)
+                {
+                    uint8_t* const data = sizeClass.freeBuffers.back();
+                    sizeClass.freeBuffers.pop_back();
+
+                    _cachedBytes.fetch_sub(classSize, std::memory_order_relaxed);
+                    _reuseCount.fetch_add(1, std::memory_order_relaxed);
+
+                    return PooledBuffer(this, data, size, classSize);
+                };
+            };
+
+            _allocationCount.fetch_add(1, std::memory_order_relaxed);
+
+            return PooledBuffer(this, AllocateMemory(classSize), size, classSize);
+        };
+
+
+        /// <summary>
+        /// Get the number of bytes a lease of the given size actually takes
+        /// </summary>
+        /// <param name="size"> The number of bytes needed </param>
+        /// <returns> The size rounded up to it's size class, or the size itself if it's too big to be cached </returns>
+        static size_t GetLeaseCapacity(size_t size)
+        {
+            if (size > MAX_CLASS_SIZE)
+                return size;
+
+            return MIN_CLASS_SIZE << GetClassIndex(size);
+        };
+
+
+        /// <summary>
+        /// Frees every cached buffer, leased buffers are unaffected
+        /// </summary>
+        void Trim()
+        {
+            for (size_t classIndex = 0; classIndex < SIZE_CLASS_COUNT; classIndex++)
+            {
+                SizeClass& sizeClass = _sizeClasses[classIndex];
+
+                std::lock_guard<std::mutex> guard(sizeClass.lock);
+
+                for (uint8_t* data : sizeClass.freeBuffers)
+                {
+                    FreeMemory(data, MIN_CLASS_SIZE << classIndex);
+                    _cachedBytes.fetch_sub(MIN_CLASS_SIZE << classIndex, std::memory_order_relaxed);
+                };
+
+                sizeClass.freeBuffers.clear();
+            };
+        };
+
+
+        BufferPoolStatistics GetStatistics() const
+        {
+            BufferPoolStatistics statistics;
+
+            statistics.leaseCount = _leaseCount.load(std::memory_order_relaxed);
+            statistics.reuseCount = _reuseCount.load(std::memory_order_relaxed);
+            statistics.allocationCount = _allocationCount.load(std::memory_order_relaxed);
+            statistics.cachedBytes = _cachedBytes.load(std::memory_order_relaxed);
+            statistics.hugePageAllocationCount = _hugePageAllocationCount.load(std::memory_order_relaxed);
+
+            return statistics;
+        };
+
+
+    private:
+
+        friend class PooledBuffer;
+
+
+        /// <summary>
+        /// Takes a buffer back, called by PooledBuffer
+        /// </summary>
+        void Return(uint8_t* data, size_t capacity)
+        {
+            if (capacity > MAX_CLASS_SIZE)
+            {
+                FreeMemory(data, capacity);
+                return;
+            };
+
+            // Over the cache limit, give the memory back instead of keeping it
+            if (_cachedBytes.fetch_add(capacity, std::memory_order_relaxed) + capacity > _maxCachedBytes)
+            {
+                _cachedBytes.fetch_sub(capacity, std::memory_order_relaxed);
+
+                FreeMemory(data, capacity);
+                return;
+            };
+
+            SizeClass& sizeClass = _sizeClasses[GetClassIndex(capacity)];
+
+            std::lock_guard<std::mutex> guard(sizeClass.lock);
+            sizeClass.freeBuffers.push_back(data);
+        };
+
+
+        /// <summary>
+        /// Get the index of the smallest size class that fits the given size
+        /// </summary>
+        static size_t GetClassIndex(size_t size)
+        {
+            size_t classIndex = 0;
+
+            while ((MIN_CLASS_SIZE << classIndex) < size)
+                classIndex++;
+
+            return classIndex;
+        };
+
+
+        /// <summary>
+        /// Returns true if buffers of the given size are allocated from the OS instead of the heap
+        /// </summary>
+        bool UsesHugePages(size_t size) const
+        {
+            return (_hugePages != HugePageMode::None) && (size >= _hugePageThreshold);
+        };
+
+
+        uint8_t* AllocateMemory(size_t size)
+        {
+            if (UsesHugePages(size) == true)
+            {
+                HugePageMode achievedMode = HugePageMode::None;
+
+                void* memory = Utilities::AllocateHugePages(size, _hugePages, achievedMode);
+
+                if (achievedMode != HugePageMode::None)
+                    _hugePageAllocationCount.fetch_add(1, std::memory_order_relaxed);
+
+                return static_cast<uint8_t*>(memory);
+            };
+
+            return static_cast<uint8_t*>(::operator new(size, std::align_val_t(BUFFER_ALIGNMENT)));
+        };
+
+        void FreeMemory(uint8_t* data, size_t size)
+        {
+            // Whether a buffer came from the OS only depends on it's size, so it's freed the same way it was allocated
+            if (UsesHugePages(size) == true)
+            {
+                Utilities::FreeHugePages(data, size);
+                return;
+            };
+
+            ::operator delete(data, std::align_val_t(BUFFER_ALIGNMENT));
+        };
+
+    };
+
+
+
+    inline void PooledBuffer::Release()
+    {
+        if ((_pool != nullptr) && (_data != nullptr))
+            _pool->Return(_data, _capacity);
+
+        _pool = nullptr;
+        _data = nullptr;
+        _size = 0;
+        _capacity = 0;
+    };
+
+};
@@ -0,0 +1,1389 @@
+#pragma once
+#include <span>
+#include <array>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+#include "deflate.h"
+#include "ThreadPool.h"
+
+
+namespace ZipExtractor
+{
+
+    /// <summary>
+    /// Decodes a single block of a BZIP2 stream (zip compression method 12).
+    /// A block starts with a 48 bit magic number at any bit offset, and is decoded in the reverse order of the encoder:
+    /// the Huffman coded symbols, the move to front and zero run length coding, the Burrows-Wheeler transform and the initial run length coding.
+    /// Blocks don't depend on each other, every thread keeps one decoder so blocks of the same stream can be decoded concurrently
+    /// </summary>
+    class Bzip2BlockDecoder
+    {
+
+    public:
+
+        // Every block starts with the BCD digits of pi, and the end of the stream with the ones of the square root of pi
+        static constexpr uint64_t BLOCK_MAGIC = 0x314159265359;
+        static constexpr uint64_t END_OF_STREAM_MAGIC = 0x177245385090;
+        static constexpr unsigned MAGIC_BITS = 48;
+
+        static constexpr unsigned CRC_BITS = 32;
+
+        // The stream starts with "BZh" and the maximum block size in units of 100000 bytes, as a digit from 1 to 9
+        static constexpr size_t STREAM_HEADER_SIZE = 4;
+        static constexpr size_t BLOCK_SIZE_UNIT = 100000;
+
+        enum class Result
+        {
+            // The block was decoded, it's output can be read
+            Success,
+
+            // The block runs past the end of the data
+            NeedMoreInput,
+
+            // The block is corrupt
+            Invalid
+        };
+
+
+    private:
+
+        static constexpr unsigned MIN_GROUPS = 2;
+        static constexpr unsigned MAX_GROUPS = 6;
+
+        // The Huffman table switches after every 50 symbols
+        static constexpr unsigned GROUP_SIZE = 50;
+
+        // 256 bytes, RUNB and the end of block symbol, RUNA takes the place of the first byte
+        static constexpr unsigned MAX_ALPHABET_SIZE = 258;
+        static constexpr unsigned MAX_CODE_LENGTH = 20;
+        static constexpr unsigned MAX_SELECTORS = 18002;
+
+        static constexpr unsigned RUN_A = 0;
+        static constexpr unsigned RUN_B = 1;
+
+        // Runs of zeros are coded in bijective base 2, this stops a corrupt run from overflowing
+        static constexpr uint32_t MAX_RUN_WEIGHT = 2 * 1024 * 1024;
+
+        // Codes up to this length are decoded with a single table lookup
+        static constexpr unsigned LOOKUP_BITS = 10;
+
+        // The lowest 5 bits of a lookup entry are the code's length, the others the symbol, 0 for codes longer than LOOKUP_BITS
+        static constexpr unsigned LOOKUP_LENGTH_BITS = 5;
+        static constexpr uint16_t LOOKUP_LENGTH_MASK = (1 << LOOKUP_LENGTH_BITS) - 1;
+
+        struct HuffmanTable
+        {
+            std::array<uint16_t, 1 << LOOKUP_BITS> lookup;
+
+            // The canonical codes of every length, for the codes that don't fit the lookup
+            std::array<uint16_t, MAX_CODE_LENGTH + 1> counts;
+            std::array<uint32_t, MAX_CODE_LENGTH + 1> firstCodes;
+            std::array<uint16_t, MAX_CODE_LENGTH + 1> firstIndices;
+
+            // The symbols sorted by code
+            std::array<uint16_t, MAX_ALPHABET_SIZE> symbols;
+        };
+
+
+        const uint8_t* _data = nullptr;
+        size_t _dataSize = 0;
+        uint64_t _bitPosition = 0;
+
+        // The inverse Burrows-Wheeler transform, the lowest 8 bits of every entry are a byte and the others the index of the next entry
+        std::vector<uint32_t> _tt;
+
+        // Maps the symbols of the move to front list to the bytes the block uses
+        std::array<uint8_t, 256> _symbolToByte = {};
+
+        std::array<uint8_t, MAX_SELECTORS> _selectors = {};
+
+        std::array<std::array<uint8_t, MAX_ALPHABET_SIZE>, MAX_GROUPS> _codeLengths = {};
+
+        std::array<HuffmanTable, MAX_GROUPS> _tables = {};
+
+        uint32_t _expectedCrc = 0;
+        uint32_t _crc = 0;
+
+        // Where the output is in the inverse transform
+        uint32_t _walkPosition = 0;
+        uint32_t _walkRemaining = 0;
+
+        // The initial run length coding, 4 equal bytes are followed by the number of further repeats
+        unsigned _runByte = 0;
+        unsigned _runLength = 0;
+        uint32_t _repeatRemaining = 0;
+
+
+    public:
+
+        /// <summary>
+        /// Returns the decoder of the calling thread, it keeps it's buffers between blocks
+        /// </summary>
+        static Bzip2BlockDecoder& GetThreadDecoder()
+        {
+            thread_local Bzip2BlockDecoder decoder;
+
+            return decoder;
+        };
+
+
+        /// <summary>
+        /// Reads up to 57 bits at any bit offset, bits past the end of the data read as zero
+        /// </summary>
+        /// <param name="data"> The data </param>
+        /// <param name="dataSize"> The size of the data </param>
+        /// <param name="bitPosition"> The offset of the first bit, counting from the most significant bit of the first byte </param>
+        /// <param name="count"> The number of bits </param>
+        /// <returns> The bits, the first one the most significant </returns>
+        static uint64_t ReadBitsAt(const uint8_t* data, size_t dataSize, uint64_t bitPosition, unsigned count)
+        {
+            const uint64_t byteIndex = bitPosition >> 3;
+            uint64_t word = 0;
+
+            if (byteIndex + sizeof(word) <= dataSize)
+            {
+                for (size_t index = 0; index < sizeof(word); index++)
+                    word = (word << 8) | data[byteIndex + index];
+            }
+            else
+            {
+                for (size_t index = 0; index < sizeof(word); index++)
+                    word = (word << 8) | ((byteIndex + index < dataSize) ? data[byteIndex + index] : 0);
+            };
+
+            return (word << (bitPosition & 7)) >> (64 - count);
+        };
+
+
+        /// <summary>
+        /// Looks for the next block or end of stream magic number, at any bit offset
+        /// </summary>
+        /// <param name="data"> The data </param>
+        /// <param name="dataSize"> The size of the data </param>
+        /// <param name="fromBit"> The first bit offset to check </param>
+        /// <param name="magicBitOut"> Receives the bit offset of the magic number </param>
+        /// <param name="isEndOfStreamOut"> Receives true if it's the end of stream magic number </param>
+        /// <returns> True if a magic number was found, the data in a block can also contain one </returns>
+        static bool FindMagic(const uint8_t* data, size_t dataSize, uint64_t fromBit, uint64_t& magicBitOut, bool& isEndOfStreamOut)
+        {
+            const uint64_t bitCount = static_cast<uint64_t>(dataSize) * 8;
+
+            if (bitCount < MAGIC_BITS)
+                return false;
+
+            const uint64_t lastBit = bitCount - MAGIC_BITS;
+            constexpr uint64_t MAGIC_MASK = (uint64_t(1) << MAGIC_BITS) - 1;
+
+            const std::array<bool, 256>& filter = GetMagicFilter();
+
+            // A window of 8 bytes, a magic number at any of the 8 bit offsets of it's first byte fits in it
+            uint64_t byteIndex = fromBit >> 3;
+            uint64_t window = 0;
+
+            for (uint64_t index = byteIndex; index < byteIndex + sizeof(window); index++)
+                window = (window << 8) | ((index < dataSize) ? data[index] : 0);
+
+            for (; (byteIndex << 3) <= lastBit; byteIndex++)
+            {
+                if (filter[(window >> 48) & 0xFF] == true)
+                {
+                    for (unsigned shift = 0; shift < 8; shift++)
+                    {
+                        const uint64_t bitPosition = (byteIndex << 3) + shift;
+
+                        if ((bitPosition < fromBit) || (bitPosition > lastBit))
+                            continue;
+
+                        const uint64_t candidate = (window >> (16 - shift)) & MAGIC_MASK;
+
+                        if ((candidate == BLOCK_MAGIC) || (candidate == END_OF_STREAM_MAGIC))
+                        {
+                            magicBitOut = bitPosition;
+                            isEndOfStreamOut = (candidate == END_OF_STREAM_MAGIC);
+
+                            return true;
+                        };
+                    };
+                };
+
+                const uint64_t nextIndex = byteIndex + sizeof(window);
+                window = (window << 8) | ((nextIndex < dataSize) ? data[nextIndex] : 0);
+            };
+
+            return false;
+        };
+
+
+        /// <summary>
+        /// Returns the values the second byte of a window can have if a magic number starts in it's first byte, at any bit offset
+        /// </summary>
+        static const std::array<bool, 256>& GetMagicFilter()
+        {
+            static const std::array<bool, 256> filter = []()
+            {
+                std::array<bool, 256> magicFilter = {};
+
+                for (unsigned shift = 0; shift < 8; shift++)
+                {
+                    magicFilter[(BLOCK_MAGIC >> (32 + shift)) & 0xFF] = true;
+                    magicFilter[(END_OF_STREAM_MAGIC >> (32 + shift)) & 0xFF] = true;
+                };
+
+                return magicFilter;
+            }();
+
+            return filter;
+        };
+
+
+        /// <summary>
+        /// The most compressed data a block can take: 20 bits for every symbol, and the tables
+        /// </summary>
+        /// <param name="maxBlockSize"> The stream's block size </param>
+        /// <returns> The size in bytes </returns>
+        static size_t GetMaxCompressedBlockSize(size_t maxBlockSize)
+        {
+            return (maxBlockSize + 1) * MAX_CODE_LENGTH / 8 + 128 * 1024;
+        };
+
+
+        /// <summary>
+        /// Returns the table of the big endian CRC-32 bzip2 uses
+        /// </summary>
+        static const std::array<uint32_t, 256>& GetCrcTable()
+        {
+            static const std::array<uint32_t, 256> table = []()
+            {
+                std::array<uint32_t, 256> crcTable = {};
+
+                for (uint32_t index = 0; index < 256; index++)
+                {
+                    uint32_t crc = index << 24;
+
+                    for (int bit = 0; bit < 8; bit++)
+                        crc = ((crc & 0x80000000) != 0) ? ((crc << 1) ^ 0x04C11DB7) : (crc << 1);
+
+                    crcTable[index] = crc;
+                };
+
+                return crcTable;
+            }();
+
+            return table;
+        };
+
+
+        /// <summary>
+        /// Decodes a block, it's output is then read with ReadOutput
+        /// </summary>
+        /// <param name="data"> The compressed data, at least up to the end of the block </param>
+        /// <param name="dataSize"> The size of the compressed data </param>
+        /// <param name="bitPosition"> The bit offset of the block's magic number </param>
+        /// <param name="maxBlockSize"> The stream's block size </param>
+        /// <param name="endBitOut"> Receives the bit offset after the block </param>
+        /// <returns> The result </returns>
+        Result Decode(const uint8_t* data, size_t dataSize, uint64_t bitPosition, size_t maxBlockSize, uint64_t& endBitOut)
+        {
+            _data = data;
+            _dataSize = dataSize;
+            _bitPosition = bitPosition;
+
+            _walkRemaining = 0;
+            _repeatRemaining = 0;
+
+            const bool isValid = DecodeBlock(maxBlockSize);
+
+            // Past the end of the data the bits read as zeros, so nothing decoded from them means anything
+            if (_bitPosition > static_cast<uint64_t>(dataSize) * 8)
+            {
+                _walkRemaining = 0;
+                return Result::NeedMoreInput;
+            };
+
+            if (isValid == false)
+            {
+                _walkRemaining = 0;
+                return Result::Invalid;
+            };
+
+            endBitOut = _bitPosition;
+
+            return Result::Success;
+        };
+
+
+        /// <summary>
+        /// Reads the next part of the decoded block's output
+        /// </summary>
+        /// <param name="destination"> The buffer that receives the output </param>
+        /// <param name="size"> The size of the buffer </param>
+        /// <returns> The number of bytes written, less than size only at the end of the block </returns>
+        size_t ReadOutput(uint8_t* destination, size_t size)
+        {
+            const std::array<uint32_t, 256>& crcTable = GetCrcTable();
+            const uint32_t* tt = _tt.data();
+
+            uint32_t crc = _crc;
+            uint32_t walkPosition = _walkPosition;
+            uint32_t walkRemaining = _walkRemaining;
+            unsigned runByte = _runByte;
+            unsigned runLength = _runLength;
+
+            size_t produced = 0;
+
+            while (produced < size)
+            {
+                if (_repeatRemaining != 0)
+                {
+                    const size_t repeatSize = std::min<size_t>(_repeatRemaining, size - produced);
+
+                    memset(&destination[produced], static_cast<int>(runByte), repeatSize);
+
+                    for (size_t index = 0; index < repeatSize; index++)
+                        crc = (crc << 8) ^ crcTable[(crc >> 24) ^ runByte];
+
+                    produced += repeatSize;
+                    _repeatRemaining -= static_cast<uint32_t>(repeatSize);
+
+                    continue;
+                };
+
+                if (walkRemaining == 0)
+                    break;
+
+                walkPosition = tt[walkPosition];
+                const unsigned byte = walkPosition & 0xFF;
+                walkPosition >>= 8;
+                walkRemaining--;
+
+                if (runLength == 4)
+                {
+                    _repeatRemaining = byte;
+                    runLength = 0;
+
+                    continue;
+                };
+
+                if (byte == runByte)
+                {
+                    runLength++;
+                }
+                else
+                {
+                    runByte = byte;
+                    runLength = 1;
+                };
+
+                destination[produced++] = static_cast<uint8_t>(byte);
+                crc = (crc << 8) ^ crcTable[(crc >> 24) ^ byte];
+            };
+
+            _crc = crc;
+            _walkPosition = walkPosition;
+            _walkRemaining = walkRemaining;
+            _runByte = runByte;
+            _runLength = runLength;
+
+            return produced;
+        };
+
+
+        /// <summary>
+        /// Returns true once all of the block's output was read
+        /// </summary>
+        bool IsOutputDone() const
+        {
+            return (_walkRemaining == 0) && (_repeatRemaining == 0);
+        };
+
+
+        /// <summary>
+        /// Returns the CRC of the output read so far, the block's CRC once all of it was read
+        /// </summary>
+        uint32_t GetCrc() const
+        {
+            return ~_crc;
+        };
+
+
+        /// <summary>
+        /// Returns the CRC stored in the block's header
+        /// </summary>
+        uint32_t GetExpectedCrc() const
+        {
+            return _expectedCrc;
+        };
+
+
+    private:
+
+        uint32_t ReadBits(unsigned count)
+        {
+            const uint32_t value = static_cast<uint32_t>(ReadBitsAt(_data, _dataSize, _bitPosition, count));
+            _bitPosition += count;
+
+            return value;
+        };
+
+
+        /// <summary>
+        /// Decodes the block's header and symbols, and prepares the inverse transform
+        /// </summary>
+        /// <param name="maxBlockSize"> The stream's block size </param>
+        /// <returns> False if the block is corrupt </returns>
+        bool DecodeBlock(size_t maxBlockSize)
+        {
+            if ((ReadBits(24) != (BLOCK_MAGIC >> 24)) || (ReadBits(24) != (BLOCK_MAGIC & 0xFFFFFF)))
+                return false;
+
+            _expectedCrc = ReadBits(32);
+
+            // Randomised blocks were deprecated in bzip2 0.9.5, nothing writes them anymore
+            if (ReadBits(1) != 0)
+                return false;
+
+            const uint32_t originPointer = ReadBits(24);
+
+            // Which of the 256 bytes the block uses, in a 16 bit map of 16 bit maps
+            const uint32_t usedRanges = ReadBits(16);
+            unsigned usedCount = 0;
+
+            for (unsigned range = 0; range < 16; range++)
+            {
+                if ((usedRanges & (0x8000 >> range)) == 0)
+                    continue;
+
+                const uint32_t usedBytes = ReadBits(16);
+
+                for (unsigned byte = 0; byte < 16; byte++)
+                {
+                    if ((usedBytes & (0x8000 >> byte)) != 0)
+                        _symbolToByte[usedCount++] = static_cast<uint8_t>(range * 16 + byte);
+                };
+            };
+
+            if (usedCount == 0)
+                return false;
+
+            const unsigned alphabetSize = usedCount + 2;
+            const unsigned endOfBlock = usedCount + 1;
+
+            const unsigned groupCount = ReadBits(3);
+
+            if ((groupCount < MIN_GROUPS) || (groupCount > MAX_GROUPS))
+                return false;
+
+            const unsigned selectorCount = ReadBits(15);
+
+            if (selectorCount == 0)
+                return false;
+
+            // The selectors are move to front coded in unary, the ones past the maximum are read but ignored
+            std::array<uint8_t, MAX_GROUPS> groupOrder = { 0, 1, 2, 3, 4, 5 };
+
+            for (unsigned selector = 0; selector < selectorCount; selector++)
+            {
+                unsigned index = 0;
+
+                while (ReadBits(1) != 0)
+                {
+                    if (++index >= groupCount)
+                        return false;
+                };
+
+                const uint8_t group = groupOrder[index];
+                memmove(&groupOrder[1], &groupOrder[0], index);
+                groupOrder[0] = group;
+
+                if (selector < MAX_SELECTORS)
+                    _selectors[selector] = group;
+            };
+
+            const unsigned usableSelectors = std::min(selectorCount, MAX_SELECTORS);
+
+            // The code lengths are delta coded, every symbol's length starts from the previous one's
+            for (unsigned group = 0; group < groupCount; group++)
+            {
+                int length = static_cast<int>(ReadBits(5));
+
+                for (unsigned symbol = 0; symbol < alphabetSize; symbol++)
+                {
+                    while (true)
+                    {
+                        if ((length < 1) || (length > static_cast<int>(MAX_CODE_LENGTH)))
+                            return false;
+
+                        if (ReadBits(1) == 0)
+                            break;
+
+                        length += (ReadBits(1) == 0) ? 1 : -1;
+                    };
+
+                    _codeLengths[group][symbol] = static_cast<uint8_t>(length);
+                };
+
+                if (BuildTable(_tables[group], _codeLengths[group], alphabetSize) == false)
+                    return false;
+            };
+
+            if (_tt.size() < maxBlockSize)
+                _tt.resize(maxBlockSize);
+
+            // The move to front list, and how often every byte occurs in the block
+            std::array<uint8_t, 256> mtfList;
+            std::array<uint32_t, 256> byteCounts = {};
+
+            for (unsigned index = 0; index < 256; index++)
+                mtfList[index] = static_cast<uint8_t>(index);
+
+            uint32_t* tt = _tt.data();
+            uint32_t blockSize = 0;
+            uint32_t runLength = 0;
+            uint32_t runWeight = 1;
+            unsigned selectorIndex = 0;
+            unsigned groupRemaining = 0;
+            const HuffmanTable* table = nullptr;
+
+            while (true)
+            {
+                if (groupRemaining == 0)
+                {
+                    if (selectorIndex >= usableSelectors)
+                        return false;
+
+                    table = &_tables[_selectors[selectorIndex++]];
+                    groupRemaining = GROUP_SIZE;
+                };
+
+                groupRemaining--;
+
+                const int symbol = DecodeSymbol(*table);
+
+                if (symbol < 0)
+                    return false;
+
+                // RUNA and RUNB add 1 and 2 times the current weight to a run of the byte at the front of the list
+                if ((symbol == RUN_A) || (symbol == RUN_B))
+                {
+                    if (runWeight >= MAX_RUN_WEIGHT)
+                        return false;
+
+                    runLength += (symbol == RUN_A) ? runWeight : 2 * runWeight;
+                    runWeight <<= 1;
+
+                    continue;
+                };
+
+                if (runLength != 0)
+                {
+                    if (runLength > maxBlockSize - blockSize)
+                        return false;
+
+                    const uint8_t byte = _symbolToByte[mtfList[0]];
+                    byteCounts[byte] += runLength;
+
+                    for (uint32_t index = 0; index < runLength; index++)
+                        tt[blockSize++] = byte;
+
+                    runLength = 0;
+                    runWeight = 1;
+                };
+
+                if (symbol == static_cast<int>(endOfBlock))
+                    break;
+
+                if (blockSize >= maxBlockSize)
+                    return false;
+
+                // Symbol n is the byte at position n - 1 of the list, which moves to the front
+                const unsigned listIndex = static_cast<unsigned>(symbol) - 1;
+                const uint8_t listEntry = mtfList[listIndex];
+                memmove(&mtfList[1], &mtfList[0], listIndex);
+                mtfList[0] = listEntry;
+
+                const uint8_t byte = _symbolToByte[listEntry];
+                byteCounts[byte]++;
+                tt[blockSize++] = byte;
+            };
+
+            if (originPointer >= blockSize)
+                return false;
+
+            // The inverse transform links every byte to the one that follows it in the original data
+            std::array<uint32_t, 256> byteStarts;
+            uint32_t total = 0;
+
+            for (unsigned byte = 0; byte < 256; byte++)
+            {
+                byteStarts[byte] = total;
+                total += byteCounts[byte];
+            };
+
+            for (uint32_t index = 0; index < blockSize; index++)
+            {
+                const uint8_t byte = static_cast<uint8_t>(tt[index]);
+                tt[byteStarts[byte]++] |= index << 8;
+            };
+
+            _walkPosition = tt[originPointer] >> 8;
+            _walkRemaining = blockSize;
+            _crc = 0xFFFFFFFF;
+            _runByte = 256;
+            _runLength = 0;
+            _repeatRemaining = 0;
+
+            return true;
+        };
+
+
+        /// <summary>
+        /// Builds the canonical Huffman codes of a table
+        /// </summary>
+        /// <returns> False if the lengths over subscribe the code space </returns>
+        static bool BuildTable(HuffmanTable& table, const std::array<uint8_t, MAX_ALPHABET_SIZE>& lengths, unsigned alphabetSize)
+        {
+            table.counts.fill(0);
+            table.lookup.fill(0);
+
+            for (unsigned symbol = 0; symbol < alphabetSize; symbol++)
+                table.counts[lengths[symbol]]++;
+
+            uint32_t code = 0;
+            uint16_t index = 0;
+
+            for (unsigned length = 1; length <= MAX_CODE_LENGTH; length++)
+            {
+                table.firstCodes[length] = code;
+                table.firstIndices[length] = index;
+
+                code += table.counts[length];
+                index += table.counts[length];
+
+                if (code > (uint32_t(1) << length))
+                    return false;
+
+                code <<= 1;
+            };
+
+            std::array<uint16_t, MAX_CODE_LENGTH + 1> offsets = table.firstIndices;
+
+            for (unsigned symbol = 0; symbol < alphabetSize; symbol++)
+                table.symbols[offsets[lengths[symbol]]++] = static_cast<uint16_t>(symbol);
+
+            for (unsigned length = 1; length <= LOOKUP_BITS; length++)
+            {
+                for (unsigned codeIndex = 0; codeIndex < table.counts[length]; codeIndex++)
+                {
+                    const uint16_t symbol = table.symbols[table.firstIndices[length] + codeIndex];
+                    const uint32_t first = (table.firstCodes[length] + codeIndex) << (LOOKUP_BITS - length);
+                    const uint16_t entry = static_cast<uint16_t>((symbol << LOOKUP_LENGTH_BITS) | length);
+
+                    std::fill_n(&table.lookup[first], size_t(1) << (LOOKUP_BITS - length), entry);
+                };
+            };
+
+            return true;
+        };
+
+
+        /// <summary>
+        /// Decodes a symbol
+        /// </summary>
+        /// <returns> The symbol, -1 if the bits aren't a code of the table </returns>
+        int DecodeSymbol(const HuffmanTable& table)
+        {
+            const uint32_t bits = static_cast<uint32_t>(ReadBitsAt(_data, _dataSize, _bitPosition, MAX_CODE_LENGTH));
+            const uint16_t entry = table.lookup[bits >> (MAX_CODE_LENGTH - LOOKUP_BITS)];
+
+            if (entry != 0)
+            {
+                _bitPosition += entry & LOOKUP_LENGTH_MASK;
+                return entry >> LOOKUP_LENGTH_BITS;
+            };
+
+            for (unsigned length = LOOKUP_BITS + 1; length <= MAX_CODE_LENGTH; length++)
+            {
+                const uint32_t offset = (bits >> (MAX_CODE_LENGTH - length)) - table.firstCodes[length];
+
+                if (offset < table.counts[length])
+                {
+                    _bitPosition += length;
+                    return table.symbols[table.firstIndices[length] + offset];
+                };
+            };
+
+            return -1;
+        };
+
+    };
+
+
+    /// <summary>
+    /// A streaming decoder for BZIP2 (zip compression method 12), for data that arrives a piece at a time.
+    /// Works on a z_stream with the same contract as inflate(Z_NO_FLUSH) on a raw stream, so it drops into any loop written for zlib:
+    /// every call consumes as much input and produces as much output as it can, and input after the end of the stream is left untouched.
+    /// A block's length isn't stored, so a block is only decoded once the next magic number was seen, and input it took past that is given back
+    /// </summary>
+    class Bzip2Decoder
+    {
+
+    private:
+
+        enum class State
+        {
+            StreamHeader,
+            ItemMagic,
+            BlockData,
+            BlockOutput,
+            StreamCrc,
+            Done,
+            Error
+        };
+
+
+        Bzip2BlockDecoder _blockDecoder;
+
+        State _state = State::StreamHeader;
+
+        // The stream's data from the current block on
+        std::vector<uint8_t> _input;
+
+        // Where the current block or end of stream starts in _input
+        uint64_t _bitPosition = 0;
+
+        // The next bit to check for a magic number after the current block's start
+        uint64_t _scanPosition = 0;
+
+        size_t _maxBlockSize = 0;
+
+        uint32_t _combinedCrc = 0;
+
+
+    public:
+
+        /// <summary>
+        /// Prepares the decoder for a new stream
+        /// </summary>
+        void Reset()
+        {
+            _state = State::StreamHeader;
+            _input.clear();
+            _bitPosition = 0;
+            _scanPosition = 0;
+            _maxBlockSize = 0;
+            _combinedCrc = 0;
+        };
+
+
+        /// <summary>
+        /// Decodes as much of the stream as the input and output allow
+        /// </summary>
+        /// <param name="stream"> The input and output, with next_in, avail_in, next_out and avail_out set like for inflate </param>
+        /// <returns> Z_STREAM_END at the end of the stream, Z_OK if progress was made, Z_BUF_ERROR if none was possible, Z_DATA_ERROR if the data is corrupt </returns>
+        int Decode(z_stream& stream)
+        {
+            const uInt inputBefore = stream.avail_in;
+            const uInt outputBefore = stream.avail_out;
+
+            while (Step(stream) == true)
+            {
+            };
+
+            if (_state == State::Done)
+                return Z_STREAM_END;
+
+            if (_state == State::Error)
+                return Z_DATA_ERROR;
+
+            if ((stream.avail_in == inputBefore) && (stream.avail_out == outputBefore))
+                return Z_BUF_ERROR;
+
+            return Z_OK;
+        };
+
+
+    private:
+
+        static size_t ByteCount(uint64_t bitCount)
+        {
+            return static_cast<size_t>((bitCount + 7) / 8);
+        };
+
+
+        bool Fail()
+        {
+            _state = State::Error;
+            return false;
+        };
+
+
+        /// <summary>
+        /// Fills the input up to a size
+        /// </summary>
+        /// <returns> True if the input has that size </returns>
+        bool TakeInput(z_stream& stream, size_t targetSize)
+        {
+            if (_input.size() < targetSize)
+            {
+                const size_t copySize = std::min<size_t>(targetSize - _input.size(), stream.avail_in);
+
+                _input.insert(_input.end(), stream.next_in, stream.next_in + copySize);
+
+                stream.next_in += copySize;
+                stream.avail_in -= static_cast<uInt>(copySize);
+                stream.total_in += copySize;
+            };
+
+            return (_input.size() >= targetSize);
+        };
+
+
+        /// <summary>
+        /// Hands input back to the caller, from the end of what was taken
+        /// </summary>
+        void GiveBackInput(z_stream& stream, size_t size)
+        {
+            _input.resize(_input.size() - size);
+
+            stream.next_in -= size;
+            stream.avail_in += static_cast<uInt>(size);
+            stream.total_in -= size;
+        };
+
+
+        /// <summary>
+        /// Runs one step of the state machine
+        /// </summary>
+        /// <returns> True if the next step can run </returns>
+        bool Step(z_stream& stream)
+        {
+            switch (_state)
+            {
+            case State::StreamHeader:
+            {
+                if (TakeInput(stream, Bzip2BlockDecoder::STREAM_HEADER_SIZE) == false)
+                    return false;
+
+                if ((_input[0] != 'B') || (_input[1] != 'Z') || (_input[2] != 'h') || (_input[3] < '1') || (_input[3] > '9'))
+                    return Fail();
+
+                _maxBlockSize = (_input[3] - '0') * Bzip2BlockDecoder::BLOCK_SIZE_UNIT;
+                _input.clear();
+                _bitPosition = 0;
+                _state = State::ItemMagic;
+
+                return true;
+            };
+
+            case State::ItemMagic:
+            {
+                // Only the partial byte the item starts in is kept from the previous block
+                const size_t usedSize = static_cast<size_t>(_bitPosition >> 3);
+
+                if (usedSize != 0)
+                {
+                    _input.erase(_input.begin(), _input.begin() + usedSize);
+                    _bitPosition -= static_cast<uint64_t>(usedSize) * 8;
+                };
+
+                if (TakeInput(stream, ByteCount(_bitPosition + Bzip2BlockDecoder::MAGIC_BITS)) == false)
+                    return false;
+
+                const uint64_t magic = Bzip2BlockDecoder::ReadBitsAt(_input.data(), _input.size(), _bitPosition, Bzip2BlockDecoder::MAGIC_BITS);
+
+                if (magic == Bzip2BlockDecoder::END_OF_STREAM_MAGIC)
+                {
+                    _state = State::StreamCrc;
+                    return true;
+                };
+
+                if (magic != Bzip2BlockDecoder::BLOCK_MAGIC)
+                    return Fail();
+
+                _scanPosition = _bitPosition + 1;
+                _state = State::BlockData;
+
+                return true;
+            };
+
+            case State::BlockData:
+                return DecodeBlockData(stream);
+
+            case State::BlockOutput:
+            {
+                if (stream.avail_out == 0)
+                    return false;
+
+                const size_t produced = _blockDecoder.ReadOutput(stream.next_out, stream.avail_out);
+
+                stream.next_out += produced;
+                stream.avail_out -= static_cast<uInt>(produced);
+                stream.total_out += produced;
+
+                if (_blockDecoder.IsOutputDone() == false)
+                    return false;
+
+                if (_blockDecoder.GetCrc() != _blockDecoder.GetExpectedCrc())
+                    return Fail();
+
+                _combinedCrc = ((_combinedCrc << 1) | (_combinedCrc >> 31)) ^ _blockDecoder.GetExpectedCrc();
+                _state = State::ItemMagic;
+
+                return true;
+            };
+
+            case State::StreamCrc:
+            {
+                // The stream ends with the combined CRC, padded to a whole byte
+                const uint64_t crcPosition = _bitPosition + Bzip2BlockDecoder::MAGIC_BITS;
+
+                if (TakeInput(stream, ByteCount(crcPosition + Bzip2BlockDecoder::CRC_BITS)) == false)
+                    return false;
+
+                if (Bzip2BlockDecoder::ReadBitsAt(_input.data(), _input.size(), crcPosition, Bzip2BlockDecoder::CRC_BITS) != _combinedCrc)
+                    return Fail();
+
+                _state = State::Done;
+
+                return false;
+            };
+
+            default:
+                return false;
+            };
+        };
+
+
+        /// <summary>
+        /// Collects the current block's data up to the next magic number and decodes the block
+        /// </summary>
+        /// <returns> True if the block was decoded </returns>
+        bool DecodeBlockData(z_stream& stream)
+        {
+            size_t takenSize = 0;
+
+            while (true)
+            {
+                uint64_t magicPosition = 0;
+                bool isEndOfStream = false;
+
+                if (Bzip2BlockDecoder::FindMagic(_input.data(), _input.size(), _scanPosition, magicPosition, isEndOfStream) == true)
+                {
+                    // Nothing after the magic number is needed yet
+                    const size_t excessSize = std::min(_input.size() - ByteCount(magicPosition + Bzip2BlockDecoder::MAGIC_BITS), takenSize);
+
+                    GiveBackInput(stream, excessSize);
+                    takenSize -= excessSize;
+
+                    uint64_t endPosition = 0;
+                    const Bzip2BlockDecoder::Result result = _blockDecoder.Decode(_input.data(), _input.size(), _bitPosition, _maxBlockSize, endPosition);
+
+                    if (result == Bzip2BlockDecoder::Result::Success)
+                    {
+                        _bitPosition = endPosition;
+                        _state = State::BlockOutput;
+
+                        return true;
+                    };
+
+                    if (result == Bzip2BlockDecoder::Result::Invalid)
+                        return Fail();
+
+                    // The magic number was part of the block's data, the block goes on past it
+                    _scanPosition = magicPosition + 1;
+
+                    continue;
+                };
+
+                // Everything up to here was checked, only the last bits can still start a magic number
+                const uint64_t bitCount = static_cast<uint64_t>(_input.size()) * 8;
+
+                if (bitCount >= Bzip2BlockDecoder::MAGIC_BITS)
+                    _scanPosition = std::max(_scanPosition, bitCount - Bzip2BlockDecoder::MAGIC_BITS + 1);
+
+                if (stream.avail_in == 0)
+                    return false;
+
+                if ((_input.size() - static_cast<size_t>(_bitPosition >> 3)) > Bzip2BlockDecoder::GetMaxCompressedBlockSize(_maxBlockSize))
+                    return Fail();
+
+                const size_t copySize = stream.avail_in;
+                TakeInput(stream, _input.size() + copySize);
+                takenSize += copySize;
+            };
+        };
+
+    };
+
+
+    /// <summary>
+    /// Decodes a BZIP2 stream that's entirely in memory, with it's blocks decoded concurrently on a thread pool.
+    /// The blocks are found by their magic numbers ahead of the one that's written next, a magic number inside a block's data is told apart
+    /// by where the previous block ends. Every block's output is checked against it's CRC before it's passed on, in the stream's order.
+    /// The calling thread decodes the next block itself if no pool thread took it yet, so it can run on a thread of the same pool
+    /// </summary>
+    class Bzip2ParallelDecoder
+    {
+
+    public:
+
+        // Receives the decompressed data block by block, in order
+        using OutputCallback = std::function<void(std::span<const uint8_t>)>;
+
+
+    private:
+
+        enum class JobState
+        {
+            Pending,
+            Running,
+            Finished
+        };
+
+        struct BlockJob
+        {
+            uint64_t startBit = 0;
+            bool isEndOfStream = false;
+
+            JobState state = JobState::Pending;
+
+            Bzip2BlockDecoder::Result result = Bzip2BlockDecoder::Result::Invalid;
+            uint64_t endBit = 0;
+            uint32_t expectedCrc = 0;
+            bool isCrcValid = false;
+
+            std::unique_ptr<uint8_t[]> output;
+            size_t outputCapacity = 0;
+            size_t outputSize = 0;
+        };
+
+        // Shared with the pool's tasks, which can outlive the call that started them
+        struct SharedState
+        {
+            const uint8_t* data = nullptr;
+            size_t dataSize = 0;
+            size_t maxBlockSize = 0;
+
+            std::mutex lock;
+
+            // Signaled when a job finishes
+            std::condition_variable jobFinished;
+
+            std::deque<BlockJob*> pendingJobs;
+
+            size_t runningJobs = 0;
+            size_t activeHelpers = 0;
+            bool isCancelled = false;
+        };
+
+
+        ThreadPool& _threadPool;
+
+
+    public:
+
+        /// <summary>
+        /// Creates a decoder that runs on a thread pool
+        /// </summary>
+        /// <param name="threadPool"> The pool the blocks are decoded on </param>
+        explicit Bzip2ParallelDecoder(ThreadPool& threadPool) :
+            _threadPool(threadPool)
+        {
+        };
+
+
+        /// <summary>
+        /// Decodes a stream
+        /// </summary>
+        /// <param name="data"> The compressed data, it has to stay valid until the call returns </param>
+        /// <param name="dataSize"> The size of the compressed data </param>
+        /// <param name="callback"> Receives the decompressed data </param>
+        /// <returns> The size of the decompressed data </returns>
+        uint64_t Decode(const uint8_t* data, uint64_t dataSize, const OutputCallback& callback)
+        {
+            if ((dataSize < Bzip2BlockDecoder::STREAM_HEADER_SIZE) || (data[0] != 'B') || (data[1] != 'Z') || (data[2] != 'h') || (data[3] < '1') || (data[3] > '9'))
+                throw std::exception("Failed to decompress file");
+
+            std::shared_ptr<SharedState> state = std::make_shared<SharedState>();
+            state->data = data;
+            state->dataSize = static_cast<size_t>(dataSize);
+            state->maxBlockSize = (data[3] - '0') * Bzip2BlockDecoder::BLOCK_SIZE_UNIT;
+
+            std::vector<std::unique_ptr<BlockJob>> jobs;
+            std::vector<BlockJob*> freeJobs;
+            std::deque<BlockJob*> window;
+
+            // Declared after the jobs so the pool's tasks are done with them before they're freed
+            CancelGuard cancelGuard(*state);
+
+            const size_t threadCount = _threadPool.GetThreadCount();
+            const size_t maxInFlight = std::max<size_t>(threadCount * 2, 2);
+
+            uint64_t scanPosition = Bzip2BlockDecoder::STREAM_HEADER_SIZE * 8;
+            uint64_t expectedPosition = scanPosition;
+            bool isScanDone = false;
+
+            uint32_t combinedCrc = 0;
+            uint64_t totalOutput = 0;
+
+            while (true)
+            {
+                // Keeps the pool busy with the blocks after the one that's passed on next
+                while ((isScanDone == false) && (window.size() < maxInFlight))
+                {
+                    uint64_t magicPosition = 0;
+                    bool isEndOfStream = false;
+
+                    if (Bzip2BlockDecoder::FindMagic(data, state->dataSize, scanPosition, magicPosition, isEndOfStream) == false)
+                    {
+                        isScanDone = true;
+                        break;
+                    };
+
+                    scanPosition = magicPosition + 1;
+
+                    BlockJob* job = nullptr;
+
+                    if (freeJobs.empty() == false)
+                    {
+                        job = freeJobs.back();
+                        freeJobs.pop_back();
+                    }
+                    else
+                    {
+                        jobs.push_back(std::make_unique<BlockJob>());
+                        job = jobs.back().get();
+                    };
+
+                    job->startBit = magicPosition;
+                    job->isEndOfStream = isEndOfStream;
+                    window.push_back(job);
+
+                    if (isEndOfStream == true)
+                    {
+                        job->state = JobState::Finished;
+                        continue;
+                    };
+
+                    job->state = JobState::Pending;
+
+                    std::lock_guard<std::mutex> guard(state->lock);
+                    state->pendingJobs.push_back(job);
+
+                    if (state->activeHelpers < threadCount)
+                    {
+                        state->activeHelpers++;
+                        _threadPool.Submit([state]() { RunHelper(state); });
+                    };
+                };
+
+                if (window.empty() == true)
+                    throw std::exception("Failed to decompress file");
+
+                BlockJob* job = window.front();
+                window.pop_front();
+
+                // A magic number inside the previous block's data
+                if (job->startBit < expectedPosition)
+                {
+                    Discard(*state, *job);
+                    freeJobs.push_back(job);
+
+                    continue;
+                };
+
+                if (job->startBit > expectedPosition)
+                    throw std::exception("Failed to decompress file");
+
+                if (job->isEndOfStream == true)
+                {
+                    const uint64_t crcPosition = job->startBit + Bzip2BlockDecoder::MAGIC_BITS;
+
+                    if ((crcPosition + Bzip2BlockDecoder::CRC_BITS > static_cast<uint64_t>(dataSize) * 8) ||
+                        (Bzip2BlockDecoder::ReadBitsAt(data, state->dataSize, crcPosition, Bzip2BlockDecoder::CRC_BITS) != combinedCrc))
+                        throw std::exception("Failed to decompress file");
+
+                    return totalOutput;
+                };
+
+                WaitForJob(*state, *job);
+
+                if ((job->result != Bzip2BlockDecoder::Result::Success) || (job->isCrcValid == false))
+                    throw std::exception("Failed to decompress file");
+
+                combinedCrc = ((combinedCrc << 1) | (combinedCrc >> 31)) ^ job->expectedCrc;
+
+                callback(std::span<const uint8_t>(job->output.get(), job->outputSize));
+
+                totalOutput += job->outputSize;
+                expectedPosition = job->endBit;
+
+                freeJobs.push_back(job);
+            };
+        };
+
+
+    private:
+
+        /// <summary>
+        /// Stops the pool's tasks from starting jobs, and waits for the running ones when the decode returns or throws
+        /// </summary>
+        class CancelGuard
+        {
+
+        private:
+
+            SharedState& _state;
+
+
+        public:
+
+            explicit CancelGuard(SharedState& state) :
+                _state(state)
+            {
+            };
+
+
+            ~CancelGuard()
+            {
+                std::unique_lock<std::mutex> guard(_state.lock);
+
+                _state.isCancelled = true;
+                _state.pendingJobs.clear();
+
+                _state.jobFinished.wait(guard, [this]() { return _state.runningJobs == 0; });
+            };
+
+        };
+
+
+        /// <summary>
+        /// Decodes a block into it's job, on the calling thread
+        /// </summary>
+        static void DecodeJob(const SharedState& state, BlockJob& job)
+        {
+            try
+            {
+                Bzip2BlockDecoder& decoder = Bzip2BlockDecoder::GetThreadDecoder();
+
+                job.outputSize = 0;
+                job.isCrcValid = false;
+                job.result = decoder.Decode(state.data, state.dataSize, job.startBit, state.maxBlockSize, job.endBit);
+
+                if (job.result != Bzip2BlockDecoder::Result::Success)
+                    return;
+
+                job.expectedCrc = decoder.GetExpectedCrc();
+
+                while (decoder.IsOutputDone() == false)
+                {
+                    if (job.outputSize == job.outputCapacity)
+                    {
+                        const size_t newCapacity = std::max<size_t>(job.outputCapacity * 2, state.maxBlockSize);
+                        std::unique_ptr<uint8_t[]> newOutput(new uint8_t[newCapacity]);
+
+                        if (job.outputSize != 0)
+                            memcpy(newOutput.get(), job.output.get(), job.outputSize);
+
+                        job.output = std::move(newOutput);
+                        job.outputCapacity = newCapacity;
+                    };
+
+                    job.outputSize += decoder.ReadOutput(&job.output[job.outputSize], job.outputCapacity - job.outputSize);
+                };
+
+                job.isCrcValid = (decoder.GetCrc() == job.expectedCrc);
+            }
+            catch (...)
+            {
+                job.result = Bzip2BlockDecoder::Result::Invalid;
+            };
+        };
+
+
+        /// <summary>
+        /// Decodes pending jobs on a thread of the pool until there are none left
+        /// </summary>
+        static void RunHelper(std::shared_ptr<SharedState> state)
+        {
+            std::unique_lock<std::mutex> guard(state->lock);
+
+            while ((state->isCancelled == false) && (state->pendingJobs.empty() == false))
+            {
+                BlockJob* job = state->pendingJobs.front();
+                state->pendingJobs.pop_front();
+
+                job->state = JobState::Running;
+                state->runningJobs++;
+
+                guard.unlock();
+                DecodeJob(*state, *job);
+                guard.lock();
+
+                job->state = JobState::Finished;
+                state->runningJobs--;
+                state->jobFinished.notify_all();
+            };
+
+            state->activeHelpers--;
+        };
+
+
+        /// <summary>
+        /// Waits for a job, and decodes it on the calling thread if no pool thread started it yet
+        /// </summary>
+        static void WaitForJob(SharedState& state, BlockJob& job)
+        {
+            std::unique_lock<std::mutex> guard(state.lock);
+
+            if (job.state == JobState::Pending)
+            {
+                state.pendingJobs.erase(std::find(state.pendingJobs.begin(), state.pendingJobs.end(), &job));
+
+                job.state = JobState::Running;
+                state.runningJobs++;
+
+                guard.unlock();
+                DecodeJob(state, job);
+                guard.lock();
+
+                job.state = JobState::Finished;
+                state.runningJobs--;
+                state.jobFinished.notify_all();
+
+                return;
+            };
+
+            state.jobFinished.wait(guard, [&job]() { return job.state == JobState::Finished; });
+        };
+
+
+        /// <summary>
+        /// Drops a job that isn't needed, waiting for it if a pool thread is decoding it
+        /// </summary>
+        static void Discard(SharedState& state, BlockJob& job)
+        {
+            std::unique_lock<std::mutex> guard(state.lock);
+
+            if (job.state == JobState::Pending)
+            {
+                state.pendingJobs.erase(std::find(state.pendingJobs.begin(), state.pendingJobs.end(), &job));
+                job.state = JobState::Finished;
+
+                return;
+            };
+
+            state.jobFinished.wait(guard, [&job]() { return job.state == JobState::Finished; });
+        };
+
+    };
+
+}
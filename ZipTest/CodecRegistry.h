@@ -0,0 +1,876 @@
+#pragma once
+#include <span>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "deflate.h"
+#include "Deflate64.h"
+#include "Lzma.h"
+#include "Bzip2.h"
+#include "Zstd.h"
+#include "ZlibAllocator.h"
+#include "AsyncIoBackend.h"
+
+
+namespace ZipExtractor
+{
+
+    // The most bytes that are handed to zlib in a single call, it's avail_in and avail_out are only 32-bit
+    constexpr uint64_t MAX_ZLIB_CHUNK_SIZE = 1ULL << 30;
+
+
+    // A compression method used by the Zip file to compresse the file's contents.
+    // Most of the time zip uses the DEFLATE algorithm to compress the files
+    enum class CompressionMethod : short
+    {
+        // No ecnryption is used
+        None = 0,
+
+        Shrunk = 1,
+
+        LZW = 1,
+
+        ReducedWithCompressionFactor1 = 2,
+        ReducedWithCompressionFactor2 = 3,
+        ReducedWithCompressionFactor3 = 4,
+        ReducedWithCompressionFactor4 = 5,
+
+        Imploded = 6,
+
+        Reserved_1 = 7,
+
+        // Zip used DEFLATE to compress the file
+        Deflated = 8,
+
+        // Deflate64, DEFLATE with a 64 KiB window, used by Windows for big files
+        EnhancedDeflated = 9,
+
+        PKWareDCLimploded = 10,
+
+        Reserved_2 = 11,
+
+        // BZIP2, it's blocks are independent and get decoded in parallel
+        BZIP2 = 12,
+
+        Reserved_3 = 13,
+
+        // LZMA, with a small header of it's own in front of the compressed data, written by 7-Zip and WinZip
+        LZMA = 14,
+
+        Reserved_4 = 15,
+        Reserved_5 = 16,
+        Reserved_6 = 17,
+
+        IBM_TERSE = 18,
+        IBM_LZ77z = 19,
+
+        // Zstandard, a single frame without a dictionary, written by newer versions of WinZip and 7-Zip
+        Zstandard = 93,
+
+        PPMd_Version_I_Rev_1 = 98,
+    };
+
+
+    // The compressed stream a codec is reset for
+    struct CodecStreamInfo
+    {
+        // The size of the decompressed data, or UINT64_MAX when it isn't known (behind a data descriptor)
+        uint64_t uncompressedSize = UINT64_MAX;
+
+        // Optional, a buffer for the whole decompressed data that every Decode call's next_out points into.
+        // Codecs with a window may use it as the window instead of allocating one
+        uint8_t* outputBuffer = nullptr;
+
+        // The entry's general purpose bit flag, some methods keep options in it
+        uint16_t generalPurposeBitFlag = 0;
+    };
+
+
+    // The work done by every instance of a codec, read through CodecRegistry::GetStatistics
+    struct CodecStatistics
+    {
+        CompressionMethod method = CompressionMethod::None;
+
+        std::string name;
+
+        // The number of streams the codec was reset for
+        uint64_t streamCount = 0;
+
+        uint64_t inputBytes = 0;
+        uint64_t outputBytes = 0;
+
+        // The time spent inside the codec, summed over every thread
+        uint64_t decodeNanoseconds = 0;
+
+
+        /// <summary>
+        /// Get the decompressed bytes per second of decode time, which on several threads is the throughput of a single thread
+        /// </summary>
+        double GetOutputBytesPerSecond() const
+        {
+            if (decodeNanoseconds == 0)
+                return 0.0;
+
+            return static_cast<double>(outputBytes) * 1e9 / static_cast<double>(decodeNanoseconds);
+        };
+    };
+
+
+
+    /// <summary>
+    /// A decompressor for a single zip compression method.
+    /// Works on a z_stream with the same contract as inflate(Z_NO_FLUSH) on a raw stream: every Decode call consumes as much input
+    /// and produces as much output as it can, and returns Z_OK, Z_STREAM_END, Z_BUF_ERROR if no progress was possible or Z_DATA_ERROR.
+    /// Only next_in, avail_in, total_in, next_out, avail_out and total_out of the stream are used.
+    /// Implementations override the protected On* functions, the public functions around them keep the codec's statistics
+    /// </summary>
+    class DecompressionCodec
+    {
+
+    public:
+
+        // Receives decompressed data in order
+        using OutputCallback = std::function<void(std::span<const uint8_t>)>;
+
+
+    private:
+
+        friend class CodecRegistry;
+
+        // The registration's counters, set when the codec was created through a registry
+        struct Counters
+        {
+            std::atomic<uint64_t> streamCount { 0 };
+            std::atomic<uint64_t> inputBytes { 0 };
+            std::atomic<uint64_t> outputBytes { 0 };
+            std::atomic<uint64_t> decodeNanoseconds { 0 };
+        };
+
+        std::shared_ptr<Counters> _counters;
+
+
+    public:
+
+        virtual ~DecompressionCodec() = default;
+
+
+        /// <summary>
+        /// Prepares the codec for a new stream
+        /// </summary>
+        /// <param name="streamInfo"> The stream that follows </param>
+        void Reset(const CodecStreamInfo& streamInfo)
+        {
+            if (_counters != nullptr)
+                _counters->streamCount.fetch_add(1, std::memory_order_relaxed);
+
+            OnReset(streamInfo);
+        };
+
+
+        /// <summary>
+        /// Decodes as much of the stream as the input and output buffers allow
+        /// </summary>
+        /// <param name="stream"> The input and output buffers </param>
+        /// <returns> The decoder's result, with inflate's meaning </returns>
+        int Decode(z_stream& stream)
+        {
+            if (_counters == nullptr)
+                return OnDecode(stream);
+
+            const uInt inputBefore = stream.avail_in;
+            const uInt outputBefore = stream.avail_out;
+            const auto startTime = std::chrono::steady_clock::now();
+
+            const int result = OnDecode(stream);
+
+            AddWork(inputBefore - stream.avail_in, outputBefore - stream.avail_out, startTime);
+
+            return result;
+        };
+
+
+        /// <summary>
+        /// Decompresses a whole stream into a caller supplied buffer that fits exactly all of it.
+        /// Both buffers can be bigger than 4 GiB
+        /// </summary>
+        /// <param name="compressedData"> A pointer to the compressed data </param>
+        /// <param name="compressedSize"> The size of the compressed data </param>
+        /// <param name="output"> A buffer that will contain the decompressed data </param>
+        /// <param name="outputSize"> The size of the decompressed data </param>
+        /// <param name="generalPurposeBitFlag"> The entry's general purpose bit flag </param>
+        void DecodeBuffer(const uint8_t* compressedData, uint64_t compressedSize, uint8_t* output, uint64_t outputSize, uint16_t generalPurposeBitFlag)
+        {
+            const auto startTime = std::chrono::steady_clock::now();
+
+            OnDecodeBuffer(compressedData, compressedSize, output, outputSize, generalPurposeBitFlag);
+
+            if (_counters != nullptr)
+            {
+                _counters->streamCount.fetch_add(1, std::memory_order_relaxed);
+
+                AddWork(compressedSize, outputSize, startTime);
+            };
+        };
+
+
+        /// <summary>
+        /// True if the codec can decode a stream when it has all of it's input at once, see DecodeWholeInput
+        /// </summary>
+        virtual bool HasWholeInputDecode() const
+        {
+            return false;
+        };
+
+
+        /// <summary>
+        /// Decompresses a whole stream that is entirely in memory, handing the decompressed data over in order.
+        /// Codecs with independent blocks use this to decode the blocks in parallel
+        /// </summary>
+        /// <param name="compressedData"> A pointer to the compressed data </param>
+        /// <param name="compressedSize"> The size of the compressed data </param>
+        /// <param name="callback"> Receives the decompressed data, may throw to stop the decoding </param>
+        /// <returns> The size of the decompressed data </returns>
+        uint64_t DecodeWholeInput(const uint8_t* compressedData, uint64_t compressedSize, const OutputCallback& callback)
+        {
+            const auto startTime = std::chrono::steady_clock::now();
+
+            const uint64_t outputSize = OnDecodeWholeInput(compressedData, compressedSize, callback);
+
+            if (_counters != nullptr)
+            {
+                _counters->streamCount.fetch_add(1, std::memory_order_relaxed);
+
+                AddWork(compressedSize, outputSize, startTime);
+            };
+
+            return outputSize;
+        };
+
+
+    protected:
+
+        virtual void OnReset(const CodecStreamInfo& streamInfo) = 0;
+
+        virtual int OnDecode(z_stream& stream) = 0;
+
+
+        /// <summary>
+        /// Decodes a whole stream into a buffer, through OnDecodeWholeInput if the codec has it and otherwise through OnDecode,
+        /// with the output buffer passed along to OnReset
+        /// </summary>
+        virtual void OnDecodeBuffer(const uint8_t* compressedData, uint64_t compressedSize, uint8_t* output, uint64_t outputSize, uint16_t generalPurposeBitFlag)
+        {
+            if (HasWholeInputDecode() == true)
+            {
+                uint64_t written = 0;
+
+                OnDecodeWholeInput(compressedData, compressedSize, [&](std::span<const uint8_t> data)
+                {
+                    if (data.size() > outputSize - written)
+                        throw std::exception("Failed to decompress file");
+
+                    memcpy(&output[written], data.data(), data.size());
+                    written += data.size();
+                });
+
+                if (written != outputSize)
+                    throw std::exception("Failed to decompress file");
+
+                return;
+            };
+
+            CodecStreamInfo streamInfo;
+            streamInfo.uncompressedSize = outputSize;
+            streamInfo.outputBuffer = output;
+            streamInfo.generalPurposeBitFlag = generalPurposeBitFlag;
+
+            OnReset(streamInfo);
+
+            z_stream stream { };
+
+            stream.next_in = const_cast<Bytef*>(compressedData);
+            stream.next_out = output;
+
+            uint64_t remainingInput = compressedSize;
+            uint64_t remainingOutput = outputSize;
+
+            int result = Z_OK;
+
+            while (result == Z_OK)
+            {
+                RefillBuffer(stream.avail_in, remainingInput);
+                RefillBuffer(stream.avail_out, remainingOutput);
+
+                result = OnDecode(stream);
+            };
+
+            if ((result != Z_STREAM_END) || (remainingOutput != 0) || (stream.avail_out != 0))
+                throw std::exception("Failed to decompress file");
+        };
+
+
+        virtual uint64_t OnDecodeWholeInput(const uint8_t*, uint64_t, const OutputCallback&)
+        {
+            throw std::exception("The codec can't decode a whole input at once");
+
+            return 0;
+        };
+
+
+        /// <summary>
+        /// Hands the next part of a buffer to a z_stream once the previous part was used up
+        /// </summary>
+        static void RefillBuffer(uInt& available, uint64_t& remaining)
+        {
+            if ((available != 0) || (remaining == 0))
+                return;
+
+            available = static_cast<uInt>(std::min<uint64_t>(remaining, MAX_ZLIB_CHUNK_SIZE));
+            remaining -= available;
+        };
+
+
+    private:
+
+        void AddWork(uint64_t inputBytes, uint64_t outputBytes, std::chrono::steady_clock::time_point startTime)
+        {
+            const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
+
+            _counters->inputBytes.fetch_add(inputBytes, std::memory_order_relaxed);
+            _counters->outputBytes.fetch_add(outputBytes, std::memory_order_relaxed);
+            _counters->decodeNanoseconds.fetch_add(static_cast<uint64_t>(elapsed.count()), std::memory_order_relaxed);
+        };
+
+    };
+
+
+
+    /// <summary>
+    /// Stored data, copied as is. The stream ends once the uncompressed size was copied
+    /// </summary>
+    class StoredCodec : public DecompressionCodec
+    {
+
+    private:
+
+        uint64_t _remainingSize = 0;
+
+
+    protected:
+
+        void OnReset(const CodecStreamInfo& streamInfo) override
+        {
+            _remainingSize = streamInfo.uncompressedSize;
+        };
+
+
+        int OnDecode(z_stream& stream) override
+        {
+            if (_remainingSize == 0)
+                return Z_STREAM_END;
+
+            const uInt copySize = static_cast<uInt>(std::min<uint64_t>(std::min(stream.avail_in, stream.avail_out), _remainingSize));
+
+            if (copySize == 0)
+                return Z_BUF_ERROR;
+
+            memcpy(stream.next_out, stream.next_in, copySize);
+
+            stream.next_in += copySize;
+            stream.avail_in -= copySize;
+            stream.total_in += copySize;
+
+            stream.next_out += copySize;
+            stream.avail_out -= copySize;
+            stream.total_out += copySize;
+
+            _remainingSize -= copySize;
+
+            return (_remainingSize == 0) ? Z_STREAM_END : Z_OK;
+        };
+
+
+        void OnDecodeBuffer(const uint8_t* compressedData, uint64_t compressedSize, uint8_t* output, uint64_t outputSize, uint16_t) override
+        {
+            if (compressedSize != outputSize)
+                throw std::exception("Failed to decompress file");
+
+            memcpy(output, compressedData, static_cast<size_t>(outputSize));
+        };
+
+    };
+
+
+
+    /// <summary>
+    /// DEFLATE through zlib, the inflate state and window come from the creating thread's zlib pool
+    /// </summary>
+    class DeflateCodec : public DecompressionCodec
+    {
+
+    private:
+
+        z_stream _stream { };
+
+
+    public:
+
+        DeflateCodec()
+        {
+            ZlibThreadPool::Attach(_stream);
+
+            // A negative window size tells zlib that the stream doesn't have a zlib header or an adler32 trailer
+            if (inflateInit2(&_stream, -MAX_WBITS) != Z_OK)
+                throw std::exception("Failed to initialize inflate");
+        };
+
+
+        ~DeflateCodec() override
+        {
+            inflateEnd(&_stream);
+        };
+
+
+        DeflateCodec(const DeflateCodec&) = delete;
+        DeflateCodec& operator = (const DeflateCodec&) = delete;
+
+
+    protected:
+
+        void OnReset(const CodecStreamInfo&) override
+        {
+            inflateReset(&_stream);
+        };
+
+
+        int OnDecode(z_stream& stream) override
+        {
+            // The inflate state stays inside the codec, only the caller's buffers are moved in and out of it
+            _stream.next_in = stream.next_in;
+            _stream.avail_in = stream.avail_in;
+            _stream.next_out = stream.next_out;
+            _stream.avail_out = stream.avail_out;
+
+            const int result = inflate(&_stream, Z_NO_FLUSH);
+
+            stream.total_in += stream.avail_in - _stream.avail_in;
+            stream.total_out += stream.avail_out - _stream.avail_out;
+
+            stream.next_in = _stream.next_in;
+            stream.avail_in = _stream.avail_in;
+            stream.next_out = _stream.next_out;
+            stream.avail_out = _stream.avail_out;
+
+            return result;
+        };
+
+
+        void OnDecodeBuffer(const uint8_t* compressedData, uint64_t compressedSize, uint8_t* output, uint64_t outputSize, uint16_t generalPurposeBitFlag) override
+        {
+            // zlib can't take more than 4 GiB in a single call, those streams are decompressed in parts by the codec's own state,
+            // which unlike the arena below can also allocate the window that decompressing in parts needs
+            if ((compressedSize > MAX_ZLIB_CHUNK_SIZE) || (outputSize > MAX_ZLIB_CHUNK_SIZE))
+            {
+                DecompressionCodec::OnDecodeBuffer(compressedData, compressedSize, output, outputSize, generalPurposeBitFlag);
+                return;
+            };
+
+            // The inflate state lives on the stack, the entire output buffer is available so the window is never allocated
+            alignas(std::max_align_t) uint8_t arenaBuffer[FixedZlibArena::INFLATE_STATE_SIZE];
+            FixedZlibArena arena(arenaBuffer, sizeof(arenaBuffer));
+
+            z_stream stream { };
+            arena.Attach(stream);
+
+            if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+                throw std::exception("Failed to initialize inflate");
+
+            stream.next_in = const_cast<Bytef*>(compressedData);
+            stream.avail_in = static_cast<uInt>(compressedSize);
+
+            stream.next_out = output;
+            stream.avail_out = static_cast<uInt>(outputSize);
+
+            const int result = inflate(&stream, Z_FINISH);
+
+            inflateEnd(&stream);
+
+            if ((result != Z_STREAM_END) || (stream.total_out != outputSize))
+                throw std::exception("Failed to decompress file");
+        };
+
+    };
+
+
+
+    /// <summary>
+    /// Deflate64
+    /// </summary>
+    class Deflate64Codec : public DecompressionCodec
+    {
+
+    private:
+
+        Deflate64Inflater _inflater;
+
+
+    protected:
+
+        void OnReset(const CodecStreamInfo&) override
+        {
+            _inflater.Reset();
+        };
+
+
+        int OnDecode(z_stream& stream) override
+        {
+            return _inflater.Inflate(stream);
+        };
+
+    };
+
+
+
+    /// <summary>
+    /// BZIP2, whole inputs are decoded block by block in parallel on the process-wide compute pool
+    /// </summary>
+    class Bzip2Codec : public DecompressionCodec
+    {
+
+    private:
+
+        Bzip2Decoder _decoder;
+
+
+    public:
+
+        bool HasWholeInputDecode() const override
+        {
+            return true;
+        };
+
+
+    protected:
+
+        void OnReset(const CodecStreamInfo&) override
+        {
+            _decoder.Reset();
+        };
+
+
+        int OnDecode(z_stream& stream) override
+        {
+            return _decoder.Decode(stream);
+        };
+
+
+        uint64_t OnDecodeWholeInput(const uint8_t* compressedData, uint64_t compressedSize, const OutputCallback& callback) override
+        {
+            Bzip2ParallelDecoder decoder(AsyncContext::GetDefault().computePool);
+
+            return decoder.Decode(compressedData, compressedSize, callback);
+        };
+
+    };
+
+
+
+    /// <summary>
+    /// LZMA, general purpose bit 1 tells that the stream ends with an end marker
+    /// </summary>
+    class LzmaCodec : public DecompressionCodec
+    {
+
+    public:
+
+        static constexpr uint16_t END_MARKER_FLAG = 1 << 1;
+
+
+    private:
+
+        LzmaDecoder _decoder;
+
+
+    protected:
+
+        void OnReset(const CodecStreamInfo& streamInfo) override
+        {
+            _decoder.Reset(streamInfo.uncompressedSize, (streamInfo.generalPurposeBitFlag & END_MARKER_FLAG) != 0, streamInfo.outputBuffer);
+        };
+
+
+        int OnDecode(z_stream& stream) override
+        {
+            return _decoder.Decode(stream);
+        };
+
+    };
+
+
+
+    /// <summary>
+    /// Zstandard
+    /// </summary>
+    class ZstdCodec : public DecompressionCodec
+    {
+
+    private:
+
+        ZstdDecoder _decoder;
+
+
+    protected:
+
+        void OnReset(const CodecStreamInfo& streamInfo) override
+        {
+            _decoder.Reset(streamInfo.uncompressedSize, streamInfo.outputBuffer);
+        };
+
+
+        int OnDecode(z_stream& stream) override
+        {
+            return _decoder.Decode(stream);
+        };
+
+    };
+
+
+
+    /// <summary>
+    /// Maps compression methods to the codecs that decompress them.
+    /// Every extraction path looks it's codec up here, so registering a codec adds a method, or replaces the implementation of one, everywhere at once.
+    /// Registering is thread safe, but codecs that were already handed out keep decoding with the implementation they were created from
+    /// </summary>
+    class CodecRegistry
+    {
+
+    public:
+
+        // Creates a new, independent instance of a codec
+        using CodecFactory = std::function<std::unique_ptr<DecompressionCodec>()>;
+
+
+    private:
+
+        struct Registration
+        {
+            CompressionMethod method = CompressionMethod::None;
+
+            std::string name;
+
+            CodecFactory factory;
+
+            std::shared_ptr<DecompressionCodec::Counters> counters;
+        };
+
+        // A thread's instance of a codec, recreated once it's registration was replaced
+        struct PooledCodec
+        {
+            std::shared_ptr<const Registration> registration;
+
+            std::unique_ptr<DecompressionCodec> codec;
+        };
+
+
+    private:
+
+        mutable std::shared_mutex _mutex;
+
+        std::unordered_map<CompressionMethod, std::shared_ptr<const Registration>> _registrations;
+
+
+    public:
+
+        CodecRegistry() = default;
+
+        CodecRegistry(const CodecRegistry&) = delete;
+        CodecRegistry& operator = (const CodecRegistry&) = delete;
+
+
+        /// <summary>
+        /// Get the registry every extraction path uses, it starts out with the built in codecs
+        /// </summary>
+        static CodecRegistry& GetDefault()
+        {
+            // The built in codecs are registered once, the first time any extraction needs a codec
+            struct DefaultRegistry
+            {
+                CodecRegistry registry;
+
+                DefaultRegistry()
+                {
+                    registry.RegisterBuiltInCodecs();
+                };
+            };
+
+            static DefaultRegistry defaultRegistry;
+
+            return defaultRegistry.registry;
+        };
+
+
+        /// <summary>
+        /// Registers a codec for a compression method, replacing the method's current codec
+        /// </summary>
+        /// <param name="method"> The compression method </param>
+        /// <param name="name"> A name for the statistics </param>
+        /// <param name="factory"> Creates instances of the codec, may be called on any thread </param>
+        void Register(CompressionMethod method, std::string name, CodecFactory factory)
+        {
+            auto registration = std::make_shared<Registration>();
+
+            registration->method = method;
+            registration->name = std::move(name);
+            registration->factory = std::move(factory);
+            registration->counters = std::make_shared<DecompressionCodec::Counters>();
+
+            std::unique_lock lock(_mutex);
+
+            _registrations[method] = std::move(registration);
+        };
+
+
+        /// <summary>
+        /// Removes a compression method's codec, the method is unsupported afterwards
+        /// </summary>
+        void Unregister(CompressionMethod method)
+        {
+            std::unique_lock lock(_mutex);
+
+            _registrations.erase(method);
+        };
+
+
+        bool IsSupported(CompressionMethod method) const
+        {
+            return (Find(method) != nullptr);
+        };
+
+
+        /// <summary>
+        /// Creates a new instance of a method's codec, for callers that keep a stream open across calls
+        /// </summary>
+        /// <param name="method"> The compression method </param>
+        /// <returns> The codec, throws if the method isn't supported </returns>
+        std::unique_ptr<DecompressionCodec> Create(CompressionMethod method) const
+        {
+            return CreateCodec(GetRegistration(method));
+        };
+
+
+        /// <summary>
+        /// Get the calling thread's instance of a method's codec, it keeps it's state and buffers from stream to stream.
+        /// It must only be used for streams that are decoded from start to end before the thread uses the same method again
+        /// </summary>
+        /// <param name="method"> The compression method </param>
+        /// <returns> The codec, throws if the method isn't supported </returns>
+        DecompressionCodec& GetThreadCodec(CompressionMethod method) const
+        {
+            thread_local std::unordered_map<CompressionMethod, PooledCodec> threadCodecs;
+
+            std::shared_ptr<const Registration> registration = GetRegistration(method);
+
+            PooledCodec& pooledCodec = threadCodecs[method];
+
+            if (pooledCodec.registration != registration)
+            {
+                pooledCodec.codec = CreateCodec(registration);
+                pooledCodec.registration = std::move(registration);
+            };
+
+            return *pooledCodec.codec;
+        };
+
+
+        /// <summary>
+        /// Get the statistics of every registered codec
+        /// </summary>
+        std::vector<CodecStatistics> GetStatistics() const
+        {
+            std::shared_lock lock(_mutex);
+
+            std::vector<CodecStatistics> statistics;
+            statistics.reserve(_registrations.size());
+
+            for (const auto& [method, registration] : _registrations)
+            {
+                CodecStatistics codecStatistics;
+
+                codecStatistics.method = method;
+                codecStatistics.name = registration->name;
+                codecStatistics.streamCount = registration->counters->streamCount.load(std::memory_order_relaxed);
+                codecStatistics.inputBytes = registration->counters->inputBytes.load(std::memory_order_relaxed);
+                codecStatistics.outputBytes = registration->counters->outputBytes.load(std::memory_order_relaxed);
+                codecStatistics.decodeNanoseconds = registration->counters->decodeNanoseconds.load(std::memory_order_relaxed);
+
+                statistics.push_back(std::move(codecStatistics));
+            };
+
+            // The map's order isn't stable, the statistics are listed by method
+            std::sort(statistics.begin(), statistics.end(), [](const CodecStatistics& left, const CodecStatistics& right)
+            {
+                return left.method < right.method;
+            });
+
+            return statistics;
+        };
+
+
+    private:
+
+        void RegisterBuiltInCodecs()
+        {
+            Register(CompressionMethod::None, "Stored", []() { return std::make_unique<StoredCodec>(); });
+            Register(CompressionMethod::Deflated, "Deflate", []() { return std::make_unique<DeflateCodec>(); });
+            Register(CompressionMethod::EnhancedDeflated, "Deflate64", []() { return std::make_unique<Deflate64Codec>(); });
+            Register(CompressionMethod::BZIP2, "BZIP2", []() { return std::make_unique<Bzip2Codec>(); });
+            Register(CompressionMethod::LZMA, "LZMA", []() { return std::make_unique<LzmaCodec>(); });
+            Register(CompressionMethod::Zstandard, "Zstandard", []() { return std::make_unique<ZstdCodec>(); });
+        };
+
+
+        std::shared_ptr<const Registration> Find(CompressionMethod method) const
+        {
+            std::shared_lock lock(_mutex);
+
+            const auto iterator = _registrations.find(method);
+
+            if (iterator == _registrations.end())
+                return nullptr;
+
+            return iterator->second;
+        };
+
+
+        std::shared_ptr<const Registration> GetRegistration(CompressionMethod method) const
+        {
+            std::shared_ptr<const Registration> registration = Find(method);
+
+            if (registration == nullptr)
+                throw std::exception("Unsupported compression method");
+
+            return registration;
+        };
+
+
+        static std::unique_ptr<DecompressionCodec> CreateCodec(const std::shared_ptr<const Registration>& registration)
+        {
+            std::unique_ptr<DecompressionCodec> codec = registration->factory();
+
+            codec->_counters = registration->counters;
+
+            return codec;
+        };
+
+    };
+
+};
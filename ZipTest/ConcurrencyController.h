@@ -0,0 +1,312 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+
+
+namespace ZipExtractor
+{
+
+    /// <summary>
+    /// A feedback controller that picks the number of active workers and concurrent writes while an extraction runs.
+    /// Workers report how long they spent decompressing, waiting for a write slot and writing. Every control interval the controller
+    /// looks at the achieved throughput and the share of time workers stalled on writes:
+    /// a lot of stalling means the disk is the bottleneck and more writes are allowed, little stalling means decompression is and more workers are allowed.
+    /// A change that lowered throughput is undone, so the limits settle where the machine is saturated.
+    /// Not thread-safe, the owner serializes all calls
+    /// </summary>
+    class ConcurrencyController
+    {
+
+    public:
+
+        using Clock = std::chrono::steady_clock;
+
+
+        // How often the limits are re-evaluated
+        static constexpr std::chrono::milliseconds CONTROL_INTERVAL = std::chrono::milliseconds(100);
+
+        // Above this share of time spent waiting for a write slot, the extraction is considered I/O bound
+        static constexpr double HIGH_WRITE_STALL_RATIO = 0.25;
+
+        // Below this share of time spent waiting for a write slot, the extraction is considered CPU bound
+        static constexpr double LOW_WRITE_STALL_RATIO = 0.05;
+
+        // A change is undone if throughput fell below this fraction of the throughput before the change
+        static constexpr double THROUGHPUT_DROP_TOLERANCE = 0.9;
+
+
+    private:
+
+        // Which limit the previous control step changed
+        enum class Adjustment
+        {
+            None,
+            Workers,
+            Writes,
+        };
+
+
+    private:
+
+        const size_t _maxWorkers;
+
+        const bool _isAdaptive;
+
+        size_t _workerLimit;
+
+        size_t _writeLimit;
+
+
+        Adjustment _lastAdjustment = Adjustment::None;
+
+        // +1 or -1, the direction of the previous change
+        int _lastDirection = 0;
+
+        // The throughput of the window before the previous change
+        double _lastThroughput = 0.0;
+
+
+        // The current control window
+
+        Clock::time_point _windowStart;
+
+        uint64_t _windowBytes = 0;
+
+        double _windowInflateSeconds = 0.0;
+
+        double _windowWriteStallSeconds = 0.0;
+
+        double _windowWriteSeconds = 0.0;
+
+
+        // Totals over the entire run
+
+        Clock::time_point _runStart;
+
+        uint64_t _totalBytes = 0;
+
+        double _totalInflateSeconds = 0.0;
+
+        double _totalWriteStallSeconds = 0.0;
+
+        double _totalWriteSeconds = 0.0;
+
+        size_t _adjustmentCount = 0;
+
+
+    public:
+
+        /// <summary>
+        /// Creates a controller
+        /// </summary>
+        /// <param name="maxWorkers"> The most workers that may ever be active </param>
+        /// <param name="initialWrites"> The number of concurrent writes to start with </param>
+        /// <param name="isAdaptive"> False keeps the limits fixed and only measures </param>
+        ConcurrencyController(size_t maxWorkers, size_t initialWrites, bool isAdaptive) :
+            _maxWorkers(std::max<size_t>(maxWorkers, 1)),
+            _isAdaptive(isAdaptive),
+            _workerLimit(_maxWorkers),
+            _writeLimit(std::clamp<size_t>(initialWrites, 1, _maxWorkers))
+        {
+            Restart(Clock::now());
+        };
+
+
+    public:
+
+        /// <summary>
+        /// Resets all measurements, the limits that were learned so far are kept
+        /// </summary>
+        /// <param name="now"> The time the run starts </param>
+        void Restart(Clock::time_point now)
+        {
+            _lastAdjustment = Adjustment::None;
+            _lastDirection = 0;
+            _lastThroughput = 0.0;
+
+            _runStart = now;
+            _totalBytes = 0;
+            _totalInflateSeconds = 0.0;
+            _totalWriteStallSeconds = 0.0;
+            _totalWriteSeconds = 0.0;
+            _adjustmentCount = 0;
+
+            StartWindow(now);
+        };
+
+
+        /// <summary>
+        /// Report a finished file
+        /// </summary>
+        /// <param name="bytes"> The number of decompressed bytes that were written </param>
+        /// <param name="inflateSeconds"> Time spent decompressing </param>
+        /// <param name="writeStallSeconds"> Time spent waiting for a write slot </param>
+        /// <param name="writeSeconds"> Time spent writing </param>
+        void AddSample(uint64_t bytes, double inflateSeconds, double writeStallSeconds, double writeSeconds)
+        {
+            _windowBytes += bytes;
+            _windowInflateSeconds += inflateSeconds;
+            _windowWriteStallSeconds += writeStallSeconds;
+            _windowWriteSeconds += writeSeconds;
+
+            _totalBytes += bytes;
+            _totalInflateSeconds += inflateSeconds;
+            _totalWriteStallSeconds += writeStallSeconds;
+            _totalWriteSeconds += writeSeconds;
+        };
+
+
+        /// <summary>
+        /// Re-evaluates the limits once the control interval has passed
+        /// </summary>
+        /// <param name="now"> The current time </param>
+        /// <returns> True if any limit changed </returns>
+        bool Update(Clock::time_point now)
+        {
+            if (now - _windowStart < CONTROL_INTERVAL)
+                return false;
+
+            const double windowSeconds = std::chrono::duration<double>(now - _windowStart).count();
+
+            const double busySeconds = _windowInflateSeconds + _windowWriteStallSeconds + _windowWriteSeconds;
+
+            // Nothing finished during this window, there is nothing to learn from it
+            if ((_isAdaptive == false) || (_windowBytes == 0) || (busySeconds <= 0.0))
+            {
+                StartWindow(now);
+                return false;
+            };
+
+            const double throughput = static_cast<double>(_windowBytes) / windowSeconds;
+            const double writeStallRatio = _windowWriteStallSeconds / busySeconds;
+
+            StartWindow(now);
+
+            // The previous change made things worse, undo it and let the next window pick again
+            if ((_lastAdjustment != Adjustment::None) && (throughput < _lastThroughput * THROUGHPUT_DROP_TOLERANCE))
+            {
+                const Adjustment undoneAdjustment = _lastAdjustment;
+                Adjust(undoneAdjustment, -_lastDirection);
+
+                _lastAdjustment = Adjustment::None;
+                _lastThroughput = 0.0;
+
+                return true;
+            };
+
+            _lastThroughput = throughput;
+
+            // I/O bound, allow more writes or stop adding workers that would only wait for one
+            if (writeStallRatio > HIGH_WRITE_STALL_RATIO)
+            {
+                if (_writeLimit < _workerLimit)
+                    return Adjust(Adjustment::Writes, +1);
+
+                if (_workerLimit > 1)
+                    return Adjust(Adjustment::Workers, -1);
+            };
+
+            // CPU bound, allow more workers to decompress
+            if (writeStallRatio < LOW_WRITE_STALL_RATIO)
+            {
+                if (_workerLimit < _maxWorkers)
+                    return Adjust(Adjustment::Workers, +1);
+            };
+
+            _lastAdjustment = Adjustment::None;
+
+            return false;
+        };
+
+
+    public:
+
+        size_t GetWorkerLimit() const
+        {
+            return _workerLimit;
+        };
+
+        size_t GetWriteLimit() const
+        {
+            return _writeLimit;
+        };
+
+        size_t GetAdjustmentCount() const
+        {
+            return _adjustmentCount;
+        };
+
+        uint64_t GetTotalBytes() const
+        {
+            return _totalBytes;
+        };
+
+        double GetTotalInflateSeconds() const
+        {
+            return _totalInflateSeconds;
+        };
+
+        double GetTotalWriteStallSeconds() const
+        {
+            return _totalWriteStallSeconds;
+        };
+
+        double GetTotalWriteSeconds() const
+        {
+            return _totalWriteSeconds;
+        };
+
+        /// <summary>
+        /// Get the seconds that passed since the run started
+        /// </summary>
+        double GetElapsedSeconds(Clock::time_point now) const
+        {
+            return std::chrono::duration<double>(now - _runStart).count();
+        };
+
+
+    private:
+
+        void StartWindow(Clock::time_point now)
+        {
+            _windowStart = now;
+            _windowBytes = 0;
+            _windowInflateSeconds = 0.0;
+            _windowWriteStallSeconds = 0.0;
+            _windowWriteSeconds = 0.0;
+        };
+
+
+        /// <summary>
+        /// Moves a limit one step, writes never exceed the number of workers
+        /// </summary>
+        /// <returns> True if the limit changed </returns>
+        bool Adjust(Adjustment adjustment, int direction)
+        {
+            size_t& limit = (adjustment == Adjustment::Workers) ? _workerLimit : _writeLimit;
+            const size_t maxLimit = (adjustment == Adjustment::Workers) ? _maxWorkers : _workerLimit;
+
+            const size_t newLimit = (direction > 0) ? std::min(limit + 1, maxLimit) : std::max<size_t>(limit - 1, 1);
+
+            if (newLimit == limit)
+            {
+                _lastAdjustment = Adjustment::None;
+                return false;
+            };
+
+            limit = newLimit;
+
+            // Fewer workers can't use more write slots than there are workers
+            _writeLimit = std::min(_writeLimit, _workerLimit);
+
+            _lastAdjustment = adjustment;
+            _lastDirection = direction;
+            _adjustmentCount++;
+
+            return true;
+        };
+
+    };
+
+};
@@ -0,0 +1,420 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <list>
+#include <array>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <filesystem>
+#include <unordered_map>
+
+#include "ZipExtractor.h"
+#include "MemoryBudget.h"
+
+
+namespace ZipExtractor
+{
+
+    // Identifies a single zip file on disk.
+    // The size and last write time are part of the identity so a zip that was replaced in place won't be served from stale cache entries
+    struct ArchiveIdentity
+    {
+        // The path to the zip file
+        std::string archivePath;
+
+        // The size of the zip file in bytes
+        uintmax_t archiveSize = 0;
+
+        // The zip file's last write time, as a raw tick count
+        int64_t lastWriteTime = 0;
+
+
+        bool operator == (const ArchiveIdentity& other) const
+        {
+            return (archiveSize == other.archiveSize) &&
+                   (lastWriteTime == other.lastWriteTime) &&
+                   (archivePath == other.archivePath);
+        };
+
+        bool operator != (const ArchiveIdentity& other) const
+        {
+            return !(*this == other);
+        };
+    };
+
+
+    // A key for a single decompressed file inside the cache
+    struct CachedEntryKey
+    {
+        // The zip file the entry belongs to
+        ArchiveIdentity archive;
+
+        // The index of the entry's central directory inside the zip
+        size_t entryIndex = 0;
+
+
+        bool operator == (const CachedEntryKey& other) const
+        {
+            return (entryIndex == other.entryIndex) &&
+                   (archive == other.archive);
+        };
+    };
+
+
+    // A hash function for CachedEntryKey so it can be used inside an unordered_map
+    struct CachedEntryKeyHash
+    {
+        size_t operator () (const CachedEntryKey& key) const
+        {
+            size_t hash = std::hash<std::string>()(key.archive.archivePath);
+
+            // Combine the rest of the key into the hash
+            hash ^= std::hash<uintmax_t>()(key.archive.archiveSize) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+            hash ^= std::hash<int64_t>()(key.archive.lastWriteTime) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+            hash ^= std::hash<size_t>()(key.entryIndex) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+
+            return hash;
+        };
+    };
+
+
+    // A reference counted, read-only decompressed file.
+    // The cache only holds one reference, so evicting an entry never frees a buffer that someone is still reading from
+    using CachedEntryBuffer = std::shared_ptr<const std::vector<uint8_t>>;
+
+
+    namespace Utilities
+    {
+
+        /// <summary>
+        /// Creates an identity for the zip file found at the given path
+        /// </summary>
+        /// <param name="zipFilepath"> A filepath to the zip </param>
+        /// <returns></returns>
+        ArchiveIdentity GetArchiveIdentity(const std::string& zipFilepath)
+        {
+            ArchiveIdentity identity;
+
+            identity.archivePath = zipFilepath;
+            identity.archiveSize = std::filesystem::file_size(zipFilepath);
+            identity.lastWriteTime = static_cast<int64_t>(std::filesystem::last_write_time(zipFilepath).time_since_epoch().count());
+
+            return identity;
+        };
+
+    };
+
+
+
+    /// <summary>
+    /// An opt-in, memory bounded cache of decompressed files.
+    /// The cache is split into shards, each with it's own lock and LRU list, so concurrent readers rarely contend on the same lock.
+    /// Each shard gets an equal part of the byte budget and evicts it's least recently used files when it runs out.
+    /// A file has to fit inside a single shard, so files bigger than 1/SHARD_COUNT of the byte budget (see GetMaxEntrySize) are never cached.
+    /// With a MemoryBudget every cached file is also reserved from it, and a shard evicts (or skips caching) instead of waiting for it
+    /// </summary>
+    class DecompressedEntryCache
+    {
+
+    public:
+
+        // The number of shards the cache is split into
+        static constexpr size_t SHARD_COUNT = 16;
+
+
+    private:
+
+        // A single cached file
+        struct CacheNode
+        {
+            CachedEntryKey key;
+
+            CachedEntryBuffer buffer;
+        };
+
+
+        // A part of the cache that is guarded by it's own lock
+        struct CacheShard
+        {
+            std::mutex lock;
+
+            // The cached files ordered from the most recently used to the least recently used
+            std::list<CacheNode> lruList;
+
+            // A lookup table into lruList
+            std::unordered_map<CachedEntryKey, std::list<CacheNode>::iterator, CachedEntryKeyHash> lookup;
+
+            // The number of decompressed bytes held by this shard
+            size_t usedBytes = 0;
+        };
+
+
+    private:
+
+        std::array<CacheShard, SHARD_COUNT> _shards;
+
+        // The maximum number of bytes the entire cache may hold
+        const size_t _byteBudget;
+
+        // The maximum number of bytes a single shard may hold
+        const size_t _shardByteBudget;
+
+        // Optional, the cached bytes are reserved from it
+        MemoryBudget* const _memoryBudget;
+
+        std::atomic<uint64_t> _hitCount { 0 };
+        std::atomic<uint64_t> _missCount { 0 };
+        std::atomic<uint64_t> _evictionCount { 0 };
+
+
+    public:
+
+        /// <summary>
+        /// Creates a cache
+        /// </summary>
+        /// <param name="byteBudget"> The maximum number of decompressed bytes the cache may hold, a single file may take up at most 1/SHARD_COUNT of it </param>
+        /// <param name="memoryBudget"> Optional, a budget shared with the rest of the extraction that the cached bytes are reserved from </param>
+        explicit DecompressedEntryCache(size_t byteBudget, MemoryBudget* memoryBudget = nullptr) :
+            _byteBudget(byteBudget),
+            _shardByteBudget(byteBudget / SHARD_COUNT),
+            _memoryBudget(memoryBudget)
+        {
+        };
+
+        // The cached bytes are only reserved from the shared budget while they are cached, hand them back
+        ~DecompressedEntryCache()
+        {
+            Clear();
+        };
+
+        DecompressedEntryCache(const DecompressedEntryCache&) = delete;
+        DecompressedEntryCache& operator = (const DecompressedEntryCache&) = delete;
+
+
+    public:
+
+        /// <summary>
+        /// Look for a file inside the cache
+        /// </summary>
+        /// <param name="key"> The file's key </param>
+        /// <returns> The decompressed file, or nullptr if it isn't cached </returns>
+        CachedEntryBuffer Find(const CachedEntryKey& key)
+        {
+            CacheShard& shard = GetShard(key);
+
+            std::lock_guard<std::mutex> guard(shard.lock);
+
+            auto lookupIterator = shard.lookup.find(key);
+
+            if (lookupIterator == shard.lookup.end())
+            {
+                _missCount.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            };
+
+            // Mark the file as the most recently used
+            shard.lruList.splice(shard.lruList.begin(), shard.lruList, lookupIterator->second);
+
+            _hitCount.fetch_add(1, std::memory_order_relaxed);
+
+            return lookupIterator->second->buffer;
+        };
+
+
+        /// <summary>
+        /// Insert a decompressed file into the cache.
+        /// If the file is already cached the existing buffer is kept and returned instead.
+        /// Files bigger than GetMaxEntrySize are returned without being cached
+        /// </summary>
+        /// <param name="key"> The file's key </param>
+        /// <param name="buffer"> The file's decompressed contents </param>
+        /// <returns> The cached buffer </returns>
+        CachedEntryBuffer Insert(const CachedEntryKey& key, std::vector<uint8_t>&& buffer)
+        {
+            CachedEntryBuffer sharedBuffer = std::make_shared<const std::vector<uint8_t>>(std::move(buffer));
+
+            // Files that are bigger than a shard can never be cached, just hand the buffer back to the caller
+            if (sharedBuffer->size() > _shardByteBudget)
+                return sharedBuffer;
+
+            CacheShard& shard = GetShard(key);
+
+            std::lock_guard<std::mutex> guard(shard.lock);
+
+            auto lookupIterator = shard.lookup.find(key);
+
+            // Someone else cached this file while we were decompressing it
+            if (lookupIterator != shard.lookup.end())
+            {
+                shard.lruList.splice(shard.lruList.begin(), shard.lruList, lookupIterator->second);
+                return lookupIterator->second->buffer;
+            };
+
+            // Evict the least recently used files until the new file fits
+            while (shard.usedBytes + sharedBuffer->size() > _shardByteBudget)
+                EvictLeastRecentlyUsed(shard);
+
+            // A cache must never make the rest of the extraction wait, so the shared budget is only tried.
+            // If even an empty shard doesn't fit the file just isn't cached
+            if (_memoryBudget != nullptr)
+            {
+                while (_memoryBudget->TryAcquire(sharedBuffer->size()) == false)
+                {
+                    if (shard.lruList.empty() == true)
+                        return sharedBuffer;
+
+                    EvictLeastRecentlyUsed(shard);
+                };
+            };
+
+            shard.lruList.push_front(CacheNode { key, sharedBuffer });
+            shard.lookup.emplace(key, shard.lruList.begin());
+            shard.usedBytes += sharedBuffer->size();
+
+            return sharedBuffer;
+        };
+
+
+        /// <summary>
+        /// Look for a file inside the cache and decompress it if it isn't cached
+        /// </summary>
+        /// <param name="key"> The file's key </param>
+        /// <param name="loader"> A function that decompresses the file into the given vector </param>
+        /// <returns> The decompressed file </returns>
+        CachedEntryBuffer GetOrLoad(const CachedEntryKey& key, const std::function<void(std::vector<uint8_t>&)>& loader)
+        {
+            CachedEntryBuffer buffer = Find(key);
+
+            if (buffer != nullptr)
+                return buffer;
+
+            // Decompress outside of the shard lock so other readers aren't blocked by it
+            std::vector<uint8_t> decompressedData;
+            loader(decompressedData);
+
+            return Insert(key, std::move(decompressedData));
+        };
+
+
+        /// <summary>
+        /// Remove every file from the cache
+        /// </summary>
+        void Clear()
+        {
+            for (CacheShard& shard : _shards)
+            {
+                std::lock_guard<std::mutex> guard(shard.lock);
+
+                if (_memoryBudget != nullptr)
+                    _memoryBudget->Release(shard.usedBytes);
+
+                shard.lookup.clear();
+                shard.lruList.clear();
+                shard.usedBytes = 0;
+            };
+        };
+
+
+    public:
+
+        size_t GetByteBudget() const
+        {
+            return _byteBudget;
+        };
+
+        /// <summary>
+        /// Get the size of the biggest file that can be cached, which is a single shard's part of the byte budget
+        /// </summary>
+        size_t GetMaxEntrySize() const
+        {
+            return _shardByteBudget;
+        };
+
+        /// <summary>
+        /// Get the number of decompressed bytes currently held by the cache
+        /// </summary>
+        size_t GetUsedBytes()
+        {
+            size_t usedBytes = 0;
+
+            for (CacheShard& shard : _shards)
+            {
+                std::lock_guard<std::mutex> guard(shard.lock);
+                usedBytes += shard.usedBytes;
+            };
+
+            return usedBytes;
+        };
+
+        uint64_t GetHitCount() const
+        {
+            return _hitCount.load(std::memory_order_relaxed);
+        };
+
+        uint64_t GetMissCount() const
+        {
+            return _missCount.load(std::memory_order_relaxed);
+        };
+
+        uint64_t GetEvictionCount() const
+        {
+            return _evictionCount.load(std::memory_order_relaxed);
+        };
+
+
+    private:
+
+        /// <summary>
+        /// Removes a shard's least recently used file, called while holding the shard's lock.
+        /// Readers that still hold the evicted buffer keep it alive until they are done with it
+        /// </summary>
+        void EvictLeastRecentlyUsed(CacheShard& shard)
+        {
+            CacheNode& leastRecentlyUsed = shard.lruList.back();
+
+            const size_t evictedBytes = leastRecentlyUsed.buffer->size();
+
+            shard.usedBytes -= evictedBytes;
+            shard.lookup.erase(leastRecentlyUsed.key);
+            shard.lruList.pop_back();
+
+            if (_memoryBudget != nullptr)
+                _memoryBudget->Release(evictedBytes);
+
+            _evictionCount.fetch_add(1, std::memory_order_relaxed);
+        };
+
+
+        CacheShard& GetShard(const CachedEntryKey& key)
+        {
+            return _shards[CachedEntryKeyHash()(key) % SHARD_COUNT];
+        };
+
+    };
+
+
+
+    /// <summary>
+    /// Decompresses a single file from inside of the zip, or returns it from the cache if it was already decompressed
+    /// </summary>
+    /// <param name="cache"> The cache to use </param>
+    /// <param name="archive"> The identity of the zip file, see Utilities::GetArchiveIdentity </param>
+    /// <param name="zipFileData"> The zip file buffer </param>
+    /// <param name="centralDirectories"> The list of central directories </param>
+    /// <param name="entryIndex"> The index of the file's central directory </param>
+    /// <returns> The decompressed file </returns>
+    CachedEntryBuffer ReadSingleFileCached(DecompressedEntryCache& cache, const ArchiveIdentity& archive, std::vector<uint8_t>& const zipFileData, const std::vector<std::vector<uint8_t>>& centralDirectories, size_t entryIndex)
+    {
+        const std::vector<uint8_t>& centralDirectory = centralDirectories.at(entryIndex);
+
+        return cache.GetOrLoad(CachedEntryKey { archive, entryIndex },
+                               [&](std::vector<uint8_t>& decompressedData)
+        {
+            ReadSingleFile(zipFileData, centralDirectory, Utilities::GetEncryptionType(centralDirectory), decompressedData);
+        });
+    };
+
+};
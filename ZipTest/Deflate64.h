@@ -0,0 +1,959 @@
+#pragma once
+#include <array>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "deflate.h"
+
+
+namespace ZipExtractor
+{
+
+    /// <summary>
+    /// A decoder for Deflate64 (zip compression method 9, "Enhanced Deflating"), which Windows Explorer uses for files over 2 GB.
+    /// Deflate64 is DEFLATE with a 64 KiB window, a length code (285) with 16 extra bits for matches of up to 65538 bytes,
+    /// and two more distance codes (30 and 31) with 14 extra bits each. zlib can't decode it,
+    /// so the block and Huffman decoding of zlib's inflate is reimplemented here with those changes.
+    /// Works on a z_stream with the same contract as inflate(Z_NO_FLUSH) on a raw stream, so it drops into any loop written for zlib:
+    /// every call consumes as much input and produces as much output as it can, and input after the end of the stream is left untouched
+    /// </summary>
+    class Deflate64Inflater
+    {
+
+    public:
+
+        // How far back a match can reach
+        static constexpr size_t HISTORY_SIZE = 64 * 1024;
+
+        // The longest match, length code 285 with all of it's 16 extra bits set
+        static constexpr size_t MAX_MATCH_LENGTH = 65538;
+
+
+    private:
+
+        // Decoded bytes go into the window and are copied out of it into the caller's buffer.
+        // It holds the history plus the decoded bytes that didn't fit into the caller's buffer yet
+        static constexpr size_t WINDOW_SIZE = 256 * 1024;
+        static constexpr size_t WINDOW_MASK = WINDOW_SIZE - 1;
+
+        static constexpr unsigned MAX_CODE_LENGTH = 15;
+
+        // Codes up to this length are decoded with a single table lookup, longer (and rarer) ones bit by bit
+        static constexpr unsigned LOOKUP_BITS = 10;
+        static constexpr size_t LOOKUP_MASK = (1 << LOOKUP_BITS) - 1;
+
+        static constexpr size_t LITERAL_LENGTH_CODE_COUNT = 288;
+        static constexpr size_t DISTANCE_CODE_COUNT = 32;
+        static constexpr size_t CODE_LENGTH_CODE_COUNT = 19;
+
+        static constexpr int END_OF_BLOCK = 256;
+
+        // The decoding loop for the middle of a block needs enough input for a whole match without checking,
+        // a literal/length code and a distance code with their extra bits are at most 60 bits
+        static constexpr size_t FAST_INPUT_MINIMUM = 16;
+
+        // Returned instead of a symbol while decoding a code
+        static constexpr int NEED_MORE_INPUT = -1;
+        static constexpr int INVALID_CODE = -2;
+
+        static constexpr uint16_t LENGTH_BASES[29] =
+        {
+            3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+            35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 3
+        };
+
+        // Unlike DEFLATE, where length code 285 is always 258, Deflate64 gives it 16 extra bits
+        static constexpr uint8_t LENGTH_EXTRA_BITS[29] =
+        {
+            0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+            3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 16
+        };
+
+        // Distance codes 30 and 31 only exist in Deflate64
+        static constexpr uint32_t DISTANCE_BASES[DISTANCE_CODE_COUNT] =
+        {
+            1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+            257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577, 32769, 49153
+        };
+
+        static constexpr uint8_t DISTANCE_EXTRA_BITS[DISTANCE_CODE_COUNT] =
+        {
+            0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+            7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14
+        };
+
+        // The order in which a dynamic block lists the code lengths of the code length code
+        static constexpr uint8_t CODE_LENGTH_ORDER[CODE_LENGTH_CODE_COUNT] =
+        {
+            16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+        };
+
+
+        // A canonical Huffman code
+        struct HuffmanTable
+        {
+            // Indexed by the next LOOKUP_BITS input bits, (symbol << 4 | code length), or 0 if the code is longer
+            std::array<uint16_t, 1 << LOOKUP_BITS> lookup { };
+
+            // The number of codes of every length
+            std::array<uint16_t, MAX_CODE_LENGTH + 1> counts { };
+
+            // The symbols, sorted by their code
+            std::array<uint16_t, LITERAL_LENGTH_CODE_COUNT> symbols { };
+        };
+
+
+        // Where the decoder stopped, every state can be resumed once more input arrives
+        enum class State
+        {
+            BlockHeader,
+            StoredHeader,
+            StoredData,
+            DynamicHeader,
+            CodeLengthCodes,
+            CodeLengths,
+            Symbol,
+            Distance,
+            Match,
+            Done,
+            Error,
+        };
+
+
+    private:
+
+        std::unique_ptr<uint8_t[]> _window;
+
+        // The number of bytes decoded so far, and how many of them were copied out to the caller
+        uint64_t _windowPosition = 0;
+        uint64_t _flushedPosition = 0;
+
+        // Input bits that were taken from the stream but not used yet, the lowest bit is the next one
+        uint64_t _bitBuffer = 0;
+        unsigned _bitCount = 0;
+
+        State _state = State::BlockHeader;
+
+        bool _isFinalBlock = false;
+
+        // The bytes left inside the current stored block
+        uint32_t _storedRemaining = 0;
+
+        // The current dynamic block's header
+        unsigned _literalLengthCodeCount = 0;
+        unsigned _distanceCodeCount = 0;
+        unsigned _codeLengthCodeCount = 0;
+        unsigned _codeLengthIndex = 0;
+
+        std::array<uint8_t, CODE_LENGTH_CODE_COUNT> _codeLengthCodeLengths { };
+        std::array<uint8_t, LITERAL_LENGTH_CODE_COUNT + DISTANCE_CODE_COUNT> _codeLengths { };
+
+        HuffmanTable _codeLengthTable;
+        HuffmanTable _literalLengthTable;
+        HuffmanTable _distanceTable;
+
+        // The current block's codes, either the dynamic ones above or the fixed ones
+        const HuffmanTable* _currentLiteralLengthTable = nullptr;
+        const HuffmanTable* _currentDistanceTable = nullptr;
+
+        // The match that is being copied
+        uint32_t _matchLength = 0;
+        uint32_t _matchDistance = 0;
+
+
+    public:
+
+        Deflate64Inflater() :
+            _window(new uint8_t[WINDOW_SIZE])
+        {
+        };
+
+        Deflate64Inflater(const Deflate64Inflater&) = delete;
+        Deflate64Inflater& operator = (const Deflate64Inflater&) = delete;
+
+
+        /// <summary>
+        /// Prepares the inflater for a new stream
+        /// </summary>
+        void Reset()
+        {
+            _windowPosition = 0;
+            _flushedPosition = 0;
+
+            _bitBuffer = 0;
+            _bitCount = 0;
+
+            _state = State::BlockHeader;
+            _isFinalBlock = false;
+        };
+
+
+        /// <summary>
+        /// Decodes as much of the stream as the input and output buffers allow.
+        /// Only next_in, avail_in, total_in, next_out, avail_out and total_out of the stream are used
+        /// </summary>
+        /// <param name="stream"> The input and output buffers </param>
+        /// <returns> Z_STREAM_END once the whole stream was decoded and copied out, Z_OK after progress,
+        /// Z_BUF_ERROR if no progress was possible and Z_DATA_ERROR for an invalid stream </returns>
+        int Inflate(z_stream& stream)
+        {
+            const uInt inputBefore = stream.avail_in;
+            const uInt outputBefore = stream.avail_out;
+
+            bool canContinue = true;
+
+            while (canContinue == true)
+            {
+                // A match may need the space of the longest match, the decoded bytes have to be copied out first
+                if (GetWindowSpace() < MAX_MATCH_LENGTH)
+                    Flush(stream);
+
+                // The caller's buffer is full
+                if (GetWindowSpace() == 0)
+                    break;
+
+                canContinue = Step(stream);
+            };
+
+            Flush(stream);
+
+            if (_state == State::Error)
+                return Z_DATA_ERROR;
+
+            if ((_state == State::Done) && (_windowPosition == _flushedPosition))
+                return Z_STREAM_END;
+
+            if ((stream.avail_in == inputBefore) && (stream.avail_out == outputBefore))
+                return Z_BUF_ERROR;
+
+            return Z_OK;
+        };
+
+
+    private:
+
+        /// <summary>
+        /// Decodes the next part of the stream
+        /// </summary>
+        /// <returns> False if more input is needed, or once the stream ended or turned out to be invalid </returns>
+        bool Step(z_stream& stream)
+        {
+            switch (_state)
+            {
+                case State::BlockHeader:
+                {
+                    if (NeedBits(stream, 3) == false)
+                        return false;
+
+                    _isFinalBlock = (_bitBuffer & 1) != 0;
+
+                    const unsigned blockType = static_cast<unsigned>(_bitBuffer >> 1) & 3;
+
+                    DropBits(3);
+
+                    switch (blockType)
+                    {
+                        case 0:
+                        {
+                            // Stored blocks start at the next byte boundary
+                            DropBits(_bitCount % 8);
+
+                            _state = State::StoredHeader;
+                            break;
+                        };
+
+                        case 1:
+                        {
+                            _currentLiteralLengthTable = &GetFixedLiteralLengthTable();
+                            _currentDistanceTable = &GetFixedDistanceTable();
+
+                            _state = State::Symbol;
+                            break;
+                        };
+
+                        case 2:
+                        {
+                            _state = State::DynamicHeader;
+                            break;
+                        };
+
+                        default:
+                            return Fail();
+                    };
+
+                    return true;
+                };
+
+                case State::StoredHeader:
+                {
+                    if (NeedBits(stream, 32) == false)
+                        return false;
+
+                    const uint32_t length = static_cast<uint32_t>(_bitBuffer & 0xFFFF);
+                    const uint32_t lengthComplement = static_cast<uint32_t>(_bitBuffer >> 16) & 0xFFFF;
+
+                    DropBits(32);
+
+                    if (length != (~lengthComplement & 0xFFFF))
+                        return Fail();
+
+                    _storedRemaining = length;
+                    _state = State::StoredData;
+
+                    return true;
+                };
+
+                case State::StoredData:
+                {
+                    // The header ended on a byte boundary, whole bytes left inside the bit buffer come first
+                    while ((_bitCount >= 8) && (_storedRemaining != 0) && (GetWindowSpace() != 0))
+                    {
+                        _window[_windowPosition++ & WINDOW_MASK] = static_cast<uint8_t>(_bitBuffer);
+
+                        DropBits(8);
+                        _storedRemaining--;
+                    };
+
+                    // The rest is copied straight from the input
+                    const size_t copySize = std::min<size_t>({ _storedRemaining, stream.avail_in, GetWindowSpace() });
+
+                    WriteWindow(stream.next_in, copySize);
+
+                    stream.next_in += copySize;
+                    stream.avail_in -= static_cast<uInt>(copySize);
+                    stream.total_in += copySize;
+
+                    _storedRemaining -= static_cast<uint32_t>(copySize);
+
+                    if (_storedRemaining == 0)
+                    {
+                        EndBlock();
+                        return true;
+                    };
+
+                    return stream.avail_in != 0;
+                };
+
+                case State::DynamicHeader:
+                {
+                    if (NeedBits(stream, 14) == false)
+                        return false;
+
+                    _literalLengthCodeCount = static_cast<unsigned>(_bitBuffer & 0x1F) + 257;
+                    _distanceCodeCount = static_cast<unsigned>(_bitBuffer >> 5 & 0x1F) + 1;
+                    _codeLengthCodeCount = static_cast<unsigned>(_bitBuffer >> 10 & 0xF) + 4;
+
+                    DropBits(14);
+
+                    if (_literalLengthCodeCount > 286)
+                        return Fail();
+
+                    _codeLengthCodeLengths.fill(0);
+                    _codeLengthIndex = 0;
+
+                    _state = State::CodeLengthCodes;
+
+                    return true;
+                };
+
+                case State::CodeLengthCodes:
+                {
+                    while (_codeLengthIndex < _codeLengthCodeCount)
+                    {
+                        if (NeedBits(stream, 3) == false)
+                            return false;
+
+                        _codeLengthCodeLengths[CODE_LENGTH_ORDER[_codeLengthIndex++]] = static_cast<uint8_t>(_bitBuffer & 7);
+
+                        DropBits(3);
+                    };
+
+                    if (BuildTable(_codeLengthTable, _codeLengthCodeLengths.data(), CODE_LENGTH_CODE_COUNT) == false)
+                        return Fail();
+
+                    _codeLengthIndex = 0;
+                    _state = State::CodeLengths;
+
+                    return true;
+                };
+
+                case State::CodeLengths:
+                {
+                    const unsigned codeCount = _literalLengthCodeCount + _distanceCodeCount;
+
+                    while (_codeLengthIndex < codeCount)
+                    {
+                        unsigned codeLength = 0;
+                        const int symbol = PeekSymbol(stream, _codeLengthTable, codeLength);
+
+                        if (symbol == NEED_MORE_INPUT)
+                            return false;
+
+                        if (symbol == INVALID_CODE)
+                            return Fail();
+
+                        if (symbol < 16)
+                        {
+                            DropBits(codeLength);
+
+                            _codeLengths[_codeLengthIndex++] = static_cast<uint8_t>(symbol);
+                            continue;
+                        };
+
+                        // 16 repeats the previous length 3-6 times, 17 and 18 repeat a zero 3-10 and 11-138 times
+                        const unsigned extraBits = (symbol == 16) ? 2 : (symbol == 17) ? 3 : 7;
+                        const unsigned repeatBase = (symbol == 18) ? 11 : 3;
+
+                        if (NeedBits(stream, codeLength + extraBits) == false)
+                            return false;
+
+                        const unsigned repeatCount = repeatBase + (static_cast<unsigned>(_bitBuffer >> codeLength) & ((1u << extraBits) - 1));
+
+                        DropBits(codeLength + extraBits);
+
+                        if ((symbol == 16) && (_codeLengthIndex == 0))
+                            return Fail();
+
+                        if ((_codeLengthIndex + repeatCount) > codeCount)
+                            return Fail();
+
+                        const uint8_t repeatedLength = (symbol == 16) ? _codeLengths[_codeLengthIndex - 1] : 0;
+
+                        std::fill_n(&_codeLengths[_codeLengthIndex], repeatCount, repeatedLength);
+                        _codeLengthIndex += repeatCount;
+                    };
+
+                    // A block without an end of block code could never end
+                    if (_codeLengths[END_OF_BLOCK] == 0)
+                        return Fail();
+
+                    if ((BuildTable(_literalLengthTable, _codeLengths.data(), _literalLengthCodeCount) == false) ||
+                        (BuildTable(_distanceTable, &_codeLengths[_literalLengthCodeCount], _distanceCodeCount) == false))
+                        return Fail();
+
+                    _currentLiteralLengthTable = &_literalLengthTable;
+                    _currentDistanceTable = &_distanceTable;
+
+                    _state = State::Symbol;
+
+                    return true;
+                };
+
+                case State::Symbol:
+                {
+                    if ((stream.avail_in >= FAST_INPUT_MINIMUM) && (GetWindowSpace() >= MAX_MATCH_LENGTH))
+                    {
+                        DecodeFast(stream);
+                        return true;
+                    };
+
+                    unsigned codeLength = 0;
+                    const int symbol = PeekSymbol(stream, *_currentLiteralLengthTable, codeLength);
+
+                    if (symbol == NEED_MORE_INPUT)
+                        return false;
+
+                    if (symbol == INVALID_CODE)
+                        return Fail();
+
+                    if (symbol < END_OF_BLOCK)
+                    {
+                        DropBits(codeLength);
+
+                        _window[_windowPosition++ & WINDOW_MASK] = static_cast<uint8_t>(symbol);
+                        return true;
+                    };
+
+                    if (symbol == END_OF_BLOCK)
+                    {
+                        DropBits(codeLength);
+
+                        EndBlock();
+                        return true;
+                    };
+
+                    const unsigned lengthCode = static_cast<unsigned>(symbol) - 257;
+
+                    if (lengthCode >= 29)
+                        return Fail();
+
+                    const unsigned extraBits = LENGTH_EXTRA_BITS[lengthCode];
+
+                    if (NeedBits(stream, codeLength + extraBits) == false)
+                        return false;
+
+                    _matchLength = LENGTH_BASES[lengthCode] + (static_cast<uint32_t>(_bitBuffer >> codeLength) & ((1u << extraBits) - 1));
+
+                    DropBits(codeLength + extraBits);
+
+                    _state = State::Distance;
+
+                    return true;
+                };
+
+                case State::Distance:
+                {
+                    unsigned codeLength = 0;
+                    const int symbol = PeekSymbol(stream, *_currentDistanceTable, codeLength);
+
+                    if (symbol == NEED_MORE_INPUT)
+                        return false;
+
+                    if (symbol == INVALID_CODE)
+                        return Fail();
+
+                    const unsigned extraBits = DISTANCE_EXTRA_BITS[symbol];
+
+                    if (NeedBits(stream, codeLength + extraBits) == false)
+                        return false;
+
+                    _matchDistance = DISTANCE_BASES[symbol] + (static_cast<uint32_t>(_bitBuffer >> codeLength) & ((1u << extraBits) - 1));
+
+                    DropBits(codeLength + extraBits);
+
+                    // A match can't reach back before the start of the stream
+                    if (_matchDistance > _windowPosition)
+                        return Fail();
+
+                    _state = State::Match;
+
+                    return true;
+                };
+
+                case State::Match:
+                {
+                    const uint32_t copySize = static_cast<uint32_t>(std::min<size_t>(_matchLength, GetWindowSpace()));
+
+                    CopyMatch(copySize, _matchDistance);
+
+                    _matchLength -= copySize;
+
+                    if (_matchLength == 0)
+                        _state = State::Symbol;
+
+                    return true;
+                };
+
+                default:
+                    return false;
+            };
+        };
+
+
+        /// <summary>
+        /// Decodes literals and matches until the block ends, the input runs low or the window runs out of space.
+        /// There's always enough input for a whole match, so the bit buffer is refilled without any checks.
+        /// The input bytes that were taken into the bit buffer but not used are handed back when it stops,
+        /// so the input after the end of the stream is never consumed
+        /// </summary>
+        void DecodeFast(z_stream& stream)
+        {
+            const HuffmanTable& literalLengthTable = *_currentLiteralLengthTable;
+            const HuffmanTable& distanceTable = *_currentDistanceTable;
+
+            size_t bytesTaken = 0;
+
+            while ((stream.avail_in >= FAST_INPUT_MINIMUM) && (GetWindowSpace() >= MAX_MATCH_LENGTH))
+            {
+                bytesTaken += RefillBits(stream);
+
+                unsigned codeLength = 0;
+                const int symbol = TryDecodeSymbol(literalLengthTable, codeLength);
+
+                if (symbol < 0)
+                {
+                    Fail();
+                    break;
+                };
+
+                DropBits(codeLength);
+
+                if (symbol < END_OF_BLOCK)
+                {
+                    _window[_windowPosition++ & WINDOW_MASK] = static_cast<uint8_t>(symbol);
+                    continue;
+                };
+
+                if (symbol == END_OF_BLOCK)
+                {
+                    EndBlock();
+                    break;
+                };
+
+                const unsigned lengthCode = static_cast<unsigned>(symbol) - 257;
+
+                if (lengthCode >= 29)
+                {
+                    Fail();
+                    break;
+                };
+
+                const unsigned lengthExtraBits = LENGTH_EXTRA_BITS[lengthCode];
+                const uint32_t matchLength = LENGTH_BASES[lengthCode] + (static_cast<uint32_t>(_bitBuffer) & ((1u << lengthExtraBits) - 1));
+
+                DropBits(lengthExtraBits);
+
+                bytesTaken += RefillBits(stream);
+
+                const int distanceSymbol = TryDecodeSymbol(distanceTable, codeLength);
+
+                if (distanceSymbol < 0)
+                {
+                    Fail();
+                    break;
+                };
+
+                DropBits(codeLength);
+
+                const unsigned distanceExtraBits = DISTANCE_EXTRA_BITS[distanceSymbol];
+                const uint32_t matchDistance = DISTANCE_BASES[distanceSymbol] + (static_cast<uint32_t>(_bitBuffer) & ((1u << distanceExtraBits) - 1));
+
+                DropBits(distanceExtraBits);
+
+                if (matchDistance > _windowPosition)
+                {
+                    Fail();
+                    break;
+                };
+
+                CopyMatch(matchLength, matchDistance);
+            };
+
+            // Hand back the whole bytes that are still inside the bit buffer, as long as they were taken here
+            const size_t bytesReturned = std::min<size_t>(_bitCount / 8, bytesTaken);
+
+            stream.next_in -= bytesReturned;
+            stream.avail_in += static_cast<uInt>(bytesReturned);
+            stream.total_in -= bytesReturned;
+
+            _bitCount -= static_cast<unsigned>(bytesReturned * 8);
+            _bitBuffer &= (uint64_t(1) << _bitCount) - 1;
+        };
+
+
+        /// <summary>
+        /// Fills the bit buffer up to at least 56 bits, the input must have enough bytes left
+        /// </summary>
+        /// <returns> The number of bytes taken from the input </returns>
+        size_t RefillBits(z_stream& stream)
+        {
+            size_t bytesTaken = 0;
+
+            while (_bitCount < 56)
+            {
+                _bitBuffer |= static_cast<uint64_t>(*stream.next_in++) << _bitCount;
+                _bitCount += 8;
+
+                bytesTaken++;
+            };
+
+            stream.avail_in -= static_cast<uInt>(bytesTaken);
+            stream.total_in += bytesTaken;
+
+            return bytesTaken;
+        };
+
+
+        /// <summary>
+        /// Takes input bytes into the bit buffer, one at a time, until it holds the given number of bits.
+        /// Never takes more bytes than needed, so the input after the end of the stream is never consumed
+        /// </summary>
+        /// <returns> False if the input ran out first </returns>
+        bool NeedBits(z_stream& stream, unsigned count)
+        {
+            while (_bitCount < count)
+            {
+                if (stream.avail_in == 0)
+                    return false;
+
+                _bitBuffer |= static_cast<uint64_t>(*stream.next_in++) << _bitCount;
+                _bitCount += 8;
+
+                stream.avail_in--;
+                stream.total_in++;
+            };
+
+            return true;
+        };
+
+
+        void DropBits(unsigned count)
+        {
+            _bitBuffer >>= count;
+            _bitCount -= count;
+        };
+
+
+        /// <summary>
+        /// Decodes the next symbol without consuming it's code, taking input bytes one at a time until the code is complete
+        /// </summary>
+        /// <param name="codeLengthOut"> The length of the symbol's code </param>
+        /// <returns> The symbol, NEED_MORE_INPUT or INVALID_CODE </returns>
+        int PeekSymbol(z_stream& stream, const HuffmanTable& table, unsigned& codeLengthOut)
+        {
+            while (true)
+            {
+                const int symbol = TryDecodeSymbol(table, codeLengthOut);
+
+                if (symbol != NEED_MORE_INPUT)
+                    return symbol;
+
+                if (NeedBits(stream, _bitCount + 8) == false)
+                    return NEED_MORE_INPUT;
+            };
+        };
+
+
+        /// <summary>
+        /// Decodes the next symbol from the bits inside the bit buffer, without consuming it's code
+        /// </summary>
+        /// <param name="codeLengthOut"> The length of the symbol's code </param>
+        /// <returns> The symbol, NEED_MORE_INPUT or INVALID_CODE </returns>
+        int TryDecodeSymbol(const HuffmanTable& table, unsigned& codeLengthOut) const
+        {
+            const uint16_t entry = table.lookup[_bitBuffer & LOOKUP_MASK];
+
+            if (entry != 0)
+            {
+                codeLengthOut = entry & 0xF;
+
+                return (codeLengthOut <= _bitCount) ? (entry >> 4) : NEED_MORE_INPUT;
+            };
+
+            // Codes are stored starting with their most significant bit, so they're read one bit at a time and compared against the
+            // first code of every length
+            uint64_t bits = _bitBuffer;
+
+            int code = 0;
+            int firstCode = 0;
+            int index = 0;
+
+            for (unsigned codeLength = 1; codeLength <= MAX_CODE_LENGTH; codeLength++)
+            {
+                if (codeLength > _bitCount)
+                    return NEED_MORE_INPUT;
+
+                code |= static_cast<int>(bits & 1);
+                bits >>= 1;
+
+                const int count = table.counts[codeLength];
+
+                if ((code - count) < firstCode)
+                {
+                    codeLengthOut = codeLength;
+                    return table.symbols[index + (code - firstCode)];
+                };
+
+                index += count;
+                firstCode += count;
+
+                firstCode <<= 1;
+                code <<= 1;
+            };
+
+            return INVALID_CODE;
+        };
+
+
+        /// <summary>
+        /// Builds a canonical Huffman code out of the code lengths of it's symbols
+        /// </summary>
+        /// <param name="table"> The table to build </param>
+        /// <param name="codeLengths"> The code length of every symbol, 0 if the symbol is unused </param>
+        /// <param name="symbolCount"> The number of symbols </param>
+        /// <returns> False if there are more codes than the lengths allow </returns>
+        static bool BuildTable(HuffmanTable& table, const uint8_t* codeLengths, size_t symbolCount)
+        {
+            table.counts.fill(0);
+            table.lookup.fill(0);
+
+            for (size_t symbol = 0; symbol < symbolCount; symbol++)
+                table.counts[codeLengths[symbol]]++;
+
+            table.counts[0] = 0;
+
+            // Incomplete codes are allowed, a single distance code is common, but codes that don't fit are not
+            int codesLeft = 1;
+
+            for (unsigned codeLength = 1; codeLength <= MAX_CODE_LENGTH; codeLength++)
+            {
+                codesLeft <<= 1;
+                codesLeft -= table.counts[codeLength];
+
+                if (codesLeft < 0)
+                    return false;
+            };
+
+            std::array<uint16_t, MAX_CODE_LENGTH + 1> offsets { };
+            std::array<uint16_t, MAX_CODE_LENGTH + 1> nextCodes { };
+
+            uint16_t code = 0;
+
+            for (unsigned codeLength = 1; codeLength <= MAX_CODE_LENGTH; codeLength++)
+            {
+                offsets[codeLength] = static_cast<uint16_t>(offsets[codeLength - 1] + table.counts[codeLength - 1]);
+
+                code = static_cast<uint16_t>((code + table.counts[codeLength - 1]) << 1);
+                nextCodes[codeLength] = code;
+            };
+
+            for (size_t symbol = 0; symbol < symbolCount; symbol++)
+            {
+                const unsigned codeLength = codeLengths[symbol];
+
+                if (codeLength == 0)
+                    continue;
+
+                table.symbols[offsets[codeLength]++] = static_cast<uint16_t>(symbol);
+
+                const unsigned symbolCode = nextCodes[codeLength]++;
+
+                if (codeLength > LOOKUP_BITS)
+                    continue;
+
+                // The lookup is indexed by the input bits, which hold the code in reverse
+                unsigned reversedCode = 0;
+
+                for (unsigned bit = 0; bit < codeLength; bit++)
+                    reversedCode |= ((symbolCode >> bit) & 1) << (codeLength - 1 - bit);
+
+                for (size_t index = reversedCode; index < table.lookup.size(); index += (size_t(1) << codeLength))
+                    table.lookup[index] = static_cast<uint16_t>(symbol << 4 | codeLength);
+            };
+
+            return true;
+        };
+
+
+        static const HuffmanTable& GetFixedLiteralLengthTable()
+        {
+            static const HuffmanTable table = []()
+            {
+                std::array<uint8_t, LITERAL_LENGTH_CODE_COUNT> codeLengths { };
+
+                std::fill(&codeLengths[0], &codeLengths[144], 8);
+                std::fill(&codeLengths[144], &codeLengths[256], 9);
+                std::fill(&codeLengths[256], &codeLengths[280], 7);
+                std::fill(&codeLengths[280], &codeLengths[288], 8);
+
+                HuffmanTable fixedTable;
+                BuildTable(fixedTable, codeLengths.data(), codeLengths.size());
+
+                return fixedTable;
+            }();
+
+            return table;
+        };
+
+        static const HuffmanTable& GetFixedDistanceTable()
+        {
+            static const HuffmanTable table = []()
+            {
+                std::array<uint8_t, DISTANCE_CODE_COUNT> codeLengths { };
+                codeLengths.fill(5);
+
+                HuffmanTable fixedTable;
+                BuildTable(fixedTable, codeLengths.data(), codeLengths.size());
+
+                return fixedTable;
+            }();
+
+            return table;
+        };
+
+
+        void EndBlock()
+        {
+            _state = (_isFinalBlock == true) ? State::Done : State::BlockHeader;
+        };
+
+        bool Fail()
+        {
+            _state = State::Error;
+            return false;
+        };
+
+
+        /// <summary>
+        /// Get the number of bytes that can be decoded before the window has to be copied out
+        /// </summary>
+        size_t GetWindowSpace() const
+        {
+            return WINDOW_SIZE - static_cast<size_t>(_windowPosition - _flushedPosition);
+        };
+
+
+        /// <summary>
+        /// Copies bytes into the window, the window must have space for them
+        /// </summary>
+        void WriteWindow(const uint8_t* data, size_t size)
+        {
+            while (size != 0)
+            {
+                const size_t windowOffset = static_cast<size_t>(_windowPosition & WINDOW_MASK);
+                const size_t copySize = std::min(size, WINDOW_SIZE - windowOffset);
+
+                memcpy(&_window[windowOffset], data, copySize);
+
+                _windowPosition += copySize;
+                data += copySize;
+                size -= copySize;
+            };
+        };
+
+
+        /// <summary>
+        /// Copies a match from the history to the end of the window, the window must have space for it
+        /// </summary>
+        void CopyMatch(uint32_t length, uint32_t distance)
+        {
+            while (length != 0)
+            {
+                const size_t sourceOffset = static_cast<size_t>((_windowPosition - distance) & WINDOW_MASK);
+                const size_t destinationOffset = static_cast<size_t>(_windowPosition & WINDOW_MASK);
+
+                const size_t copySize = std::min<size_t>({ length, WINDOW_SIZE - sourceOffset, WINDOW_SIZE - destinationOffset });
+
+                // A match that overlaps itself repeats it's first distance bytes, so it has to be copied front to back one byte at a time
+                if (distance >= copySize)
+                    memcpy(&_window[destinationOffset], &_window[sourceOffset], copySize);
+                else
+                {
+                    for (size_t index = 0; index < copySize; index++)
+                        _window[destinationOffset + index] = _window[sourceOffset + index];
+                };
+
+                _windowPosition += copySize;
+                length -= static_cast<uint32_t>(copySize);
+            };
+        };
+
+
+        /// <summary>
+        /// Copies as many decoded bytes as fit out of the window into the stream's output buffer
+        /// </summary>
+        void Flush(z_stream& stream)
+        {
+            size_t flushSize = std::min<size_t>(static_cast<size_t>(_windowPosition - _flushedPosition), stream.avail_out);
+
+            while (flushSize != 0)
+            {
+                const size_t windowOffset = static_cast<size_t>(_flushedPosition & WINDOW_MASK);
+                const size_t copySize = std::min(flushSize, WINDOW_SIZE - windowOffset);
+
+                memcpy(stream.next_out, &_window[windowOffset], copySize);
+
+                stream.next_out += copySize;
+                stream.avail_out -= static_cast<uInt>(copySize);
+                stream.total_out += copySize;
+
+                _flushedPosition += copySize;
+                flushSize -= copySize;
+            };
+        };
+
+    };
+
+};
@@ -0,0 +1,416 @@
+#pragma once
+#include <span>
+#include <array>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <streambuf>
+#include <algorithm>
+
+#include "ZipArchive.h"
+
+
+namespace ZipExtractor
+{
+
+    /// <summary>
+    /// A pull reader over a single entry's decompressed contents.
+    /// The entry is decompressed on demand straight into the caller's buffer, so reading an entry of any size takes a constant amount of memory.
+    /// The archive must outlive the reader.
+    /// A single reader must not be shared between threads, but any number of readers can read from the same archive concurrently.
+    /// An entry that is read sequentially from the start has it's CRC-32 checked once the last byte is read, skipping or seeking anywhere but the start turns the check off
+    /// </summary>
+    class EntryReader
+    {
+
+    private:
+
+        const ZipArchive& _archive;
+
+        EntryInfo _entry;
+
+        // A pointer to the entry's compressed data inside the mapping
+        const uint8_t* _fileDataPointer = nullptr;
+
+        // The number of decompressed bytes that were read so far
+        uint64_t _position = 0;
+
+        // Only it's buffers are used, the decoding state lives in the codec
+        z_stream _stream { };
+
+        // The entry's decoder, created by the codec registry. Not created for stored entries
+        std::unique_ptr<DecompressionCodec> _codec;
+
+        // The compressed bytes that weren't handed to the inflate state yet, entries bigger than 4 GiB are handed over in parts
+        uint64_t _remainingInput = 0;
+
+        // The CRC-32 of every byte read so far
+        uint32_t _crc32 = 0;
+
+        // Cleared once bytes are skipped, the CRC-32 can only be checked if every byte went through Read
+        bool _checkCrc32 = true;
+
+
+    public:
+
+        /// <summary>
+        /// Creates a reader for the given entry
+        /// </summary>
+        /// <param name="archive"> The zip containing the entry </param>
+        /// <param name="entry"> An entry inside the zip </param>
+        EntryReader(const ZipArchive& archive, const EntryInfo& entry) :
+            _archive(archive),
+            _entry(entry)
+        {
+            if (_entry.encryptionType != ZipEncryption::None)
+                throw std::exception("Encryption isn't supported, yet.");
+
+            if (CodecRegistry::GetDefault().IsSupported(_entry.compressionMethod) == false)
+                throw std::exception("Unsupported compression method");
+
+            // Also rejects stored entries whose sizes differ, Read copies them out of the mapping up to their uncompressed size
+            _fileDataPointer = _archive.GetEntryData(_entry);
+
+            if (_entry.compressionMethod != CompressionMethod::None)
+            {
+                // Readers can be long lived, each one owns it's decoder instead of borrowing the thread's
+                _codec = CodecRegistry::GetDefault().Create(_entry.compressionMethod);
+
+                ResetStream();
+            };
+        };
+
+
+        EntryReader(const EntryReader&) = delete;
+        EntryReader& operator = (const EntryReader&) = delete;
+
+
+    public:
+
+        /// <summary>
+        /// Reads the next part of the entry
+        /// </summary>
+        /// <param name="destination"> A buffer that will contain the read bytes </param>
+        /// <returns> The number of bytes read, 0 only once the entire entry was read </returns>
+        size_t Read(std::span<uint8_t> destination)
+        {
+            // Don't read past the end of the entry
+            const size_t length = static_cast<size_t>(std::min<uint64_t>(destination.size(), _entry.uncompressedSize - _position));
+
+            if (length == 0)
+                return 0;
+
+            // The constructor made sure a stored entry's data is as long as it's uncompressed size
+            if (_entry.compressionMethod == CompressionMethod::None)
+            {
+                memcpy(destination.data(), &_fileDataPointer[_position], length);
+
+                _position += length;
+
+                UpdateCrc32(destination.data(), length);
+                return length;
+            };
+
+            uint64_t remainingOutput = length;
+
+            _stream.next_out = destination.data();
+            _stream.avail_out = 0;
+
+            int result = Z_OK;
+
+            while (((_stream.avail_out != 0) || (remainingOutput != 0)) && (result == Z_OK))
+            {
+                Utilities::RefillZlibBuffer(_stream.avail_in, _remainingInput);
+                Utilities::RefillZlibBuffer(_stream.avail_out, remainingOutput);
+
+                result = Decompress();
+            };
+
+            const size_t bytesRead = static_cast<size_t>(length - remainingOutput - _stream.avail_out);
+
+            if ((result != Z_OK && result != Z_STREAM_END) || (bytesRead != length))
+                throw std::exception("Failed to decompress file");
+
+            _position += bytesRead;
+
+            UpdateCrc32(destination.data(), bytesRead);
+            return bytesRead;
+        };
+
+
+        /// <summary>
+        /// Skips over the next part of the entry
+        /// </summary>
+        /// <param name="count"> The number of bytes to skip, skipping any turns off the CRC-32 check </param>
+        /// <returns> The number of bytes skipped, less than count only if the end of the entry was reached </returns>
+        uint64_t Skip(uint64_t count)
+        {
+            count = std::min<uint64_t>(count, _entry.uncompressedSize - _position);
+
+            if (count != 0)
+                _checkCrc32 = false;
+
+            if (_entry.compressionMethod == CompressionMethod::None)
+            {
+                _position += count;
+                return count;
+            };
+
+            // DEFLATE can't seek, the skipped bytes are decompressed into this buffer and thrown away
+            std::array<uint8_t, 16384> discardBuffer;
+
+            uint64_t bytesSkipped = 0;
+
+            while (bytesSkipped < count)
+            {
+                const size_t chunkSize = static_cast<size_t>(std::min<uint64_t>(discardBuffer.size(), count - bytesSkipped));
+
+                bytesSkipped += Read(std::span<uint8_t>(discardBuffer.data(), chunkSize));
+            };
+
+            return bytesSkipped;
+        };
+
+
+        /// <summary>
+        /// Moves the reader to an absolute position inside the entry.
+        /// Moving backwards in a DEFLATE entry restarts the decompression from the beginning.
+        /// Seeking back to the start turns the CRC-32 check back on, seeking anywhere else turns it off
+        /// </summary>
+        /// <param name="position"> The new position </param>
+        void Seek(uint64_t position)
+        {
+            position = std::min<uint64_t>(position, _entry.uncompressedSize);
+
+            if (position < _position)
+            {
+                if (_entry.compressionMethod == CompressionMethod::None)
+                {
+                    _position = position;
+
+                    _crc32 = 0;
+                    _checkCrc32 = (position == 0);
+                    return;
+                };
+
+                ResetStream();
+            };
+
+            Skip(position - _position);
+        };
+
+
+    public:
+
+        const EntryInfo& GetEntry() const
+        {
+            return _entry;
+        };
+
+        uint64_t GetPosition() const
+        {
+            return _position;
+        };
+
+        uint64_t GetSize() const
+        {
+            return _entry.uncompressedSize;
+        };
+
+        bool IsFinished() const
+        {
+            return _position == _entry.uncompressedSize;
+        };
+
+
+    private:
+
+        /// <summary>
+        /// Restart the decompression from the beginning of the entry
+        /// </summary>
+        void ResetStream()
+        {
+            CodecStreamInfo streamInfo;
+            streamInfo.uncompressedSize = _entry.uncompressedSize;
+            streamInfo.generalPurposeBitFlag = _entry.generalPurposeBitFlag;
+
+            _codec->Reset(streamInfo);
+
+            _stream.next_in = const_cast<Bytef*>(_fileDataPointer);
+            _stream.avail_in = 0;
+
+            _remainingInput = _entry.compressedSize;
+
+            _position = 0;
+
+            _crc32 = 0;
+            _checkCrc32 = true;
+        };
+
+
+        /// <summary>
+        /// Adds bytes that were just read to the CRC-32, and checks it once the last byte of the entry was read
+        /// </summary>
+        /// <param name="data"> The bytes that were read </param>
+        /// <param name="size"> The number of bytes </param>
+        void UpdateCrc32(const uint8_t* data, size_t size)
+        {
+            if (_checkCrc32 == false)
+                return;
+
+            _crc32 = Utilities::Crc32(_crc32, data, size);
+
+            if ((_position == _entry.uncompressedSize) && (_crc32 != _entry.crc32))
+                throw std::exception("CRC mismatch");
+        };
+
+
+        /// <summary>
+        /// Decompresses as much of the stream's input into it's output as fits
+        /// </summary>
+        /// <returns> The decoder's result, with inflate's meaning </returns>
+        int Decompress()
+        {
+            return _codec->Decode(_stream);
+        };
+
+    };
+
+
+
+    /// <summary>
+    /// A std::streambuf over a single entry, decompresses the entry on demand into a small internal buffer.
+    /// Supports seeking, seeking backwards in a DEFLATE entry restarts the decompression
+    /// </summary>
+    class EntryStreamBuffer : public std::streambuf
+    {
+
+    public:
+
+        // The size of the internal buffer
+        static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+
+    private:
+
+        EntryReader _reader;
+
+        std::array<char, BUFFER_SIZE> _buffer;
+
+
+    public:
+
+        /// <summary>
+        /// Creates a stream buffer for the given entry
+        /// </summary>
+        /// <param name="archive"> The zip containing the entry, must outlive the stream buffer </param>
+        /// <param name="entry"> An entry inside the zip </param>
+        EntryStreamBuffer(const ZipArchive& archive, const EntryInfo& entry) :
+            _reader(archive, entry)
+        {
+            setg(_buffer.data(), _buffer.data(), _buffer.data());
+        };
+
+
+    protected:
+
+        int_type underflow() override
+        {
+            if (gptr() < egptr())
+                return traits_type::to_int_type(*gptr());
+
+            const size_t bytesRead = _reader.Read(std::span<uint8_t>(reinterpret_cast<uint8_t*>(_buffer.data()), _buffer.size()));
+
+            if (bytesRead == 0)
+                return traits_type::eof();
+
+            setg(_buffer.data(), _buffer.data(), _buffer.data() + bytesRead);
+
+            return traits_type::to_int_type(*gptr());
+        };
+
+
+        std::streamsize showmanyc() override
+        {
+            return static_cast<std::streamsize>(_reader.GetSize() - _reader.GetPosition());
+        };
+
+
+        pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode which) override
+        {
+            if ((which & std::ios_base::in) == 0)
+                return pos_type(off_type(-1));
+
+            // The reader is ahead of the stream by the number of buffered bytes that weren't consumed yet
+            const uint64_t currentPosition = _reader.GetPosition() - static_cast<uint64_t>(egptr() - gptr());
+
+            off_type basePosition = 0;
+
+            if (direction == std::ios_base::cur)
+                basePosition = static_cast<off_type>(currentPosition);
+            else if (direction == std::ios_base::end)
+                basePosition = static_cast<off_type>(_reader.GetSize());
+
+            return seekpos(pos_type(basePosition + offset), which);
+        };
+
+
+        pos_type seekpos(pos_type position, std::ios_base::openmode which) override
+        {
+            if (((which & std::ios_base::in) == 0) ||
+                (off_type(position) < 0) ||
+                (static_cast<uint64_t>(off_type(position)) > _reader.GetSize()))
+                return pos_type(off_type(-1));
+
+            const uint64_t targetPosition = static_cast<uint64_t>(off_type(position));
+
+            // The buffer covers the range [bufferStart, _reader.GetPosition())
+            const uint64_t bufferStart = _reader.GetPosition() - static_cast<uint64_t>(egptr() - eback());
+
+            // If the target is inside the buffer just move the get pointer
+            if ((targetPosition >= bufferStart) && (targetPosition < _reader.GetPosition()))
+            {
+                setg(eback(), eback() + (targetPosition - bufferStart), egptr());
+                return position;
+            };
+
+            _reader.Seek(targetPosition);
+
+            setg(_buffer.data(), _buffer.data(), _buffer.data());
+
+            return position;
+        };
+
+    };
+
+
+
+    /// <summary>
+    /// A std::istream over a single entry's decompressed contents
+    /// </summary>
+    class EntryInputStream : public std::istream
+    {
+
+    private:
+
+        EntryStreamBuffer _streamBuffer;
+
+
+    public:
+
+        /// <summary>
+        /// Creates an input stream for the given entry
+        /// </summary>
+        /// <param name="archive"> The zip containing the entry, must outlive the stream </param>
+        /// <param name="entry"> An entry inside the zip </param>
+        EntryInputStream(const ZipArchive& archive, const EntryInfo& entry) :
+            std::istream(nullptr),
+            _streamBuffer(archive, entry)
+        {
+            rdbuf(&_streamBuffer);
+        };
+
+    };
+
+};
@@ -0,0 +1,762 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <exception>
+#include <algorithm>
+
+#include "deflate.h"
+#include "WinZipAes.h"
+#include "CodecRegistry.h"
+#include "ExtractionProgress.h"
+
+
+namespace ZipExtractor
+{
+
+    /// <summary>
+    /// A bounded, lock-free queue with a single producer thread and a single consumer thread.
+    /// Push and Pop block (without holding any lock) until there's room or an item, or until the queue is woken up for cancellation
+    /// </summary>
+    template<typename T, size_t Capacity>
+    class SpscQueue
+    {
+
+    private:
+
+        std::array<T, Capacity> _items { };
+
+        // The index of the next item to pop, only written by the consumer
+        alignas(64) std::atomic<size_t> _head { 0 };
+
+        // The index of the next item to push, only written by the producer
+        alignas(64) std::atomic<size_t> _tail { 0 };
+
+        // Changes every time the queue changes, blocked threads wait on it
+        alignas(64) std::atomic<uint32_t> _signal { 0 };
+
+
+    public:
+
+        bool TryPush(const T& item)
+        {
+            const size_t tail = _tail.load(std::memory_order_relaxed);
+
+            // The queue is full
+            if ((tail - _head.load(std::memory_order_acquire)) == Capacity)
+                return false;
+
+            _items[tail % Capacity] = item;
+            _tail.store(tail + 1, std::memory_order_release);
+
+            Notify();
+            return true;
+        };
+
+
+        bool TryPop(T& itemOut)
+        {
+            const size_t head = _head.load(std::memory_order_relaxed);
+
+            // The queue is empty
+            if (head == _tail.load(std::memory_order_acquire))
+                return false;
+
+            itemOut = _items[head % Capacity];
+            _head.store(head + 1, std::memory_order_release);
+
+            Notify();
+            return true;
+        };
+
+
+        /// <summary>
+        /// Push an item, waits while the queue is full
+        /// </summary>
+        /// <param name="item"> The item to push </param>
+        /// <param name="cancelled"> Stops waiting once this is set </param>
+        /// <returns> False if the push was cancelled </returns>
+        bool Push(const T& item, const std::atomic<bool>& cancelled)
+        {
+            while (true)
+            {
+                const uint32_t signal = _signal.load(std::memory_order_acquire);
+
+                if (TryPush(item) == true)
+                    return true;
+
+                if (cancelled.load(std::memory_order_acquire) == true)
+                    return false;
+
+                // Sleep until the consumer pops something (or someone calls Notify)
+                _signal.wait(signal, std::memory_order_acquire);
+            };
+        };
+
+
+        /// <summary>
+        /// Pop an item, waits while the queue is empty
+        /// </summary>
+        /// <param name="itemOut"> The popped item </param>
+        /// <param name="cancelled"> Stops waiting once this is set </param>
+        /// <returns> False if the pop was cancelled </returns>
+        bool Pop(T& itemOut, const std::atomic<bool>& cancelled)
+        {
+            while (true)
+            {
+                const uint32_t signal = _signal.load(std::memory_order_acquire);
+
+                if (TryPop(itemOut) == true)
+                    return true;
+
+                if (cancelled.load(std::memory_order_acquire) == true)
+                    return false;
+
+                _signal.wait(signal, std::memory_order_acquire);
+            };
+        };
+
+
+        /// <summary>
+        /// Wake up every thread that is blocked on this queue
+        /// </summary>
+        void Notify()
+        {
+            _signal.fetch_add(1, std::memory_order_release);
+            _signal.notify_all();
+        };
+
+
+        /// <summary>
+        /// Empty the queue, must only be called while no other thread uses it
+        /// </summary>
+        void Clear()
+        {
+            _head.store(0, std::memory_order_relaxed);
+            _tail.store(0, std::memory_order_relaxed);
+        };
+
+    };
+
+
+
+    /// <summary>
+    /// Extracts a single file through three stages that run at the same time:
+    /// a read stage that pulls the compressed data in (which is where page faults on a mapped zip hit the disk),
+    /// an inflate stage, and a write stage that writes the decompressed data onto disk.
+    /// Encrypted files are decrypted by the read stage in place of it's copy, so decryption overlaps with decompression too.
+    /// The stages pass a fixed set of reusable buffers to each other through bounded lock-free queues,
+    /// so the disk and the CPU are both kept busy while memory use stays at BUFFER_COUNT * CHUNK_SIZE per direction.
+    /// The read and write stages get threads of their own that live as long as the pipeline, the inflate stage runs on the calling thread.
+    /// A pipeline runs one file at a time, use one pipeline per extracting thread
+    /// </summary>
+    class ExtractionPipeline
+    {
+
+    public:
+
+        // The size of a single buffer passed between the stages
+        static constexpr size_t CHUNK_SIZE = 256 * 1024;
+
+        // The number of buffers between each pair of stages
+        static constexpr size_t BUFFER_COUNT = 4;
+
+        // The memory held by a pipeline's buffers while they are allocated
+        static constexpr size_t MEMORY_SIZE = 2 * BUFFER_COUNT * CHUNK_SIZE;
+
+
+    private:
+
+        // A buffer that is passed between the stages
+        struct PipelineChunk
+        {
+            uint8_t* data = nullptr;
+
+            // The number of valid bytes inside data
+            size_t size = 0;
+
+            // True for the last chunk of the file
+            bool isLast = false;
+        };
+
+        using ChunkQueue = SpscQueue<PipelineChunk*, BUFFER_COUNT>;
+
+
+    private:
+
+        // The memory for every buffer, allocated by the first Run and not zero filled
+        std::unique_ptr<uint8_t[]> _bufferMemory;
+
+        std::array<PipelineChunk, BUFFER_COUNT> _inputChunks;
+        std::array<PipelineChunk, BUFFER_COUNT> _outputChunks;
+
+        // Read stage -> inflate stage
+        ChunkQueue _filledInputQueue;
+
+        // Inflate stage -> read stage
+        ChunkQueue _freeInputQueue;
+
+        // Inflate stage -> write stage
+        ChunkQueue _filledOutputQueue;
+
+        // Write stage -> inflate stage
+        ChunkQueue _freeOutputQueue;
+
+        // Set when a stage fails, stops every stage
+        std::atomic<bool> _cancelled { false };
+
+        // Set when a stage fails or when the inflate stage doesn't need any more input, stops the read stage
+        std::atomic<bool> _stopReading { false };
+
+        // The first error thrown by any of the stages
+        std::exception_ptr _error;
+        std::atomic<bool> _hasError { false };
+
+        // Only the buffers are used, the codec keeps it's own state
+        z_stream _stream { };
+
+
+        // The current file
+        const uint8_t* _fileData = nullptr;
+        uint64_t _fileDataSize = 0;
+        uint64_t _uncompressedSize = 0;
+
+        // The entry's general purpose bit flag, some methods keep options in it
+        uint16_t _generalPurposeBitFlag = 0;
+
+        // The calling thread's codec for the file's compression method
+        DecompressionCodec* _codec = nullptr;
+
+        // True if the codec decodes the whole file's data at once, the read stage then has nothing to do
+        bool _decodesWholeInput = false;
+
+        // Optional, decrypts the file's data as the read stage reads it
+        WinZipAesDecryptor* _decryptor = nullptr;
+
+        // The decrypted data of an encrypted file whose codec decodes the whole file's data at once
+        std::unique_ptr<uint8_t[]> _decryptedData;
+
+        std::string _outputFilepath;
+
+        // Optional, updated and polled by the write stage once per chunk
+        ExtractionProgress* _progress = nullptr;
+
+        // The crc32 of the written data
+        uint32_t _writtenCrc32 = 0;
+
+
+        // Run the read and write stages of files that don't fit inside a single buffer, started by the first of those files
+        std::thread _readThread;
+        std::thread _writeThread;
+
+        // Changes for every file handed to the stage threads, and once more when they have to exit
+        std::atomic<uint32_t> _jobSignal { 0 };
+
+        // The number of stage threads that are done with the current file
+        std::atomic<uint32_t> _finishedStages { 0 };
+
+        // Set by the destructor, the stage threads exit instead of waiting for another file
+        std::atomic<bool> _shuttingDown { false };
+
+
+    public:
+
+        ExtractionPipeline() = default;
+
+
+        ~ExtractionPipeline()
+        {
+            _shuttingDown.store(true);
+
+            _jobSignal.fetch_add(1, std::memory_order_release);
+            _jobSignal.notify_all();
+
+            if (_readThread.joinable() == true)
+                _readThread.join();
+
+            if (_writeThread.joinable() == true)
+                _writeThread.join();
+        };
+
+
+        ExtractionPipeline(const ExtractionPipeline&) = delete;
+        ExtractionPipeline& operator = (const ExtractionPipeline&) = delete;
+
+
+        /// <summary>
+        /// Get the calling thread's pipeline, so the buffers are reused between files
+        /// </summary>
+        static ExtractionPipeline& GetThreadPipeline()
+        {
+            thread_local ExtractionPipeline pipeline;
+
+            return pipeline;
+        };
+
+
+    public:
+
+        /// <summary>
+        /// Extracts a single file onto disk
+        /// </summary>
+        /// <param name="fileData"> A pointer to the file's (possibly compressed) data, ignored if a decryptor is given </param>
+        /// <param name="fileDataSize"> The size of the file's data inside the zip, ignored if a decryptor is given </param>
+        /// <param name="uncompressedSize"> The size of the file after decompression </param>
+        /// <param name="compressionMethod"> How the data was compressed, throws if there's no codec registered for it </param>
+        /// <param name="generalPurposeBitFlag"> The entry's general purpose bit flag </param>
+        /// <param name="outputFilepath"> The path of the file that will be written </param>
+        /// <param name="progress"> Optional, receives the written bytes and can cancel the file between chunks </param>
+        /// <param name="decryptor"> Optional, the decryptor of an encrypted file. The caller checks it's authentication code afterwards </param>
+        /// <returns> The crc32 of the written data </returns>
+        uint32_t Run(const uint8_t* fileData, uint64_t fileDataSize, uint64_t uncompressedSize, CompressionMethod compressionMethod, uint16_t generalPurposeBitFlag, const std::string& outputFilepath, ExtractionProgress* progress = nullptr, WinZipAesDecryptor* decryptor = nullptr)
+        {
+            // The inflate stage runs on the calling thread, so it can use the thread's codec
+            _codec = &CodecRegistry::GetDefault().GetThreadCodec(compressionMethod);
+            _decodesWholeInput = _codec->HasWholeInputDecode();
+
+            _decryptor = decryptor;
+
+            if (_decryptor != nullptr)
+            {
+                fileData = _decryptor->GetEncryptedData();
+                fileDataSize = _decryptor->GetEncryptedSize();
+
+                // Those codecs read the whole file's data themselves, so it's decrypted up front
+                if (_decodesWholeInput == true)
+                {
+                    _decryptedData.reset(new uint8_t[static_cast<size_t>(fileDataSize)]);
+                    _decryptor->Decrypt(_decryptedData.get(), static_cast<size_t>(fileDataSize));
+
+                    fileData = _decryptedData.get();
+                    _decryptor = nullptr;
+                };
+            };
+
+            _fileData = fileData;
+            _fileDataSize = fileDataSize;
+            _uncompressedSize = uncompressedSize;
+            _generalPurposeBitFlag = generalPurposeBitFlag;
+            _outputFilepath = outputFilepath;
+            _progress = progress;
+
+            if (_bufferMemory == nullptr)
+                AllocateBuffers();
+
+            Reset();
+
+            // Small files fit inside a single buffer, running them through threads would cost more than it saves.
+            // The stages can run one after the other because no queue ever has to hold more than 2 chunks,
+            // the decode stages stop at the declared size so a file that decompresses to more can't fill the queues either
+            if ((fileDataSize < CHUNK_SIZE) && (uncompressedSize < CHUNK_SIZE))
+            {
+                ReadStage();
+                InflateStage();
+                WriteStage();
+            }
+            else
+            {
+                // The threads are started once, and reused by every file after this one
+                if (_readThread.joinable() == false)
+                    _readThread = std::thread(&ExtractionPipeline::StageThread, this, &ExtractionPipeline::ReadStage, _jobSignal.load());
+
+                if (_writeThread.joinable() == false)
+                    _writeThread = std::thread(&ExtractionPipeline::StageThread, this, &ExtractionPipeline::WriteStage, _jobSignal.load());
+
+                // The stage threads pick the file up from the members set above
+                _finishedStages.store(0);
+
+                _jobSignal.fetch_add(1, std::memory_order_release);
+                _jobSignal.notify_all();
+
+                InflateStage();
+
+                // Every stage returns once the file is done or cancelled
+                uint32_t finishedStages = 0;
+
+                while ((finishedStages = _finishedStages.load(std::memory_order_acquire)) != 2)
+                    _finishedStages.wait(finishedStages, std::memory_order_acquire);
+            };
+
+            _decryptedData.reset();
+
+            if (_hasError.load() == true)
+                std::rethrow_exception(_error);
+
+            return _writtenCrc32;
+        };
+
+
+        /// <summary>
+        /// Frees the buffers until the next Run, for callers that account for the pipeline's memory only while it's running
+        /// </summary>
+        void ReleaseBuffers()
+        {
+            _bufferMemory.reset();
+
+            for (size_t chunkIndex = 0; chunkIndex < BUFFER_COUNT; chunkIndex++)
+            {
+                _inputChunks[chunkIndex].data = nullptr;
+                _outputChunks[chunkIndex].data = nullptr;
+            };
+        };
+
+
+    private:
+
+        void AllocateBuffers()
+        {
+            _bufferMemory.reset(new uint8_t[MEMORY_SIZE]);
+
+            for (size_t chunkIndex = 0; chunkIndex < BUFFER_COUNT; chunkIndex++)
+            {
+                _inputChunks[chunkIndex].data = &_bufferMemory[chunkIndex * CHUNK_SIZE];
+                _outputChunks[chunkIndex].data = &_bufferMemory[(BUFFER_COUNT + chunkIndex) * CHUNK_SIZE];
+            };
+        };
+
+
+        /// <summary>
+        /// The loop of a stage thread, runs the stage once for every file handed to it until the pipeline is destroyed
+        /// </summary>
+        /// <param name="stage"> The stage the thread runs </param>
+        /// <param name="jobSignal"> The value of _jobSignal before the thread's first file was handed to it </param>
+        void StageThread(void (ExtractionPipeline::* stage)(), uint32_t jobSignal)
+        {
+            while (true)
+            {
+                _jobSignal.wait(jobSignal, std::memory_order_acquire);
+                jobSignal = _jobSignal.load(std::memory_order_acquire);
+
+                if (_shuttingDown.load() == true)
+                    return;
+
+                // The stages catch their own errors and hand them to the calling thread through Cancel
+                (this->*stage)();
+
+                _finishedStages.fetch_add(1, std::memory_order_release);
+                _finishedStages.notify_all();
+            };
+        };
+
+
+        /// <summary>
+        /// Get every buffer back into the free queues before running a new file
+        /// </summary>
+        void Reset()
+        {
+            _filledInputQueue.Clear();
+            _freeInputQueue.Clear();
+            _filledOutputQueue.Clear();
+            _freeOutputQueue.Clear();
+
+            for (size_t chunkIndex = 0; chunkIndex < BUFFER_COUNT; chunkIndex++)
+            {
+                _freeInputQueue.TryPush(&_inputChunks[chunkIndex]);
+                _freeOutputQueue.TryPush(&_outputChunks[chunkIndex]);
+            };
+
+            _cancelled.store(false);
+            _stopReading.store(false);
+            _hasError.store(false);
+            _error = nullptr;
+
+            _writtenCrc32 = 0;
+
+            // The size is known, LZMA still needs the flag to tell whether an end marker follows the data
+            CodecStreamInfo streamInfo;
+            streamInfo.uncompressedSize = _uncompressedSize;
+            streamInfo.generalPurposeBitFlag = _generalPurposeBitFlag;
+
+            if (_decodesWholeInput == false)
+                _codec->Reset(streamInfo);
+        };
+
+
+        /// <summary>
+        /// Stop every stage, optionally because of an error
+        /// </summary>
+        /// <param name="error"> The error that caused the cancellation, or nullptr </param>
+        void Cancel(std::exception_ptr error)
+        {
+            // Only keep the first error
+            if ((error != nullptr) && (_hasError.exchange(true) == false))
+                _error = error;
+
+            _cancelled.store(true);
+            _stopReading.store(true);
+
+            _filledInputQueue.Notify();
+            _freeInputQueue.Notify();
+            _filledOutputQueue.Notify();
+            _freeOutputQueue.Notify();
+        };
+
+
+        /// <summary>
+        /// Copies (or decrypts) the file's data into input buffers, one chunk at a time
+        /// </summary>
+        void ReadStage()
+        {
+            // Those codecs read the file's data themselves, they need all of it at once
+            if (_decodesWholeInput == true)
+                return;
+
+            try
+            {
+                uint64_t offset = 0;
+
+                do
+                {
+                    PipelineChunk* chunk = nullptr;
+
+                    if (_freeInputQueue.Pop(chunk, _stopReading) == false)
+                        return;
+
+                    chunk->size = static_cast<size_t>(std::min<uint64_t>(CHUNK_SIZE, _fileDataSize - offset));
+
+                    if (_decryptor != nullptr)
+                        _decryptor->Decrypt(chunk->data, chunk->size);
+                    else
+                        memcpy(chunk->data, &_fileData[offset], chunk->size);
+
+                    offset += chunk->size;
+                    chunk->isLast = (offset == _fileDataSize);
+
+                    if (_filledInputQueue.Push(chunk, _stopReading) == false)
+                        return;
+                }
+                while (offset < _fileDataSize);
+            }
+            catch (...)
+            {
+                Cancel(std::current_exception());
+            };
+        };
+
+
+        /// <summary>
+        /// Decompresses (or copies) input buffers into output buffers
+        /// </summary>
+        void InflateStage()
+        {
+            if (_decodesWholeInput == true)
+            {
+                WholeInputDecodeStage();
+                return;
+            };
+
+            try
+            {
+                PipelineChunk* outputChunk = nullptr;
+
+                if (_freeOutputQueue.Pop(outputChunk, _cancelled) == false)
+                    return;
+
+                _stream.next_out = outputChunk->data;
+                _stream.avail_out = static_cast<uInt>(CHUNK_SIZE);
+
+                uint64_t totalOutput = 0;
+                bool streamEnded = false;
+
+                while (streamEnded == false)
+                {
+                    PipelineChunk* inputChunk = nullptr;
+
+                    if (_filledInputQueue.Pop(inputChunk, _cancelled) == false)
+                        return;
+
+                    _stream.next_in = inputChunk->data;
+                    _stream.avail_in = static_cast<uInt>(inputChunk->size);
+
+                    while (true)
+                    {
+                        const uInt outputBefore = _stream.avail_out;
+
+                        const int result = _codec->Decode(_stream);
+
+                        if (result == Z_STREAM_END)
+                            streamEnded = true;
+                        else if ((result != Z_OK) && (result != Z_BUF_ERROR))
+                            throw std::exception("Failed to decompress file");
+
+                        totalOutput += outputBefore - _stream.avail_out;
+
+                        // Stops as soon as the file turns out bigger than it's declared size, rather than writing all of it
+                        if (totalOutput > _uncompressedSize)
+                            throw std::exception("Failed to decompress file");
+
+                        // Hand a full output buffer to the write stage and continue with a free one
+                        if (_stream.avail_out == 0)
+                        {
+                            outputChunk->size = CHUNK_SIZE;
+                            outputChunk->isLast = false;
+
+                            if (_filledOutputQueue.Push(outputChunk, _cancelled) == false)
+                                return;
+
+                            if (_freeOutputQueue.Pop(outputChunk, _cancelled) == false)
+                                return;
+
+                            _stream.next_out = outputChunk->data;
+                            _stream.avail_out = static_cast<uInt>(CHUNK_SIZE);
+                        }
+                        // Out of input, fetch the next input buffer
+                        else if ((streamEnded == true) || (_stream.avail_in == 0))
+                            break;
+                    };
+
+                    const bool wasLastInput = inputChunk->isLast;
+
+                    if (_freeInputQueue.Push(inputChunk, _cancelled) == false)
+                        return;
+
+                    if ((wasLastInput == true) && (streamEnded == false))
+                        throw std::exception("Failed to decompress file");
+                };
+
+                if (totalOutput != _uncompressedSize)
+                    throw std::exception("Failed to decompress file");
+
+                // The read stage may still be waiting to push data that came after the end of the compressed stream
+                _stopReading.store(true);
+                _freeInputQueue.Notify();
+                _filledInputQueue.Notify();
+
+                // Hand the last, possibly partial, buffer to the write stage
+                outputChunk->size = CHUNK_SIZE - _stream.avail_out;
+                outputChunk->isLast = true;
+
+                _filledOutputQueue.Push(outputChunk, _cancelled);
+            }
+            catch (...)
+            {
+                Cancel(std::current_exception());
+            };
+        };
+
+
+        /// <summary>
+        /// Decodes a file's data all at once and fills output buffers in order, in place of the inflate stage.
+        /// The BZIP2 codec decodes the blocks in parallel on the process-wide compute pool
+        /// </summary>
+        void WholeInputDecodeStage()
+        {
+            try
+            {
+                PipelineChunk* outputChunk = nullptr;
+
+                if (_freeOutputQueue.Pop(outputChunk, _cancelled) == false)
+                    return;
+
+                size_t outputSize = 0;
+                uint64_t totalOutput = 0;
+
+                _codec->DecodeWholeInput(_fileData, _fileDataSize, [&](std::span<const uint8_t> blockData)
+                {
+                    totalOutput += blockData.size();
+
+                    // Stops at the first block that doesn't fit, rather than writing all of a file that's too big
+                    if (totalOutput > _uncompressedSize)
+                        throw std::exception("Failed to decompress file");
+
+                    while (blockData.empty() == false)
+                    {
+                        const size_t copySize = std::min(blockData.size(), CHUNK_SIZE - outputSize);
+
+                        memcpy(&outputChunk->data[outputSize], blockData.data(), copySize);
+
+                        outputSize += copySize;
+                        blockData = blockData.subspan(copySize);
+
+                        // Hand a full output buffer to the write stage and continue with a free one, a failed queue means the extraction was cancelled
+                        if (outputSize == CHUNK_SIZE)
+                        {
+                            outputChunk->size = CHUNK_SIZE;
+                            outputChunk->isLast = false;
+
+                            if ((_filledOutputQueue.Push(outputChunk, _cancelled) == false) || (_freeOutputQueue.Pop(outputChunk, _cancelled) == false))
+                                throw std::exception("Extraction cancelled");
+
+                            outputSize = 0;
+                        };
+                    };
+                });
+
+                if (totalOutput != _uncompressedSize)
+                    throw std::exception("Failed to decompress file");
+
+                // Hand the last, possibly partial, buffer to the write stage
+                outputChunk->size = outputSize;
+                outputChunk->isLast = true;
+
+                _filledOutputQueue.Push(outputChunk, _cancelled);
+            }
+            catch (...)
+            {
+                Cancel(std::current_exception());
+            };
+        };
+
+
+        /// <summary>
+        /// Writes output buffers onto disk
+        /// </summary>
+        void WriteStage()
+        {
+            try
+            {
+                std::ofstream output(_outputFilepath, std::ios::binary);
+
+                if (output.is_open() == false)
+                    throw std::exception("Error opening output file");
+
+                uint32_t writtenCrc32 = 0;
+
+                while (true)
+                {
+                    PipelineChunk* chunk = nullptr;
+
+                    if (_filledOutputQueue.Pop(chunk, _cancelled) == false)
+                        return;
+
+                    output.write(reinterpret_cast<const char*>(chunk->data), chunk->size);
+
+                    writtenCrc32 = crc32(writtenCrc32, chunk->data, static_cast<uInt>(chunk->size));
+
+                    // Cancelling from here stops every stage through Cancel
+                    if (_progress != nullptr)
+                    {
+                        _progress->AddBytes(chunk->size);
+                        _progress->ThrowIfCancelled();
+                    };
+
+                    const bool wasLastChunk = chunk->isLast;
+
+                    if (_freeOutputQueue.Push(chunk, _cancelled) == false)
+                        return;
+
+                    if (wasLastChunk == true)
+                        break;
+                };
+
+                output.close();
+
+                if (output.fail() == true)
+                    throw std::exception("Error writing output file");
+
+                _writtenCrc32 = writtenCrc32;
+            }
+            catch (...)
+            {
+                Cancel(std::current_exception());
+            };
+        };
+
+    };
+
+};
@@ -0,0 +1,150 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <exception>
+#include <functional>
+
+
+namespace ZipExtractor
+{
+
+    /// <summary>
+    /// Progress reporting and cooperative cancellation for an extraction.
+    /// Extracting threads add to relaxed atomic counters once per pipeline chunk and poll the cancellation flag at the same points,
+    /// so enabling progress costs an atomic add and a load per chunk instead of anything per byte.
+    /// The counters can be read from any thread while the extraction runs, Cancel stops every thread that shares this object.
+    /// Only files are counted as entries, folders are created without being reported
+    /// </summary>
+    class ExtractionProgress
+    {
+
+    public:
+
+        // Called from the extracting thread every time a file is done
+        using EntryCallback = std::function<void(const std::string& filename, uint64_t uncompressedSize)>;
+
+
+    private:
+
+        // The counters that every extracting thread writes to live on their own cache line,
+        // so polling the cancellation flag doesn't keep invalidating them
+
+        alignas(64) std::atomic<uint64_t> _bytesDone { 0 };
+
+        std::atomic<uint64_t> _entriesDone { 0 };
+
+        alignas(64) std::atomic<uint64_t> _totalBytes { 0 };
+
+        std::atomic<uint64_t> _totalEntries { 0 };
+
+        alignas(64) std::atomic<bool> _cancelled { false };
+
+        EntryCallback _entryCallback;
+
+
+    public:
+
+        ExtractionProgress() = default;
+
+        /// <summary>
+        /// Creates a progress object that reports every finished file
+        /// </summary>
+        /// <param name="entryCallback"> Called from the extracting thread every time a file is done, must be thread-safe when extracting with many threads </param>
+        explicit ExtractionProgress(EntryCallback entryCallback) :
+            _entryCallback(std::move(entryCallback))
+        {
+        };
+
+        ExtractionProgress(const ExtractionProgress&) = delete;
+        ExtractionProgress& operator = (const ExtractionProgress&) = delete;
+
+
+    public:
+
+        /// <summary>
+        /// Ask every thread that uses this object to stop, they stop at their next chunk and throw
+        /// </summary>
+        void Cancel()
+        {
+            _cancelled.store(true, std::memory_order_relaxed);
+        };
+
+        bool IsCancelled() const
+        {
+            return _cancelled.load(std::memory_order_relaxed);
+        };
+
+        uint64_t GetBytesDone() const
+        {
+            return _bytesDone.load(std::memory_order_relaxed);
+        };
+
+        uint64_t GetEntriesDone() const
+        {
+            return _entriesDone.load(std::memory_order_relaxed);
+        };
+
+        uint64_t GetTotalBytes() const
+        {
+            return _totalBytes.load(std::memory_order_relaxed);
+        };
+
+        uint64_t GetTotalEntries() const
+        {
+            return _totalEntries.load(std::memory_order_relaxed);
+        };
+
+
+    public:
+
+        // Called by the extractors
+
+        /// <summary>
+        /// Add work that is about to be extracted
+        /// </summary>
+        /// <param name="entries"> The number of files </param>
+        /// <param name="bytes"> Their total decompressed size </param>
+        void AddTotal(uint64_t entries, uint64_t bytes)
+        {
+            _totalEntries.fetch_add(entries, std::memory_order_relaxed);
+            _totalBytes.fetch_add(bytes, std::memory_order_relaxed);
+        };
+
+
+        /// <summary>
+        /// Report a chunk of decompressed data that was written
+        /// </summary>
+        /// <param name="bytes"> The size of the chunk </param>
+        void AddBytes(uint64_t bytes)
+        {
+            _bytesDone.fetch_add(bytes, std::memory_order_relaxed);
+        };
+
+
+        /// <summary>
+        /// Report a finished file
+        /// </summary>
+        /// <param name="filename"> The file's name inside the zip </param>
+        /// <param name="uncompressedSize"> The file's decompressed size </param>
+        void FinishEntry(const std::string& filename, uint64_t uncompressedSize)
+        {
+            _entriesDone.fetch_add(1, std::memory_order_relaxed);
+
+            if (_entryCallback)
+                _entryCallback(filename, uncompressedSize);
+        };
+
+
+        /// <summary>
+        /// Throws if the extraction was cancelled, called between chunks
+        /// </summary>
+        void ThrowIfCancelled() const
+        {
+            if (IsCancelled() == true)
+                throw std::exception("Extraction was cancelled");
+        };
+
+    };
+
+};
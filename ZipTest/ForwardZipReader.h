@@ -0,0 +1,984 @@
+#pragma once
+#include <span>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <unordered_map>
+
+#include "ZipArchive.h"
+#include "ZipInputSource.h"
+
+
+namespace ZipExtractor
+{
+
+    // The reason an entry read by a ForwardZipReader couldn't be fully validated against the central directory
+    enum class EntryValidationIssue
+    {
+        // The zip ended before a complete central directory, the entry was only checked against it's own crc32
+        NoCentralDirectory,
+
+        // The central directory's record of the entry disagrees with what was read
+        CentralDirectoryMismatch,
+
+        // The central directory doesn't list the entry, usually an older copy of an entry that was replaced by appending to the zip
+        NotInCentralDirectory,
+
+        // The central directory lists an entry that wasn't found between the File headers, it was never read
+        NotInStream,
+    };
+
+
+    // An entry that couldn't be fully validated
+    struct UnvalidatedEntry
+    {
+        // The entry's name inside the zip
+        std::string filename;
+
+        // An offset to the entry's File header
+        uint64_t fileHeaderOffset = 0;
+
+        EntryValidationIssue issue = EntryValidationIssue::NoCentralDirectory;
+    };
+
+
+
+    /// <summary>
+    /// Reads a zip front to back through it's File headers, pulling the bytes from a sequential source as they're needed,
+    /// so a zip that is still arriving through a pipe can be extracted while it arrives, in a constant amount of memory.
+    /// Streaming zippers set general purpose bit 3 and leave the File header's sizes and crc32 zeroed, the real ones follow the data inside a data descriptor.
+    /// The end of such a DEFLATE entry is found by decompressing it until it's DEFLATE stream ends,
+    /// the end of such a stored entry by searching for a data descriptor that matches the data before it.
+    /// Either way the data descriptor is checked against the data that was actually read.
+    /// Once the File headers end, the central directory that follows them is read and every entry is checked against it,
+    /// entries that couldn't be fully validated are reported by GetUnvalidatedEntries
+    /// </summary>
+    class ForwardZipReader
+    {
+
+    public:
+
+        // Receives an entry's decompressed contents, one chunk at a time
+        using DataCallback = std::function<void(std::span<const uint8_t> data)>;
+
+        // The most decompressed bytes handed to a DataCallback at once
+        static constexpr size_t OUTPUT_CHUNK_SIZE = 256 * 1024;
+
+        // The size of the input buffer, it only grows to fit a single header that is bigger
+        static constexpr size_t INPUT_BUFFER_SIZE = 1024 * 1024;
+
+
+    private:
+
+        // The size of a File header without the filename and extra field
+        static constexpr size_t FILE_HEADER_SIZE = 30;
+
+        // The size of a Central directory without the filename, extra field and comment
+        static constexpr size_t CENTRAL_DIRECTORY_SIZE = 46;
+
+        // The size of the biggest data descriptor, a ZIP64 one with it's signature
+        static constexpr size_t MAX_DATA_DESCRIPTOR_SIZE = 24;
+
+        // General purpose bit 3, the entry's sizes and crc32 are stored inside a data descriptor that follows it's data
+        static constexpr uint16_t DATA_DESCRIPTOR_FLAG = 1 << 3;
+
+
+    private:
+
+        // Only set when the reader created it's own source
+        std::unique_ptr<IZipInputSource> _ownedSource;
+
+        IZipInputSource* _source = nullptr;
+
+        // Bytes that were read from the source but not consumed yet live in [_bufferPosition, _bufferEnd)
+        std::vector<uint8_t> _inputBuffer;
+
+        size_t _bufferPosition = 0;
+
+        size_t _bufferEnd = 0;
+
+        bool _sourceEnded = false;
+
+        // The offset of the next unconsumed byte inside the zip
+        uint64_t _offset = 0;
+
+        // The entry returned by the last call to NextEntry
+        EntryInfo _entry;
+
+        // True if the current entry's data wasn't read or skipped yet
+        bool _hasPendingData = false;
+
+        // True if the current entry's File header has a ZIP64 extra field, it's data descriptor then holds 64-bit sizes
+        bool _isZip64 = false;
+
+        // Every entry that was read, checked against the central directory at the end
+        std::vector<EntryInfo> _readEntries;
+
+        // True once the File headers ended and the central directory was checked
+        bool _isFinished = false;
+
+        bool _hasCentralDirectory = false;
+
+        std::vector<UnvalidatedEntry> _unvalidatedEntries;
+
+        // Only it's buffers are used, the decoding state lives in the codecs
+        z_stream _stream { };
+
+        // One decoder per compression method, created by the codec registry for the first entry that uses it
+        std::unordered_map<CompressionMethod, std::unique_ptr<DecompressionCodec>> _codecs;
+
+        std::vector<uint8_t> _outputBuffer;
+
+
+    public:
+
+        /// <summary>
+        /// Creates a reader that pulls the zip from a source
+        /// </summary>
+        /// <param name="source"> The source, must outlive the reader </param>
+        explicit ForwardZipReader(IZipInputSource& source) :
+            _source(&source),
+            _inputBuffer(INPUT_BUFFER_SIZE),
+            _outputBuffer(OUTPUT_CHUNK_SIZE)
+        {
+        };
+
+        /// <summary>
+        /// Creates a reader over an entire zip file that is already in memory
+        /// </summary>
+        /// <param name="zipFileData"> The zip file, must outlive the reader </param>
+        explicit ForwardZipReader(std::span<const uint8_t> zipFileData) :
+            ForwardZipReader(std::make_unique<MemoryInputSource>(zipFileData))
+        {
+        };
+
+        /// <summary>
+        /// Creates a reader over a stream
+        /// </summary>
+        /// <param name="stream"> A stream opened in binary mode, must outlive the reader </param>
+        explicit ForwardZipReader(std::istream& stream) :
+            ForwardZipReader(std::make_unique<StreamInputSource>(stream))
+        {
+        };
+
+        ForwardZipReader(const ForwardZipReader&) = delete;
+        ForwardZipReader& operator = (const ForwardZipReader&) = delete;
+
+
+    private:
+
+        explicit ForwardZipReader(std::unique_ptr<IZipInputSource> ownedSource) :
+            ForwardZipReader(*ownedSource)
+        {
+            _ownedSource = std::move(ownedSource);
+        };
+
+
+    public:
+
+        /// <summary>
+        /// Moves to the next entry, skipping the current entry's data if it wasn't read.
+        /// Entries with a data descriptor have zeroed sizes and crc32 until their data was read or skipped.
+        /// Once the File headers end the central directory is read and checked against every entry that was read
+        /// </summary>
+        /// <returns> The next entry, or nullptr once the File headers end </returns>
+        const EntryInfo* NextEntry()
+        {
+            if (_isFinished == true)
+                return nullptr;
+
+            if (_hasPendingData == true)
+                SkipEntryData();
+
+            // The first part of a split zip starts with a data descriptor signature
+            if ((_offset == 0) && (FillBuffer(4) == true) && (Utilities::ReadUInt32(GetBufferedData()) == PK_DATA_DESCRIPTOR_SIGNATURE_LITTLE_ENDIAN))
+                Consume(4);
+
+            // Anything else, usually the first central directory, ends the File headers
+            if ((FillBuffer(4) == false) || (Utilities::ReadUInt32(GetBufferedData()) != PK_FILE_HEADER_SIGNATURE_LITTLE_ENDIAN))
+            {
+                Finish();
+                return nullptr;
+            };
+
+            if (FillBuffer(FILE_HEADER_SIZE) == false)
+                throw std::exception("Unexpected end of zip");
+
+            const uint16_t filenameLength = Utilities::ReadUInt16(&GetBufferedData()[26]);
+            const uint16_t extraFieldLength = Utilities::ReadUInt16(&GetBufferedData()[28]);
+
+            const size_t fileHeaderLength = FILE_HEADER_SIZE + filenameLength + extraFieldLength;
+
+            if (FillBuffer(fileHeaderLength) == false)
+                throw std::exception("Unexpected end of zip");
+
+            const uint8_t* const fileHeaderPointer = GetBufferedData();
+            const uint8_t* const extraField = &fileHeaderPointer[FILE_HEADER_SIZE + filenameLength];
+
+            _entry = EntryInfo();
+
+            _entry.entryIndex = _readEntries.size();
+            _entry.fileHeaderOffset = _offset;
+            _entry.generalPurposeBitFlag = Utilities::ReadUInt16(&fileHeaderPointer[6]);
+            _entry.compressionMethod = static_cast<CompressionMethod>(Utilities::ReadUInt16(&fileHeaderPointer[8]));
+            _entry.crc32 = Utilities::ReadUInt32(&fileHeaderPointer[14]);
+
+            Utilities::ReadFileHeaderSizes(fileHeaderPointer, _entry.compressedSize, _entry.uncompressedSize);
+
+            _entry.filename.assign(reinterpret_cast<const char*>(&fileHeaderPointer[FILE_HEADER_SIZE]), filenameLength);
+
+            // Folders are stored as empty entries with a trailing slash
+            _entry.isDirectory = (_entry.filename.empty() == false) && (_entry.filename.back() == '/');
+
+            if ((_entry.generalPurposeBitFlag & 1 << 0) != 0)
+                _entry.encryptionType = (static_cast<uint16_t>(_entry.compressionMethod) == AES_COMPRESSION_METHOD) ? ZipEncryption::AES : ZipEncryption::ZipCrypto;
+
+            _isZip64 = HasZip64ExtraField(extraField, extraFieldLength);
+
+            // The sizes inside the File header are meaningless when a data descriptor follows
+            if (HasDataDescriptor() == true)
+            {
+                _entry.crc32 = 0;
+                _entry.compressedSize = 0;
+                _entry.uncompressedSize = 0;
+            };
+
+            Consume(fileHeaderLength);
+
+            _hasPendingData = true;
+
+            return &_entry;
+        };
+
+
+        /// <summary>
+        /// Decompresses the current entry's data, checks it against the entry's crc32 and moves past it and it's data descriptor.
+        /// The data is handed to the callback as it's decompressed, so a corrupt entry is only detected after it's data was handed over
+        /// </summary>
+        /// <param name="callback"> Receives the decompressed data, one chunk at a time </param>
+        void ReadEntryData(const DataCallback& callback)
+        {
+            if (_hasPendingData == false)
+                throw std::exception("The entry's data was already read");
+
+            // Thrown before anything is consumed, so the entry can still be skipped
+            if (_entry.encryptionType != ZipEncryption::None)
+                throw std::exception("Encryption isn't supported, yet.");
+
+            _hasPendingData = false;
+
+            uint64_t compressedSize = 0;
+            uint64_t uncompressedSize = 0;
+            uint32_t crc32 = 0;
+
+            switch (_entry.compressionMethod)
+            {
+                case CompressionMethod::None:
+                {
+                    if (HasDataDescriptor() == true)
+                        ReadStoredDataUntilDescriptor(callback, compressedSize, crc32);
+                    else
+                    {
+                        compressedSize = _entry.compressedSize;
+                        crc32 = ReadStoredData(compressedSize, callback, true);
+                    };
+
+                    uncompressedSize = compressedSize;
+                    break;
+                };
+
+                default:
+                {
+                    if (CodecRegistry::GetDefault().IsSupported(_entry.compressionMethod) == false)
+                        throw std::exception("Unsupported compression method");
+
+                    // Without a data descriptor the compressed size is known, otherwise the compressed stream has to end by itself
+                    const uint64_t inputLimit = (HasDataDescriptor() == true) ? UINT64_MAX : _entry.compressedSize;
+
+                    InflateEntryData(inputLimit, callback, compressedSize, uncompressedSize, crc32);
+                    break;
+                };
+            };
+
+            if (HasDataDescriptor() == true)
+            {
+                ReadDataDescriptor(compressedSize, uncompressedSize);
+
+                _entry.compressedSize = compressedSize;
+                _entry.uncompressedSize = uncompressedSize;
+            }
+            else if ((compressedSize != _entry.compressedSize) || (uncompressedSize != _entry.uncompressedSize))
+                throw std::exception("Failed to decompress file");
+
+            if (crc32 != _entry.crc32)
+                throw std::exception("CRC mismatch");
+
+            _readEntries.push_back(_entry);
+        };
+
+
+        /// <summary>
+        /// Moves past the current entry's data without keeping it.
+        /// Entries with known sizes (encrypted ones included) are skipped without being checked,
+        /// DEFLATE entries with a data descriptor still have to be decompressed to find where they end,
+        /// and encrypted entries with a data descriptor are searched for it since they can't be decrypted
+        /// </summary>
+        void SkipEntryData()
+        {
+            if ((_hasPendingData == true) && (HasDataDescriptor() == false))
+            {
+                ReadStoredData(_entry.compressedSize, nullptr, false);
+
+                _hasPendingData = false;
+                _readEntries.push_back(_entry);
+                return;
+            };
+
+            if ((_hasPendingData == true) && (_entry.encryptionType != ZipEncryption::None))
+            {
+                uint64_t compressedSize = 0;
+                uint64_t uncompressedSize = 0;
+
+                SkipEncryptedDataUntilDescriptor(compressedSize, uncompressedSize);
+
+                _hasPendingData = false;
+
+                ReadDataDescriptor(compressedSize, uncompressedSize);
+
+                _entry.compressedSize = compressedSize;
+                _entry.uncompressedSize = uncompressedSize;
+
+                _readEntries.push_back(_entry);
+                return;
+            };
+
+            ReadEntryData(nullptr);
+        };
+
+
+        /// <summary>
+        /// Extracts the current entry onto disk, folders are created and files are decompressed straight into their output file
+        /// </summary>
+        /// <param name="outputFolder"> An output path to which the entry will be extracted </param>
+        /// <param name="progress"> Optional, receives the written bytes and the finished file and can cancel it between chunks </param>
+        void ExtractEntry(const std::string& outputFolder, ExtractionProgress* progress = nullptr)
+        {
+            if (progress != nullptr)
+                progress->ThrowIfCancelled();
+
+            const std::filesystem::path outputPath = Utilities::GetOutputPath(outputFolder, _entry.filename);
+
+            if (_entry.isDirectory == true)
+            {
+                std::filesystem::create_directories(outputPath);
+
+                SkipEntryData();
+                return;
+            };
+
+            // Zips don't have to contain an entry for every folder
+            if (outputPath.has_parent_path() == true)
+                std::filesystem::create_directories(outputPath.parent_path());
+
+            std::ofstream output(outputPath, std::ios::binary);
+
+            if (output.is_open() == false)
+                throw std::exception("Error opening output file");
+
+            ReadEntryData([&](std::span<const uint8_t> data)
+            {
+                output.write(reinterpret_cast<const char*>(data.data()), data.size());
+
+                if (progress != nullptr)
+                {
+                    progress->AddBytes(data.size());
+                    progress->ThrowIfCancelled();
+                };
+            });
+
+            if (output.good() == false)
+                throw std::exception("Error writing output file");
+
+            if (progress != nullptr)
+                progress->FinishEntry(_entry.filename, _entry.uncompressedSize);
+        };
+
+
+        /// <summary>
+        /// Extracts every remaining entry onto disk, one after the other, and checks them against the central directory
+        /// </summary>
+        /// <param name="outputFolder"> An output path to which the zip will be extracted </param>
+        /// <param name="progress"> Optional, receives the extraction's progress and can cancel it between chunks, the totals aren't known up front </param>
+        /// <returns> Every entry that couldn't be fully validated, empty if the whole zip checked out </returns>
+        const std::vector<UnvalidatedEntry>& ExtractAll(const std::string& outputFolder, ExtractionProgress* progress = nullptr)
+        {
+            while (NextEntry() != nullptr)
+                ExtractEntry(outputFolder, progress);
+
+            return _unvalidatedEntries;
+        };
+
+
+    public:
+
+        /// <summary>
+        /// Get the entry returned by the last call to NextEntry
+        /// </summary>
+        const EntryInfo& GetEntry() const
+        {
+            return _entry;
+        };
+
+        /// <summary>
+        /// Get the offset of the next unconsumed byte inside the zip
+        /// </summary>
+        uint64_t GetOffset() const
+        {
+            return _offset;
+        };
+
+        /// <summary>
+        /// Returns true once the File headers ended and the central directory was checked
+        /// </summary>
+        bool IsFinished() const
+        {
+            return _isFinished;
+        };
+
+        /// <summary>
+        /// Returns true if a complete central directory followed the File headers
+        /// </summary>
+        bool HasCentralDirectory() const
+        {
+            return _hasCentralDirectory;
+        };
+
+        /// <summary>
+        /// Get every entry that couldn't be fully validated, only complete once IsFinished returns true
+        /// </summary>
+        const std::vector<UnvalidatedEntry>& GetUnvalidatedEntries() const
+        {
+            return _unvalidatedEntries;
+        };
+
+
+    private:
+
+        bool HasDataDescriptor() const
+        {
+            return (_entry.generalPurposeBitFlag & DATA_DESCRIPTOR_FLAG) != 0;
+        };
+
+
+        const uint8_t* GetBufferedData() const
+        {
+            return &_inputBuffer[_bufferPosition];
+        };
+
+        size_t GetBufferedSize() const
+        {
+            return _bufferEnd - _bufferPosition;
+        };
+
+
+        /// <summary>
+        /// Reads from the source until at least the given number of bytes are buffered
+        /// </summary>
+        /// <param name="size"> The number of bytes needed </param>
+        /// <returns> False if the source ended first, whatever it had is still buffered </returns>
+        bool FillBuffer(size_t size)
+        {
+            while (GetBufferedSize() < size)
+            {
+                if (_sourceEnded == true)
+                    return false;
+
+                // Move the unconsumed bytes to the front when the rest of the buffer can't fit the missing ones
+                if ((_inputBuffer.size() - _bufferPosition) < size)
+                {
+                    memmove(_inputBuffer.data(), GetBufferedData(), GetBufferedSize());
+
+                    _bufferEnd -= _bufferPosition;
+                    _bufferPosition = 0;
+                };
+
+                if (_inputBuffer.size() < size)
+                    _inputBuffer.resize(size);
+
+                const size_t readSize = _source->Read(std::span<uint8_t>(&_inputBuffer[_bufferEnd], _inputBuffer.size() - _bufferEnd));
+
+                if (readSize == 0)
+                    _sourceEnded = true;
+
+                _bufferEnd += readSize;
+            };
+
+            return true;
+        };
+
+
+        /// <summary>
+        /// Marks buffered bytes as consumed
+        /// </summary>
+        void Consume(size_t size)
+        {
+            _bufferPosition += size;
+            _offset += size;
+
+            if (_bufferPosition == _bufferEnd)
+            {
+                _bufferPosition = 0;
+                _bufferEnd = 0;
+            };
+        };
+
+
+        /// <summary>
+        /// Hands data to a callback in chunks of at most OUTPUT_CHUNK_SIZE
+        /// </summary>
+        static void EmitData(const uint8_t* data, size_t size, const DataCallback& callback)
+        {
+            if (!callback)
+                return;
+
+            for (size_t offset = 0; offset < size; offset += OUTPUT_CHUNK_SIZE)
+                callback(std::span<const uint8_t>(&data[offset], std::min(OUTPUT_CHUNK_SIZE, size - offset)));
+        };
+
+
+        /// <summary>
+        /// Reads stored data of a known size
+        /// </summary>
+        /// <param name="size"> The size of the data </param>
+        /// <param name="callback"> Receives the data, or nullptr </param>
+        /// <param name="calculateCrc32"> True to calculate the crc32 of the data </param>
+        /// <returns> The data's crc32, or 0 </returns>
+        uint32_t ReadStoredData(uint64_t size, const DataCallback& callback, bool calculateCrc32)
+        {
+            uint32_t crc32 = 0;
+
+            while (size != 0)
+            {
+                if (FillBuffer(1) == false)
+                    throw std::exception("Unexpected end of zip");
+
+                const size_t chunkSize = static_cast<size_t>(std::min<uint64_t>(GetBufferedSize(), size));
+
+                if (calculateCrc32 == true)
+                    crc32 = Utilities::Crc32(crc32, GetBufferedData(), chunkSize);
+
+                EmitData(GetBufferedData(), chunkSize, callback);
+
+                Consume(chunkSize);
+                size -= chunkSize;
+            };
+
+            return crc32;
+        };
+
+
+        /// <summary>
+        /// Reads stored data up to the first data descriptor whose sizes and crc32 match the data before it.
+        /// Only data descriptors with a signature can be found this way
+        /// </summary>
+        /// <param name="callback"> Receives the data, or nullptr </param>
+        /// <param name="sizeOut"> The size of the data </param>
+        /// <param name="crc32Out"> The crc32 of the data </param>
+        void ReadStoredDataUntilDescriptor(const DataCallback& callback, uint64_t& sizeOut, uint32_t& crc32Out)
+        {
+            sizeOut = 0;
+            crc32Out = 0;
+
+            while (true)
+            {
+                FillBuffer(MAX_DATA_DESCRIPTOR_SIZE);
+
+                const uint8_t* const data = GetBufferedData();
+                const size_t available = GetBufferedSize();
+
+                // Candidates are only checked once their entire data descriptor is buffered, unless nothing else will arrive
+                const size_t searchEnd = (_sourceEnded == true) ? available : (available - MAX_DATA_DESCRIPTOR_SIZE + 1);
+
+                if ((_sourceEnded == true) && (available == 0))
+                    throw std::exception("Missing data descriptor");
+
+                // The crc32 of data[0, crcEnd)
+                uint32_t crc32 = crc32Out;
+                size_t crcEnd = 0;
+
+                size_t position = 0;
+
+                while (position < searchEnd)
+                {
+                    const void* signature = memchr(&data[position], 'P', searchEnd - position);
+
+                    if (signature == nullptr)
+                        break;
+
+                    position = static_cast<size_t>(static_cast<const uint8_t*>(signature) - data);
+
+                    if (((position + 4) <= available) && (Utilities::ReadUInt32(&data[position]) == PK_DATA_DESCRIPTOR_SIGNATURE_LITTLE_ENDIAN))
+                    {
+                        crc32 = Utilities::Crc32(crc32, &data[crcEnd], position - crcEnd);
+                        crcEnd = position;
+
+                        const uint64_t dataSize = sizeOut + position;
+
+                        const uint8_t* const descriptor = &data[position + 4];
+                        const uint64_t descriptorAvailable = available - position - 4;
+
+                        if (((MatchDataDescriptor(descriptor, descriptorAvailable, _isZip64, dataSize, dataSize) != 0) ||
+                             (MatchDataDescriptor(descriptor, descriptorAvailable, !_isZip64, dataSize, dataSize) != 0)) &&
+                            (descriptorAvailable >= 4) && (Utilities::ReadUInt32(descriptor) == crc32))
+                        {
+                            EmitData(data, position, callback);
+                            Consume(position);
+
+                            sizeOut = dataSize;
+                            crc32Out = crc32;
+                            return;
+                        };
+                    };
+
+                    position++;
+                };
+
+                if (_sourceEnded == true)
+                    throw std::exception("Missing data descriptor");
+
+                // Nothing before searchEnd starts a data descriptor, so it's all data
+                crc32Out = Utilities::Crc32(crc32, &data[crcEnd], searchEnd - crcEnd);
+                sizeOut += searchEnd;
+
+                EmitData(data, searchEnd, callback);
+                Consume(searchEnd);
+            };
+        };
+
+
+        /// <summary>
+        /// Moves past an encrypted entry's data up to it's data descriptor.
+        /// Without decrypting there's no crc32 to check, the data ends at the first data descriptor whose compressed size matches the bytes before it
+        /// </summary>
+        /// <param name="compressedSizeOut"> The size of the entry's data </param>
+        /// <param name="uncompressedSizeOut"> The decompressed size the data descriptor holds </param>
+        void SkipEncryptedDataUntilDescriptor(uint64_t& compressedSizeOut, uint64_t& uncompressedSizeOut)
+        {
+            compressedSizeOut = 0;
+
+            while (true)
+            {
+                FillBuffer(MAX_DATA_DESCRIPTOR_SIZE);
+
+                const uint8_t* const data = GetBufferedData();
+                const size_t available = GetBufferedSize();
+
+                if ((_sourceEnded == true) && (available == 0))
+                    throw std::exception("Missing data descriptor");
+
+                // Candidates are only checked once their entire data descriptor is buffered, unless nothing else will arrive
+                const size_t searchEnd = (_sourceEnded == true) ? available : (available - MAX_DATA_DESCRIPTOR_SIZE + 1);
+
+                size_t position = 0;
+
+                while (position < searchEnd)
+                {
+                    const void* signature = memchr(&data[position], 'P', searchEnd - position);
+
+                    if (signature == nullptr)
+                        break;
+
+                    position = static_cast<size_t>(static_cast<const uint8_t*>(signature) - data);
+
+                    if (((position + 4) <= available) && (Utilities::ReadUInt32(&data[position]) == PK_DATA_DESCRIPTOR_SIGNATURE_LITTLE_ENDIAN))
+                    {
+                        const uint64_t dataSize = compressedSizeOut + position;
+
+                        const uint8_t* const descriptor = &data[position + 4];
+                        const uint64_t descriptorAvailable = available - position - 4;
+
+                        uint64_t descriptorCompressedSize = 0;
+
+                        // Both layouts are tried, like ReadDataDescriptor does
+                        if (((ReadDataDescriptorSizes(descriptor, descriptorAvailable, _isZip64, descriptorCompressedSize, uncompressedSizeOut) != 0) && (descriptorCompressedSize == dataSize)) ||
+                            ((ReadDataDescriptorSizes(descriptor, descriptorAvailable, !_isZip64, descriptorCompressedSize, uncompressedSizeOut) != 0) && (descriptorCompressedSize == dataSize)))
+                        {
+                            Consume(position);
+
+                            compressedSizeOut = dataSize;
+                            return;
+                        };
+                    };
+
+                    position++;
+                };
+
+                if (_sourceEnded == true)
+                    throw std::exception("Missing data descriptor");
+
+                // Nothing before searchEnd starts a data descriptor, so it's all data
+                compressedSizeOut += searchEnd;
+
+                Consume(searchEnd);
+            };
+        };
+
+
+        /// <summary>
+        /// Decompresses the current entry's compressed stream with it's method's codec until it ends
+        /// </summary>
+        /// <param name="inputLimit"> The most compressed bytes the stream may take </param>
+        /// <param name="callback"> Receives the decompressed data, or nullptr </param>
+        /// <param name="compressedSizeOut"> The number of compressed bytes the stream took </param>
+        /// <param name="uncompressedSizeOut"> The number of decompressed bytes </param>
+        /// <param name="crc32Out"> The crc32 of the decompressed bytes </param>
+        void InflateEntryData(uint64_t inputLimit, const DataCallback& callback, uint64_t& compressedSizeOut, uint64_t& uncompressedSizeOut, uint32_t& crc32Out)
+        {
+            const CompressionMethod compressionMethod = _entry.compressionMethod;
+
+            std::unique_ptr<DecompressionCodec>& codec = _codecs[compressionMethod];
+
+            if (codec == nullptr)
+                codec = CodecRegistry::GetDefault().Create(compressionMethod);
+
+            // Behind a data descriptor the size isn't known yet, the stream then has to end by itself.
+            // LZMA entries say in their flags whether their stream ends with an end marker
+            CodecStreamInfo streamInfo;
+            streamInfo.uncompressedSize = (HasDataDescriptor() == true) ? UINT64_MAX : _entry.uncompressedSize;
+            streamInfo.generalPurposeBitFlag = _entry.generalPurposeBitFlag;
+
+            codec->Reset(streamInfo);
+
+            compressedSizeOut = 0;
+            uncompressedSizeOut = 0;
+            crc32Out = 0;
+
+            int result = Z_OK;
+
+            while (result != Z_STREAM_END)
+            {
+                // Once every compressed byte was handed over the decoder may still hold output, without any it fails with Z_BUF_ERROR
+                if ((compressedSizeOut != inputLimit) && (FillBuffer(1) == false))
+                    throw std::exception("Unexpected end of zip");
+
+                // Never hand zlib the bytes that follow the entry, the rest of the buffer belongs to the next header
+                const size_t inputSize = static_cast<size_t>(std::min<uint64_t>(GetBufferedSize(), inputLimit - compressedSizeOut));
+
+                _stream.next_in = const_cast<Bytef*>(GetBufferedData());
+                _stream.avail_in = static_cast<uInt>(inputSize);
+
+                _stream.next_out = _outputBuffer.data();
+                _stream.avail_out = static_cast<uInt>(_outputBuffer.size());
+
+                result = codec->Decode(_stream);
+
+                if ((result != Z_OK) && (result != Z_STREAM_END))
+                    throw std::exception("Failed to decompress file");
+
+                const size_t inputUsed = inputSize - _stream.avail_in;
+                const size_t outputSize = _outputBuffer.size() - _stream.avail_out;
+
+                Consume(inputUsed);
+                compressedSizeOut += inputUsed;
+
+                if (outputSize == 0)
+                    continue;
+
+                crc32Out = Utilities::Crc32(crc32Out, _outputBuffer.data(), outputSize);
+                uncompressedSizeOut += outputSize;
+
+                if (callback)
+                    callback(std::span<const uint8_t>(_outputBuffer.data(), outputSize));
+            };
+        };
+
+
+        /// <summary>
+        /// Reads the data descriptor at the current offset, takes the entry's crc32 from it and moves past it
+        /// </summary>
+        /// <param name="compressedSize"> The entry's compressed size as it was read </param>
+        /// <param name="uncompressedSize"> The entry's decompressed size as it was read </param>
+        void ReadDataDescriptor(uint64_t compressedSize, uint64_t uncompressedSize)
+        {
+            // The signature is optional
+            if ((FillBuffer(4) == true) && (Utilities::ReadUInt32(GetBufferedData()) == PK_DATA_DESCRIPTOR_SIGNATURE_LITTLE_ENDIAN))
+                Consume(4);
+
+            FillBuffer(MAX_DATA_DESCRIPTOR_SIZE - 4);
+
+            const uint8_t* const descriptor = GetBufferedData();
+            const uint64_t available = GetBufferedSize();
+
+            // ZIP64 entries have 64-bit sizes, but not every zipper agrees on when an entry counts as a ZIP64 one, so both layouts are tried
+            uint64_t descriptorSize = MatchDataDescriptor(descriptor, available, _isZip64, compressedSize, uncompressedSize);
+
+            if (descriptorSize == 0)
+                descriptorSize = MatchDataDescriptor(descriptor, available, !_isZip64, compressedSize, uncompressedSize);
+
+            if (descriptorSize == 0)
+                throw std::exception("Invalid data descriptor");
+
+            _entry.crc32 = Utilities::ReadUInt32(descriptor);
+
+            Consume(static_cast<size_t>(descriptorSize));
+        };
+
+
+        /// <summary>
+        /// Reads the central directory that follows the File headers and checks every entry that was read against it
+        /// </summary>
+        void Finish()
+        {
+            _isFinished = true;
+
+            // Central directories are matched to the read entries by their File header offset
+            std::unordered_map<uint64_t, size_t> readEntryIndices;
+
+            for (size_t entryIndex = 0; entryIndex < _readEntries.size(); entryIndex++)
+                readEntryIndices[_readEntries[entryIndex].fileHeaderOffset] = entryIndex;
+
+            std::vector<bool> isListed(_readEntries.size(), false);
+            std::vector<UnvalidatedEntry> centralDirectoryIssues;
+
+            while ((FillBuffer(4) == true) && (Utilities::ReadUInt32(GetBufferedData()) == static_cast<uint32_t>(PK_CENTRAL_DIRECTORY_SIGNATURE_LITTLE_ENDIAN)))
+            {
+                if (FillBuffer(CENTRAL_DIRECTORY_SIZE) == false)
+                    break;
+
+                const uint16_t filenameLength = Utilities::ReadUInt16(&GetBufferedData()[28]);
+                const uint16_t extraFieldLength = Utilities::ReadUInt16(&GetBufferedData()[30]);
+                const uint16_t commentLength = Utilities::ReadUInt16(&GetBufferedData()[32]);
+
+                const size_t centralDirectoryLength = CENTRAL_DIRECTORY_SIZE + filenameLength + extraFieldLength + commentLength;
+
+                if (FillBuffer(centralDirectoryLength) == false)
+                    break;
+
+                const uint8_t* const centralDirectory = GetBufferedData();
+
+                EntryInfo listedEntry;
+
+                listedEntry.compressionMethod = static_cast<CompressionMethod>(Utilities::ReadUInt16(&centralDirectory[10]));
+                listedEntry.crc32 = Utilities::ReadUInt32(&centralDirectory[16]);
+                listedEntry.filename.assign(reinterpret_cast<const char*>(&centralDirectory[CENTRAL_DIRECTORY_SIZE]), filenameLength);
+
+                Utilities::ReadCentralDirectorySizes(centralDirectory, listedEntry.compressedSize, listedEntry.uncompressedSize, listedEntry.fileHeaderOffset);
+
+                Consume(centralDirectoryLength);
+
+                auto readEntryIterator = readEntryIndices.find(listedEntry.fileHeaderOffset);
+
+                if (readEntryIterator == readEntryIndices.end())
+                {
+                    centralDirectoryIssues.push_back(UnvalidatedEntry { listedEntry.filename, listedEntry.fileHeaderOffset, EntryValidationIssue::NotInStream });
+                    continue;
+                };
+
+                const EntryInfo& readEntry = _readEntries[readEntryIterator->second];
+                isListed[readEntryIterator->second] = true;
+
+                if ((readEntry.filename != listedEntry.filename) ||
+                    (readEntry.compressionMethod != listedEntry.compressionMethod) ||
+                    (readEntry.crc32 != listedEntry.crc32) ||
+                    (readEntry.compressedSize != listedEntry.compressedSize) ||
+                    (readEntry.uncompressedSize != listedEntry.uncompressedSize))
+                    centralDirectoryIssues.push_back(UnvalidatedEntry { readEntry.filename, readEntry.fileHeaderOffset, EntryValidationIssue::CentralDirectoryMismatch });
+            };
+
+            // A complete central directory is followed by the (ZIP64) End central directory
+            _hasCentralDirectory = (GetBufferedSize() >= 4) &&
+                                   ((Utilities::ReadUInt32(GetBufferedData()) == PK_END_OF_CENTRAL_DIRECTORY_LITTLE_ENDIAN) ||
+                                    (Utilities::ReadUInt32(GetBufferedData()) == PK_ZIP64_END_OF_CENTRAL_DIRECTORY_LITTLE_ENDIAN));
+
+            if (_hasCentralDirectory == false)
+            {
+                for (const EntryInfo& readEntry : _readEntries)
+                    _unvalidatedEntries.push_back(UnvalidatedEntry { readEntry.filename, readEntry.fileHeaderOffset, EntryValidationIssue::NoCentralDirectory });
+
+                return;
+            };
+
+            _unvalidatedEntries = std::move(centralDirectoryIssues);
+
+            for (size_t entryIndex = 0; entryIndex < _readEntries.size(); entryIndex++)
+            {
+                if (isListed[entryIndex] == false)
+                    _unvalidatedEntries.push_back(UnvalidatedEntry { _readEntries[entryIndex].filename, _readEntries[entryIndex].fileHeaderOffset, EntryValidationIssue::NotInCentralDirectory });
+            };
+        };
+
+
+        /// <summary>
+        /// Checks if a data descriptor, without it's signature, holds the given sizes
+        /// </summary>
+        /// <param name="descriptor"> A pointer to the data descriptor's crc32 </param>
+        /// <param name="available"> The number of readable bytes at descriptor </param>
+        /// <param name="isZip64"> True to read 64-bit sizes </param>
+        /// <param name="compressedSize"> The expected compressed size </param>
+        /// <param name="uncompressedSize"> The expected decompressed size </param>
+        /// <returns> The data descriptor's size without it's signature, or 0 if it doesn't match </returns>
+        static uint64_t MatchDataDescriptor(const uint8_t* descriptor, uint64_t available, bool isZip64, uint64_t compressedSize, uint64_t uncompressedSize)
+        {
+            uint64_t descriptorCompressedSize = 0;
+            uint64_t descriptorUncompressedSize = 0;
+
+            const uint64_t descriptorSize = ReadDataDescriptorSizes(descriptor, available, isZip64, descriptorCompressedSize, descriptorUncompressedSize);
+
+            if ((descriptorCompressedSize != compressedSize) || (descriptorUncompressedSize != uncompressedSize))
+                return 0;
+
+            return descriptorSize;
+        };
+
+
+        /// <summary>
+        /// Reads the sizes of a data descriptor with the given layout
+        /// </summary>
+        /// <param name="descriptor"> A pointer to the data descriptor's crc32 </param>
+        /// <param name="available"> The number of readable bytes at descriptor </param>
+        /// <param name="isZip64"> True to read 64-bit sizes </param>
+        /// <param name="compressedSizeOut"> The compressed size the data descriptor holds </param>
+        /// <param name="uncompressedSizeOut"> The decompressed size the data descriptor holds </param>
+        /// <returns> The data descriptor's size without it's signature, or 0 if it isn't entirely available </returns>
+        static uint64_t ReadDataDescriptorSizes(const uint8_t* descriptor, uint64_t available, bool isZip64, uint64_t& compressedSizeOut, uint64_t& uncompressedSizeOut)
+        {
+            const uint64_t descriptorSize = (isZip64 == true) ? 20 : 12;
+
+            if (available < descriptorSize)
+                return 0;
+
+            compressedSizeOut = (isZip64 == true) ? Utilities::ReadUInt64(&descriptor[4]) : Utilities::ReadUInt32(&descriptor[4]);
+            uncompressedSizeOut = (isZip64 == true) ? Utilities::ReadUInt64(&descriptor[12]) : Utilities::ReadUInt32(&descriptor[8]);
+
+            return descriptorSize;
+        };
+
+
+        /// <summary>
+        /// Checks if an extra field contains a ZIP64 extra field
+        /// </summary>
+        static bool HasZip64ExtraField(const uint8_t* extraField, uint16_t extraFieldLength)
+        {
+            size_t extraFieldOffset = 0;
+
+            // The extra field is a list of (header ID, data size, data) blocks
+            while ((extraFieldOffset + 4) <= extraFieldLength)
+            {
+                if (Utilities::ReadUInt16(&extraField[extraFieldOffset]) == ZIP64_EXTRA_FIELD_ID)
+                    return true;
+
+                extraFieldOffset += 4 + static_cast<size_t>(Utilities::ReadUInt16(&extraField[extraFieldOffset + 2]));
+            };
+
+            return false;
+        };
+
+    };
+
+};
@@ -0,0 +1,196 @@
+#pragma once
+#include <span>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+
+#include "ZipInputSource.h"
+
+#ifndef _WIN32
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+
+namespace ZipExtractor
+{
+
+    /// <summary>
+    /// A source over a zip file that is still being written, for example by a download that is still running.
+    /// Reads never see the end of the file while the writer is active, they wait for the file to grow instead,
+    /// so a ForwardZipReader extracts each entry as soon as it's bytes land and the download and the extraction overlap.
+    /// On Linux the waiting is driven by inotify, with a periodic poll as a fallback for file systems that don't report changes
+    /// </summary>
+    class GrowingFileInputSource : public IZipInputSource
+    {
+
+    public:
+
+        // The longest a wait for new bytes sleeps before the file is checked again, even without a change notification
+        static constexpr std::chrono::milliseconds POLL_INTERVAL { 50 };
+
+
+    private:
+
+        const std::filesystem::path _path;
+
+        // How long the file may stop growing before the writer is assumed to be gone
+        const std::chrono::milliseconds _idleTimeout;
+
+        std::ifstream _file;
+
+        // Set by the writer's side once the file is complete, the rest of the file is then read without waiting
+        std::atomic<bool> _isComplete = false;
+
+#ifndef _WIN32
+        int _inotifyDescriptor = -1;
+#endif
+
+
+    public:
+
+        /// <summary>
+        /// Creates a source over a file that is still being written, the file doesn't have to exist yet
+        /// </summary>
+        /// <param name="path"> The path to the zip file </param>
+        /// <param name="idleTimeout"> How long the file may stop growing, or not exist, before the source ends </param>
+        explicit GrowingFileInputSource(const std::filesystem::path& path, std::chrono::milliseconds idleTimeout = std::chrono::seconds(30)) :
+            _path(path),
+            _idleTimeout(idleTimeout)
+        {
+        };
+
+        ~GrowingFileInputSource()
+        {
+#ifndef _WIN32
+            if (_inotifyDescriptor != -1)
+                close(_inotifyDescriptor);
+#endif
+        };
+
+        GrowingFileInputSource(const GrowingFileInputSource&) = delete;
+        GrowingFileInputSource& operator = (const GrowingFileInputSource&) = delete;
+
+
+        /// <summary>
+        /// Marks the file as complete, reads stop waiting once they reach it's end.
+        /// Safe to call from the writer's thread
+        /// </summary>
+        void SetComplete()
+        {
+            _isComplete = true;
+        };
+
+
+        /// <summary>
+        /// Read the next bytes, waiting for the file to grow while it's still being written
+        /// </summary>
+        /// <param name="destination"> A buffer that will contain the read bytes </param>
+        /// <returns> The number of bytes read, 0 once the file is complete or stopped growing for longer than the idle timeout </returns>
+        size_t Read(std::span<uint8_t> destination) override
+        {
+            const std::chrono::steady_clock::time_point idleStart = std::chrono::steady_clock::now();
+
+            while (true)
+            {
+                // Checked before reading, bytes written before the file was marked complete are then never missed
+                const bool wasComplete = _isComplete;
+
+                if (OpenFile() == true)
+                {
+                    _file.read(reinterpret_cast<char*>(destination.data()), static_cast<std::streamsize>(destination.size()));
+
+                    const size_t readSize = static_cast<size_t>(_file.gcount());
+
+                    if (_file.bad() == true)
+                        throw std::exception("Error reading zip file");
+
+                    // Reaching the end sets eof, which has to be cleared before the file can be read again once it grew
+                    _file.clear();
+
+                    if (readSize != 0)
+                        return readSize;
+                };
+
+                if (wasComplete == true)
+                    return 0;
+
+                const std::chrono::milliseconds idleTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - idleStart);
+
+                if (idleTime >= _idleTimeout)
+                    return 0;
+
+                WaitForChange(std::min(_idleTimeout - idleTime, std::chrono::milliseconds(POLL_INTERVAL)));
+            };
+        };
+
+
+    private:
+
+        /// <summary>
+        /// Opens the file once it exists, and starts watching it for changes
+        /// </summary>
+        /// <returns> True if the file is open </returns>
+        bool OpenFile()
+        {
+            if (_file.is_open() == true)
+                return true;
+
+            _file.open(_path, std::ios::binary);
+
+            if (_file.is_open() == false)
+            {
+                _file.clear();
+                return false;
+            };
+
+#ifndef _WIN32
+            _inotifyDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+            // Without inotify the file is simply polled
+            if ((_inotifyDescriptor != -1) && (inotify_add_watch(_inotifyDescriptor, _path.c_str(), IN_MODIFY | IN_CLOSE_WRITE) == -1))
+            {
+                close(_inotifyDescriptor);
+                _inotifyDescriptor = -1;
+            };
+#endif
+
+            return true;
+        };
+
+
+        /// <summary>
+        /// Waits until the file changed or the timeout passed, whichever comes first
+        /// </summary>
+        void WaitForChange(std::chrono::milliseconds timeout)
+        {
+#ifndef _WIN32
+            if (_inotifyDescriptor != -1)
+            {
+                pollfd pollDescriptor { _inotifyDescriptor, POLLIN, 0 };
+
+                if (poll(&pollDescriptor, 1, static_cast<int>(timeout.count())) > 0)
+                {
+                    // Only the wake up matters, the events themselves are drained and dropped
+                    alignas(inotify_event) char events[4096];
+
+                    while (read(_inotifyDescriptor, events, sizeof(events)) > 0)
+                    {
+                    };
+                };
+
+                return;
+            };
+#endif
+
+            std::this_thread::sleep_for(timeout);
+        };
+
+    };
+
+};
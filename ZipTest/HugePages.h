@@ -0,0 +1,223 @@
+#pragma once
+#include <new>
+#include <cstdint>
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+
+namespace ZipExtractor
+{
+
+    // How memory is backed by huge pages, both as a request and as what was actually achieved
+    enum class HugePageMode
+    {
+        // Regular pages
+        None,
+
+        // Regular memory that the OS is asked to back with huge pages when it can (madvise(MADV_HUGEPAGE) on Linux)
+        Transparent,
+
+        // Memory allocated from the OS's reserved huge page pool (MAP_HUGETLB on Linux, MEM_LARGE_PAGES on Windows)
+        Explicit,
+    };
+
+
+    namespace Utilities
+    {
+
+        /// <summary>
+        /// Get the size of a single huge page
+        /// </summary>
+        inline size_t GetHugePageSize()
+        {
+#ifdef _WIN32
+            const size_t largePageMinimum = GetLargePageMinimum();
+
+            return (largePageMinimum != 0) ? largePageMinimum : 2 * 1024 * 1024;
+#else
+            return 2 * 1024 * 1024;
+#endif
+        };
+
+
+        /// <summary>
+        /// Round a size up to a whole number of huge pages
+        /// </summary>
+        inline size_t RoundUpToHugePages(size_t size)
+        {
+            const size_t hugePageSize = GetHugePageSize();
+
+            return ((size + hugePageSize - 1) / hugePageSize) * hugePageSize;
+        };
+
+
+#ifdef _WIN32
+        /// <summary>
+        /// Large pages can only be allocated by a process that holds SeLockMemoryPrivilege, and it has to be enabled first.
+        /// Only done once per process
+        /// </summary>
+        /// <returns> True if the privilege is enabled </returns>
+        inline bool EnableLockMemoryPrivilege()
+        {
+            static const bool isEnabled = []()
+            {
+                HANDLE tokenHandle = nullptr;
+
+                if (OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &tokenHandle) == FALSE)
+                    return false;
+
+                TOKEN_PRIVILEGES privileges { };
+                privileges.PrivilegeCount = 1;
+                privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+                bool adjusted = false;
+
+                if (LookupPrivilegeValueW(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) == TRUE)
+                {
+                    // AdjustTokenPrivileges succeeds even when the privilege isn't held, GetLastError tells them apart
+                    adjusted = (AdjustTokenPrivileges(tokenHandle, FALSE, &privileges, 0, nullptr, nullptr) == TRUE) &&
+                               (GetLastError() == ERROR_SUCCESS);
+                };
+
+                CloseHandle(tokenHandle);
+
+                return adjusted;
+            }();
+
+            return isEnabled;
+        };
+#endif
+
+
+        /// <summary>
+        /// Allocates memory straight from the OS, backed by huge pages if possible.
+        /// Falls back from Explicit to Transparent to regular pages, so this only fails if the OS is out of memory.
+        /// The memory is uninitialized and must be released with FreeHugePages
+        /// </summary>
+        /// <param name="size"> The number of bytes needed, rounded up to whole huge pages </param>
+        /// <param name="requestedMode"> The backing to try first </param>
+        /// <param name="achievedModeOut"> The backing that was actually used </param>
+        /// <returns> The allocated memory </returns>
+        inline void* AllocateHugePages(size_t size, HugePageMode requestedMode, HugePageMode& achievedModeOut)
+        {
+            const size_t allocationSize = RoundUpToHugePages(size);
+
+#ifdef _WIN32
+            if ((requestedMode == HugePageMode::Explicit) && (EnableLockMemoryPrivilege() == true))
+            {
+                void* memory = VirtualAlloc(nullptr, allocationSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+
+                if (memory != nullptr)
+                {
+                    achievedModeOut = HugePageMode::Explicit;
+                    return memory;
+                };
+            };
+
+            // Windows has no transparent huge pages, regular pages are the only fallback
+            void* memory = VirtualAlloc(nullptr, allocationSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+
+            if (memory == nullptr)
+                throw std::bad_alloc();
+
+            achievedModeOut = HugePageMode::None;
+            return memory;
+#else
+            if (requestedMode == HugePageMode::Explicit)
+            {
+                // Fails when no huge pages were reserved through /proc/sys/vm/nr_hugepages
+                void* memory = mmap(nullptr, allocationSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+                if (memory != MAP_FAILED)
+                {
+                    achievedModeOut = HugePageMode::Explicit;
+                    return memory;
+                };
+            };
+
+            const size_t hugePageSize = GetHugePageSize();
+
+            // Transparent huge pages only back huge page aligned ranges, so map an extra page and trim the unaligned ends
+            const size_t mappingSize = allocationSize + hugePageSize;
+
+            void* mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+            if (mapping == MAP_FAILED)
+                throw std::bad_alloc();
+
+            const uintptr_t mappingStart = reinterpret_cast<uintptr_t>(mapping);
+            const uintptr_t alignedStart = (mappingStart + hugePageSize - 1) & ~(static_cast<uintptr_t>(hugePageSize) - 1);
+
+            if (alignedStart != mappingStart)
+                munmap(mapping, alignedStart - mappingStart);
+
+            const uintptr_t alignedEnd = alignedStart + allocationSize;
+            const uintptr_t mappingEnd = mappingStart + mappingSize;
+
+            if (mappingEnd != alignedEnd)
+                munmap(reinterpret_cast<void*>(alignedEnd), mappingEnd - alignedEnd);
+
+            void* memory = reinterpret_cast<void*>(alignedStart);
+
+            achievedModeOut = HugePageMode::None;
+
+            if ((requestedMode != HugePageMode::None) && (madvise(memory, allocationSize, MADV_HUGEPAGE) == 0))
+                achievedModeOut = HugePageMode::Transparent;
+
+            return memory;
+#endif
+        };
+
+
+        /// <summary>
+        /// Releases memory that was allocated by AllocateHugePages
+        /// </summary>
+        /// <param name="memory"> The allocated memory </param>
+        /// <param name="size"> The size that was passed to AllocateHugePages </param>
+        inline void FreeHugePages(void* memory, size_t size)
+        {
+            if (memory == nullptr)
+                return;
+
+#ifdef _WIN32
+            VirtualFree(memory, 0, MEM_RELEASE);
+#else
+            munmap(memory, RoundUpToHugePages(size));
+#endif
+        };
+
+
+        /// <summary>
+        /// Asks the OS to back an existing mapping with transparent huge pages.
+        /// On Linux read-only file mappings are only collapsed into huge pages by kernels built with CONFIG_READ_ONLY_THP_FOR_FS,
+        /// Windows can't back file mappings with large pages at all
+        /// </summary>
+        /// <param name="memory"> The start of the mapping </param>
+        /// <param name="size"> The size of the mapping </param>
+        /// <returns> Transparent if the OS accepted the advice, None otherwise </returns>
+        inline HugePageMode AdviseHugePages(const void* memory, size_t size)
+        {
+#ifdef _WIN32
+            return HugePageMode::None;
+#else
+            if (madvise(const_cast<void*>(memory), size, MADV_HUGEPAGE) == 0)
+                return HugePageMode::Transparent;
+
+            return HugePageMode::None;
+#endif
+        };
+
+    };
+
+};
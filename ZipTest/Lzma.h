@@ -0,0 +1,1009 @@
+#pragma once
+#include <array>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "deflate.h"
+
+
+namespace ZipExtractor
+{
+
+    /// <summary>
+    /// A decoder for LZMA (zip compression method 14), as written by 7-Zip and WinZip.
+    /// Implements the range coder and the literal, length and distance models of the LZMA specification,
+    /// and reads the header zip puts in front of the LZMA data (the version of the LZMA SDK, the size of the properties and the properties themselves).
+    /// Works on a z_stream with the same contract as inflate(Z_NO_FLUSH) on a raw stream, so it drops into any loop written for zlib:
+    /// every call consumes as much input and produces as much output as it can, and input after the end of the stream is left untouched
+    /// </summary>
+    class LzmaDecoder
+    {
+
+    public:
+
+        // Passed as the uncompressed size when it isn't known, the stream then has to end with an end marker
+        static constexpr uint64_t UNKNOWN_SIZE = UINT64_MAX;
+
+        // The longest match
+        static constexpr uint32_t MAX_MATCH_LENGTH = 273;
+
+
+    private:
+
+        // Zip's header: the LZMA SDK's major and minor version, the size of the properties, and the properties
+        static constexpr size_t ZIP_HEADER_SIZE = 4;
+        static constexpr size_t PROPERTIES_SIZE = 5;
+
+        // The range coder starts with a zero byte and the first 32 bits of the code
+        static constexpr size_t RANGE_CODER_INIT_SIZE = 5;
+
+        static constexpr size_t HEADER_SIZE = ZIP_HEADER_SIZE + PROPERTIES_SIZE + RANGE_CODER_INIT_SIZE;
+
+        // The most input a single literal or match can take, symbols are only decoded without input checks while this much is left
+        static constexpr size_t REQUIRED_INPUT_MAX = 20;
+
+        // The most probabilities a single symbol updates, a match takes up to 23
+        static constexpr size_t MAX_PROBABILITY_UPDATES = 32;
+
+        static constexpr uint32_t RANGE_TOP = 1 << 24;
+
+        // Probabilities are 11 bit fixed point numbers, that move by 1/32 of the distance to 0 or 1 after every bit
+        static constexpr unsigned PROBABILITY_BITS = 11;
+        static constexpr unsigned PROBABILITY_MOVE_BITS = 5;
+        static constexpr uint16_t PROBABILITY_INITIAL = (1 << PROBABILITY_BITS) / 2;
+
+        static constexpr unsigned STATE_COUNT = 12;
+
+        // The first state after a match, every state from here on follows a match instead of a literal
+        static constexpr unsigned FIRST_MATCH_STATE = 7;
+
+        static constexpr unsigned MAX_POSITION_BITS = 4;
+        static constexpr unsigned POSITION_STATE_COUNT = 1 << MAX_POSITION_BITS;
+
+        static constexpr unsigned LITERAL_CODER_SIZE = 0x300;
+
+        static constexpr unsigned MATCH_MIN_LENGTH = 2;
+
+        static constexpr unsigned LENGTH_LOW_BITS = 3;
+        static constexpr unsigned LENGTH_MID_BITS = 3;
+        static constexpr unsigned LENGTH_HIGH_BITS = 8;
+
+        // Distances are coded with a 6 bit slot, picked by the match's length
+        static constexpr unsigned LENGTH_TO_POSITION_STATES = 4;
+        static constexpr unsigned POSITION_SLOT_BITS = 6;
+
+        // Slots below this one code their low bits with probabilities, the ones above with direct bits and 4 align bits
+        static constexpr unsigned END_POSITION_MODEL_INDEX = 14;
+        static constexpr unsigned FULL_DISTANCES = 128;
+        static constexpr unsigned ALIGN_BITS = 4;
+
+        // The distance of the end marker
+        static constexpr uint32_t END_MARKER_DISTANCE = 0xFFFFFFFF;
+
+        static constexpr uint32_t MIN_DICTIONARY_SIZE = 4096;
+
+        // The decoded bytes that didn't fit into the caller's buffer yet are kept in the dictionary on top of the history
+        static constexpr size_t DICTIONARY_SLACK = 256 * 1024;
+
+
+        struct LengthModel
+        {
+            uint16_t choice = PROBABILITY_INITIAL;
+            uint16_t choice2 = PROBABILITY_INITIAL;
+
+            std::array<std::array<uint16_t, 1 << LENGTH_LOW_BITS>, POSITION_STATE_COUNT> low { };
+            std::array<std::array<uint16_t, 1 << LENGTH_MID_BITS>, POSITION_STATE_COUNT> mid { };
+            std::array<uint16_t, 1 << LENGTH_HIGH_BITS> high { };
+        };
+
+
+        // Every probability except the literals', whose number depends on the properties
+        struct Model
+        {
+            std::array<std::array<uint16_t, POSITION_STATE_COUNT>, STATE_COUNT> isMatch { };
+            std::array<uint16_t, STATE_COUNT> isRep { };
+            std::array<uint16_t, STATE_COUNT> isRepG0 { };
+            std::array<uint16_t, STATE_COUNT> isRepG1 { };
+            std::array<uint16_t, STATE_COUNT> isRepG2 { };
+            std::array<std::array<uint16_t, POSITION_STATE_COUNT>, STATE_COUNT> isRep0Long { };
+
+            std::array<std::array<uint16_t, 1 << POSITION_SLOT_BITS>, LENGTH_TO_POSITION_STATES> positionSlot { };
+            std::array<uint16_t, 1 + FULL_DISTANCES - END_POSITION_MODEL_INDEX> positionSpecial { };
+            std::array<uint16_t, 1 << ALIGN_BITS> align { };
+
+            LengthModel length;
+            LengthModel repLength;
+        };
+
+
+        // Where the decoder stopped, every state can be resumed once more input arrives
+        enum class State
+        {
+            Header,
+            Symbols,
+            Done,
+            Error,
+        };
+
+
+        enum class SymbolKind
+        {
+            Literal,
+            Match,
+            EndMarker,
+            Invalid,
+        };
+
+
+        // A probability's value before a symbol that ran out of input changed it
+        struct ProbabilityUpdate
+        {
+            uint16_t* probability = nullptr;
+            uint16_t value = 0;
+        };
+
+
+    private:
+
+        // Decoded bytes go into the dictionary and are copied out of it into the caller's buffer.
+        // A caller that provides a buffer for the whole stream has it used as the dictionary directly
+        uint8_t* _dictionary = nullptr;
+        size_t _dictionaryCapacity = 0;
+        bool _isDictionaryExternal = false;
+
+        // Allocated by the first stream that needs it, and kept for the next ones
+        std::unique_ptr<uint8_t[]> _ownedDictionary;
+        size_t _ownedDictionaryCapacity = 0;
+
+        // Where the next byte is written, and where the next byte is copied out from
+        size_t _dictionaryIndex = 0;
+        size_t _flushIndex = 0;
+
+        // The number of bytes decoded so far, and how many of them were copied out to the caller
+        uint64_t _totalPosition = 0;
+        uint64_t _flushedPosition = 0;
+
+        uint64_t _uncompressedSize = UNKNOWN_SIZE;
+        bool _hasEndMarker = false;
+
+        State _state = State::Header;
+
+        std::array<uint8_t, HEADER_SIZE> _header { };
+        size_t _headerSize = 0;
+
+        // The properties
+        unsigned _literalContextBits = 0;
+        unsigned _literalPositionMask = 0;
+        unsigned _positionMask = 0;
+        uint32_t _dictionarySize = 0;
+
+        Model _model;
+        std::vector<uint16_t> _literalProbabilities;
+
+        uint32_t _range = 0;
+        uint32_t _code = 0;
+
+        // The kinds of the last few symbols, and the last four match distances (minus 1)
+        unsigned _sequenceState = 0;
+        uint32_t _rep0 = 0;
+        uint32_t _rep1 = 0;
+        uint32_t _rep2 = 0;
+        uint32_t _rep3 = 0;
+
+        // The input the range coder reads from, either the caller's buffer or the pending input
+        const uint8_t* _input = nullptr;
+        const uint8_t* _inputEnd = nullptr;
+        bool _isInputOverrun = false;
+
+        // The end of the caller's input, which may be split between two calls, is collected here before it's decoded
+        std::array<uint8_t, REQUIRED_INPUT_MAX> _pendingInput { };
+        size_t _pendingInputSize = 0;
+
+        // Filled while a symbol is decoded from the pending input, so it can be undone if the input runs out in it's middle
+        std::array<ProbabilityUpdate, MAX_PROBABILITY_UPDATES> _probabilityUpdates { };
+        size_t _probabilityUpdateCount = 0;
+
+        // The last decoded symbol
+        uint8_t _literal = 0;
+        uint32_t _matchLength = 0;
+
+
+    public:
+
+        LzmaDecoder() = default;
+
+        LzmaDecoder(const LzmaDecoder&) = delete;
+        LzmaDecoder& operator = (const LzmaDecoder&) = delete;
+
+
+        /// <summary>
+        /// Prepares the decoder for a new stream
+        /// </summary>
+        /// <param name="uncompressedSize"> The size of the decompressed data, or UNKNOWN_SIZE </param>
+        /// <param name="hasEndMarker"> True if the stream ends with an end marker, which zip flags with general purpose bit 1 </param>
+        /// <param name="outputBuffer"> Optional, a buffer for the whole decompressed data that every call's next_out points into.
+        /// It's used as the dictionary, so nothing is allocated or copied </param>
+        void Reset(uint64_t uncompressedSize, bool hasEndMarker, uint8_t* outputBuffer = nullptr)
+        {
+            _uncompressedSize = uncompressedSize;
+            _hasEndMarker = hasEndMarker || (uncompressedSize == UNKNOWN_SIZE);
+
+            _isDictionaryExternal = (outputBuffer != nullptr) && (uncompressedSize != UNKNOWN_SIZE);
+
+            if (_isDictionaryExternal == true)
+            {
+                _dictionary = outputBuffer;
+                _dictionaryCapacity = static_cast<size_t>(uncompressedSize);
+            };
+
+            _dictionaryIndex = 0;
+            _flushIndex = 0;
+
+            _totalPosition = 0;
+            _flushedPosition = 0;
+
+            _state = State::Header;
+            _headerSize = 0;
+            _pendingInputSize = 0;
+        };
+
+
+        /// <summary>
+        /// Decodes as much of the stream as the input and output buffers allow.
+        /// Only next_in, avail_in, total_in, next_out, avail_out and total_out of the stream are used
+        /// </summary>
+        /// <param name="stream"> The input and output buffers </param>
+        /// <returns> Z_STREAM_END once the whole stream was decoded and copied out, Z_OK after progress,
+        /// Z_BUF_ERROR if no progress was possible and Z_DATA_ERROR for an invalid stream </returns>
+        int Decode(z_stream& stream)
+        {
+            const uInt inputBefore = stream.avail_in;
+            const uInt outputBefore = stream.avail_out;
+
+            bool canContinue = true;
+
+            while (canContinue == true)
+            {
+                // A symbol may need the space of the longest match, the decoded bytes have to be copied out first
+                if (GetDictionarySpace() < GetRequiredSpace())
+                    Flush(stream);
+
+                // The caller's buffer is full
+                if (GetDictionarySpace() < GetRequiredSpace())
+                    break;
+
+                canContinue = Step(stream);
+            };
+
+            Flush(stream);
+
+            if (_state == State::Error)
+                return Z_DATA_ERROR;
+
+            if ((_state == State::Done) && (_totalPosition == _flushedPosition))
+                return Z_STREAM_END;
+
+            if ((stream.avail_in == inputBefore) && (stream.avail_out == outputBefore))
+                return Z_BUF_ERROR;
+
+            return Z_OK;
+        };
+
+
+    private:
+
+        /// <summary>
+        /// Decodes the next part of the stream
+        /// </summary>
+        /// <returns> False if more input is needed, or once the stream ended or turned out to be invalid </returns>
+        bool Step(z_stream& stream)
+        {
+            switch (_state)
+            {
+                case State::Header:
+                    return ReadHeader(stream);
+
+                case State::Symbols:
+                {
+                    // Without an end marker the stream ends with it's last byte, once the range coder is finished
+                    if ((_hasEndMarker == false) && (_totalPosition == _uncompressedSize) && (_code == 0))
+                    {
+                        _state = State::Done;
+                        return false;
+                    };
+
+                    if ((_pendingInputSize == 0) && (stream.avail_in >= REQUIRED_INPUT_MAX))
+                    {
+                        DecodeFast(stream);
+                        return true;
+                    };
+
+                    return DecodeChecked(stream);
+                };
+
+                default:
+                    return false;
+            };
+        };
+
+
+        /// <summary>
+        /// Collects the header and the start of the range coder, which are taken one byte at a time so nothing after them is consumed
+        /// </summary>
+        /// <returns> False if more input is needed or the header is invalid </returns>
+        bool ReadHeader(z_stream& stream)
+        {
+            const size_t copySize = std::min<size_t>(HEADER_SIZE - _headerSize, stream.avail_in);
+
+            memcpy(&_header[_headerSize], stream.next_in, copySize);
+
+            stream.next_in += copySize;
+            stream.avail_in -= static_cast<uInt>(copySize);
+            stream.total_in += copySize;
+
+            _headerSize += copySize;
+
+            if (_headerSize != HEADER_SIZE)
+                return false;
+
+            const uint16_t propertiesSize = static_cast<uint16_t>(_header[2] | _header[3] << 8);
+
+            if (propertiesSize != PROPERTIES_SIZE)
+                return Fail();
+
+            // The first property packs the literal context bits, the literal position bits and the position bits as ((pb * 5 + lp) * 9 + lc)
+            unsigned properties = _header[ZIP_HEADER_SIZE];
+
+            if (properties >= (9 * 5 * 5))
+                return Fail();
+
+            const unsigned literalContextBits = properties % 9;
+            properties /= 9;
+
+            const unsigned literalPositionBits = properties % 5;
+            const unsigned positionBits = properties / 5;
+
+            if (positionBits > MAX_POSITION_BITS)
+                return Fail();
+
+            _literalContextBits = literalContextBits;
+            _literalPositionMask = (1u << literalPositionBits) - 1;
+            _positionMask = (1u << positionBits) - 1;
+
+            _dictionarySize = static_cast<uint32_t>(_header[ZIP_HEADER_SIZE + 1]) |
+                              static_cast<uint32_t>(_header[ZIP_HEADER_SIZE + 2]) << 8 |
+                              static_cast<uint32_t>(_header[ZIP_HEADER_SIZE + 3]) << 16 |
+                              static_cast<uint32_t>(_header[ZIP_HEADER_SIZE + 4]) << 24;
+
+            _dictionarySize = std::max(_dictionarySize, MIN_DICTIONARY_SIZE);
+
+            const uint8_t* rangeCoderInit = &_header[ZIP_HEADER_SIZE + PROPERTIES_SIZE];
+
+            if (rangeCoderInit[0] != 0)
+                return Fail();
+
+            _range = 0xFFFFFFFF;
+            _code = static_cast<uint32_t>(rangeCoderInit[1]) << 24 |
+                    static_cast<uint32_t>(rangeCoderInit[2]) << 16 |
+                    static_cast<uint32_t>(rangeCoderInit[3]) << 8 |
+                    static_cast<uint32_t>(rangeCoderInit[4]);
+
+            if (_code == _range)
+                return Fail();
+
+            InitializeModel(literalContextBits + literalPositionBits);
+            AllocateDictionary();
+
+            _state = State::Symbols;
+
+            return true;
+        };
+
+
+        void InitializeModel(unsigned literalBits)
+        {
+            // The model is a flat block of probabilities, they all start out at one half
+            static_assert(sizeof(Model) % sizeof(uint16_t) == 0);
+
+            std::fill_n(reinterpret_cast<uint16_t*>(&_model), sizeof(Model) / sizeof(uint16_t), PROBABILITY_INITIAL);
+
+            // Resizing keeps the capacity, so only a stream with more literal bits than any before it allocates
+            _literalProbabilities.resize(size_t(LITERAL_CODER_SIZE) << literalBits);
+            std::fill(_literalProbabilities.begin(), _literalProbabilities.end(), PROBABILITY_INITIAL);
+
+            _sequenceState = 0;
+            _rep0 = 0;
+            _rep1 = 0;
+            _rep2 = 0;
+            _rep3 = 0;
+        };
+
+
+        /// <summary>
+        /// Makes sure the owned dictionary can hold the history plus the slack, unless the caller's buffer is used
+        /// </summary>
+        void AllocateDictionary()
+        {
+            if (_isDictionaryExternal == true)
+                return;
+
+            // A match can't reach back before the start of the stream, so a small file doesn't need the whole dictionary
+            uint64_t historySize = _dictionarySize;
+
+            if (_uncompressedSize != UNKNOWN_SIZE)
+                historySize = std::min<uint64_t>(historySize, std::max<uint64_t>(_uncompressedSize, 1));
+
+            const size_t capacity = static_cast<size_t>(historySize) + DICTIONARY_SLACK;
+
+            if (_ownedDictionaryCapacity < capacity)
+            {
+                _ownedDictionary.reset(new uint8_t[capacity]);
+                _ownedDictionaryCapacity = capacity;
+            };
+
+            _dictionary = _ownedDictionary.get();
+            _dictionaryCapacity = capacity;
+        };
+
+
+        /// <summary>
+        /// Decodes symbols straight out of the caller's input until less than REQUIRED_INPUT_MAX bytes are left,
+        /// so the range coder never has to check for the end of the input
+        /// </summary>
+        void DecodeFast(z_stream& stream)
+        {
+            _input = stream.next_in;
+            _inputEnd = stream.next_in + stream.avail_in;
+
+            const uint8_t* const inputLimit = _inputEnd - REQUIRED_INPUT_MAX;
+
+            while ((_input <= inputLimit) && (_state == State::Symbols) && (GetDictionarySpace() >= GetRequiredSpace()))
+            {
+                if ((_hasEndMarker == false) && (_totalPosition == _uncompressedSize) && (_code == 0))
+                    break;
+
+                const SymbolKind symbol = DecodeSymbol<false>();
+
+                ApplySymbol(symbol);
+            };
+
+            const size_t bytesConsumed = static_cast<size_t>(_input - stream.next_in);
+
+            stream.next_in += bytesConsumed;
+            stream.avail_in -= static_cast<uInt>(bytesConsumed);
+            stream.total_in += bytesConsumed;
+        };
+
+
+        /// <summary>
+        /// Decodes a single symbol from the pending input, topped up from the caller's input.
+        /// If the input runs out in the middle of the symbol, every change it made is undone and the input is kept for the next call
+        /// </summary>
+        /// <returns> False if more input is needed, or once the stream ended or turned out to be invalid </returns>
+        bool DecodeChecked(z_stream& stream)
+        {
+            const size_t bytesTaken = std::min<size_t>(REQUIRED_INPUT_MAX - _pendingInputSize, stream.avail_in);
+
+            memcpy(&_pendingInput[_pendingInputSize], stream.next_in, bytesTaken);
+
+            stream.next_in += bytesTaken;
+            stream.avail_in -= static_cast<uInt>(bytesTaken);
+            stream.total_in += bytesTaken;
+
+            _pendingInputSize += bytesTaken;
+
+            const uint32_t range = _range;
+            const uint32_t code = _code;
+            const unsigned sequenceState = _sequenceState;
+            const std::array<uint32_t, 4> reps = { _rep0, _rep1, _rep2, _rep3 };
+
+            _input = _pendingInput.data();
+            _inputEnd = _pendingInput.data() + _pendingInputSize;
+            _isInputOverrun = false;
+            _probabilityUpdateCount = 0;
+
+            const SymbolKind symbol = DecodeSymbol<true>();
+
+            if (_isInputOverrun == true)
+            {
+                while (_probabilityUpdateCount != 0)
+                {
+                    const ProbabilityUpdate& update = _probabilityUpdates[--_probabilityUpdateCount];
+
+                    *update.probability = update.value;
+                };
+
+                _range = range;
+                _code = code;
+                _sequenceState = sequenceState;
+                _rep0 = reps[0];
+                _rep1 = reps[1];
+                _rep2 = reps[2];
+                _rep3 = reps[3];
+
+                return false;
+            };
+
+            const size_t bytesConsumed = static_cast<size_t>(_input - _pendingInput.data());
+            const size_t bytesLeft = _pendingInputSize - bytesConsumed;
+
+            // The unused bytes were all taken from the caller's input in this call, they're handed back so the fast path can take over
+            if (bytesLeft <= bytesTaken)
+            {
+                stream.next_in -= bytesLeft;
+                stream.avail_in += static_cast<uInt>(bytesLeft);
+                stream.total_in -= bytesLeft;
+
+                _pendingInputSize = 0;
+            }
+            else
+            {
+                memmove(_pendingInput.data(), &_pendingInput[bytesConsumed], bytesLeft);
+                _pendingInputSize = bytesLeft;
+            };
+
+            return ApplySymbol(symbol);
+        };
+
+
+        /// <summary>
+        /// Decodes the next literal, match or end marker, and updates the state and the last distances.
+        /// The symbol's bytes are left to ApplySymbol, so a symbol that ran out of input can still be undone
+        /// </summary>
+        template<bool IsChecked>
+        SymbolKind DecodeSymbol()
+        {
+            const unsigned positionState = static_cast<unsigned>(_totalPosition) & _positionMask;
+
+            if (DecodeBit<IsChecked>(_model.isMatch[_sequenceState][positionState]) == 0)
+            {
+                uint16_t* const probabilities = &_literalProbabilities[size_t(LITERAL_CODER_SIZE) * GetLiteralState()];
+
+                unsigned symbol = 1;
+
+                // After a match the literal is coded relative to the byte the last match would have continued with
+                if (_sequenceState >= FIRST_MATCH_STATE)
+                {
+                    unsigned matchByte = GetHistoryByte(_rep0 + 1);
+
+                    do
+                    {
+                        const unsigned matchBit = (matchByte >> 7) & 1;
+                        matchByte <<= 1;
+
+                        const unsigned bit = DecodeBit<IsChecked>(probabilities[((1 + matchBit) << 8) + symbol]);
+                        symbol = (symbol << 1) | bit;
+
+                        if (matchBit != bit)
+                            break;
+                    }
+                    while (symbol < 0x100);
+                };
+
+                while (symbol < 0x100)
+                    symbol = (symbol << 1) | DecodeBit<IsChecked>(probabilities[symbol]);
+
+                _literal = static_cast<uint8_t>(symbol);
+                _sequenceState = (_sequenceState < 4) ? 0 : (_sequenceState < 10) ? (_sequenceState - 3) : (_sequenceState - 6);
+
+                return SymbolKind::Literal;
+            };
+
+            if (DecodeBit<IsChecked>(_model.isRep[_sequenceState]) != 0)
+            {
+                // There's nothing to repeat at the start of the stream
+                if (_totalPosition == 0)
+                    return SymbolKind::Invalid;
+
+                if (DecodeBit<IsChecked>(_model.isRepG0[_sequenceState]) == 0)
+                {
+                    // A single byte at the last distance
+                    if (DecodeBit<IsChecked>(_model.isRep0Long[_sequenceState][positionState]) == 0)
+                    {
+                        _sequenceState = (_sequenceState < FIRST_MATCH_STATE) ? 9 : 11;
+                        _matchLength = 1;
+
+                        return SymbolKind::Match;
+                    };
+                }
+                else
+                {
+                    uint32_t distance = 0;
+
+                    if (DecodeBit<IsChecked>(_model.isRepG1[_sequenceState]) == 0)
+                        distance = _rep1;
+                    else
+                    {
+                        if (DecodeBit<IsChecked>(_model.isRepG2[_sequenceState]) == 0)
+                            distance = _rep2;
+                        else
+                        {
+                            distance = _rep3;
+                            _rep3 = _rep2;
+                        };
+
+                        _rep2 = _rep1;
+                    };
+
+                    _rep1 = _rep0;
+                    _rep0 = distance;
+                };
+
+                _matchLength = DecodeLength<IsChecked>(_model.repLength, positionState) + MATCH_MIN_LENGTH;
+                _sequenceState = (_sequenceState < FIRST_MATCH_STATE) ? 8 : 11;
+
+                return SymbolKind::Match;
+            };
+
+            _rep3 = _rep2;
+            _rep2 = _rep1;
+            _rep1 = _rep0;
+
+            const unsigned length = DecodeLength<IsChecked>(_model.length, positionState);
+
+            _sequenceState = (_sequenceState < FIRST_MATCH_STATE) ? 7 : 10;
+            _rep0 = DecodeDistance<IsChecked>(length);
+
+            if (_rep0 == END_MARKER_DISTANCE)
+                return SymbolKind::EndMarker;
+
+            // A match can't reach back before the start of the stream, or further than the dictionary
+            if ((_rep0 >= _totalPosition) || (_rep0 >= _dictionarySize))
+                return SymbolKind::Invalid;
+
+            _matchLength = length + MATCH_MIN_LENGTH;
+
+            return SymbolKind::Match;
+        };
+
+
+        /// <summary>
+        /// Writes the last decoded symbol into the dictionary, the dictionary must have space for it
+        /// </summary>
+        /// <returns> False once the stream ended or turned out to be invalid </returns>
+        bool ApplySymbol(SymbolKind symbol)
+        {
+            switch (symbol)
+            {
+                case SymbolKind::Literal:
+                {
+                    if (_totalPosition == _uncompressedSize)
+                        return Fail();
+
+                    _dictionary[_dictionaryIndex] = _literal;
+
+                    if (++_dictionaryIndex == _dictionaryCapacity)
+                        _dictionaryIndex = 0;
+
+                    _totalPosition++;
+
+                    return true;
+                };
+
+                case SymbolKind::Match:
+                {
+                    if (_matchLength > (_uncompressedSize - _totalPosition))
+                        return Fail();
+
+                    CopyMatch(_matchLength, _rep0 + 1);
+
+                    return true;
+                };
+
+                case SymbolKind::EndMarker:
+                {
+                    // The range coder ends with a zero code, and a known size has to be reached exactly
+                    if ((_code != 0) || ((_uncompressedSize != UNKNOWN_SIZE) && (_totalPosition != _uncompressedSize)))
+                        return Fail();
+
+                    _state = State::Done;
+
+                    return false;
+                };
+
+                default:
+                    return Fail();
+            };
+        };
+
+
+        template<bool IsChecked>
+        unsigned DecodeBit(uint16_t& probability)
+        {
+            if constexpr (IsChecked == true)
+                _probabilityUpdates[_probabilityUpdateCount++] = { &probability, probability };
+
+            const uint32_t bound = (_range >> PROBABILITY_BITS) * probability;
+
+            unsigned bit = 0;
+
+            if (_code < bound)
+            {
+                _range = bound;
+                probability += static_cast<uint16_t>(((1 << PROBABILITY_BITS) - probability) >> PROBABILITY_MOVE_BITS);
+            }
+            else
+            {
+                _range -= bound;
+                _code -= bound;
+                probability -= static_cast<uint16_t>(probability >> PROBABILITY_MOVE_BITS);
+
+                bit = 1;
+            };
+
+            Normalize<IsChecked>();
+
+            return bit;
+        };
+
+
+        /// <summary>
+        /// Decodes bits with a fixed probability of one half
+        /// </summary>
+        template<bool IsChecked>
+        uint32_t DecodeDirectBits(unsigned count)
+        {
+            uint32_t result = 0;
+
+            while (count-- != 0)
+            {
+                _range >>= 1;
+                _code -= _range;
+
+                // All ones if the code was below the range, which makes the bit a 0
+                const uint32_t mask = 0 - (_code >> 31);
+
+                _code += _range & mask;
+                result = (result << 1) + (mask + 1);
+
+                Normalize<IsChecked>();
+            };
+
+            return result;
+        };
+
+
+        template<bool IsChecked>
+        void Normalize()
+        {
+            if (_range >= RANGE_TOP)
+                return;
+
+            _range <<= 8;
+            _code <<= 8;
+
+            if constexpr (IsChecked == true)
+            {
+                // The symbol is undone anyway, it's only decoded to it's end
+                if (_input == _inputEnd)
+                {
+                    _isInputOverrun = true;
+                    return;
+                };
+            };
+
+            _code |= *_input++;
+        };
+
+
+        /// <summary>
+        /// Decodes a number, most significant bit first, with a probability for every prefix
+        /// </summary>
+        template<bool IsChecked>
+        unsigned DecodeBitTree(uint16_t* probabilities, unsigned bitCount)
+        {
+            unsigned index = 1;
+
+            for (unsigned bit = 0; bit < bitCount; bit++)
+                index = (index << 1) | DecodeBit<IsChecked>(probabilities[index]);
+
+            return index - (1u << bitCount);
+        };
+
+
+        /// <summary>
+        /// Decodes a number, least significant bit first, with a probability for every prefix
+        /// </summary>
+        template<bool IsChecked>
+        unsigned DecodeReverseBitTree(uint16_t* probabilities, unsigned bitCount)
+        {
+            unsigned index = 1;
+            unsigned result = 0;
+
+            for (unsigned bit = 0; bit < bitCount; bit++)
+            {
+                const unsigned decodedBit = DecodeBit<IsChecked>(probabilities[index]);
+
+                index = (index << 1) | decodedBit;
+                result |= decodedBit << bit;
+            };
+
+            return result;
+        };
+
+
+        /// <summary>
+        /// Decodes a match length, minus MATCH_MIN_LENGTH
+        /// </summary>
+        template<bool IsChecked>
+        unsigned DecodeLength(LengthModel& model, unsigned positionState)
+        {
+            if (DecodeBit<IsChecked>(model.choice) == 0)
+                return DecodeBitTree<IsChecked>(model.low[positionState].data(), LENGTH_LOW_BITS);
+
+            if (DecodeBit<IsChecked>(model.choice2) == 0)
+                return (1 << LENGTH_LOW_BITS) + DecodeBitTree<IsChecked>(model.mid[positionState].data(), LENGTH_MID_BITS);
+
+            return (1 << LENGTH_LOW_BITS) + (1 << LENGTH_MID_BITS) + DecodeBitTree<IsChecked>(model.high.data(), LENGTH_HIGH_BITS);
+        };
+
+
+        /// <summary>
+        /// Decodes a match distance, minus 1
+        /// </summary>
+        template<bool IsChecked>
+        uint32_t DecodeDistance(unsigned length)
+        {
+            const unsigned lengthState = std::min(length, LENGTH_TO_POSITION_STATES - 1);
+            const unsigned positionSlot = DecodeBitTree<IsChecked>(_model.positionSlot[lengthState].data(), POSITION_SLOT_BITS);
+
+            if (positionSlot < 4)
+                return positionSlot;
+
+            const unsigned directBitCount = (positionSlot >> 1) - 1;
+            const uint32_t distance = (2 | (positionSlot & 1)) << directBitCount;
+
+            if (positionSlot < END_POSITION_MODEL_INDEX)
+                return distance + DecodeReverseBitTree<IsChecked>(&_model.positionSpecial[distance - positionSlot], directBitCount);
+
+            const uint32_t directBits = DecodeDirectBits<IsChecked>(directBitCount - ALIGN_BITS) << ALIGN_BITS;
+
+            return distance + directBits + DecodeReverseBitTree<IsChecked>(_model.align.data(), ALIGN_BITS);
+        };
+
+
+        /// <summary>
+        /// Get the literal coder for the next byte, picked by it's position and the high bits of the previous byte
+        /// </summary>
+        size_t GetLiteralState() const
+        {
+            const unsigned previousByte = (_totalPosition != 0) ? GetHistoryByte(1) : 0;
+
+            return ((static_cast<unsigned>(_totalPosition) & _literalPositionMask) << _literalContextBits) + (previousByte >> (8 - _literalContextBits));
+        };
+
+
+        /// <summary>
+        /// Get a byte that was already decoded
+        /// </summary>
+        /// <param name="distance"> How far back the byte is, at least 1 </param>
+        uint8_t GetHistoryByte(size_t distance) const
+        {
+            const size_t index = (_dictionaryIndex >= distance) ? (_dictionaryIndex - distance) : (_dictionaryIndex + _dictionaryCapacity - distance);
+
+            return _dictionary[index];
+        };
+
+
+        /// <summary>
+        /// Copies a match from the history to the end of the dictionary, the dictionary must have space for it
+        /// </summary>
+        void CopyMatch(uint32_t length, uint32_t distance)
+        {
+            size_t sourceIndex = (_dictionaryIndex >= distance) ? (_dictionaryIndex - distance) : (_dictionaryIndex + _dictionaryCapacity - distance);
+
+            _totalPosition += length;
+
+            // Neither side wraps around, and a match that doesn't overlap itself is copied in one go
+            if (((sourceIndex + length) <= _dictionaryCapacity) && ((_dictionaryIndex + length) <= _dictionaryCapacity))
+            {
+                uint8_t* destination = &_dictionary[_dictionaryIndex];
+                const uint8_t* source = &_dictionary[sourceIndex];
+
+                if (distance >= length)
+                    memcpy(destination, source, length);
+                else
+                {
+                    // A match that overlaps itself repeats it's first distance bytes, so it has to be copied front to back one byte at a time
+                    for (uint32_t index = 0; index < length; index++)
+                        destination[index] = source[index];
+                };
+
+                _dictionaryIndex += length;
+
+                if (_dictionaryIndex == _dictionaryCapacity)
+                    _dictionaryIndex = 0;
+
+                return;
+            };
+
+            while (length-- != 0)
+            {
+                _dictionary[_dictionaryIndex] = _dictionary[sourceIndex];
+
+                if (++_dictionaryIndex == _dictionaryCapacity)
+                    _dictionaryIndex = 0;
+
+                if (++sourceIndex == _dictionaryCapacity)
+                    sourceIndex = 0;
+            };
+        };
+
+
+        bool Fail()
+        {
+            _state = State::Error;
+            return false;
+        };
+
+
+        /// <summary>
+        /// Get the space the next symbol may need, the longest match unless the stream ends sooner
+        /// </summary>
+        size_t GetRequiredSpace() const
+        {
+            return static_cast<size_t>(std::min<uint64_t>(MAX_MATCH_LENGTH, _uncompressedSize - _totalPosition));
+        };
+
+
+        /// <summary>
+        /// Get the number of bytes that can be decoded before the dictionary has to be copied out
+        /// </summary>
+        size_t GetDictionarySpace() const
+        {
+            // Before the header is read there's no dictionary, the header itself doesn't need any space
+            if (_state == State::Header)
+                return MAX_MATCH_LENGTH;
+
+            // The caller's buffer holds the whole stream, so it never runs out of space
+            if (_isDictionaryExternal == true)
+                return static_cast<size_t>(_uncompressedSize - _totalPosition);
+
+            return _dictionaryCapacity - static_cast<size_t>(_totalPosition - _flushedPosition);
+        };
+
+
+        /// <summary>
+        /// Copies as many decoded bytes as fit out of the dictionary into the stream's output buffer
+        /// </summary>
+        void Flush(z_stream& stream)
+        {
+            size_t flushSize = std::min<size_t>(static_cast<size_t>(_totalPosition - _flushedPosition), stream.avail_out);
+
+            // The bytes were decoded straight into the caller's buffer, they only have to be handed over
+            if (_isDictionaryExternal == true)
+            {
+                stream.next_out += flushSize;
+                stream.avail_out -= static_cast<uInt>(flushSize);
+                stream.total_out += flushSize;
+
+                _flushedPosition += flushSize;
+                return;
+            };
+
+            while (flushSize != 0)
+            {
+                const size_t copySize = std::min(flushSize, _dictionaryCapacity - _flushIndex);
+
+                memcpy(stream.next_out, &_dictionary[_flushIndex], copySize);
+
+                stream.next_out += copySize;
+                stream.avail_out -= static_cast<uInt>(copySize);
+                stream.total_out += copySize;
+
+                _flushIndex += copySize;
+
+                if (_flushIndex == _dictionaryCapacity)
+                    _flushIndex = 0;
+
+                _flushedPosition += copySize;
+                flushSize -= copySize;
+            };
+        };
+
+    };
+
+};
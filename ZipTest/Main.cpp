@@ -1,13 +1,132 @@
+#include <span>
+#include <atomic>
 #include <string>
+#include <thread>
 #include <vector>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
 
 #include "ZipExtractor.h"
+#include "ZipArchive.h"
+#include "EntryReader.h"
 
 #undef _CRT_SECURE_NO_DEPRECATE  
 #undef _CRT_NONSTDC_NO_DEPRECATE
 
 
 
+/// <summary>
+/// Reads every entry of a single ZipArchive from many threads at the same time, through ExtractTo, ReadRange and EntryReader,
+/// and compares the results with the entries read by a single thread beforehand
+/// </summary>
+/// <param name="zipFilepath"> The zip file to read </param>
+/// <param name="threadCount"> The number of threads that read at the same time </param>
+/// <returns> The number of reads that failed or returned the wrong data </returns>
+size_t TestConcurrentReads(const std::string& zipFilepath, size_t threadCount)
+{
+    const ZipExtractor::ZipArchive archive(zipFilepath);
+
+    const std::vector<ZipExtractor::EntryInfo>& entries = archive.GetEntries();
+
+    // The expected contents, read before any other thread uses the archive
+    std::vector<std::vector<uint8_t>> expectedData(entries.size());
+
+    for (size_t entryIndex = 0; entryIndex < entries.size(); entryIndex++)
+    {
+        // Encrypted entries need a password and can't be read in ranges
+        if ((entries[entryIndex].isDirectory == true) || (entries[entryIndex].encryptionType != ZipExtractor::ZipEncryption::None))
+            continue;
+
+        archive.ReadEntry(entries[entryIndex], expectedData[entryIndex]);
+    };
+
+    std::atomic<size_t> failedReads { 0 };
+
+    std::vector<std::thread> threads;
+
+    for (size_t threadIndex = 0; threadIndex < threadCount; threadIndex++)
+    {
+        threads.emplace_back([&, threadIndex]()
+        {
+            for (size_t entryIndex = 0; entryIndex < entries.size(); entryIndex++)
+            {
+                const ZipExtractor::EntryInfo& entry = entries[entryIndex];
+                const std::vector<uint8_t>& expected = expectedData[entryIndex];
+
+                if ((entry.isDirectory == true) || (entry.encryptionType != ZipExtractor::ZipEncryption::None))
+                    continue;
+
+                std::vector<uint8_t> data(expected.size());
+
+                try
+                {
+                    // Every entry is read in all three ways at once by neighbouring threads
+                    switch ((threadIndex + entryIndex) % 3)
+                    {
+                        case 0:
+                        {
+                            archive.ExtractTo(entry, data);
+                            break;
+                        };
+
+                        case 1:
+                        {
+                            // The second half first, then the whole entry, so both a range and a full read are checked
+                            const size_t halfSize = data.size() / 2;
+
+                            if ((archive.ReadRange(entry, halfSize, data.size() - halfSize, data.data() + halfSize) != (data.size() - halfSize)) ||
+                                (memcmp(data.data() + halfSize, expected.data() + halfSize, data.size() - halfSize) != 0))
+                                failedReads++;
+
+                            if (archive.ReadRange(entry, 0, data.size(), data.data()) != data.size())
+                                failedReads++;
+
+                            break;
+                        };
+
+                        default:
+                        {
+                            ZipExtractor::EntryReader reader(archive, entry);
+
+                            size_t position = 0;
+
+                            while (position < data.size())
+                            {
+                                const size_t readSize = reader.Read(std::span<uint8_t>(data).subspan(position, std::min<size_t>(16 * 1024, data.size() - position)));
+
+                                if (readSize == 0)
+                                    break;
+
+                                position += readSize;
+                            };
+
+                            if (position != data.size())
+                                failedReads++;
+
+                            break;
+                        };
+                    };
+
+                    if ((data.empty() == false) && (memcmp(data.data(), expected.data(), data.size()) != 0))
+                        failedReads++;
+                }
+                catch (const std::exception&)
+                {
+                    failedReads++;
+                };
+            };
+        });
+    };
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    return failedReads.load();
+};
+
+
+
 int main()
 {
     const std::string zipOutFolder("ZipTest out");
@@ -30,4 +149,16 @@ int main()
     // Extract zip file
     ZipExtractor::ExtractZip(zipOutFolder, zipFileBuffer, centralDirectories);
 
-};
\ No newline at end of file
+
+    // A ZipArchive's const functions are safe to call from many threads at once
+    const size_t failedReads = TestConcurrentReads(zipFilepath, 8);
+
+    if (failedReads != 0)
+    {
+        std::cout << "Concurrent reads failed: " << failedReads << '\n';
+        return 1;
+    };
+
+    std::cout << "Concurrent reads passed" << '\n';
+
+};
@@ -0,0 +1,218 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <cstring>
+#include <filesystem>
+
+#include "HugePages.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+
+namespace ZipExtractor
+{
+
+    /// <summary>
+    /// A read-only memory mapping of an entire file.
+    /// The file handle is closed as soon as the mapping is created, so an open MappedFile only costs a single mapping.
+    /// Big archives can ask for huge pages, which cuts the TLB misses of walking a mapping that is hundreds of megabytes large.
+    /// Transparent huge pages only advise the mapping, explicit huge pages read the file into memory from the OS's huge page pool
+    /// and fall back to the advised mapping when the pool is empty or the process isn't allowed to use it
+    /// </summary>
+    class MappedFile
+    {
+
+    private:
+
+        // A pointer to the first byte of the mapping
+        const uint8_t* _data = nullptr;
+
+        // The size of the mapped file
+        size_t _size = 0;
+
+        // How the data is backed
+        HugePageMode _hugePageMode = HugePageMode::None;
+
+        // True if the data was read into an explicit huge page allocation instead of being mapped
+        bool _isCopy = false;
+
+
+    public:
+
+        /// <summary>
+        /// Maps the file found at the given path
+        /// </summary>
+        /// <param name="filepath"> A path to the file </param>
+        /// <param name="hugePages"> The huge page backing to try, falls back silently </param>
+        explicit MappedFile(const std::string& filepath, HugePageMode hugePages = HugePageMode::None)
+        {
+#ifdef _WIN32
+            HANDLE fileHandle = CreateFileW(std::filesystem::path(filepath).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+            if (fileHandle == INVALID_HANDLE_VALUE)
+                throw std::exception("Error opening file");
+
+            LARGE_INTEGER fileSize { };
+
+            if (GetFileSizeEx(fileHandle, &fileSize) == FALSE)
+            {
+                CloseHandle(fileHandle);
+                throw std::exception("File error");
+            };
+
+            _size = static_cast<size_t>(fileSize.QuadPart);
+
+            // A file mapping of an empty file can't be created
+            if (_size == 0)
+            {
+                CloseHandle(fileHandle);
+                return;
+            };
+
+            HANDLE mappingHandle = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+            // The view keeps the mapping alive, so both handles can be closed right away
+            CloseHandle(fileHandle);
+
+            if (mappingHandle == nullptr)
+                throw std::exception("Error mapping file");
+
+            _data = static_cast<const uint8_t*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+
+            CloseHandle(mappingHandle);
+
+            if (_data == nullptr)
+                throw std::exception("Error mapping file");
+
+            if (hugePages == HugePageMode::Explicit)
+                LoadIntoHugePages();
+#else
+            const int fileDescriptor = open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+
+            if (fileDescriptor == -1)
+                throw std::exception("Error opening file");
+
+            struct stat fileStatus { };
+
+            if (fstat(fileDescriptor, &fileStatus) == -1)
+            {
+                close(fileDescriptor);
+                throw std::exception("File error");
+            };
+
+            _size = static_cast<size_t>(fileStatus.st_size);
+
+            // An empty file can't be mapped
+            if (_size == 0)
+            {
+                close(fileDescriptor);
+                return;
+            };
+
+            void* mapping = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+
+            // The mapping keeps the file alive, so the descriptor can be closed right away
+            close(fileDescriptor);
+
+            if (mapping == MAP_FAILED)
+                throw std::exception("Error mapping file");
+
+            _data = static_cast<const uint8_t*>(mapping);
+
+            if (hugePages == HugePageMode::Explicit)
+                LoadIntoHugePages();
+
+            if ((hugePages != HugePageMode::None) && (_isCopy == false))
+                _hugePageMode = Utilities::AdviseHugePages(_data, _size);
+#endif
+        };
+
+
+        ~MappedFile()
+        {
+            if (_data == nullptr)
+                return;
+
+            if (_isCopy == true)
+            {
+                Utilities::FreeHugePages(const_cast<uint8_t*>(_data), _size);
+                return;
+            };
+
+#ifdef _WIN32
+            UnmapViewOfFile(_data);
+#else
+            munmap(const_cast<uint8_t*>(_data), _size);
+#endif
+        };
+
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator = (const MappedFile&) = delete;
+
+
+    public:
+
+        const uint8_t* GetData() const
+        {
+            return _data;
+        };
+
+        size_t GetSize() const
+        {
+            return _size;
+        };
+
+        HugePageMode GetHugePageMode() const
+        {
+            return _hugePageMode;
+        };
+
+
+    private:
+
+        /// <summary>
+        /// Copies the mapped file into explicit huge pages and drops the mapping.
+        /// Keeps the mapping if no explicit huge pages could be allocated, a copy in regular pages would only cost memory
+        /// </summary>
+        void LoadIntoHugePages()
+        {
+            HugePageMode achievedMode = HugePageMode::None;
+
+            void* memory = Utilities::AllocateHugePages(_size, HugePageMode::Explicit, achievedMode);
+
+            if (achievedMode != HugePageMode::Explicit)
+            {
+                Utilities::FreeHugePages(memory, _size);
+                return;
+            };
+
+            std::memcpy(memory, _data, _size);
+
+#ifdef _WIN32
+            UnmapViewOfFile(_data);
+#else
+            munmap(const_cast<uint8_t*>(_data), _size);
+#endif
+
+            _data = static_cast<const uint8_t*>(memory);
+            _hugePageMode = HugePageMode::Explicit;
+            _isCopy = true;
+        };
+
+    };
+
+};
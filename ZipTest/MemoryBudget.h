@@ -0,0 +1,233 @@
+#pragma once
+#include <mutex>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+#include <condition_variable>
+
+
+namespace ZipExtractor
+{
+
+    /// <summary>
+    /// A hard cap on the memory an extraction may use at once.
+    /// Buffers, caches and workers reserve their memory before allocating it and release it once it's freed.
+    /// A reservation that doesn't fit waits until enough memory is released instead of failing,
+    /// a reservation bigger than the whole budget waits until nothing else is reserved and then takes the entire budget
+    /// </summary>
+    class MemoryBudget
+    {
+
+    private:
+
+        const size_t _capacity;
+
+        std::mutex _lock;
+
+        // Signaled when memory is released
+        std::condition_variable _memoryReleased;
+
+        size_t _usedBytes = 0;
+
+        // The most bytes that were reserved at the same time
+        size_t _peakBytes = 0;
+
+        // The number of reservations that had to wait
+        uint64_t _waitCount = 0;
+
+
+    public:
+
+        /// <summary>
+        /// Creates a budget
+        /// </summary>
+        /// <param name="capacity"> The maximum number of bytes that can be reserved at the same time </param>
+        explicit MemoryBudget(size_t capacity) :
+            _capacity(std::max<size_t>(capacity, 1))
+        {
+        };
+
+        MemoryBudget(const MemoryBudget&) = delete;
+        MemoryBudget& operator = (const MemoryBudget&) = delete;
+
+
+    public:
+
+        /// <summary>
+        /// Reserves memory, blocking until it fits into the budget
+        /// </summary>
+        /// <param name="bytes"> The number of bytes to reserve </param>
+        /// <returns> The number of bytes that were actually reserved, which is what has to be released </returns>
+        size_t Acquire(size_t bytes)
+        {
+            const size_t reservedBytes = std::min(bytes, _capacity);
+
+            std::unique_lock<std::mutex> guard(_lock);
+
+            if (_usedBytes + reservedBytes > _capacity)
+            {
+                _waitCount++;
+
+                _memoryReleased.wait(guard, [&]()
+                {
+                    return _usedBytes + reservedBytes <= _capacity;
+                });
+            };
+
+            Reserve(reservedBytes);
+
+            return reservedBytes;
+        };
+
+
+        /// <summary>
+        /// Reserves memory only if it fits into the budget right now
+        /// </summary>
+        /// <param name="bytes"> The number of bytes to reserve </param>
+        /// <returns> True if the memory was reserved </returns>
+        bool TryAcquire(size_t bytes)
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+
+            if (_usedBytes + bytes > _capacity)
+                return false;
+
+            Reserve(bytes);
+
+            return true;
+        };
+
+
+        /// <summary>
+        /// Returns reserved memory to the budget
+        /// </summary>
+        /// <param name="bytes"> The number of bytes that Acquire returned, or that were passed to a successful TryAcquire </param>
+        void Release(size_t bytes)
+        {
+            {
+                std::lock_guard<std::mutex> guard(_lock);
+                _usedBytes -= bytes;
+            };
+
+            _memoryReleased.notify_all();
+        };
+
+
+    public:
+
+        size_t GetCapacity() const
+        {
+            return _capacity;
+        };
+
+        size_t GetUsedBytes()
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            return _usedBytes;
+        };
+
+        size_t GetPeakBytes()
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            return _peakBytes;
+        };
+
+        uint64_t GetWaitCount()
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            return _waitCount;
+        };
+
+
+    private:
+
+        void Reserve(size_t bytes)
+        {
+            _usedBytes += bytes;
+            _peakBytes = std::max(_peakBytes, _usedBytes);
+        };
+
+    };
+
+
+
+    /// <summary>
+    /// Holds memory reserved from a MemoryBudget for as long as it's alive.
+    /// A reservation without a budget does nothing, so callers don't need a separate path for running without one
+    /// </summary>
+    class MemoryReservation
+    {
+
+    private:
+
+        MemoryBudget* _budget = nullptr;
+
+        size_t _reservedBytes = 0;
+
+
+    public:
+
+        MemoryReservation() = default;
+
+        /// <summary>
+        /// Reserves memory, blocking until it fits into the budget
+        /// </summary>
+        /// <param name="budget"> The budget to reserve from, or nullptr </param>
+        /// <param name="bytes"> The number of bytes to reserve </param>
+        MemoryReservation(MemoryBudget* budget, size_t bytes) :
+            _budget(budget),
+            _reservedBytes((budget != nullptr) ? budget->Acquire(bytes) : 0)
+        {
+        };
+
+        MemoryReservation(MemoryReservation&& other) noexcept :
+            _budget(std::exchange(other._budget, nullptr)),
+            _reservedBytes(std::exchange(other._reservedBytes, 0))
+        {
+        };
+
+        MemoryReservation& operator = (MemoryReservation&& other) noexcept
+        {
+            if (this != &other)
+            {
+                Release();
+
+                _budget = std::exchange(other._budget, nullptr);
+                _reservedBytes = std::exchange(other._reservedBytes, 0);
+            };
+
+            return *this;
+        };
+
+        ~MemoryReservation()
+        {
+            Release();
+        };
+
+        MemoryReservation(const MemoryReservation&) = delete;
+        MemoryReservation& operator = (const MemoryReservation&) = delete;
+
+
+    public:
+
+        /// <summary>
+        /// Returns the memory to the budget early
+        /// </summary>
+        void Release()
+        {
+            if (_budget != nullptr)
+                _budget->Release(_reservedBytes);
+
+            _budget = nullptr;
+            _reservedBytes = 0;
+        };
+
+
+        size_t GetReservedBytes() const
+        {
+            return _reservedBytes;
+        };
+
+    };
+
+};
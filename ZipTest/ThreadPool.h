@@ -0,0 +1,124 @@
+#pragma once
+#include <mutex>
+#include <deque>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+
+namespace ZipExtractor
+{
+
+    /// <summary>
+    /// A fixed size pool of worker threads that run submitted tasks in submission order.
+    /// Destroying the pool runs every task that was already submitted before the threads exit
+    /// </summary>
+    class ThreadPool
+    {
+
+    private:
+
+        std::vector<std::thread> _threads;
+
+        std::mutex _lock;
+
+        // Signaled when a task is submitted or when the pool is stopping
+        std::condition_variable _taskAvailable;
+
+        std::deque<std::function<void()>> _tasks;
+
+        bool _stopping = false;
+
+
+    public:
+
+        /// <summary>
+        /// Creates a pool and starts it's threads
+        /// </summary>
+        /// <param name="threadCount"> The number of worker threads, 0 uses the number of hardware threads </param>
+        explicit ThreadPool(size_t threadCount = 0)
+        {
+            if (threadCount == 0)
+                threadCount = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+            _threads.reserve(threadCount);
+
+            for (size_t threadIndex = 0; threadIndex < threadCount; threadIndex++)
+                _threads.emplace_back(&ThreadPool::WorkerLoop, this);
+        };
+
+
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> guard(_lock);
+                _stopping = true;
+            };
+
+            _taskAvailable.notify_all();
+
+            for (std::thread& thread : _threads)
+                thread.join();
+        };
+
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator = (const ThreadPool&) = delete;
+
+
+    public:
+
+        /// <summary>
+        /// Queue a task to run on one of the pool's threads
+        /// </summary>
+        /// <param name="task"> The task to run </param>
+        void Submit(std::function<void()> task)
+        {
+            {
+                std::lock_guard<std::mutex> guard(_lock);
+                _tasks.push_back(std::move(task));
+            };
+
+            _taskAvailable.notify_one();
+        };
+
+
+        size_t GetThreadCount() const
+        {
+            return _threads.size();
+        };
+
+
+    private:
+
+        void WorkerLoop()
+        {
+            while (true)
+            {
+                std::function<void()> task;
+
+                {
+                    std::unique_lock<std::mutex> guard(_lock);
+
+                    _taskAvailable.wait(guard, [this]()
+                    {
+                        return (_stopping == true) || (_tasks.empty() == false);
+                    });
+
+                    // Only exit once every queued task ran
+                    if (_tasks.empty() == true)
+                        return;
+
+                    task = std::move(_tasks.front());
+                    _tasks.pop_front();
+                };
+
+                task();
+            };
+        };
+
+    };
+
+};
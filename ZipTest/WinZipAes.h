@@ -0,0 +1,1170 @@
+#pragma once
+#include <array>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+// x64 builds get the AES-NI and SHA-NI paths, they're only taken if the processor has the instructions
+#if defined(_M_X64) || defined(__x86_64__)
+#define ZIPEXTRACTOR_X64_INTRINSICS
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+#include <immintrin.h>
+#endif
+
+// GCC and Clang only allow the intrinsics inside functions that are compiled for the instructions, MSVC allows them anywhere
+#if defined(__GNUC__) || defined(__clang__)
+#define ZIPEXTRACTOR_TARGET(features) __attribute__((target(features)))
+#else
+#define ZIPEXTRACTOR_TARGET(features)
+#endif
+
+
+namespace ZipExtractor
+{
+
+    /// <summary>
+    /// The instruction set extensions the processor supports, checked once per process
+    /// </summary>
+    class CpuFeatures
+    {
+
+    public:
+
+        /// <summary>
+        /// True if the processor has the AES-NI instructions
+        /// </summary>
+        static bool HasAesNi()
+        {
+            static const bool hasAesNi = []()
+            {
+                uint32_t registers[4] = { };
+
+                // CPUID leaf 1, ECX bit 25
+                return (ReadCpuid(1, 0, registers) == true) && ((registers[2] & (1u << 25)) != 0);
+            }();
+
+            return hasAesNi;
+        };
+
+
+        /// <summary>
+        /// True if the processor has the SHA-NI instructions, and the SSSE3 and SSE4.1 ones the SHA-1 path needs next to them
+        /// </summary>
+        static bool HasShaNi()
+        {
+            static const bool hasShaNi = []()
+            {
+                uint32_t registers[4] = { };
+
+                // CPUID leaf 1, ECX bit 9 is SSSE3 and bit 19 is SSE4.1
+                if ((ReadCpuid(1, 0, registers) == false) || ((registers[2] & (1u << 9)) == 0) || ((registers[2] & (1u << 19)) == 0))
+                    return false;
+
+                // CPUID leaf 7, EBX bit 29
+                return (ReadCpuid(7, 0, registers) == true) && ((registers[1] & (1u << 29)) != 0);
+            }();
+
+            return hasShaNi;
+        };
+
+
+    private:
+
+        /// <summary>
+        /// Runs CPUID
+        /// </summary>
+        /// <param name="leaf"> The leaf to read </param>
+        /// <param name="subleaf"> The subleaf to read </param>
+        /// <param name="registersOut"> EAX, EBX, ECX and EDX </param>
+        /// <returns> False if the processor doesn't have the leaf, or isn't an x64 one </returns>
+        static bool ReadCpuid(uint32_t leaf, uint32_t subleaf, uint32_t registersOut[4])
+        {
+#if defined(ZIPEXTRACTOR_X64_INTRINSICS) && defined(_MSC_VER)
+            int registers[4] = { };
+
+            __cpuid(registers, 0);
+
+            if (static_cast<uint32_t>(registers[0]) < leaf)
+                return false;
+
+            __cpuidex(registers, static_cast<int>(leaf), static_cast<int>(subleaf));
+
+            for (size_t index = 0; index < 4; index++)
+                registersOut[index] = static_cast<uint32_t>(registers[index]);
+
+            return true;
+#elif defined(ZIPEXTRACTOR_X64_INTRINSICS)
+            if (__get_cpuid_max(0, nullptr) < leaf)
+                return false;
+
+            __cpuid_count(leaf, subleaf, registersOut[0], registersOut[1], registersOut[2], registersOut[3]);
+
+            return true;
+#else
+            return false;
+#endif
+        };
+
+    };
+
+
+
+    /// <summary>
+    /// SHA-1, hashes with the SHA-NI instructions if the processor has them
+    /// </summary>
+    class Sha1
+    {
+
+    public:
+
+        static constexpr size_t BLOCK_SIZE = 64;
+
+        static constexpr size_t DIGEST_SIZE = 20;
+
+        using State = std::array<uint32_t, 5>;
+
+        static constexpr State INITIAL_STATE = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+
+    private:
+
+        State _state = INITIAL_STATE;
+
+        // The start of a block that didn't fully arrive yet
+        std::array<uint8_t, BLOCK_SIZE> _buffer;
+        size_t _bufferSize = 0;
+
+        // The number of bytes hashed so far
+        uint64_t _length = 0;
+
+
+    public:
+
+        Sha1() = default;
+
+        /// <summary>
+        /// Continues a hash from a state that already hashed whole blocks
+        /// </summary>
+        /// <param name="state"> The state after the hashed blocks </param>
+        /// <param name="length"> The number of bytes the state hashed, a multiple of BLOCK_SIZE </param>
+        Sha1(const State& state, uint64_t length) :
+            _state(state),
+            _length(length)
+        {
+        };
+
+
+    public:
+
+        void Update(const uint8_t* data, size_t size)
+        {
+            _length += size;
+
+            // Complete the buffered block first
+            if (_bufferSize != 0)
+            {
+                const size_t copySize = std::min(size, BLOCK_SIZE - _bufferSize);
+
+                memcpy(&_buffer[_bufferSize], data, copySize);
+
+                _bufferSize += copySize;
+                data += copySize;
+                size -= copySize;
+
+                if (_bufferSize != BLOCK_SIZE)
+                    return;
+
+                Compress(_state.data(), _buffer.data(), 1);
+                _bufferSize = 0;
+            };
+
+            // Whole blocks are hashed straight from the data
+            const size_t blockCount = size / BLOCK_SIZE;
+
+            if (blockCount != 0)
+            {
+                Compress(_state.data(), data, blockCount);
+
+                data += blockCount * BLOCK_SIZE;
+                size -= blockCount * BLOCK_SIZE;
+            };
+
+            if (size != 0)
+            {
+                memcpy(_buffer.data(), data, size);
+                _bufferSize = size;
+            };
+        };
+
+
+        /// <summary>
+        /// Pads the message and writes the digest, the hash can't be updated afterwards
+        /// </summary>
+        /// <param name="digestOut"> DIGEST_SIZE bytes that will contain the digest </param>
+        void Final(uint8_t* digestOut)
+        {
+            const uint64_t bitLength = _length * 8;
+
+            // A 1 bit, zeros until 8 bytes before the end of a block, and the message's length in bits
+            std::array<uint8_t, BLOCK_SIZE + 8> padding { };
+            padding[0] = 0x80;
+
+            const size_t paddingSize = ((_bufferSize < BLOCK_SIZE - 8) ? (BLOCK_SIZE - 8) : (2 * BLOCK_SIZE - 8)) - _bufferSize;
+
+            for (size_t index = 0; index < 8; index++)
+                padding[paddingSize + index] = static_cast<uint8_t>(bitLength >> (56 - 8 * index));
+
+            Update(padding.data(), paddingSize + 8);
+
+            StoreState(_state, digestOut);
+        };
+
+
+    public:
+
+        /// <summary>
+        /// Hashes whole blocks into a state
+        /// </summary>
+        /// <param name="state"> The state to update </param>
+        /// <param name="blocks"> The blocks </param>
+        /// <param name="blockCount"> The number of blocks </param>
+        static void Compress(uint32_t* state, const uint8_t* blocks, size_t blockCount)
+        {
+#ifdef ZIPEXTRACTOR_X64_INTRINSICS
+            if (CpuFeatures::HasShaNi() == true)
+            {
+                CompressShaNi(state, blocks, blockCount);
+                return;
+            };
+#endif
+
+            CompressPortable(state, blocks, blockCount);
+        };
+
+
+        /// <summary>
+        /// Writes a state as a digest
+        /// </summary>
+        /// <param name="state"> The state </param>
+        /// <param name="digestOut"> DIGEST_SIZE bytes that will contain the digest </param>
+        static void StoreState(const State& state, uint8_t* digestOut)
+        {
+            for (size_t index = 0; index < state.size(); index++)
+            {
+                digestOut[4 * index + 0] = static_cast<uint8_t>(state[index] >> 24);
+                digestOut[4 * index + 1] = static_cast<uint8_t>(state[index] >> 16);
+                digestOut[4 * index + 2] = static_cast<uint8_t>(state[index] >> 8);
+                digestOut[4 * index + 3] = static_cast<uint8_t>(state[index]);
+            };
+        };
+
+
+    private:
+
+        static uint32_t RotateLeft(uint32_t value, unsigned count)
+        {
+            return (value << count) | (value >> (32 - count));
+        };
+
+
+        static void CompressPortable(uint32_t* state, const uint8_t* blocks, size_t blockCount)
+        {
+            for (; blockCount != 0; blockCount--, blocks += BLOCK_SIZE)
+            {
+                // The message schedule only ever looks 16 words back, so it's kept in a ring
+                uint32_t schedule[16];
+
+                for (size_t index = 0; index < 16; index++)
+                {
+                    schedule[index] = (static_cast<uint32_t>(blocks[4 * index]) << 24) |
+                                      (static_cast<uint32_t>(blocks[4 * index + 1]) << 16) |
+                                      (static_cast<uint32_t>(blocks[4 * index + 2]) << 8) |
+                                      static_cast<uint32_t>(blocks[4 * index + 3]);
+                };
+
+                uint32_t a = state[0];
+                uint32_t b = state[1];
+                uint32_t c = state[2];
+                uint32_t d = state[3];
+                uint32_t e = state[4];
+
+                for (unsigned round = 0; round < 80; round++)
+                {
+                    if (round >= 16)
+                    {
+                        const uint32_t word = schedule[(round - 3) & 15] ^ schedule[(round - 8) & 15] ^ schedule[(round - 14) & 15] ^ schedule[round & 15];
+
+                        schedule[round & 15] = RotateLeft(word, 1);
+                    };
+
+                    uint32_t function = 0;
+                    uint32_t constant = 0;
+
+                    if (round < 20)
+                    {
+                        function = (b & c) | (~b & d);
+                        constant = 0x5A827999;
+                    }
+                    else if (round < 40)
+                    {
+                        function = b ^ c ^ d;
+                        constant = 0x6ED9EBA1;
+                    }
+                    else if (round < 60)
+                    {
+                        function = (b & c) | (b & d) | (c & d);
+                        constant = 0x8F1BBCDC;
+                    }
+                    else
+                    {
+                        function = b ^ c ^ d;
+                        constant = 0xCA62C1D6;
+                    };
+
+                    const uint32_t temp = RotateLeft(a, 5) + function + e + constant + schedule[round & 15];
+
+                    e = d;
+                    d = c;
+                    c = RotateLeft(b, 30);
+                    b = a;
+                    a = temp;
+                };
+
+                state[0] += a;
+                state[1] += b;
+                state[2] += c;
+                state[3] += d;
+                state[4] += e;
+            };
+        };
+
+
+#ifdef ZIPEXTRACTOR_X64_INTRINSICS
+        /// <summary>
+        /// Four rounds, and the message schedule work that overlaps with them.
+        /// The schedule rotates through four registers, w is the one the rounds use
+        /// </summary>
+        template<int Function>
+        ZIPEXTRACTOR_TARGET("sha,ssse3,sse4.1")
+        static void ShaNiRounds(__m128i& abcd, __m128i& e, __m128i& nextE, const __m128i& w, __m128i& msg2Target, __m128i& xorTarget, __m128i& msg1Target)
+        {
+            e = _mm_sha1nexte_epu32(e, w);
+            nextE = abcd;
+            msg2Target = _mm_sha1msg2_epu32(msg2Target, w);
+            abcd = _mm_sha1rnds4_epu32(abcd, e, Function);
+            msg1Target = _mm_sha1msg1_epu32(msg1Target, w);
+            xorTarget = _mm_xor_si128(xorTarget, w);
+        };
+
+
+        ZIPEXTRACTOR_TARGET("sha,ssse3,sse4.1")
+        static void CompressShaNi(uint32_t* state, const uint8_t* blocks, size_t blockCount)
+        {
+            // The message words are big endian
+            const __m128i byteSwapMask = _mm_set_epi64x(0x0001020304050607LL, 0x08090A0B0C0D0E0FLL);
+
+            __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1B);
+            __m128i e0 = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+            __m128i e1;
+
+            for (; blockCount != 0; blockCount--, blocks += BLOCK_SIZE)
+            {
+                const __m128i abcdSave = abcd;
+                const __m128i eSave = e0;
+
+                __m128i message0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&blocks[0])), byteSwapMask);
+                __m128i message1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&blocks[16])), byteSwapMask);
+                __m128i message2 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&blocks[32])), byteSwapMask);
+                __m128i message3 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&blocks[48])), byteSwapMask);
+
+                // Rounds 0-11 start the message schedule
+                e0 = _mm_add_epi32(e0, message0);
+                e1 = abcd;
+                abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+                e1 = _mm_sha1nexte_epu32(e1, message1);
+                e0 = abcd;
+                abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+                message0 = _mm_sha1msg1_epu32(message0, message1);
+
+                e0 = _mm_sha1nexte_epu32(e0, message2);
+                e1 = abcd;
+                abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+                message1 = _mm_sha1msg1_epu32(message1, message2);
+                message0 = _mm_xor_si128(message0, message2);
+
+                // Rounds 12-79, the last ones compute schedule words that are never used
+                ShaNiRounds<0>(abcd, e1, e0, message3, message0, message1, message2);
+                ShaNiRounds<0>(abcd, e0, e1, message0, message1, message2, message3);
+                ShaNiRounds<1>(abcd, e1, e0, message1, message2, message3, message0);
+                ShaNiRounds<1>(abcd, e0, e1, message2, message3, message0, message1);
+                ShaNiRounds<1>(abcd, e1, e0, message3, message0, message1, message2);
+                ShaNiRounds<1>(abcd, e0, e1, message0, message1, message2, message3);
+                ShaNiRounds<1>(abcd, e1, e0, message1, message2, message3, message0);
+                ShaNiRounds<2>(abcd, e0, e1, message2, message3, message0, message1);
+                ShaNiRounds<2>(abcd, e1, e0, message3, message0, message1, message2);
+                ShaNiRounds<2>(abcd, e0, e1, message0, message1, message2, message3);
+                ShaNiRounds<2>(abcd, e1, e0, message1, message2, message3, message0);
+                ShaNiRounds<2>(abcd, e0, e1, message2, message3, message0, message1);
+                ShaNiRounds<3>(abcd, e1, e0, message3, message0, message1, message2);
+                ShaNiRounds<3>(abcd, e0, e1, message0, message1, message2, message3);
+                ShaNiRounds<3>(abcd, e1, e0, message1, message2, message3, message0);
+                ShaNiRounds<3>(abcd, e0, e1, message2, message3, message0, message1);
+                ShaNiRounds<3>(abcd, e1, e0, message3, message0, message1, message2);
+
+                e0 = _mm_sha1nexte_epu32(e0, eSave);
+                abcd = _mm_add_epi32(abcd, abcdSave);
+            };
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_shuffle_epi32(abcd, 0x1B));
+            state[4] = static_cast<uint32_t>(_mm_extract_epi32(e0, 3));
+        };
+#endif
+
+    };
+
+
+
+    /// <summary>
+    /// HMAC-SHA1. The key's padded blocks are hashed once, so every message only costs it's own blocks plus one
+    /// </summary>
+    class HmacSha1
+    {
+
+    private:
+
+        // The states after hashing the key XOR ipad and the key XOR opad
+        Sha1::State _innerKeyState = Sha1::INITIAL_STATE;
+        Sha1::State _outerKeyState = Sha1::INITIAL_STATE;
+
+        // The inner hash of the message that's being authenticated
+        Sha1 _inner;
+
+
+    public:
+
+        void SetKey(const uint8_t* key, size_t keySize)
+        {
+            std::array<uint8_t, Sha1::BLOCK_SIZE> keyBlock { };
+
+            // Keys longer than a block are hashed first
+            if (keySize > Sha1::BLOCK_SIZE)
+            {
+                Sha1 keyHash;
+                keyHash.Update(key, keySize);
+                keyHash.Final(keyBlock.data());
+            }
+            else if (keySize != 0)
+                memcpy(keyBlock.data(), key, keySize);
+
+            std::array<uint8_t, Sha1::BLOCK_SIZE> padBlock;
+
+            for (size_t index = 0; index < Sha1::BLOCK_SIZE; index++)
+                padBlock[index] = keyBlock[index] ^ 0x36;
+
+            _innerKeyState = Sha1::INITIAL_STATE;
+            Sha1::Compress(_innerKeyState.data(), padBlock.data(), 1);
+
+            for (size_t index = 0; index < Sha1::BLOCK_SIZE; index++)
+                padBlock[index] = keyBlock[index] ^ 0x5C;
+
+            _outerKeyState = Sha1::INITIAL_STATE;
+            Sha1::Compress(_outerKeyState.data(), padBlock.data(), 1);
+
+            _inner = Sha1(_innerKeyState, Sha1::BLOCK_SIZE);
+        };
+
+
+        void Update(const uint8_t* data, size_t size)
+        {
+            _inner.Update(data, size);
+        };
+
+
+        /// <summary>
+        /// Writes the message's MAC and starts a new message
+        /// </summary>
+        /// <param name="macOut"> Sha1::DIGEST_SIZE bytes that will contain the MAC </param>
+        void Final(uint8_t* macOut)
+        {
+            uint8_t innerDigest[Sha1::DIGEST_SIZE];
+            _inner.Final(innerDigest);
+
+            Sha1 outer(_outerKeyState, Sha1::BLOCK_SIZE);
+            outer.Update(innerDigest, sizeof(innerDigest));
+            outer.Final(macOut);
+
+            _inner = Sha1(_innerKeyState, Sha1::BLOCK_SIZE);
+        };
+
+
+        /// <summary>
+        /// Computes the MAC of a message that is itself a SHA-1 digest, which PBKDF2 does for every iteration.
+        /// Both hashes then take exactly one block, so the padding is written once and the blocks are hashed directly
+        /// </summary>
+        /// <param name="block"> A block that holds the message in it's first Sha1::DIGEST_SIZE bytes and was prepared by PrepareDigestBlock </param>
+        /// <param name="macOut"> Sha1::DIGEST_SIZE bytes that will contain the MAC, may be the start of block </param>
+        void ComputeDigestMac(uint8_t* block, uint8_t* macOut) const
+        {
+            Sha1::State state = _innerKeyState;
+            Sha1::Compress(state.data(), block, 1);
+            Sha1::StoreState(state, block);
+
+            state = _outerKeyState;
+            Sha1::Compress(state.data(), block, 1);
+            Sha1::StoreState(state, macOut);
+        };
+
+
+        /// <summary>
+        /// Writes the padding of a message that is a SHA-1 digest hashed after the key's block
+        /// </summary>
+        /// <param name="block"> A block whose first Sha1::DIGEST_SIZE bytes will hold the message </param>
+        static void PrepareDigestBlock(std::array<uint8_t, Sha1::BLOCK_SIZE>& block)
+        {
+            constexpr uint64_t bitLength = (Sha1::BLOCK_SIZE + Sha1::DIGEST_SIZE) * 8;
+
+            block.fill(0);
+            block[Sha1::DIGEST_SIZE] = 0x80;
+            block[Sha1::BLOCK_SIZE - 2] = static_cast<uint8_t>(bitLength >> 8);
+            block[Sha1::BLOCK_SIZE - 1] = static_cast<uint8_t>(bitLength);
+        };
+
+    };
+
+
+
+    /// <summary>
+    /// The AES block cipher, encryption only since counter mode never decrypts a block.
+    /// Uses AES-NI if the processor has it, and tables otherwise
+    /// </summary>
+    class AesEncryptor
+    {
+
+    public:
+
+        static constexpr size_t BLOCK_SIZE = 16;
+
+        // AES-256
+        static constexpr unsigned MAX_ROUNDS = 14;
+
+
+    private:
+
+        // The round keys as words, used by the tables
+        std::array<uint32_t, (MAX_ROUNDS + 1) * 4> _roundKeys { };
+
+        // The same round keys as bytes, used by AES-NI
+        alignas(16) std::array<uint8_t, (MAX_ROUNDS + 1) * BLOCK_SIZE> _roundKeyBytes { };
+
+        unsigned _rounds = 0;
+
+
+    public:
+
+        /// <summary>
+        /// Expands a key
+        /// </summary>
+        /// <param name="key"> The key </param>
+        /// <param name="keySize"> 16, 24 or 32 bytes </param>
+        void SetKey(const uint8_t* key, size_t keySize)
+        {
+            if ((keySize != 16) && (keySize != 24) && (keySize != 32))
+                throw std::exception("Invalid AES key size");
+
+            const std::array<uint8_t, 256>& substitutionBox = GetSubstitutionBox();
+
+            const auto substituteWord = [&](uint32_t word)
+            {
+                return (static_cast<uint32_t>(substitutionBox[word >> 24]) << 24) |
+                       (static_cast<uint32_t>(substitutionBox[(word >> 16) & 0xFF]) << 16) |
+                       (static_cast<uint32_t>(substitutionBox[(word >> 8) & 0xFF]) << 8) |
+                       static_cast<uint32_t>(substitutionBox[word & 0xFF]);
+            };
+
+            const size_t keyWords = keySize / 4;
+            const size_t totalWords = (keyWords + 7) * 4;
+
+            _rounds = static_cast<unsigned>(keyWords + 6);
+
+            for (size_t index = 0; index < keyWords; index++)
+                _roundKeys[index] = LoadBigEndian(&key[4 * index]);
+
+            uint8_t roundConstant = 1;
+
+            for (size_t index = keyWords; index < totalWords; index++)
+            {
+                uint32_t word = _roundKeys[index - 1];
+
+                if ((index % keyWords) == 0)
+                {
+                    word = substituteWord((word << 8) | (word >> 24)) ^ (static_cast<uint32_t>(roundConstant) << 24);
+                    roundConstant = MultiplyByTwo(roundConstant);
+                }
+                else if ((keyWords > 6) && ((index % keyWords) == 4))
+                    word = substituteWord(word);
+
+                _roundKeys[index] = _roundKeys[index - keyWords] ^ word;
+            };
+
+            for (size_t index = 0; index < totalWords; index++)
+                StoreBigEndian(_roundKeys[index], &_roundKeyBytes[4 * index]);
+        };
+
+
+        void EncryptBlock(const uint8_t* input, uint8_t* output) const
+        {
+#ifdef ZIPEXTRACTOR_X64_INTRINSICS
+            if (CpuFeatures::HasAesNi() == true)
+            {
+                EncryptBlockAesNi(input, output);
+                return;
+            };
+#endif
+
+            EncryptBlockPortable(input, output);
+        };
+
+
+        /// <summary>
+        /// XORs data with the encrypted counter blocks of counter mode.
+        /// The counter is little endian and fills the first 8 bytes of the block, the rest stays 0, like WinZip's
+        /// </summary>
+        /// <param name="counter"> The counter of the first block, moved past the last one </param>
+        /// <param name="input"> The data </param>
+        /// <param name="output"> The XORed data, may be the same as input </param>
+        /// <param name="blockCount"> The number of whole blocks </param>
+        void CounterXor(uint64_t& counter, const uint8_t* input, uint8_t* output, size_t blockCount) const
+        {
+#ifdef ZIPEXTRACTOR_X64_INTRINSICS
+            if (CpuFeatures::HasAesNi() == true)
+            {
+                CounterXorAesNi(counter, input, output, blockCount);
+                return;
+            };
+#endif
+
+            for (size_t blockIndex = 0; blockIndex < blockCount; blockIndex++)
+            {
+                uint8_t keystream[BLOCK_SIZE];
+
+                MakeCounterBlock(counter++, keystream);
+                EncryptBlockPortable(keystream, keystream);
+
+                for (size_t index = 0; index < BLOCK_SIZE; index++)
+                    output[index] = input[index] ^ keystream[index];
+
+                input += BLOCK_SIZE;
+                output += BLOCK_SIZE;
+            };
+        };
+
+
+        static void MakeCounterBlock(uint64_t counter, uint8_t* blockOut)
+        {
+            for (size_t index = 0; index < 8; index++)
+                blockOut[index] = static_cast<uint8_t>(counter >> (8 * index));
+
+            memset(&blockOut[8], 0, BLOCK_SIZE - 8);
+        };
+
+
+    private:
+
+        static uint8_t MultiplyByTwo(uint8_t value)
+        {
+            return static_cast<uint8_t>((value << 1) ^ (((value & 0x80) != 0) ? 0x1B : 0));
+        };
+
+
+        static uint32_t LoadBigEndian(const uint8_t* pointer)
+        {
+            return (static_cast<uint32_t>(pointer[0]) << 24) |
+                   (static_cast<uint32_t>(pointer[1]) << 16) |
+                   (static_cast<uint32_t>(pointer[2]) << 8) |
+                   static_cast<uint32_t>(pointer[3]);
+        };
+
+
+        static void StoreBigEndian(uint32_t value, uint8_t* pointer)
+        {
+            pointer[0] = static_cast<uint8_t>(value >> 24);
+            pointer[1] = static_cast<uint8_t>(value >> 16);
+            pointer[2] = static_cast<uint8_t>(value >> 8);
+            pointer[3] = static_cast<uint8_t>(value);
+        };
+
+
+        /// <summary>
+        /// The S-box, built from the multiplicative inverses in GF(2^8) and the affine transformation
+        /// </summary>
+        static const std::array<uint8_t, 256>& GetSubstitutionBox()
+        {
+            static const std::array<uint8_t, 256> substitutionBox = []()
+            {
+                std::array<uint8_t, 256> box { };
+
+                const auto rotate = [](uint8_t value, unsigned count)
+                {
+                    return static_cast<uint8_t>((value << count) | (value >> (8 - count)));
+                };
+
+                // p walks through every non zero element as a power of 3, q through the same powers of 3's inverse
+                uint8_t p = 1;
+                uint8_t q = 1;
+
+                do
+                {
+                    p = static_cast<uint8_t>(p ^ (p << 1) ^ (((p & 0x80) != 0) ? 0x1B : 0));
+
+                    q = static_cast<uint8_t>(q ^ (q << 1));
+                    q = static_cast<uint8_t>(q ^ (q << 2));
+                    q = static_cast<uint8_t>(q ^ (q << 4));
+
+                    if ((q & 0x80) != 0)
+                        q ^= 0x09;
+
+                    box[p] = static_cast<uint8_t>(q ^ rotate(q, 1) ^ rotate(q, 2) ^ rotate(q, 3) ^ rotate(q, 4) ^ 0x63);
+                }
+                while (p != 1);
+
+                // 0 has no inverse
+                box[0] = 0x63;
+
+                return box;
+            }();
+
+            return substitutionBox;
+        };
+
+
+        /// <summary>
+        /// SubBytes, ShiftRows and MixColumns of a single byte as 4 tables, each one rotated by a byte from the one before
+        /// </summary>
+        static const std::array<std::array<uint32_t, 256>, 4>& GetRoundTables()
+        {
+            static const std::array<std::array<uint32_t, 256>, 4> roundTables = []()
+            {
+                const std::array<uint8_t, 256>& substitutionBox = GetSubstitutionBox();
+
+                std::array<std::array<uint32_t, 256>, 4> tables { };
+
+                for (size_t index = 0; index < 256; index++)
+                {
+                    const uint8_t value = substitutionBox[index];
+                    const uint8_t doubled = MultiplyByTwo(value);
+                    const uint8_t tripled = doubled ^ value;
+
+                    const uint32_t word = (static_cast<uint32_t>(doubled) << 24) |
+                                          (static_cast<uint32_t>(value) << 16) |
+                                          (static_cast<uint32_t>(value) << 8) |
+                                          static_cast<uint32_t>(tripled);
+
+                    tables[0][index] = word;
+                    tables[1][index] = (word >> 8) | (word << 24);
+                    tables[2][index] = (word >> 16) | (word << 16);
+                    tables[3][index] = (word >> 24) | (word << 8);
+                };
+
+                return tables;
+            }();
+
+            return roundTables;
+        };
+
+
+        void EncryptBlockPortable(const uint8_t* input, uint8_t* output) const
+        {
+            const std::array<std::array<uint32_t, 256>, 4>& tables = GetRoundTables();
+            const std::array<uint8_t, 256>& substitutionBox = GetSubstitutionBox();
+
+            const uint32_t* roundKey = _roundKeys.data();
+
+            uint32_t s0 = LoadBigEndian(&input[0]) ^ roundKey[0];
+            uint32_t s1 = LoadBigEndian(&input[4]) ^ roundKey[1];
+            uint32_t s2 = LoadBigEndian(&input[8]) ^ roundKey[2];
+            uint32_t s3 = LoadBigEndian(&input[12]) ^ roundKey[3];
+
+            for (unsigned round = 1; round < _rounds; round++)
+            {
+                roundKey += 4;
+
+                const uint32_t t0 = tables[0][s0 >> 24] ^ tables[1][(s1 >> 16) & 0xFF] ^ tables[2][(s2 >> 8) & 0xFF] ^ tables[3][s3 & 0xFF] ^ roundKey[0];
+                const uint32_t t1 = tables[0][s1 >> 24] ^ tables[1][(s2 >> 16) & 0xFF] ^ tables[2][(s3 >> 8) & 0xFF] ^ tables[3][s0 & 0xFF] ^ roundKey[1];
+                const uint32_t t2 = tables[0][s2 >> 24] ^ tables[1][(s3 >> 16) & 0xFF] ^ tables[2][(s0 >> 8) & 0xFF] ^ tables[3][s1 & 0xFF] ^ roundKey[2];
+                const uint32_t t3 = tables[0][s3 >> 24] ^ tables[1][(s0 >> 16) & 0xFF] ^ tables[2][(s1 >> 8) & 0xFF] ^ tables[3][s2 & 0xFF] ^ roundKey[3];
+
+                s0 = t0;
+                s1 = t1;
+                s2 = t2;
+                s3 = t3;
+            };
+
+            roundKey += 4;
+
+            // The last round doesn't have MixColumns
+            const auto lastRound = [&](uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint32_t key)
+            {
+                return ((static_cast<uint32_t>(substitutionBox[a >> 24]) << 24) |
+                        (static_cast<uint32_t>(substitutionBox[(b >> 16) & 0xFF]) << 16) |
+                        (static_cast<uint32_t>(substitutionBox[(c >> 8) & 0xFF]) << 8) |
+                        static_cast<uint32_t>(substitutionBox[d & 0xFF])) ^ key;
+            };
+
+            StoreBigEndian(lastRound(s0, s1, s2, s3, roundKey[0]), &output[0]);
+            StoreBigEndian(lastRound(s1, s2, s3, s0, roundKey[1]), &output[4]);
+            StoreBigEndian(lastRound(s2, s3, s0, s1, roundKey[2]), &output[8]);
+            StoreBigEndian(lastRound(s3, s0, s1, s2, roundKey[3]), &output[12]);
+        };
+
+
+#ifdef ZIPEXTRACTOR_X64_INTRINSICS
+        ZIPEXTRACTOR_TARGET("aes,sse2")
+        void EncryptBlockAesNi(const uint8_t* input, uint8_t* output) const
+        {
+            const __m128i* roundKeys = reinterpret_cast<const __m128i*>(_roundKeyBytes.data());
+
+            __m128i block = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input)), _mm_load_si128(&roundKeys[0]));
+
+            for (unsigned round = 1; round < _rounds; round++)
+                block = _mm_aesenc_si128(block, _mm_load_si128(&roundKeys[round]));
+
+            block = _mm_aesenclast_si128(block, _mm_load_si128(&roundKeys[_rounds]));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output), block);
+        };
+
+
+        ZIPEXTRACTOR_TARGET("aes,sse2")
+        void CounterXorAesNi(uint64_t& counter, const uint8_t* input, uint8_t* output, size_t blockCount) const
+        {
+            // The blocks are independent, so 8 are encrypted at a time to hide the latency of aesenc
+            constexpr size_t PARALLEL_BLOCKS = 8;
+
+            const __m128i* roundKeys = reinterpret_cast<const __m128i*>(_roundKeyBytes.data());
+
+            const __m128i firstKey = _mm_load_si128(&roundKeys[0]);
+            const __m128i lastKey = _mm_load_si128(&roundKeys[_rounds]);
+
+            while (blockCount >= PARALLEL_BLOCKS)
+            {
+                __m128i blocks[PARALLEL_BLOCKS];
+
+                for (size_t index = 0; index < PARALLEL_BLOCKS; index++)
+                    blocks[index] = _mm_xor_si128(_mm_set_epi64x(0, static_cast<long long>(counter + index)), firstKey);
+
+                for (unsigned round = 1; round < _rounds; round++)
+                {
+                    const __m128i roundKey = _mm_load_si128(&roundKeys[round]);
+
+                    for (size_t index = 0; index < PARALLEL_BLOCKS; index++)
+                        blocks[index] = _mm_aesenc_si128(blocks[index], roundKey);
+                };
+
+                for (size_t index = 0; index < PARALLEL_BLOCKS; index++)
+                {
+                    const __m128i keystream = _mm_aesenclast_si128(blocks[index], lastKey);
+                    const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&input[index * BLOCK_SIZE]));
+
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(&output[index * BLOCK_SIZE]), _mm_xor_si128(data, keystream));
+                };
+
+                counter += PARALLEL_BLOCKS;
+                input += PARALLEL_BLOCKS * BLOCK_SIZE;
+                output += PARALLEL_BLOCKS * BLOCK_SIZE;
+                blockCount -= PARALLEL_BLOCKS;
+            };
+
+            for (; blockCount != 0; blockCount--)
+            {
+                __m128i block = _mm_xor_si128(_mm_set_epi64x(0, static_cast<long long>(counter++)), firstKey);
+
+                for (unsigned round = 1; round < _rounds; round++)
+                    block = _mm_aesenc_si128(block, _mm_load_si128(&roundKeys[round]));
+
+                block = _mm_aesenclast_si128(block, lastKey);
+
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(output), _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input)), block));
+
+                input += BLOCK_SIZE;
+                output += BLOCK_SIZE;
+            };
+        };
+#endif
+
+    };
+
+
+
+    /// <summary>
+    /// Decrypts the data of a WinZip AES entry (AE-1 or AE-2, compression method 99).
+    /// The data is a salt, a 2 byte password verification value, the encrypted (possibly compressed) data and a 10 byte authentication code.
+    /// The keys come from the password and salt through PBKDF2-HMAC-SHA1, the data is encrypted with AES in counter mode
+    /// and authenticated with HMAC-SHA1 over the encrypted data, which is updated as the data is decrypted so it's only read once.
+    /// The data is decrypted from start to end, in any number of calls
+    /// </summary>
+    class WinZipAesDecryptor
+    {
+
+    public:
+
+        // The entry's crc32 is stored and checked
+        static constexpr uint16_t AE_1 = 1;
+
+        // The entry's crc32 is stored as 0, the authentication code replaces it
+        static constexpr uint16_t AE_2 = 2;
+
+        static constexpr size_t PASSWORD_VERIFIER_SIZE = 2;
+
+        static constexpr size_t AUTHENTICATION_CODE_SIZE = 10;
+
+        static constexpr unsigned KEY_DERIVATION_ITERATIONS = 1000;
+
+
+    private:
+
+        // The authentication code is updated one piece at a time right before the piece is decrypted, while the piece is still in the cache
+        static constexpr size_t PIECE_SIZE = 16 * 1024;
+
+        AesEncryptor _aes;
+
+        HmacSha1 _hmac;
+
+        const uint8_t* _encryptedData = nullptr;
+        uint64_t _encryptedSize = 0;
+
+        // The number of bytes that were decrypted (and authenticated) so far
+        uint64_t _decryptedSize = 0;
+
+        // The counter of the next keystream block, WinZip starts at 1
+        uint64_t _counter = 1;
+
+        // The rest of the keystream block a call ended inside of
+        std::array<uint8_t, AesEncryptor::BLOCK_SIZE> _keystream { };
+        size_t _keystreamOffset = AesEncryptor::BLOCK_SIZE;
+
+
+    public:
+
+        /// <summary>
+        /// Derives the keys and checks the password
+        /// </summary>
+        /// <param name="password"> The password </param>
+        /// <param name="strength"> The strength from the AES extra field, 1, 2 or 3 for AES-128, AES-192 or AES-256 </param>
+        /// <param name="data"> The entry's data, must outlive the decryptor </param>
+        /// <param name="dataSize"> The entry's compressed size </param>
+        WinZipAesDecryptor(const std::string& password, uint8_t strength, const uint8_t* data, uint64_t dataSize)
+        {
+            if (password.empty() == true)
+                throw std::exception("The file is encrypted, a password is required");
+
+            const size_t keySize = GetKeySize(strength);
+            const size_t saltSize = keySize / 2;
+
+            if (dataSize < GetOverhead(strength))
+                throw std::exception("Reading invalid data");
+
+            // The encryption key, the authentication key and the password verification value
+            std::array<uint8_t, 2 * 32 + PASSWORD_VERIFIER_SIZE> keys;
+
+            DeriveKeys(password, data, saltSize, keys.data(), 2 * keySize + PASSWORD_VERIFIER_SIZE);
+
+            // Wrong passwords are caught here 65535 times out of 65536, the authentication code catches the rest
+            if (memcmp(&keys[2 * keySize], &data[saltSize], PASSWORD_VERIFIER_SIZE) != 0)
+                throw std::exception("Wrong password");
+
+            _aes.SetKey(keys.data(), keySize);
+            _hmac.SetKey(&keys[keySize], keySize);
+
+            _encryptedData = &data[saltSize + PASSWORD_VERIFIER_SIZE];
+            _encryptedSize = dataSize - GetOverhead(strength);
+        };
+
+
+        WinZipAesDecryptor(const WinZipAesDecryptor&) = delete;
+        WinZipAesDecryptor& operator = (const WinZipAesDecryptor&) = delete;
+
+
+    public:
+
+        /// <summary>
+        /// Get the size of the AES key
+        /// </summary>
+        /// <param name="strength"> The strength from the AES extra field </param>
+        /// <returns> 16, 24 or 32 bytes, throws for an unknown strength </returns>
+        static size_t GetKeySize(uint8_t strength)
+        {
+            if ((strength < 1) || (strength > 3))
+                throw std::exception("Invalid AES strength");
+
+            return 8 + 8 * static_cast<size_t>(strength);
+        };
+
+
+        /// <summary>
+        /// Get the number of bytes the encryption adds to the compressed data: the salt, the password verification value and the authentication code
+        /// </summary>
+        /// <param name="strength"> The strength from the AES extra field </param>
+        static uint64_t GetOverhead(uint8_t strength)
+        {
+            return GetKeySize(strength) / 2 + PASSWORD_VERIFIER_SIZE + AUTHENTICATION_CODE_SIZE;
+        };
+
+
+        /// <summary>
+        /// Get a pointer to the encrypted data, past the salt and the password verification value
+        /// </summary>
+        const uint8_t* GetEncryptedData() const
+        {
+            return _encryptedData;
+        };
+
+        /// <summary>
+        /// Get the size of the encrypted data, which is the size of the (possibly compressed) data before it was encrypted
+        /// </summary>
+        uint64_t GetEncryptedSize() const
+        {
+            return _encryptedSize;
+        };
+
+
+        /// <summary>
+        /// Decrypts the next part of the data
+        /// </summary>
+        /// <param name="output"> A buffer that will contain the decrypted bytes </param>
+        /// <param name="size"> The number of bytes to decrypt </param>
+        void Decrypt(uint8_t* output, size_t size)
+        {
+            if (size > (_encryptedSize - _decryptedSize))
+                throw std::exception("Reading invalid data");
+
+            const uint8_t* input = &_encryptedData[_decryptedSize];
+
+            _decryptedSize += size;
+
+            while (size != 0)
+            {
+                const size_t pieceSize = std::min(size, PIECE_SIZE);
+
+                _hmac.Update(input, pieceSize);
+                XorKeystream(input, output, pieceSize);
+
+                input += pieceSize;
+                output += pieceSize;
+                size -= pieceSize;
+            };
+        };
+
+
+        /// <summary>
+        /// Checks the authentication code, data that wasn't decrypted yet is authenticated first
+        /// </summary>
+        /// <returns> True if the data is authentic and the password was right </returns>
+        bool IsAuthentic()
+        {
+            // A decoder can stop before the end of the data, those bytes are still covered by the code
+            if (_decryptedSize < _encryptedSize)
+            {
+                _hmac.Update(&_encryptedData[_decryptedSize], static_cast<size_t>(_encryptedSize - _decryptedSize));
+                _decryptedSize = _encryptedSize;
+            };
+
+            uint8_t mac[Sha1::DIGEST_SIZE];
+            _hmac.Final(mac);
+
+            // WinZip keeps only the first 10 bytes of the MAC
+            return memcmp(mac, &_encryptedData[_encryptedSize], AUTHENTICATION_CODE_SIZE) == 0;
+        };
+
+
+    private:
+
+        void XorKeystream(const uint8_t* input, uint8_t* output, size_t size)
+        {
+            // Use up the keystream the last call left over
+            while ((size != 0) && (_keystreamOffset < AesEncryptor::BLOCK_SIZE))
+            {
+                *output++ = *input++ ^ _keystream[_keystreamOffset++];
+                size--;
+            };
+
+            const size_t blockCount = size / AesEncryptor::BLOCK_SIZE;
+
+            if (blockCount != 0)
+            {
+                _aes.CounterXor(_counter, input, output, blockCount);
+
+                input += blockCount * AesEncryptor::BLOCK_SIZE;
+                output += blockCount * AesEncryptor::BLOCK_SIZE;
+                size -= blockCount * AesEncryptor::BLOCK_SIZE;
+            };
+
+            // A partial block keeps the rest of it's keystream for the next call
+            if (size != 0)
+            {
+                AesEncryptor::MakeCounterBlock(_counter++, _keystream.data());
+                _aes.EncryptBlock(_keystream.data(), _keystream.data());
+
+                for (size_t index = 0; index < size; index++)
+                    output[index] = input[index] ^ _keystream[index];
+
+                _keystreamOffset = size;
+            };
+        };
+
+
+        /// <summary>
+        /// PBKDF2-HMAC-SHA1
+        /// </summary>
+        /// <param name="password"> The password </param>
+        /// <param name="salt"> The salt </param>
+        /// <param name="saltSize"> The size of the salt </param>
+        /// <param name="output"> A buffer that will contain the derived bytes </param>
+        /// <param name="outputSize"> The number of bytes to derive </param>
+        static void DeriveKeys(const std::string& password, const uint8_t* salt, size_t saltSize, uint8_t* output, size_t outputSize)
+        {
+            HmacSha1 hmac;
+            hmac.SetKey(reinterpret_cast<const uint8_t*>(password.data()), password.size());
+
+            std::array<uint8_t, Sha1::BLOCK_SIZE> block;
+            HmacSha1::PrepareDigestBlock(block);
+
+            for (uint32_t blockIndex = 1; outputSize != 0; blockIndex++)
+            {
+                const uint8_t blockIndexBytes[4] = { static_cast<uint8_t>(blockIndex >> 24), static_cast<uint8_t>(blockIndex >> 16), static_cast<uint8_t>(blockIndex >> 8), static_cast<uint8_t>(blockIndex) };
+
+                // U1 = HMAC(salt || block index), every following U is the HMAC of the one before
+                hmac.Update(salt, saltSize);
+                hmac.Update(blockIndexBytes, sizeof(blockIndexBytes));
+                hmac.Final(block.data());
+
+                uint8_t derived[Sha1::DIGEST_SIZE];
+                memcpy(derived, block.data(), sizeof(derived));
+
+                for (unsigned iteration = 1; iteration < KEY_DERIVATION_ITERATIONS; iteration++)
+                {
+                    hmac.ComputeDigestMac(block.data(), block.data());
+
+                    for (size_t index = 0; index < sizeof(derived); index++)
+                        derived[index] ^= block[index];
+                };
+
+                const size_t copySize = std::min(outputSize, sizeof(derived));
+
+                memcpy(output, derived, copySize);
+
+                output += copySize;
+                outputSize -= copySize;
+            };
+        };
+
+    };
+
+};
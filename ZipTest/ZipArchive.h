@@ -0,0 +1,772 @@
+#pragma once
+#include <span>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstring>
+#include <algorithm>
+
+#include "ZipExtractor.h"
+#include "MappedFile.h"
+#include "DecompressedEntryCache.h"
+#include "BufferPool.h"
+#include "AsyncIoBackend.h"
+
+
+namespace ZipExtractor
+{
+
+    // Information about a single file or folder inside the zip, parsed from it's central directory
+    struct EntryInfo
+    {
+        // The file's name (and path) inside the zip
+        std::string filename;
+
+        // The compression method that was used to compress the file
+        CompressionMethod compressionMethod = CompressionMethod::None;
+
+        // The encryption that was used to encrypt the file
+        ZipEncryption encryptionType = ZipEncryption::None;
+
+        // The general purpose bit flag from the central directory
+        uint16_t generalPurposeBitFlag = 0;
+
+        // The crc32 of the uncompressed data
+        uint32_t crc32 = 0;
+
+        // Size of the file after compression
+        uint64_t compressedSize = 0;
+
+        // Size of the file pre-compression
+        uint64_t uncompressedSize = 0;
+
+        // An offset to the file's File header
+        uint64_t fileHeaderOffset = 0;
+
+        // The index of the entry's central directory
+        size_t entryIndex = 0;
+
+        // WinZipAesDecryptor::AE_1 or WinZipAesDecryptor::AE_2, only set if the entry is AES encrypted
+        uint16_t aesVersion = 0;
+
+        // 1, 2 or 3 for AES-128, AES-192 or AES-256, only set if the entry is AES encrypted
+        uint8_t aesStrength = 0;
+
+        // True if this entry is a folder
+        bool isDirectory = false;
+    };
+
+
+
+    /// <summary>
+    /// An opened zip file.
+    /// The zip file is memory mapped and it's central directories are parsed once when the archive is opened.
+    /// All const functions are safe to call from many threads at the same time, they only read from the mapping
+    /// and every call decompresses with it's own (or the calling thread's) inflate state
+    /// </summary>
+    class ZipArchive
+    {
+
+    private:
+
+        // The size of the End central directory without the comment
+        static constexpr size_t END_CENTRAL_DIRECTORY_SIZE = 22;
+
+        // The size of a Central directory without the filename, extra field and comment
+        static constexpr size_t CENTRAL_DIRECTORY_SIZE = 46;
+
+        // The size of a File header without the filename and extra field
+        static constexpr size_t FILE_HEADER_SIZE = 30;
+
+
+    private:
+
+        // Nothing below changes after the constructor is done, which is what makes concurrent reads safe
+
+        // The memory mapped zip file
+        const MappedFile _mappedFile;
+
+        const ArchiveIdentity _identity;
+
+        // Every file and folder inside the zip, in central directory order
+        const std::vector<EntryInfo> _entries;
+
+        // The password of the encrypted entries, empty if there is none
+        const std::string _password;
+
+
+    public:
+
+        /// <summary>
+        /// Opens the zip file found at the given path
+        /// </summary>
+        /// <param name="zipFilepath"> A filepath to the zip </param>
+        /// <param name="hugePages"> The huge page backing to try for the archive's mapping </param>
+        /// <param name="password"> The password of the encrypted entries, if there are any </param>
+        explicit ZipArchive(const std::string& zipFilepath, HugePageMode hugePages = HugePageMode::None, const std::string& password = std::string()) :
+            _mappedFile(zipFilepath, hugePages),
+            _identity(Utilities::GetArchiveIdentity(zipFilepath)),
+            _entries(ParseCentralDirectories(_mappedFile)),
+            _password(password)
+        {
+        };
+
+        ZipArchive(const ZipArchive&) = delete;
+        ZipArchive& operator = (const ZipArchive&) = delete;
+
+
+        /// <summary>
+        /// Opens the zip file found at the given path
+        /// </summary>
+        /// <param name="zipFilepath"> A filepath to the zip </param>
+        /// <param name="hugePages"> The huge page backing to try for the archive's mapping </param>
+        /// <param name="password"> The password of the encrypted entries, if there are any </param>
+        /// <returns></returns>
+        static std::shared_ptr<ZipArchive> Open(const std::string& zipFilepath, HugePageMode hugePages = HugePageMode::None, const std::string& password = std::string())
+        {
+            return std::make_shared<ZipArchive>(zipFilepath, hugePages, password);
+        };
+
+
+    public:
+
+        /// <summary>
+        /// Look for an entry by it's name
+        /// </summary>
+        /// <param name="filename"> The entry's name inside the zip </param>
+        /// <returns> The entry, or nullptr if the zip doesn't contain it </returns>
+        const EntryInfo* FindEntry(const std::string& filename) const
+        {
+            auto entryIterator = std::find_if(_entries.begin(), _entries.end(), [&](const EntryInfo& entry)
+            {
+                return entry.filename == filename;
+            });
+
+            if (entryIterator == _entries.end())
+                return nullptr;
+
+            return &(*entryIterator);
+        };
+
+
+        /// <summary>
+        /// Get a pointer to the entry's (possibly compressed) data inside the mapping.
+        /// Throws if the data doesn't fit inside the zip, or if a stored entry's sizes differ
+        /// </summary>
+        /// <param name="entry"> An entry inside this zip </param>
+        /// <returns></returns>
+        const uint8_t* GetEntryData(const EntryInfo& entry) const
+        {
+            const uint8_t* const zipFileData = _mappedFile.GetData();
+            const size_t zipFileSize = _mappedFile.GetSize();
+
+            if ((entry.fileHeaderOffset + FILE_HEADER_SIZE) > zipFileSize)
+                throw std::exception("Reading invalid data");
+
+            // A pointer to the File header
+            const uint8_t* const fileHeaderPointer = &zipFileData[entry.fileHeaderOffset];
+
+            if (Utilities::ReadUInt32(fileHeaderPointer) != PK_FILE_HEADER_SIGNATURE_LITTLE_ENDIAN)
+                throw std::exception("Invalid file header");
+
+            // The filename and extra field inside the File header don't have to match the ones inside the central directory
+            const uint16_t filenameLength = Utilities::ReadUInt16(&fileHeaderPointer[26]);
+            const uint16_t extraFieldLength = Utilities::ReadUInt16(&fileHeaderPointer[28]);
+
+            const uint64_t fileDataOffset = entry.fileHeaderOffset + FILE_HEADER_SIZE + filenameLength + extraFieldLength;
+
+            if ((fileDataOffset + entry.compressedSize) > zipFileSize)
+                throw std::exception("Reading invalid data");
+
+            CheckStoredSizes(entry);
+
+            return &zipFileData[fileDataOffset];
+        };
+
+
+        /// <summary>
+        /// Decompresses an entry into memory
+        /// </summary>
+        /// <param name="entry"> An entry inside this zip </param>
+        /// <param name="fileDataOut"> An output buffer that will contain the entry's decompressed contents </param>
+        void ReadEntry(const EntryInfo& entry, std::vector<uint8_t>& fileDataOut) const
+        {
+            fileDataOut.resize(static_cast<size_t>(entry.uncompressedSize));
+
+            ExtractTo(entry, fileDataOut);
+        };
+
+
+        /// <summary>
+        /// Decompresses an entry into a buffer leased from a pool, which unlike a vector isn't zero filled first
+        /// </summary>
+        /// <param name="entry"> An entry inside this zip </param>
+        /// <param name="bufferPool"> The pool to lease the buffer from </param>
+        /// <returns> The entry's decompressed contents, returned to the pool once it's destroyed </returns>
+        PooledBuffer ReadEntry(const EntryInfo& entry, BufferPool& bufferPool) const
+        {
+            PooledBuffer fileData = bufferPool.Lease(static_cast<size_t>(entry.uncompressedSize));
+
+            ExtractTo(entry, fileData);
+
+            return fileData;
+        };
+
+
+        /// <summary>
+        /// Extracts an entry onto disk, folders are created and files are written through the calling thread's ExtractionPipeline
+        /// </summary>
+        /// <param name="entry"> An entry inside this zip </param>
+        /// <param name="outputFolder"> An output path to which the entry will be extracted </param>
+        /// <param name="progress"> Optional, receives the written bytes and the finished file and can cancel it between chunks </param>
+        void ExtractEntry(const EntryInfo& entry, const std::string& outputFolder, ExtractionProgress* progress = nullptr) const
+        {
+            if (progress != nullptr)
+                progress->ThrowIfCancelled();
+
+            if (entry.encryptionType == ZipEncryption::ZipCrypto)
+                throw std::exception("ZipCrypto encryption isn't supported, yet.");
+
+            // Throws for names that would end up outside of the output folder
+            const std::filesystem::path outputPath = Utilities::GetOutputPath(outputFolder, entry.filename);
+
+            if (entry.isDirectory == true)
+            {
+                std::filesystem::create_directories(outputPath);
+                return;
+            };
+
+            if (CodecRegistry::GetDefault().IsSupported(entry.compressionMethod) == false)
+                throw std::exception("Unsupported compression method");
+
+            // Zips don't have to contain an entry for every folder
+            if (outputPath.has_parent_path() == true)
+                std::filesystem::create_directories(outputPath.parent_path());
+
+            const uint8_t* const fileDataPointer = GetEntryData(entry);
+
+            // Checks the password before the file is created
+            std::unique_ptr<WinZipAesDecryptor> decryptor;
+
+            if (entry.encryptionType == ZipEncryption::AES)
+                decryptor = std::make_unique<WinZipAesDecryptor>(_password, entry.aesStrength, fileDataPointer, entry.compressedSize);
+
+            // An encrypted entry is decrypted by the pipeline's read stage
+            const uint32_t writtenCrc32 = ExtractionPipeline::GetThreadPipeline().Run(fileDataPointer,
+                                                                                      entry.compressedSize,
+                                                                                      entry.uncompressedSize,
+                                                                                      entry.compressionMethod,
+                                                                                      entry.generalPurposeBitFlag,
+                                                                                      outputPath.string(),
+                                                                                      progress,
+                                                                                      decryptor.get());
+
+            if ((decryptor != nullptr) && (decryptor->IsAuthentic() == false))
+                throw std::exception("Authentication failed, the file was modified or the password is wrong");
+
+            if ((HasCrc32(entry) == true) && (writtenCrc32 != entry.crc32))
+                throw std::exception("CRC mismatch");
+
+            if (progress != nullptr)
+                progress->FinishEntry(entry.filename, entry.uncompressedSize);
+        };
+
+
+        /// <summary>
+        /// Extracts every entry onto disk, one after the other
+        /// </summary>
+        /// <param name="outputFolder"> An output path to which the zip will be extracted </param>
+        /// <param name="progress"> Optional, receives the extraction's progress and can cancel it between files and chunks </param>
+        void ExtractAll(const std::string& outputFolder, ExtractionProgress* progress = nullptr) const
+        {
+            if (progress != nullptr)
+            {
+                uint64_t totalEntries = 0;
+                uint64_t totalBytes = 0;
+
+                for (const EntryInfo& entry : _entries)
+                {
+                    if (entry.isDirectory == true)
+                        continue;
+
+                    totalEntries++;
+                    totalBytes += entry.uncompressedSize;
+                };
+
+                progress->AddTotal(totalEntries, totalBytes);
+            };
+
+            for (const EntryInfo& entry : _entries)
+                ExtractEntry(entry, outputFolder, progress);
+        };
+
+
+        /// <summary>
+        /// Decompresses an entry into a caller supplied buffer without any heap allocations.
+        /// The buffer must be at least EntryInfo::uncompressedSize bytes long, and the decompressed data is checked against the entry's crc32
+        /// </summary>
+        /// <param name="entry"> An entry inside this zip </param>
+        /// <param name="destination"> A buffer that will contain the entry's decompressed contents </param>
+        /// <returns> The number of bytes written into destination </returns>
+        size_t ExtractTo(const EntryInfo& entry, std::span<uint8_t> destination) const
+        {
+            return DecompressEntryData(entry, GetEntryData(entry), destination);
+        };
+
+
+        /// <summary>
+        /// Reads the bytes [offset, offset + length) of an entry's decompressed contents.
+        /// Stored entries are copied straight out of the mapping, compressed entries are only decompressed up to the end of the range
+        /// </summary>
+        /// <param name="entry"> An entry inside this zip </param>
+        /// <param name="offset"> An offset inside the entry's decompressed contents </param>
+        /// <param name="length"> The number of bytes to read </param>
+        /// <param name="destination"> A buffer of at least length bytes that will contain the read bytes </param>
+        /// <returns> The number of bytes read, less than length only if the range goes past the end of the entry </returns>
+        size_t ReadRange(const EntryInfo& entry, uint64_t offset, size_t length, uint8_t* destination) const
+        {
+            // The authentication code covers the whole entry, so encrypted entries are only ever read whole
+            if (entry.encryptionType != ZipEncryption::None)
+                throw std::exception("Reading a range of an encrypted entry isn't supported, yet.");
+
+            if (offset >= entry.uncompressedSize)
+                return 0;
+
+            // Don't read past the end of the entry
+            length = static_cast<size_t>(std::min<uint64_t>(length, entry.uncompressedSize - offset));
+
+            if (length == 0)
+                return 0;
+
+            const uint8_t* const fileDataPointer = GetEntryData(entry);
+
+            switch (entry.compressionMethod)
+            {
+                case CompressionMethod::None:
+                {
+                    memcpy(destination, &fileDataPointer[offset], length);
+                    return length;
+                };
+
+                default:
+                {
+                    // Every thread has it's own codecs so concurrent range reads don't share any state, the stream only carries the buffers
+                    DecompressionCodec& codec = CodecRegistry::GetDefault().GetThreadCodec(entry.compressionMethod);
+
+                    CodecStreamInfo streamInfo;
+                    streamInfo.uncompressedSize = entry.uncompressedSize;
+                    streamInfo.generalPurposeBitFlag = entry.generalPurposeBitFlag;
+
+                    codec.Reset(streamInfo);
+
+                    z_stream stream { };
+
+                    // The compressed data can be bigger than avail_in can describe, it's handed to zlib in parts
+                    uint64_t remainingInput = entry.compressedSize;
+
+                    stream.next_in = const_cast<Bytef*>(fileDataPointer);
+                    stream.avail_in = 0;
+
+                    // None of the codecs can seek, everything before the range is decompressed into this buffer and thrown away
+                    uint8_t discardBuffer[16384];
+
+                    uint64_t bytesDiscarded = 0;
+
+                    int result = Z_OK;
+
+                    while ((bytesDiscarded < offset) && (result == Z_OK))
+                    {
+                        Utilities::RefillZlibBuffer(stream.avail_in, remainingInput);
+
+                        stream.next_out = discardBuffer;
+                        stream.avail_out = static_cast<uInt>(std::min<uint64_t>(sizeof(discardBuffer), offset - bytesDiscarded));
+
+                        const uInt outputBefore = stream.avail_out;
+
+                        result = codec.Decode(stream);
+
+                        bytesDiscarded += outputBefore - stream.avail_out;
+                    };
+
+                    // Decompress the range itself straight into the destination and stop as soon as it's full
+                    uint64_t remainingOutput = length;
+
+                    stream.next_out = destination;
+                    stream.avail_out = 0;
+
+                    while (((stream.avail_out != 0) || (remainingOutput != 0)) && (result == Z_OK))
+                    {
+                        Utilities::RefillZlibBuffer(stream.avail_in, remainingInput);
+                        Utilities::RefillZlibBuffer(stream.avail_out, remainingOutput);
+
+                        result = codec.Decode(stream);
+                    };
+
+                    const size_t bytesRead = static_cast<size_t>(length - remainingOutput - stream.avail_out);
+
+                    if ((result != Z_OK && result != Z_STREAM_END) || (bytesRead != length))
+                        throw std::exception("Failed to decompress file");
+
+                    return bytesRead;
+                };
+            };
+        };
+
+
+        /// <summary>
+        /// Decompresses an entry into memory, or returns it from the cache if it was already decompressed.
+        /// Encrypted entries are never cached, the cache is shared by archives opened with any (or no) password
+        /// </summary>
+        /// <param name="entry"> An entry inside this zip </param>
+        /// <param name="cache"> The cache to use </param>
+        /// <returns> The decompressed entry </returns>
+        CachedEntryBuffer ReadEntry(const EntryInfo& entry, DecompressedEntryCache& cache) const
+        {
+            if (entry.encryptionType != ZipEncryption::None)
+            {
+                std::vector<uint8_t> decompressedData;
+                ReadEntry(entry, decompressedData);
+
+                return std::make_shared<const std::vector<uint8_t>>(std::move(decompressedData));
+            };
+
+            return cache.GetOrLoad(CachedEntryKey { _identity, entry.entryIndex },
+                                   [&](std::vector<uint8_t>& decompressedData)
+            {
+                ReadEntry(entry, decompressedData);
+            });
+        };
+
+
+    public:
+
+        /// <summary>
+        /// Reads and decompresses an entry into memory without blocking the calling thread.
+        /// The compressed data is read through the context's I/O backend and decompressed on it's compute pool,
+        /// so the awaiting coroutine resumes on one of the context's threads. The archive must outlive the task
+        /// </summary>
+        /// <param name="entry"> An entry inside this zip </param>
+        /// <param name="context"> The I/O backend and compute pool to run on </param>
+        /// <param name="bufferPool"> The pool the read and decompressed data is leased from </param>
+        /// <returns> The entry's decompressed contents </returns>
+        Task<PooledBuffer> ReadEntryAsync(EntryInfo entry, AsyncContext& context = AsyncContext::GetDefault(), BufferPool& bufferPool = BufferPool::GetDefault()) const
+        {
+            if (entry.encryptionType == ZipEncryption::ZipCrypto)
+                throw std::exception("ZipCrypto encryption isn't supported, yet.");
+
+            // Read the File header to find where the data starts
+            uint8_t fileHeader[FILE_HEADER_SIZE];
+            co_await ReadAsync(context, MakeReadRequest(entry.fileHeaderOffset, fileHeader));
+
+            if (Utilities::ReadUInt32(fileHeader) != PK_FILE_HEADER_SIGNATURE_LITTLE_ENDIAN)
+                throw std::exception("Invalid file header");
+
+            const uint16_t filenameLength = Utilities::ReadUInt16(&fileHeader[26]);
+            const uint16_t extraFieldLength = Utilities::ReadUInt16(&fileHeader[28]);
+
+            const uint64_t fileDataOffset = entry.fileHeaderOffset + FILE_HEADER_SIZE + filenameLength + extraFieldLength;
+
+            PooledBuffer compressedData = bufferPool.Lease(static_cast<size_t>(entry.compressedSize));
+            co_await ReadAsync(context, MakeReadRequest(fileDataOffset, compressedData));
+
+            co_await ScheduleOn(context.computePool);
+
+            // Stored entries are already the decompressed contents, only the crc has to be checked
+            if ((entry.compressionMethod == CompressionMethod::None) && (entry.encryptionType == ZipEncryption::None))
+            {
+                CheckStoredSizes(entry);
+
+                if (Utilities::Crc32(0, compressedData.data(), compressedData.size()) != entry.crc32)
+                    throw std::exception("CRC mismatch");
+
+                co_return compressedData;
+            };
+
+            PooledBuffer fileData = bufferPool.Lease(static_cast<size_t>(entry.uncompressedSize));
+            DecompressEntryData(entry, compressedData.data(), fileData);
+
+            co_return fileData;
+        };
+
+
+        /// <summary>
+        /// Extracts an entry onto disk without blocking the calling thread.
+        /// The awaiting coroutine resumes on one of the context's threads, and the archive must outlive the task
+        /// </summary>
+        /// <param name="entry"> An entry inside this zip </param>
+        /// <param name="outputFolder"> An output path to which the entry will be extracted </param>
+        /// <param name="context"> The I/O backend and compute pool to run on </param>
+        /// <returns></returns>
+        Task<void> ExtractAsync(EntryInfo entry, std::string outputFolder, AsyncContext& context = AsyncContext::GetDefault()) const
+        {
+            // Throws for names that would end up outside of the output folder
+            const std::filesystem::path outputPath = Utilities::GetOutputPath(outputFolder, entry.filename);
+
+            if (entry.isDirectory == true)
+            {
+                std::filesystem::create_directories(outputPath);
+                co_return;
+            };
+
+            const PooledBuffer fileData = co_await ReadEntryAsync(entry, context);
+
+            // Zips don't have to contain an entry for every folder
+            if (outputPath.has_parent_path() == true)
+                std::filesystem::create_directories(outputPath.parent_path());
+
+            co_await WriteFileAsync(context, outputPath.string(), fileData);
+        };
+
+
+    public:
+
+        const std::vector<EntryInfo>& GetEntries() const
+        {
+            return _entries;
+        };
+
+        const ArchiveIdentity& GetIdentity() const
+        {
+            return _identity;
+        };
+
+        /// <summary>
+        /// Get a pointer to the entire memory mapped zip file
+        /// </summary>
+        const uint8_t* GetData() const
+        {
+            return _mappedFile.GetData();
+        };
+
+        size_t GetSize() const
+        {
+            return _mappedFile.GetSize();
+        };
+
+        /// <summary>
+        /// Get the huge page backing the zip file actually got
+        /// </summary>
+        HugePageMode GetHugePageMode() const
+        {
+            return _mappedFile.GetHugePageMode();
+        };
+
+
+    private:
+
+        /// <summary>
+        /// Creates a request that reads a range of this zip
+        /// </summary>
+        /// <param name="offset"> An offset inside the zip file to read from </param>
+        /// <param name="destination"> A buffer that will contain the read bytes </param>
+        /// <returns></returns>
+        AsyncReadRequest MakeReadRequest(uint64_t offset, std::span<uint8_t> destination) const
+        {
+            return AsyncReadRequest { &_identity.archivePath, _mappedFile.GetData(), _mappedFile.GetSize(), offset, destination };
+        };
+
+
+        /// <summary>
+        /// Decompresses (and decrypts) an entry's data into a caller supplied buffer and checks it against the entry's crc32
+        /// </summary>
+        /// <param name="entry"> The entry the data belongs to </param>
+        /// <param name="fileDataPointer"> A pointer to the entry's (possibly compressed and encrypted) data </param>
+        /// <param name="destination"> A buffer that will contain the entry's decompressed contents </param>
+        /// <returns> The number of bytes written into destination </returns>
+        size_t DecompressEntryData(const EntryInfo& entry, const uint8_t* fileDataPointer, std::span<uint8_t> destination) const
+        {
+            if (entry.encryptionType == ZipEncryption::ZipCrypto)
+                throw std::exception("ZipCrypto encryption isn't supported, yet.");
+
+            if (destination.size() < entry.uncompressedSize)
+                throw std::exception("Destination buffer is too small");
+
+            // Checked up front so an encrypted entry doesn't derive it's keys for nothing
+            if (CodecRegistry::GetDefault().IsSupported(entry.compressionMethod) == false)
+                throw std::exception("Unsupported compression method");
+
+            const size_t uncompressedSize = static_cast<size_t>(entry.uncompressedSize);
+
+            if (entry.encryptionType == ZipEncryption::AES)
+            {
+                WinZipAesDecryptor decryptor(_password, entry.aesStrength, fileDataPointer, entry.compressedSize);
+
+                Utilities::InflateEncrypted(decryptor, destination.data(), entry.uncompressedSize, entry.compressionMethod, entry.generalPurposeBitFlag);
+
+                if (decryptor.IsAuthentic() == false)
+                    throw std::exception("Authentication failed, the file was modified or the password is wrong");
+            }
+            else if (uncompressedSize != 0)
+            {
+                // The destination holds the whole entry, codecs with a window use it as their window
+                DecompressionCodec& codec = CodecRegistry::GetDefault().GetThreadCodec(entry.compressionMethod);
+
+                codec.DecodeBuffer(fileDataPointer, entry.compressedSize, destination.data(), entry.uncompressedSize, entry.generalPurposeBitFlag);
+            };
+
+            if ((HasCrc32(entry) == true) && (Utilities::Crc32(0, destination.data(), uncompressedSize) != entry.crc32))
+                throw std::exception("CRC mismatch");
+
+            return uncompressedSize;
+        };
+
+
+        /// <summary>
+        /// Throws if a stored entry's sizes differ.
+        /// Stored entries are copied straight out of the zip up to their uncompressed size, which must not run past their data
+        /// </summary>
+        /// <param name="entry"> An entry inside this zip </param>
+        static void CheckStoredSizes(const EntryInfo& entry)
+        {
+            if ((entry.compressionMethod == CompressionMethod::None) &&
+                (entry.encryptionType == ZipEncryption::None) &&
+                (entry.compressedSize != entry.uncompressedSize))
+                throw std::exception("Invalid stored entry, it's sizes don't match");
+        };
+
+
+        /// <summary>
+        /// Check if the entry's crc32 was stored, AE-2 entries store 0 and rely on their authentication code instead
+        /// </summary>
+        /// <param name="entry"> An entry inside this zip </param>
+        static bool HasCrc32(const EntryInfo& entry)
+        {
+            return (entry.encryptionType != ZipEncryption::AES) || (entry.aesVersion != WinZipAesDecryptor::AE_2);
+        };
+
+
+        /// <summary>
+        /// Finds the End central directory and parses every central directory
+        /// </summary>
+        /// <param name="mappedFile"> The memory mapped zip file </param>
+        /// <returns> Every file and folder inside the zip </returns>
+        static std::vector<EntryInfo> ParseCentralDirectories(const MappedFile& mappedFile)
+        {
+            const uint8_t* const zipFileData = mappedFile.GetData();
+            const size_t zipFileSize = mappedFile.GetSize();
+
+            if (zipFileSize < END_CENTRAL_DIRECTORY_SIZE)
+                throw std::exception("Invalid zip file");
+
+            // The End central directory is followed by a comment of at most 65535 bytes, so only the end of the file has to be searched
+            const size_t searchEnd = (zipFileSize > END_CENTRAL_DIRECTORY_SIZE + 0xFFFF) ? (zipFileSize - END_CENTRAL_DIRECTORY_SIZE - 0xFFFF) : 0;
+
+            size_t endCentralDirectoryOffset = zipFileSize - END_CENTRAL_DIRECTORY_SIZE;
+
+            while (Utilities::ReadUInt32(&zipFileData[endCentralDirectoryOffset]) != PK_END_OF_CENTRAL_DIRECTORY_LITTLE_ENDIAN)
+            {
+                if (endCentralDirectoryOffset == searchEnd)
+                    throw std::exception("Invalid zip file");
+
+                endCentralDirectoryOffset--;
+            };
+
+            const uint8_t* const endCentralDirectory = &zipFileData[endCentralDirectoryOffset];
+
+            // The number of central directories in the zip
+            uint64_t entryCount = Utilities::ReadUInt16(&endCentralDirectory[10]);
+
+            // Get the offset to the first Central directory
+            uint64_t centralDirectoryOffset = Utilities::ReadUInt32(&endCentralDirectory[16]);
+
+            // The central directories end where the End central directory, or the ZIP64 End central directory that precedes it, begins
+            uint64_t centralDirectoriesEnd = endCentralDirectoryOffset;
+
+            const uint8_t* const zip64EndCentralDirectory = Utilities::FindZip64EndCentralDirectory(zipFileData, endCentralDirectoryOffset);
+
+            // ZIP64 files keep the real 64-bit entry count and offset inside the ZIP64 End central directory
+            if (zip64EndCentralDirectory != nullptr)
+            {
+                entryCount = Utilities::ReadUInt64(&zip64EndCentralDirectory[32]);
+                centralDirectoryOffset = Utilities::ReadUInt64(&zip64EndCentralDirectory[48]);
+                centralDirectoriesEnd = static_cast<uint64_t>(zip64EndCentralDirectory - zipFileData);
+            };
+
+            if (centralDirectoryOffset > centralDirectoriesEnd)
+                throw std::exception("Reading invalid data");
+
+            std::vector<EntryInfo> entries;
+
+            // Don't trust the entry count with the allocation, every entry takes at least CENTRAL_DIRECTORY_SIZE bytes
+            entries.reserve(static_cast<size_t>(std::min<uint64_t>(entryCount, (centralDirectoriesEnd - centralDirectoryOffset) / CENTRAL_DIRECTORY_SIZE)));
+
+            uint64_t currentOffset = centralDirectoryOffset;
+
+            for (uint64_t entryIndex = 0; entryIndex < entryCount; entryIndex++)
+            {
+                if ((currentOffset + CENTRAL_DIRECTORY_SIZE) > centralDirectoriesEnd)
+                    throw std::exception("Reading invalid data");
+
+                const uint8_t* const centralDirectory = &zipFileData[currentOffset];
+
+                if (Utilities::ReadUInt32(centralDirectory) != static_cast<uint32_t>(PK_CENTRAL_DIRECTORY_SIGNATURE_LITTLE_ENDIAN))
+                    throw std::exception("Invalid central directory");
+
+                const uint16_t filenameLength = Utilities::ReadUInt16(&centralDirectory[28]);
+                const uint16_t extraFieldLength = Utilities::ReadUInt16(&centralDirectory[30]);
+                const uint16_t commentLength = Utilities::ReadUInt16(&centralDirectory[32]);
+
+                const uint64_t centralDirectoryLength = CENTRAL_DIRECTORY_SIZE + filenameLength + extraFieldLength + commentLength;
+
+                if ((currentOffset + centralDirectoryLength) > centralDirectoriesEnd)
+                    throw std::exception("Reading invalid data");
+
+                EntryInfo entry;
+
+                entry.entryIndex = static_cast<size_t>(entryIndex);
+                entry.generalPurposeBitFlag = Utilities::ReadUInt16(&centralDirectory[8]);
+                entry.compressionMethod = static_cast<CompressionMethod>(Utilities::ReadUInt16(&centralDirectory[10]));
+                entry.crc32 = Utilities::ReadUInt32(&centralDirectory[16]);
+
+                // Sizes and offsets that don't fit into 32 bits are stored inside the ZIP64 extra field
+                Utilities::ReadCentralDirectorySizes(centralDirectory, entry.compressedSize, entry.uncompressedSize, entry.fileHeaderOffset);
+
+                const char* filenamePointer = reinterpret_cast<const char*>(&centralDirectory[CENTRAL_DIRECTORY_SIZE]);
+                entry.filename.assign(filenamePointer, filenameLength);
+
+                // Folders are stored as empty entries with a trailing slash
+                entry.isDirectory = (entry.filename.empty() == false) && (entry.filename.back() == '/');
+
+                ParseEncryption(entry, &centralDirectory[CENTRAL_DIRECTORY_SIZE + filenameLength], extraFieldLength);
+
+                entries.push_back(std::move(entry));
+
+                currentOffset += centralDirectoryLength;
+            };
+
+            return entries;
+        };
+
+
+        /// <summary>
+        /// Find out which encryption was used to encrypt the entry
+        /// </summary>
+        /// <param name="entry"> The entry, the compression method will be replaced with the real one if AES was used </param>
+        /// <param name="extraField"> A pointer to the central directory's extra field </param>
+        /// <param name="extraFieldLength"> The length of the extra field </param>
+        static void ParseEncryption(EntryInfo& entry, const uint8_t* extraField, uint16_t extraFieldLength)
+        {
+            // If the first bit inside the flag isn't marked, the entry isn't encrypted
+            if ((entry.generalPurposeBitFlag & 1 << 0) == 0)
+            {
+                entry.encryptionType = ZipEncryption::None;
+                return;
+            };
+
+            // WinZip AES sets the compression method to 99 and stores the real compression method inside it's own extra field
+            if (static_cast<uint16_t>(entry.compressionMethod) != AES_COMPRESSION_METHOD)
+            {
+                entry.encryptionType = ZipEncryption::ZipCrypto;
+                return;
+            };
+
+            entry.encryptionType = ZipEncryption::AES;
+
+            // Without the AES extra field the compression method stays 99, which no codec is registered for
+            Utilities::ReadAesExtraField(extraField, extraFieldLength, entry.aesVersion, entry.aesStrength, entry.compressionMethod);
+        };
+
+    };
+
+};
@@ -1,11 +1,17 @@
 #pragma once
+#include <array>
+#include <memory>
 #include <cstdint>
 #include <vector>
 #include <string>
 #include <fstream>
 #include <filesystem>
+#include <algorithm>
 
 #include "deflate.h"
+#include "WinZipAes.h"
+#include "CodecRegistry.h"
+#include "ExtractionPipeline.h"
 
 
 namespace ZipExtractor
@@ -19,55 +25,42 @@ namespace ZipExtractor
     // A signature for a zip file End central directory
     constexpr int PK_END_OF_CENTRAL_DIRECTORY = 0x504b0506;
 
+    // A signature for a zip file header, as read by Utilities::ReadUInt32
+    constexpr uint32_t PK_FILE_HEADER_SIGNATURE_LITTLE_ENDIAN = 0x04034B50;
 
-    // A compression method used by the Zip file to compresse the file's contents.
-    // Most of the time zip uses the DEFLATE algorithm to compress the files
-    enum class CompressionMethod : short
-    {
-        // No ecnryption is used
-        None = 0,
-
-        Shrunk = 1,
-
-        LZW = 1,
-
-        ReducedWithCompressionFactor1 = 2,
-        ReducedWithCompressionFactor2 = 3,
-        ReducedWithCompressionFactor3 = 4,
-        ReducedWithCompressionFactor4 = 5,
-
-        Imploded = 6,
-
-        Reserved_1 = 7,
-
-        // Zip used DEFLATE to compress the file
-        Deflated = 8,
+    // A signature for a zip file End central directory, as read by Utilities::ReadUInt32
+    constexpr uint32_t PK_END_OF_CENTRAL_DIRECTORY_LITTLE_ENDIAN = 0x06054B50;
 
-        EnhancedDeflated = 9,
+    // A signature for a ZIP64 End central directory record, as read by Utilities::ReadUInt32
+    constexpr uint32_t PK_ZIP64_END_OF_CENTRAL_DIRECTORY_LITTLE_ENDIAN = 0x06064B50;
 
-        PKWareDCLimploded = 10,
+    // A signature for a ZIP64 End central directory locator, as read by Utilities::ReadUInt32
+    constexpr uint32_t PK_ZIP64_END_OF_CENTRAL_DIRECTORY_LOCATOR_LITTLE_ENDIAN = 0x07064B50;
 
-        Reserved_2 = 11,
+    // A signature for a data descriptor, as read by Utilities::ReadUInt32
+    constexpr uint32_t PK_DATA_DESCRIPTOR_SIGNATURE_LITTLE_ENDIAN = 0x08074B50;
 
-        BZIP2 = 12,
+    // The header ID of the ZIP64 extended information extra field
+    constexpr uint16_t ZIP64_EXTRA_FIELD_ID = 0x0001;
 
-        Reserved_3 = 13,
+    // A 32-bit size or offset with this value was moved into the ZIP64 extra field
+    constexpr uint32_t ZIP64_PLACEHOLDER = 0xFFFFFFFF;
 
-        LZMA = 14,
+    // The size of a ZIP64 End central directory locator
+    constexpr size_t ZIP64_END_CENTRAL_DIRECTORY_LOCATOR_SIZE = 20;
 
-        Reserved_4 = 15,
-        Reserved_5 = 16,
-        Reserved_6 = 17,
+    // The size of a ZIP64 End central directory record without it's extensible data
+    constexpr size_t ZIP64_END_CENTRAL_DIRECTORY_SIZE = 56;
 
-        IBM_TERSE = 18,
-        IBM_LZ77z = 19,
+    // The header ID of the extra field that WinZip AES uses to store the actual compression method
+    constexpr uint16_t AES_EXTRA_FIELD_ID = 0x9901;
 
-        PPMd_Version_I_Rev_1 = 98,
-    };
+    // The compression method WinZip AES entries are stored with, the actual one is inside the AES extra field
+    constexpr uint16_t AES_COMPRESSION_METHOD = 99;
 
 
     // An encryption type used by zip to encrypt the data.
-    // Unfortunately this extractor doesn't yet implement an encryption-decryption system
+    // Only WinZip AES is decrypted, ZipCrypto isn't implemented
     enum class ZipEncryption
     {
         // No encryption was used 
@@ -86,6 +79,266 @@ namespace ZipExtractor
     namespace Utilities
     {
 
+        /// <summary>
+        /// Reads a little endian 2 byte value
+        /// </summary>
+        /// <param name="pointer"> A pointer to the value </param>
+        /// <returns></returns>
+        uint16_t ReadUInt16(const uint8_t* pointer)
+        {
+            return static_cast<uint16_t>(pointer[0] |
+                                         pointer[1] << 8);
+        };
+
+        /// <summary>
+        /// Reads a little endian 4 byte value
+        /// </summary>
+        /// <param name="pointer"> A pointer to the value </param>
+        /// <returns></returns>
+        uint32_t ReadUInt32(const uint8_t* pointer)
+        {
+            return (static_cast<uint32_t>(pointer[0]) |
+                    static_cast<uint32_t>(pointer[1]) << 8 |
+                    static_cast<uint32_t>(pointer[2]) << 16 |
+                    static_cast<uint32_t>(pointer[3]) << 24);
+        };
+
+        /// <summary>
+        /// Reads a little endian 8 byte value
+        /// </summary>
+        /// <param name="pointer"> A pointer to the value </param>
+        /// <returns></returns>
+        uint64_t ReadUInt64(const uint8_t* pointer)
+        {
+            return (static_cast<uint64_t>(ReadUInt32(pointer)) |
+                    static_cast<uint64_t>(ReadUInt32(pointer + 4)) << 32);
+        };
+
+
+        /// <summary>
+        /// Replaces the sizes and offset that are set to ZIP64_PLACEHOLDER with their 64-bit values from the ZIP64 extra field.
+        /// The extra field only contains the values that didn't fit into 32 bits, always in this order
+        /// </summary>
+        /// <param name="extraField"> A pointer to a Central directory's or File header's extra field </param>
+        /// <param name="extraFieldLength"> The length of the extra field </param>
+        /// <param name="uncompressedSize"> The 32-bit uncompressed size, replaced if it's a placeholder </param>
+        /// <param name="compressedSize"> The 32-bit compressed size, replaced if it's a placeholder </param>
+        /// <param name="fileHeaderOffset"> The 32-bit File header offset, replaced if it's a placeholder </param>
+        void ReadZip64ExtraField(const uint8_t* extraField, size_t extraFieldLength, uint64_t& uncompressedSize, uint64_t& compressedSize, uint64_t& fileHeaderOffset)
+        {
+            size_t extraFieldOffset = 0;
+
+            // The extra field is a list of (header ID, data size, data) blocks
+            while ((extraFieldOffset + 4) <= extraFieldLength)
+            {
+                const uint16_t headerID = ReadUInt16(&extraField[extraFieldOffset]);
+                const uint16_t dataSize = ReadUInt16(&extraField[extraFieldOffset + 2]);
+
+                if ((extraFieldOffset + 4 + dataSize) > extraFieldLength)
+                    break;
+
+                if (headerID == ZIP64_EXTRA_FIELD_ID)
+                {
+                    const uint8_t* const data = &extraField[extraFieldOffset + 4];
+
+                    size_t dataOffset = 0;
+
+                    for (uint64_t* value : { &uncompressedSize, &compressedSize, &fileHeaderOffset })
+                    {
+                        if (*value != ZIP64_PLACEHOLDER)
+                            continue;
+
+                        if ((dataOffset + 8) > dataSize)
+                            throw std::exception("Invalid ZIP64 extra field");
+
+                        *value = ReadUInt64(&data[dataOffset]);
+                        dataOffset += 8;
+                    };
+
+                    return;
+                };
+
+                extraFieldOffset += 4 + static_cast<size_t>(dataSize);
+            };
+
+            if ((uncompressedSize == ZIP64_PLACEHOLDER) || (compressedSize == ZIP64_PLACEHOLDER) || (fileHeaderOffset == ZIP64_PLACEHOLDER))
+                throw std::exception("Missing ZIP64 extra field");
+        };
+
+
+        /// <summary>
+        /// Reads the extra field WinZip AES adds to every encrypted entry
+        /// </summary>
+        /// <param name="extraField"> A pointer to a Central directory's or File header's extra field </param>
+        /// <param name="extraFieldLength"> The length of the extra field </param>
+        /// <param name="versionOut"> WinZipAesDecryptor::AE_1 or WinZipAesDecryptor::AE_2 </param>
+        /// <param name="strengthOut"> 1, 2 or 3 for AES-128, AES-192 or AES-256 </param>
+        /// <param name="compressionMethodOut"> The actual compression method of the entry </param>
+        /// <returns> False if the extra field doesn't contain an AES extra field </returns>
+        bool ReadAesExtraField(const uint8_t* extraField, size_t extraFieldLength, uint16_t& versionOut, uint8_t& strengthOut, CompressionMethod& compressionMethodOut)
+        {
+            size_t extraFieldOffset = 0;
+
+            // The extra field is a list of (header ID, data size, data) blocks
+            while ((extraFieldOffset + 4) <= extraFieldLength)
+            {
+                const uint16_t headerID = ReadUInt16(&extraField[extraFieldOffset]);
+                const uint16_t dataSize = ReadUInt16(&extraField[extraFieldOffset + 2]);
+
+                if ((extraFieldOffset + 4 + dataSize) > extraFieldLength)
+                    break;
+
+                // The version, a 2 byte vendor ID ("AE"), the strength and the compression method
+                if ((headerID == AES_EXTRA_FIELD_ID) && (dataSize >= 7))
+                {
+                    versionOut = ReadUInt16(&extraField[extraFieldOffset + 4]);
+                    strengthOut = extraField[extraFieldOffset + 8];
+                    compressionMethodOut = static_cast<CompressionMethod>(ReadUInt16(&extraField[extraFieldOffset + 9]));
+
+                    return true;
+                };
+
+                extraFieldOffset += 4 + static_cast<size_t>(dataSize);
+            };
+
+            return false;
+        };
+
+
+        /// <summary>
+        /// Reads the sizes and File header offset of a Central directory, including the ones that are stored inside the ZIP64 extra field
+        /// </summary>
+        /// <param name="centralDirectory"> A pointer to the entire Central directory </param>
+        /// <param name="compressedSizeOut"> The size of the file after compression </param>
+        /// <param name="uncompressedSizeOut"> The size of the file pre-compression </param>
+        /// <param name="fileHeaderOffsetOut"> An offset to the file's File header </param>
+        void ReadCentralDirectorySizes(const uint8_t* centralDirectory, uint64_t& compressedSizeOut, uint64_t& uncompressedSizeOut, uint64_t& fileHeaderOffsetOut)
+        {
+            compressedSizeOut = ReadUInt32(&centralDirectory[20]);
+            uncompressedSizeOut = ReadUInt32(&centralDirectory[24]);
+            fileHeaderOffsetOut = ReadUInt32(&centralDirectory[42]);
+
+            const uint16_t filenameLength = ReadUInt16(&centralDirectory[28]);
+            const uint16_t extraFieldLength = ReadUInt16(&centralDirectory[30]);
+
+            ReadZip64ExtraField(&centralDirectory[46 + filenameLength], extraFieldLength, uncompressedSizeOut, compressedSizeOut, fileHeaderOffsetOut);
+        };
+
+
+        /// <summary>
+        /// Reads the sizes of a File header, including the ones that are stored inside the ZIP64 extra field
+        /// </summary>
+        /// <param name="fileHeaderPointer"> A pointer to the entire File header </param>
+        /// <param name="compressedSizeOut"> The size of the file after compression </param>
+        /// <param name="uncompressedSizeOut"> The size of the file pre-compression </param>
+        void ReadFileHeaderSizes(const uint8_t* fileHeaderPointer, uint64_t& compressedSizeOut, uint64_t& uncompressedSizeOut)
+        {
+            compressedSizeOut = ReadUInt32(&fileHeaderPointer[18]);
+            uncompressedSizeOut = ReadUInt32(&fileHeaderPointer[22]);
+
+            const uint16_t filenameLength = ReadUInt16(&fileHeaderPointer[26]);
+            const uint16_t extraFieldLength = ReadUInt16(&fileHeaderPointer[28]);
+
+            // A File header doesn't have an offset to itself
+            uint64_t fileHeaderOffset = 0;
+
+            ReadZip64ExtraField(&fileHeaderPointer[30 + filenameLength], extraFieldLength, uncompressedSizeOut, compressedSizeOut, fileHeaderOffset);
+        };
+
+
+        /// <summary>
+        /// Finds the ZIP64 End central directory record through the locator that directly precedes the End central directory
+        /// </summary>
+        /// <param name="zipFileData"> The entire zip file </param>
+        /// <param name="endCentralDirectoryOffset"> The offset of the End central directory </param>
+        /// <returns> A pointer to the ZIP64 End central directory record, or nullptr if the zip isn't a ZIP64 file </returns>
+        const uint8_t* FindZip64EndCentralDirectory(const uint8_t* zipFileData, uint64_t endCentralDirectoryOffset)
+        {
+            if (endCentralDirectoryOffset < ZIP64_END_CENTRAL_DIRECTORY_LOCATOR_SIZE)
+                return nullptr;
+
+            const uint64_t locatorOffset = endCentralDirectoryOffset - ZIP64_END_CENTRAL_DIRECTORY_LOCATOR_SIZE;
+            const uint8_t* const locator = &zipFileData[locatorOffset];
+
+            if (ReadUInt32(locator) != PK_ZIP64_END_OF_CENTRAL_DIRECTORY_LOCATOR_LITTLE_ENDIAN)
+                return nullptr;
+
+            const uint64_t zip64EndCentralDirectoryOffset = ReadUInt64(&locator[8]);
+
+            if ((zip64EndCentralDirectoryOffset > locatorOffset) ||
+                ((locatorOffset - zip64EndCentralDirectoryOffset) < ZIP64_END_CENTRAL_DIRECTORY_SIZE))
+                throw std::exception("Invalid zip file");
+
+            const uint8_t* const zip64EndCentralDirectory = &zipFileData[zip64EndCentralDirectoryOffset];
+
+            if (ReadUInt32(zip64EndCentralDirectory) != PK_ZIP64_END_OF_CENTRAL_DIRECTORY_LITTLE_ENDIAN)
+                throw std::exception("Invalid zip file");
+
+            return zip64EndCentralDirectory;
+        };
+
+
+        /// <summary>
+        /// Calculates the crc32 of a buffer of any size, zlib's crc32 only takes 32-bit lengths
+        /// </summary>
+        /// <param name="crc"> The crc32 of the preceding data, 0 for the first buffer </param>
+        /// <param name="data"> A pointer to the data </param>
+        /// <param name="size"> The size of the data </param>
+        /// <returns></returns>
+        uint32_t Crc32(uint32_t crc, const uint8_t* data, uint64_t size)
+        {
+            while (size != 0)
+            {
+                const uInt chunkSize = static_cast<uInt>(std::min<uint64_t>(size, MAX_ZLIB_CHUNK_SIZE));
+
+                crc = static_cast<uint32_t>(::crc32(crc, data, chunkSize));
+
+                data += chunkSize;
+                size -= chunkSize;
+            };
+
+            return crc;
+        };
+
+
+        /// <summary>
+        /// Hands zlib the next part of a buffer that can be bigger than avail_in or avail_out can describe.
+        /// Only refills once zlib used up the previous part, zlib advances next_in and next_out by itself
+        /// </summary>
+        /// <param name="available"> The stream's avail_in or avail_out </param>
+        /// <param name="remaining"> The number of bytes that weren't handed to zlib yet </param>
+        void RefillZlibBuffer(uInt& available, uint64_t& remaining)
+        {
+            if ((available != 0) || (remaining == 0))
+                return;
+
+            available = static_cast<uInt>(std::min<uint64_t>(remaining, MAX_ZLIB_CHUNK_SIZE));
+            remaining -= available;
+        };
+
+
+        /// <summary>
+        /// Joins an entry's name onto the output folder.
+        /// Entry names come from the zip and can't be trusted, absolute names and names that climb out of the output folder with ".." are rejected
+        /// </summary>
+        /// <param name="outputFolder"> The output folder </param>
+        /// <param name="filename"> The entry's name inside the zip </param>
+        /// <returns> The path the entry is extracted to, always inside the output folder </returns>
+        std::filesystem::path GetOutputPath(const std::string& outputFolder, const std::string& filename)
+        {
+            // After normalization a ".." can only be left at the start of the name
+            const std::filesystem::path entryPath = std::filesystem::path(filename).lexically_normal();
+
+            if ((entryPath.empty() == true) ||
+                (entryPath.has_root_name() == true) ||
+                (entryPath.has_root_directory() == true) ||
+                (*entryPath.begin() == ".."))
+                throw std::exception("Invalid entry name, it points outside of the output folder");
+
+            return std::filesystem::path(outputFolder) / entryPath;
+        };
+
+
         /// <summary>
         /// Get the compression method used to compress the files
         /// </summary>
@@ -111,9 +364,17 @@ namespace ZipExtractor
             // If AES encryption was used...
             else if (encryptionType == ZipEncryption::AES)
             {
-                // Get compression method from the extra field 
-                compressionMethod = (extraField[static_cast<short>(9)] |
-                                     extraField[static_cast<short>(10)] << 8);
+                const size_t extraFieldLength = ReadUInt16(&fileHeaderPointer[28]);
+
+                uint16_t aesVersion = 0;
+                uint8_t aesStrength = 0;
+                CompressionMethod aesCompressionMethod = CompressionMethod::None;
+
+                // Get compression method from the extra field, other extra fields can come before it
+                if (ReadAesExtraField(extraField, extraFieldLength, aesVersion, aesStrength, aesCompressionMethod) == false)
+                    throw std::exception("Missing AES extra field");
+
+                compressionMethod = static_cast<unsigned short>(aesCompressionMethod);
             };
 
             // Return the compression method and cast the 2 byte value to the CompressionMethod enum
@@ -138,7 +399,7 @@ namespace ZipExtractor
         /// <summary>
         /// Gets the encryption type used to encrypt this zip file
         /// </summary>
-        /// <remarks> At the moment the only encryption types supported are; None, and AES </remarks>
+        /// <remarks> At the moment the only encryption types supported are; None, and AES. ZipCrypto is detected but can't be decrypted </remarks>
         /// <param name="centralDirectory">  </param>
         /// <returns></returns>
         ZipExtractor::ZipEncryption GetEncryptionType(const std::vector<uint8_t>& centralDirectory)
@@ -147,29 +408,28 @@ namespace ZipExtractor
             const unsigned short generalPurposeBitFlag = (centralDirectory[8] |
                                                           centralDirectory[9] << 8);
 
-            // If the first bit inside the flag is marked, then AES was used 
+            // If the first bit inside the flag is marked, then the file is encrypted
             bool isEncrypted = generalPurposeBitFlag & 1 << 0;
 
 
             // Because AES isn't actually implemented by the PKZip standard it uses a different "convention" to indicate which encryption was used.
-            // The compression method inside the central directory will be set to 99 if AES was used
+            // The compression method inside the central directory will be set to 99 if AES was used.
+            // The crc32 can't tell them apart, AE-1 keeps the real crc32 and only AE-2 sets it to 0
             const unsigned short compressionMethod = (centralDirectory[10] |
                                                       centralDirectory[11] << 8);
 
-            // crc32 value will be set to 0 if AES is used
-            const unsigned int crc32 = (centralDirectory[16] |
-                                        centralDirectory[17]);
-
 
-            if ((isEncrypted == true) &&
-                (compressionMethod == 99) &&
-                (crc32 == 0))
+            if (isEncrypted == false)
+            {
+                return ZipEncryption::None;
+            }
+            else if (compressionMethod == AES_COMPRESSION_METHOD)
             {
                 return ZipEncryption::AES;
             }
             else
             {
-                return ZipEncryption::None;
+                return ZipEncryption::ZipCrypto;
             };
         };
 
@@ -192,6 +452,114 @@ namespace ZipExtractor
                 return false;
         };
 
+
+        /// <summary>
+        /// Decompresses a compressed stream (as it's stored inside the zip, without a zlib header) into a caller supplied buffer with the calling thread's codec for it's method.
+        /// Both buffers can be bigger than 4 GiB, they're handed to the codec in MAX_ZLIB_CHUNK_SIZE parts
+        /// </summary>
+        /// <param name="compressedData"> A pointer to the compressed data </param>
+        /// <param name="compressedSize"> The size of the compressed data </param>
+        /// <param name="uncompressedDataOut"> A buffer that will contain the decompressed data </param>
+        /// <param name="uncompressedSize"> The size of the decompressed data </param>
+        /// <param name="compressionMethod"> Any method the codec registry has a codec for </param>
+        /// <param name="generalPurposeBitFlag"> The entry's general purpose bit flag </param>
+        void InflateRaw(const uint8_t* compressedData, uint64_t compressedSize, uint8_t* uncompressedDataOut, uint64_t uncompressedSize, CompressionMethod compressionMethod = CompressionMethod::Deflated, uint16_t generalPurposeBitFlag = 0)
+        {
+            // Nothing to decompress, zlib also rejects a null output buffer
+            if (uncompressedSize == 0)
+                return;
+
+            CodecRegistry::GetDefault().GetThreadCodec(compressionMethod).DecodeBuffer(compressedData, compressedSize, uncompressedDataOut, uncompressedSize, generalPurposeBitFlag);
+        };
+
+
+        /// <summary>
+        /// Decrypts and decompresses a WinZip AES entry into a caller supplied buffer.
+        /// The data is decrypted a small piece at a time right before the codec reads it, so it's never decrypted into a buffer of it's own size.
+        /// The caller checks the decryptor's authentication code afterwards
+        /// </summary>
+        /// <param name="decryptor"> The entry's decryptor, nothing of it may be decrypted yet </param>
+        /// <param name="uncompressedDataOut"> A buffer that will contain the decompressed data </param>
+        /// <param name="uncompressedSize"> The size of the decompressed data </param>
+        /// <param name="compressionMethod"> Any method the codec registry has a codec for </param>
+        /// <param name="generalPurposeBitFlag"> The entry's general purpose bit flag </param>
+        void InflateEncrypted(WinZipAesDecryptor& decryptor, uint8_t* uncompressedDataOut, uint64_t uncompressedSize, CompressionMethod compressionMethod, uint16_t generalPurposeBitFlag)
+        {
+            const uint64_t encryptedSize = decryptor.GetEncryptedSize();
+
+            // Stored data is decrypted straight into the output
+            if (compressionMethod == CompressionMethod::None)
+            {
+                if (encryptedSize != uncompressedSize)
+                    throw std::exception("Failed to decompress file");
+
+                decryptor.Decrypt(uncompressedDataOut, static_cast<size_t>(uncompressedSize));
+                return;
+            };
+
+            // Nothing to decompress, zlib also rejects a null output buffer
+            if (uncompressedSize == 0)
+                return;
+
+            DecompressionCodec& codec = CodecRegistry::GetDefault().GetThreadCodec(compressionMethod);
+
+            // Those codecs need all of the input at once
+            if (codec.HasWholeInputDecode() == true)
+            {
+                std::unique_ptr<uint8_t[]> decryptedData(new uint8_t[static_cast<size_t>(encryptedSize)]);
+
+                decryptor.Decrypt(decryptedData.get(), static_cast<size_t>(encryptedSize));
+
+                codec.DecodeBuffer(decryptedData.get(), encryptedSize, uncompressedDataOut, uncompressedSize, generalPurposeBitFlag);
+                return;
+            };
+
+            CodecStreamInfo streamInfo;
+            streamInfo.uncompressedSize = uncompressedSize;
+            streamInfo.outputBuffer = uncompressedDataOut;
+            streamInfo.generalPurposeBitFlag = generalPurposeBitFlag;
+
+            codec.Reset(streamInfo);
+
+            // Small enough to stay in the L1 cache between being decrypted and being decoded
+            std::array<uint8_t, 32 * 1024> inputBuffer;
+
+            z_stream stream { };
+
+            stream.next_out = uncompressedDataOut;
+
+            uint64_t remainingInput = encryptedSize;
+            uint64_t remainingOutput = uncompressedSize;
+
+            int result = Z_OK;
+
+            while (result == Z_OK)
+            {
+                if ((stream.avail_in == 0) && (remainingInput != 0))
+                {
+                    const size_t inputSize = static_cast<size_t>(std::min<uint64_t>(remainingInput, inputBuffer.size()));
+
+                    decryptor.Decrypt(inputBuffer.data(), inputSize);
+
+                    stream.next_in = inputBuffer.data();
+                    stream.avail_in = static_cast<uInt>(inputSize);
+
+                    remainingInput -= inputSize;
+                };
+
+                RefillZlibBuffer(stream.avail_out, remainingOutput);
+
+                result = codec.Decode(stream);
+
+                // Out of input with room left in the output
+                if ((result == Z_BUF_ERROR) && (stream.avail_in == 0) && (remainingInput != 0))
+                    result = Z_OK;
+            };
+
+            if ((result != Z_STREAM_END) || (remainingOutput != 0) || (stream.avail_out != 0))
+                throw std::exception("Failed to decompress file");
+        };
+
     };
 
 
@@ -220,21 +588,13 @@ namespace ZipExtractor
         // Find the size of the zip file
         uintmax_t zipFileBufferLength = std::filesystem::file_size(zipFilepath);
 
-        // Reserve some space inside the out buffer
-        zipFileBufferOut.reserve(zipFileBufferLength);
+        // Read straight into the out buffer, instead of zero filling an intermediate buffer and copying it over
+        zipFileBufferOut.resize(static_cast<size_t>(zipFileBufferLength));
 
-        // Store the zip file data inside an intermediate buffer 
-        uint8_t* zipFileBuffer = new uint8_t[zipFileBufferLength] { 0 };
+        fileStream.read(reinterpret_cast<char*>(zipFileBufferOut.data()), zipFileBufferLength);
 
-        // Read the zip file's contents into zipFileBuffer 
-        fileStream.read((char*)&zipFileBuffer[0], zipFileBufferLength);
-
-        // copy the data inside zipFileBuffer to zipFileBufferOut
-        zipFileBufferOut.assign(zipFileBuffer, zipFileBuffer + zipFileBufferLength);
-
-        // Free zipFileBuffer
-        delete[] zipFileBuffer;
-        zipFileBuffer = nullptr;
+        if (fileStream.gcount() != static_cast<std::streamsize>(zipFileBufferLength))
+            throw std::exception("Error reading file");
     };
 
 
@@ -296,16 +656,30 @@ namespace ZipExtractor
     void GetCentralDirectories(std::vector<uint8_t>& const zipFileData, const std::vector<uint8_t>& endCentralDirectory, std::vector<std::vector<uint8_t>>& centralDirectoriesOut)
     {
         // Get the offset to the first Central directory
-        int centralDirectoryOffset = (endCentralDirectory[16] |
-                                      endCentralDirectory[17] << 8 |
-                                      endCentralDirectory[18] << 16 |
-                                      endCentralDirectory[19] << 24);
+        uint64_t centralDirectoryOffset = Utilities::ReadUInt32(&endCentralDirectory[16]);
+
+        const uint64_t endCentralDirectoryOffset = zipFileData.size() - endCentralDirectory.size();
+
+        // The central directories end where the End Central Directory, or the ZIP64 End Central Directory that precedes it, begins
+        uint64_t centralDirectoriesEnd = endCentralDirectoryOffset;
+
+        const uint8_t* const zip64EndCentralDirectory = Utilities::FindZip64EndCentralDirectory(zipFileData.data(), endCentralDirectoryOffset);
+
+        // ZIP64 files keep the real 64-bit offset inside the ZIP64 End Central Directory
+        if (zip64EndCentralDirectory != nullptr)
+        {
+            centralDirectoryOffset = Utilities::ReadUInt64(&zip64EndCentralDirectory[48]);
+            centralDirectoriesEnd = static_cast<uint64_t>(zip64EndCentralDirectory - zipFileData.data());
+        };
+
+        if (centralDirectoryOffset > centralDirectoriesEnd)
+            throw std::exception("Reading invalid data");
 
         // A pointer to the central directory
         uint8_t* centralDirectoryPointer = &zipFileData[centralDirectoryOffset];
 
-        // A pointer to the end of the last central directory, pointer to the byte just before the End Central Directory
-        uint8_t const* const centralDirectoryPointerEnd = &zipFileData[(zipFileData.size() - endCentralDirectory.size()) - 1];
+        // A pointer to the end of the last central directory
+        uint8_t const* const centralDirectoryPointerEnd = zipFileData.data() + centralDirectoriesEnd;
 
         int centralDirectoySignature = 0;
 
@@ -344,11 +718,13 @@ namespace ZipExtractor
     /// <param name="outputFolder"> An path where the output folder will be created </param>
     void ExtractSingleFolder(std::vector<uint8_t>& const zipFileData, const std::vector<uint8_t>& centralDirectory, std::string outputFolder)
     {
-        // An offset inside the central directory from where the file header begins
-        const int fileHeaderOffset = (centralDirectory[42] |
-                                      centralDirectory[43] << 8 |
-                                      centralDirectory[44] << 16 |
-                                      centralDirectory[45] << 24);
+        uint64_t compressedSize = 0;
+        uint64_t uncompressedSize = 0;
+
+        // An offset inside the zip from where the file header begins
+        uint64_t fileHeaderOffset = 0;
+
+        Utilities::ReadCentralDirectorySizes(centralDirectory.data(), compressedSize, uncompressedSize, fileHeaderOffset);
 
         // A pointer to the File header
         uint8_t* const fileHeaderPointer = &zipFileData[fileHeaderOffset];
@@ -376,13 +752,20 @@ namespace ZipExtractor
     /// <param name="centralDirectory"> A central directory of the file </param>
     /// <param name="encryptionType"> An encryption type used to encrypt the zip </param>
     /// <param name="outputFolder"> An output path to which the file will be extracted </param>
-    void ExtractSingleFile(std::vector<uint8_t>& const zipFileData, const std::vector<uint8_t>& centralDirectory, ZipEncryption encryptionType, std::string outputFolder)
+    /// <param name="progress"> Optional, receives the written bytes and the finished file and can cancel the extraction </param>
+    /// <param name="password"> The password of an encrypted file </param>
+    void ExtractSingleFile(std::vector<uint8_t>& const zipFileData, const std::vector<uint8_t>& centralDirectory, ZipEncryption encryptionType, std::string outputFolder, ExtractionProgress* progress = nullptr, const std::string& password = std::string())
     {
+        if (encryptionType == ZipEncryption::ZipCrypto)
+            throw std::exception("ZipCrypto encryption isn't supported, yet.");
+
+        uint64_t compressedSize = 0;
+        uint64_t uncompressedSize = 0;
+
         // An offset to the File header
-        const int fileHeaderOffset = (centralDirectory[42] |
-                                      centralDirectory[43] << 8 |
-                                      centralDirectory[44] << 16 |
-                                      centralDirectory[45] << 24);
+        uint64_t fileHeaderOffset = 0;
+
+        Utilities::ReadCentralDirectorySizes(centralDirectory.data(), compressedSize, uncompressedSize, fileHeaderOffset);
 
         // A pointer to the File header
         uint8_t* const fileHeaderPointer = &zipFileData[fileHeaderOffset];
@@ -410,121 +793,151 @@ namespace ZipExtractor
         // Get compression method used to compress this file 
         CompressionMethod compressionMethod = Utilities::GetCompressionMethod(encryptionType, fileHeaderPointer, extraField);
 
-        // Size of the file after compression
-        const unsigned int compressedSize = (fileHeaderPointer[18] |
-                                             fileHeaderPointer[19] << 8 |
-                                             fileHeaderPointer[20] << 16 |
-                                             fileHeaderPointer[21] << 24);
+        uint16_t aesVersion = 0;
+        uint8_t aesStrength = 0;
+
+        if (encryptionType == ZipEncryption::AES)
+            Utilities::ReadAesExtraField(extraField, extraFieldLength, aesVersion, aesStrength, compressionMethod);
 
-        // Size of the file pre-compression
-        const unsigned int uncompressedSize = (fileHeaderPointer[22] |
-                                               fileHeaderPointer[23] << 8 |
-                                               fileHeaderPointer[24] << 16 |
-                                               fileHeaderPointer[25] << 24);
+
+        // The extra field isn't needed past this point
+        if (extraField != nullptr)
+        {
+            delete[] extraField;
+            extraField = nullptr;
+        };
+
+        // The sizes and crc32 are taken from the central directory, streamed zips (general purpose bit 3) leave them zeroed inside the File header
+        const uint32_t expectedCrc32 = Utilities::ReadUInt32(&centralDirectory[16]);
+
+        // Some methods keep options in the general purpose bit flag, like LZMA's end marker
+        const uint16_t generalPurposeBitFlag = Utilities::ReadUInt16(&centralDirectory[8]);
 
 
-        // Different extraction operations are performed depending on the compression type
-        switch (compressionMethod)
+        // Every method the codec registry has a codec for is extracted the same way
+        if (CodecRegistry::GetDefault().IsSupported(compressionMethod) == false)
+            throw std::exception("Unsupported compression method");
+
+        // A pointer to the file's data
+        uint8_t* fileHeaderDataPointer = &fileHeaderPointer[30 + filenameLength + extraFieldLength];
+
+        // Get the filename
+        std::string filename;
+        Utilities::GetFilenname(fileHeaderPointer, filenameLength, filename);
+
+        // Append the filename to the output folder
+        outputFolder.append("/");
+        outputFolder.append(filename);
+
+        // If the file isn't encrypted
+        if (encryptionType == ZipEncryption::None)
         {
-            // If DEFLATE compression was used
-            case CompressionMethod::Deflated:
-            {
-                // If the file isn't encrypted
-                if (encryptionType == ZipEncryption::None)
-                {
-                    // A pointer to the file's data
-                    uint8_t* fileHeaderDataPointer = &fileHeaderPointer[30 + filenameLength + extraFieldLength];
+            // Decompress and write the file, the read, decompress and write stages run at the same time
+            const uint32_t writtenCrc32 = ExtractionPipeline::GetThreadPipeline().Run(fileHeaderDataPointer, compressedSize, uncompressedSize, compressionMethod, generalPurposeBitFlag, outputFolder, progress);
 
-                    // A buffer contaning the uncompressed data.
-                    // Because we are using DEFLATE we must add a header so the decompression algorithm knows how to handle this data
-                    uint8_t* fileDataBuffer = new uint8_t[static_cast<size_t>(uncompressedSize) + 2] { 0 };
-                    // This is why we add the 2 bytes here
-                    fileDataBuffer[0] = 0x78;
-                    fileDataBuffer[1] = 0xDA;
+            if (writtenCrc32 != expectedCrc32)
+                throw std::exception("CRC mismatch");
+        }
+        else if (encryptionType == ZipEncryption::AES)
+        {
+            // Checks the password before the file is created
+            WinZipAesDecryptor decryptor(password, aesStrength, fileHeaderDataPointer, compressedSize);
 
-                    // Copy the data from the zipfile into fileDataBuffer 
-                    memcpy_s(fileDataBuffer + 2, uncompressedSize, fileHeaderDataPointer, uncompressedSize);
+            // The read stage decrypts the data, so decryption runs at the same time as decompression and writing
+            const uint32_t writtenCrc32 = ExtractionPipeline::GetThreadPipeline().Run(nullptr, 0, uncompressedSize, compressionMethod, generalPurposeBitFlag, outputFolder, progress, &decryptor);
 
-                    // A buffer that will store the uncompressed data
-                    uint8_t* uncompressedFileData = new uint8_t[uncompressedSize] { 0 };
+            if (decryptor.IsAuthentic() == false)
+                throw std::exception("Authentication failed, the file was modified or the password is wrong");
 
-                    // The file size after decompression
-                    uLong uncompressedFileSize = static_cast<uLong>(uncompressedSize);
+            // AE-2 stores a crc32 of 0, the authentication code takes it's place
+            if ((aesVersion != WinZipAesDecryptor::AE_2) && (writtenCrc32 != expectedCrc32))
+                throw std::exception("CRC mismatch");
+        };
 
-                    // Decompress the file
-                    int result = uncompress(uncompressedFileData, &uncompressedFileSize, fileDataBuffer, compressedSize + 2);
+        if (progress != nullptr)
+            progress->FinishEntry(filename, uncompressedSize);
+    };
 
-                    // Get the filename
-                    std::string filename;
-                    Utilities::GetFilenname(fileHeaderPointer, filenameLength, filename);
 
-                    // Append the filename to the output folder
-                    outputFolder.append("/");
-                    outputFolder.append(filename);
+    /// <summary>
+    /// Decompresses a single file from inside of the zip into memory instead of writing it onto disk
+    /// </summary>
+    /// <param name="zipFileData"> The zip file buffer </param>
+    /// <param name="centralDirectory"> A central directory of the file </param>
+    /// <param name="encryptionType"> An encryption type used to encrypt the zip </param>
+    /// <param name="fileDataOut"> An output buffer that will contain the file's decompressed contents </param>
+    /// <param name="password"> The password of an encrypted file </param>
+    void ReadSingleFile(std::vector<uint8_t>& const zipFileData, const std::vector<uint8_t>& centralDirectory, ZipEncryption encryptionType, std::vector<uint8_t>& fileDataOut, const std::string& password = std::string())
+    {
+        if (encryptionType == ZipEncryption::ZipCrypto)
+            throw std::exception("ZipCrypto encryption isn't supported, yet.");
+
+        uint64_t compressedSize = 0;
+        uint64_t uncompressedSize = 0;
 
+        // An offset to the File header
+        uint64_t fileHeaderOffset = 0;
 
-                    // Write the decompressed file contents onto disk
-                    std::ofstream output(outputFolder, std::ios::binary);
+        Utilities::ReadCentralDirectorySizes(centralDirectory.data(), compressedSize, uncompressedSize, fileHeaderOffset);
 
-                    output.write(reinterpret_cast<char*>(&uncompressedFileData[0]), uncompressedFileSize);
-                    output.close();
+        // A pointer to the File header
+        uint8_t* const fileHeaderPointer = &zipFileData[fileHeaderOffset];
+
+        // The length of the file name
+        const short filenameLength = (fileHeaderPointer[26] |
+                                      fileHeaderPointer[27] << 8);
 
+        // The length of the extras field
+        const short extraFieldLength = (fileHeaderPointer[28] |
+                                        fileHeaderPointer[29] << 8);
 
-                    delete[] uncompressedFileData;
-                    uncompressedFileData = nullptr;
+        // The extra field is only needed for AES, it's read in place
+        uint8_t* const extraField = &fileHeaderPointer[30 + filenameLength];
 
-                    delete[] fileDataBuffer;
-                    fileDataBuffer = nullptr;
-                }
-                else if (encryptionType == ZipEncryption::AES)
-                {
-                    throw std::exception("AES encryption isn't supported, yet.");
-                };
+        // Get compression method used to compress this file
+        CompressionMethod compressionMethod = Utilities::GetCompressionMethod(encryptionType, fileHeaderPointer, extraField);
 
-                break;
-            };
+        // The sizes and crc32 are taken from the central directory, streamed zips (general purpose bit 3) leave them zeroed inside the File header
+        const uint32_t expectedCrc32 = Utilities::ReadUInt32(&centralDirectory[16]);
 
+        // Some methods keep options in the general purpose bit flag, like LZMA's end marker
+        const uint16_t generalPurposeBitFlag = Utilities::ReadUInt16(&centralDirectory[8]);
 
-            // If no compression was used
-            case CompressionMethod::None:
-            {
-                // If the file isn't encrypted
-                if (encryptionType == ZipEncryption::None)
-                {
-                    // A pointer to the file's data
-                    uint8_t* fileHeaderDataPointer = &fileHeaderPointer[30 + filenameLength + extraFieldLength];
+        // A pointer to the file's data
+        const uint8_t* fileHeaderDataPointer = &fileHeaderPointer[30 + filenameLength + extraFieldLength];
 
-                    // Get filename
-                    std::string filename;
-                    Utilities::GetFilenname(fileHeaderPointer, filenameLength, filename);
+        fileDataOut.resize(static_cast<size_t>(uncompressedSize));
 
-                    // Append the filename to the output folder path
-                    outputFolder.append("/");
-                    outputFolder.append(filename);
+        if (encryptionType == ZipEncryption::AES)
+        {
+            uint16_t aesVersion = 0;
+            uint8_t aesStrength = 0;
 
-                    // Write file to disk
-                    std::ofstream output(outputFolder, std::ios::binary);
+            Utilities::ReadAesExtraField(extraField, extraFieldLength, aesVersion, aesStrength, compressionMethod);
 
-                    output.write(reinterpret_cast<char*>(&fileHeaderDataPointer[0]), uncompressedSize);
-                    output.close();
-                }
-                else if (encryptionType == ZipEncryption::AES)
-                {
-                    throw std::exception("AES encryption isn't supported, yet.");
-                };
+            if (CodecRegistry::GetDefault().IsSupported(compressionMethod) == false)
+                throw std::exception("Unsupported compression method");
 
-                break;
-            };
+            WinZipAesDecryptor decryptor(password, aesStrength, fileHeaderDataPointer, compressedSize);
 
-        };
+            // Decrypt and decompress straight from the zip buffer into the output buffer
+            Utilities::InflateEncrypted(decryptor, fileDataOut.data(), uncompressedSize, compressionMethod, generalPurposeBitFlag);
 
+            if (decryptor.IsAuthentic() == false)
+                throw std::exception("Authentication failed, the file was modified or the password is wrong");
 
-        if (extraField != nullptr)
+            // AE-2 stores a crc32 of 0, the authentication code takes it's place
+            if (aesVersion == WinZipAesDecryptor::AE_2)
+                return;
+        }
+        else
         {
-            delete[] extraField;
-            extraField = nullptr;
+            // Decompress straight from the zip buffer into the output buffer, stored entries are copied by their codec
+            Utilities::InflateRaw(fileHeaderDataPointer, compressedSize, fileDataOut.data(), uncompressedSize, compressionMethod, generalPurposeBitFlag);
         };
 
+        if (Utilities::Crc32(0, fileDataOut.data(), fileDataOut.size()) != expectedCrc32)
+            throw std::exception("CRC mismatch");
     };
 
 
@@ -534,22 +947,50 @@ namespace ZipExtractor
     /// <param name="outputPath"> An output path to where the contents will be extracted </param>
     /// <param name="zipFileBuffer"> The zip's file buffer </param>
     /// <param name="centralDirectories"> The list of central directories </param>
-    void ExtractZip(const std::string& outputPath, std::vector<uint8_t>& const zipFileBuffer, const std::vector<std::vector<uint8_t>>& centralDirectories)
+    /// <param name="progress"> Optional, receives the extraction's progress and can cancel it between files and chunks </param>
+    /// <param name="password"> The password of the encrypted files, if there are any </param>
+    void ExtractZip(const std::string& outputPath, std::vector<uint8_t>& const zipFileBuffer, const std::vector<std::vector<uint8_t>>& centralDirectories, ExtractionProgress* progress = nullptr, const std::string& password = std::string())
     {
+        if (progress != nullptr)
+        {
+            uint64_t totalEntries = 0;
+            uint64_t totalBytes = 0;
+
+            for (const std::vector<uint8_t>& centralDirectory : centralDirectories)
+            {
+                if (Utilities::IsDirectory(centralDirectory) == true)
+                    continue;
+
+                uint64_t compressedSize = 0;
+                uint64_t uncompressedSize = 0;
+                uint64_t fileHeaderOffset = 0;
+
+                Utilities::ReadCentralDirectorySizes(centralDirectory.data(), compressedSize, uncompressedSize, fileHeaderOffset);
+
+                totalEntries++;
+                totalBytes += uncompressedSize;
+            };
+
+            progress->AddTotal(totalEntries, totalBytes);
+        };
+
         // Go through every central directory
         for (const std::vector<uint8_t>& centralDirectory : centralDirectories)
         {
+            if (progress != nullptr)
+                progress->ThrowIfCancelled();
+
             // Check if central directory is encrypted
             ZipExtractor::ZipEncryption encryptionType = Utilities::GetEncryptionType(centralDirectory);
 
-            if (encryptionType == ZipExtractor::ZipEncryption::AES)
-                throw std::exception("AES encryption isn't supported, yet.");
+            if (encryptionType == ZipExtractor::ZipEncryption::ZipCrypto)
+                throw std::exception("ZipCrypto encryption isn't supported, yet.");
 
             // Check if central directory is a folder or file
             if (Utilities::IsDirectory(centralDirectory) == true)
                 ZipExtractor::ExtractSingleFolder(zipFileBuffer, centralDirectory, outputPath);
             else
-                ZipExtractor::ExtractSingleFile(zipFileBuffer, centralDirectory, encryptionType, outputPath);
+                ZipExtractor::ExtractSingleFile(zipFileBuffer, centralDirectory, encryptionType, outputPath, progress, password);
         };
 
     };
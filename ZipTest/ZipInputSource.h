@@ -0,0 +1,171 @@
+#pragma once
+#include <span>
+#include <cstdio>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+
+namespace ZipExtractor
+{
+
+    /// <summary>
+    /// A sequential source of zip bytes for ForwardZipReader.
+    /// Sources are only ever read front to back, so pipes and sockets work as well as files
+    /// </summary>
+    class IZipInputSource
+    {
+
+    public:
+
+        virtual ~IZipInputSource() = default;
+
+
+        /// <summary>
+        /// Read the next bytes, blocking until at least one byte is available or the source ended
+        /// </summary>
+        /// <param name="destination"> A buffer that will contain the read bytes </param>
+        /// <returns> The number of bytes read, 0 only once the source ended </returns>
+        virtual size_t Read(std::span<uint8_t> destination) = 0;
+
+    };
+
+
+
+    /// <summary>
+    /// A source over a zip that is already in memory
+    /// </summary>
+    class MemoryInputSource : public IZipInputSource
+    {
+
+    private:
+
+        const std::span<const uint8_t> _data;
+
+        size_t _offset = 0;
+
+
+    public:
+
+        /// <summary>
+        /// Creates a source over a buffer
+        /// </summary>
+        /// <param name="data"> The zip file, must outlive the source </param>
+        explicit MemoryInputSource(std::span<const uint8_t> data) :
+            _data(data)
+        {
+        };
+
+
+        size_t Read(std::span<uint8_t> destination) override
+        {
+            const size_t readSize = std::min(destination.size(), _data.size() - _offset);
+
+            memcpy(destination.data(), &_data[_offset], readSize);
+            _offset += readSize;
+
+            return readSize;
+        };
+
+    };
+
+
+
+    /// <summary>
+    /// A source over a std::istream, which must be opened in binary mode
+    /// </summary>
+    class StreamInputSource : public IZipInputSource
+    {
+
+    private:
+
+        std::istream& _stream;
+
+
+    public:
+
+        /// <summary>
+        /// Creates a source over a stream
+        /// </summary>
+        /// <param name="stream"> The stream, must outlive the source </param>
+        explicit StreamInputSource(std::istream& stream) :
+            _stream(stream)
+        {
+        };
+
+
+        size_t Read(std::span<uint8_t> destination) override
+        {
+            if (_stream.good() == false)
+                return 0;
+
+            // Take whatever the stream already buffered, a stream can only block until the entire destination is filled
+            std::streamsize readSize = _stream.readsome(reinterpret_cast<char*>(destination.data()), static_cast<std::streamsize>(destination.size()));
+
+            if (readSize == 0)
+            {
+                _stream.read(reinterpret_cast<char*>(destination.data()), static_cast<std::streamsize>(destination.size()));
+                readSize = _stream.gcount();
+            };
+
+            if (_stream.bad() == true)
+                throw std::exception("Error reading zip stream");
+
+            return static_cast<size_t>(readSize);
+        };
+
+    };
+
+
+
+    /// <summary>
+    /// A source over the process's standard input, for extracting zips that are piped in.
+    /// Reads the file descriptor directly, so every read returns as soon as the pipe has any data instead of waiting for a full buffer
+    /// </summary>
+    class StandardInputSource : public IZipInputSource
+    {
+
+    public:
+
+        StandardInputSource()
+        {
+#ifdef _WIN32
+            // Standard input is opened in text mode, which would translate line endings inside the zip
+            _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        };
+
+
+        size_t Read(std::span<uint8_t> destination) override
+        {
+#ifdef _WIN32
+            const int readSize = _read(_fileno(stdin), destination.data(), static_cast<unsigned int>(std::min<size_t>(destination.size(), INT_MAX)));
+#else
+            ssize_t readSize = 0;
+
+            do
+            {
+                readSize = ::read(STDIN_FILENO, destination.data(), destination.size());
+            }
+            while ((readSize == -1) && (errno == EINTR));
+#endif
+
+            if (readSize < 0)
+                throw std::exception("Error reading standard input");
+
+            return static_cast<size_t>(readSize);
+        };
+
+    };
+
+};
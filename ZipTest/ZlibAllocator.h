@@ -0,0 +1,459 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "deflate.h"
+
+
+namespace ZipExtractor
+{
+
+    /// <summary>
+    /// A bump allocator for zlib over a fixed, caller supplied buffer.
+    /// Nothing is freed individually, the whole arena is released together with the buffer.
+    /// When the arena runs out zlib gets a null pointer back and reports Z_MEM_ERROR instead of falling back to the heap
+    /// </summary>
+    class FixedZlibArena
+    {
+
+    public:
+
+        // Enough space for zlib's inflate_state (about 7 KiB on 64 bit) but not for the 32 KiB inflate window.
+        // A DEFLATE stream that is decompressed with a single inflate(Z_FINISH) call never needs the window
+        static constexpr size_t INFLATE_STATE_SIZE = 8 * 1024;
+
+
+    private:
+
+        uint8_t* const _buffer;
+
+        const size_t _capacity;
+
+        // The number of bytes handed out so far
+        size_t _used = 0;
+
+
+    public:
+
+        /// <summary>
+        /// Creates an arena over the given buffer
+        /// </summary>
+        /// <param name="buffer"> The memory that the arena hands out </param>
+        /// <param name="capacity"> The size of the buffer </param>
+        FixedZlibArena(void* buffer, size_t capacity) :
+            _buffer(static_cast<uint8_t*>(buffer)),
+            _capacity(capacity)
+        {
+        };
+
+        FixedZlibArena(const FixedZlibArena&) = delete;
+        FixedZlibArena& operator = (const FixedZlibArena&) = delete;
+
+
+    public:
+
+        /// <summary>
+        /// Makes zlib allocate the stream's state from this arena, must be called before inflateInit/deflateInit
+        /// </summary>
+        /// <param name="stream"> The stream that will use this arena </param>
+        void Attach(z_stream& stream)
+        {
+            stream.zalloc = &FixedZlibArena::Allocate;
+            stream.zfree = &FixedZlibArena::Free;
+            stream.opaque = this;
+        };
+
+
+        size_t GetUsedBytes() const
+        {
+            return _used;
+        };
+
+
+    private:
+
+        static voidpf Allocate(voidpf opaque, uInt items, uInt size)
+        {
+            FixedZlibArena* const arena = static_cast<FixedZlibArena*>(opaque);
+
+            const size_t alignment = alignof(std::max_align_t);
+
+            // Round the current position up so every allocation is suitably aligned
+            const size_t allocationStart = (arena->_used + alignment - 1) & ~(alignment - 1);
+            const size_t allocationSize = static_cast<size_t>(items) * size;
+
+            if ((allocationStart + allocationSize) > arena->_capacity)
+                return Z_NULL;
+
+            arena->_used = allocationStart + allocationSize;
+
+            return arena->_buffer + allocationStart;
+        };
+
+        static void Free(voidpf, voidpf)
+        {
+            // Memory is released all at once together with the arena's buffer
+        };
+
+    };
+
+
+
+    // Allocation counters of a ZlibThreadPool
+    struct ZlibAllocatorStatistics
+    {
+        // The number of times zlib asked for memory
+        uint64_t allocationCount = 0;
+
+        // The number of times zlib released memory
+        uint64_t freeCount = 0;
+
+        // The number of allocations that weren't served from a cached block and went to the global heap
+        uint64_t heapAllocationCount = 0;
+
+        // The bytes currently handed out to zlib
+        uint64_t bytesInUse = 0;
+
+        // The most bytes that were handed out to zlib at the same time
+        uint64_t highWaterBytes = 0;
+
+        // The bytes of released blocks that are kept for reuse
+        uint64_t cachedBytes = 0;
+    };
+
+
+
+    /// <summary>
+    /// A per-thread pool allocator for zlib's inflate/deflate states and windows.
+    /// Released blocks are kept on a free list per allocation size and handed out again, so once every
+    /// size a thread needs has been allocated once, creating and destroying streams never touches the global heap.
+    /// A block that is released on a different thread than the one that allocated it goes straight back to the heap,
+    /// it's size is handed to the allocating pool, which takes it off it's bytes in use the next time it's thread uses the pool
+    /// </summary>
+    class ZlibThreadPool
+    {
+
+    public:
+
+        // zlib only asks for a handful of different sizes, anything beyond this many goes to the heap uncached
+        static constexpr size_t MAX_SIZE_CLASSES = 8;
+
+
+    private:
+
+        // Placed in front of every block that is handed to zlib
+        struct alignas(std::max_align_t) BlockHeader
+        {
+            // The pool that allocated the block
+            ZlibThreadPool* owner = nullptr;
+
+            // The id of the pool that allocated the block, a new thread's pool can end up at the address of an old one
+            uint64_t ownerId = 0;
+
+            // The size that zlib asked for
+            size_t size = 0;
+
+            // The next cached block of the same size
+            BlockHeader* nextFree = nullptr;
+        };
+
+
+        // Cached blocks of a single size
+        struct SizeClass
+        {
+            size_t size = 0;
+
+            BlockHeader* freeList = nullptr;
+        };
+
+
+    private:
+
+        std::array<SizeClass, MAX_SIZE_CLASSES> _sizeClasses { };
+
+        size_t _sizeClassCount = 0;
+
+        ZlibAllocatorStatistics _statistics;
+
+        const uint64_t _id;
+
+        // Blocks of this pool that were released on other threads, not yet taken off the statistics
+        std::atomic<uint64_t> _remoteFreeCount { 0 };
+        std::atomic<uint64_t> _remoteFreedBytes { 0 };
+
+
+        // The calling thread's pool while it's alive, used to tell if a block is freed on it's own thread
+        static inline thread_local ZlibThreadPool* _currentThreadPool = nullptr;
+
+        // Process-wide counters, readable from any thread
+        static inline std::atomic<uint64_t> _processHeapAllocationCount { 0 };
+        static inline std::atomic<uint64_t> _processCrossThreadFreeCount { 0 };
+
+        static inline std::atomic<uint64_t> _nextPoolId { 1 };
+
+        // Every thread's pool that is still alive, a cross-thread free only touches a pool that is in here
+        static inline std::mutex _livePoolsLock;
+        static inline std::vector<ZlibThreadPool*> _livePools;
+
+
+    private:
+
+        ZlibThreadPool() :
+            _id(_nextPoolId.fetch_add(1, std::memory_order_relaxed))
+        {
+            _currentThreadPool = this;
+
+            std::lock_guard<std::mutex> guard(_livePoolsLock);
+            _livePools.push_back(this);
+        };
+
+
+    public:
+
+        ~ZlibThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> guard(_livePoolsLock);
+                _livePools.erase(std::find(_livePools.begin(), _livePools.end(), this));
+            };
+
+            _currentThreadPool = nullptr;
+
+            Trim();
+        };
+
+        ZlibThreadPool(const ZlibThreadPool&) = delete;
+        ZlibThreadPool& operator = (const ZlibThreadPool&) = delete;
+
+
+        /// <summary>
+        /// Get the calling thread's pool
+        /// </summary>
+        static ZlibThreadPool& GetThreadPool()
+        {
+            thread_local ZlibThreadPool pool;
+
+            return pool;
+        };
+
+
+    public:
+
+        /// <summary>
+        /// Makes zlib allocate the stream's state and window from the calling thread's pool, must be called before inflateInit/deflateInit
+        /// </summary>
+        /// <param name="stream"> The stream that will use the pool </param>
+        static void Attach(z_stream& stream)
+        {
+            stream.zalloc = &ZlibThreadPool::Allocate;
+            stream.zfree = &ZlibThreadPool::Free;
+            stream.opaque = &GetThreadPool();
+        };
+
+
+        /// <summary>
+        /// Releases every cached block back to the heap, blocks that are still in use are unaffected
+        /// </summary>
+        void Trim()
+        {
+            for (size_t classIndex = 0; classIndex < _sizeClassCount; classIndex++)
+            {
+                SizeClass& sizeClass = _sizeClasses[classIndex];
+
+                while (sizeClass.freeList != nullptr)
+                {
+                    BlockHeader* const block = sizeClass.freeList;
+                    sizeClass.freeList = block->nextFree;
+
+                    _statistics.cachedBytes -= block->size;
+
+                    std::free(block);
+                };
+            };
+        };
+
+
+        /// <summary>
+        /// Get the counters of this thread's pool
+        /// </summary>
+        const ZlibAllocatorStatistics& GetStatistics()
+        {
+            CollectRemoteFrees();
+
+            return _statistics;
+        };
+
+        /// <summary>
+        /// Restart the counters, the bytes in use and cached are kept and become the new high-water mark
+        /// </summary>
+        void ResetStatistics()
+        {
+            CollectRemoteFrees();
+
+            _statistics.allocationCount = 0;
+            _statistics.freeCount = 0;
+            _statistics.heapAllocationCount = 0;
+            _statistics.highWaterBytes = _statistics.bytesInUse;
+        };
+
+
+        /// <summary>
+        /// Get the number of heap allocations made by every thread's pool, can be called from any thread
+        /// </summary>
+        static uint64_t GetProcessHeapAllocationCount()
+        {
+            return _processHeapAllocationCount.load(std::memory_order_relaxed);
+        };
+
+        /// <summary>
+        /// Get the number of blocks that were released on a different thread than the one that allocated them, can be called from any thread
+        /// </summary>
+        static uint64_t GetProcessCrossThreadFreeCount()
+        {
+            return _processCrossThreadFreeCount.load(std::memory_order_relaxed);
+        };
+
+
+    private:
+
+        static voidpf Allocate(voidpf opaque, uInt items, uInt size)
+        {
+            ZlibThreadPool* const pool = static_cast<ZlibThreadPool*>(opaque);
+
+            const size_t allocationSize = static_cast<size_t>(items) * size;
+
+            pool->CollectRemoteFrees();
+
+            pool->_statistics.allocationCount++;
+
+            SizeClass* const sizeClass = pool->FindSizeClass(allocationSize);
+
+            BlockHeader* block = nullptr;
+
+            if ((sizeClass != nullptr) && (sizeClass->freeList != nullptr))
+            {
+                block = sizeClass->freeList;
+                sizeClass->freeList = block->nextFree;
+
+                pool->_statistics.cachedBytes -= allocationSize;
+            }
+            else
+            {
+                block = static_cast<BlockHeader*>(std::malloc(sizeof(BlockHeader) + allocationSize));
+
+                if (block == nullptr)
+                    return Z_NULL;
+
+                block->owner = pool;
+                block->ownerId = pool->_id;
+                block->size = allocationSize;
+
+                pool->_statistics.heapAllocationCount++;
+                _processHeapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+            };
+
+            block->nextFree = nullptr;
+
+            pool->_statistics.bytesInUse += allocationSize;
+            pool->_statistics.highWaterBytes = std::max(pool->_statistics.highWaterBytes, pool->_statistics.bytesInUse);
+
+            return block + 1;
+        };
+
+
+        // The owning pool is found through the block's header, the stream's opaque is the pool of the thread that attached it
+        static void Free(voidpf, voidpf address)
+        {
+            if (address == nullptr)
+                return;
+
+            BlockHeader* const block = static_cast<BlockHeader*>(address) - 1;
+            ZlibThreadPool* const pool = block->owner;
+
+            // The allocating thread's pool isn't safe to touch from here, and might not even exist anymore
+            if (pool != _currentThreadPool)
+            {
+                _processCrossThreadFreeCount.fetch_add(1, std::memory_order_relaxed);
+
+                {
+                    // Holding the lock keeps the pool from being destroyed while it's counters are updated
+                    std::lock_guard<std::mutex> guard(_livePoolsLock);
+
+                    if ((std::find(_livePools.begin(), _livePools.end(), pool) != _livePools.end()) && (pool->_id == block->ownerId))
+                    {
+                        pool->_remoteFreeCount.fetch_add(1, std::memory_order_relaxed);
+                        pool->_remoteFreedBytes.fetch_add(block->size, std::memory_order_relaxed);
+                    };
+                };
+
+                std::free(block);
+                return;
+            };
+
+            pool->_statistics.freeCount++;
+            pool->_statistics.bytesInUse -= block->size;
+
+            SizeClass* const sizeClass = pool->FindSizeClass(block->size);
+
+            if (sizeClass == nullptr)
+            {
+                std::free(block);
+                return;
+            };
+
+            block->nextFree = sizeClass->freeList;
+            sizeClass->freeList = block;
+
+            pool->_statistics.cachedBytes += block->size;
+        };
+
+
+        /// <summary>
+        /// Takes the blocks that other threads released off this pool's statistics
+        /// </summary>
+        void CollectRemoteFrees()
+        {
+            // Checked first, so the common case doesn't write to the shared counters
+            if (_remoteFreeCount.load(std::memory_order_relaxed) == 0)
+                return;
+
+            // Taken so both counters come from the same set of frees
+            std::lock_guard<std::mutex> guard(_livePoolsLock);
+
+            _statistics.freeCount += _remoteFreeCount.exchange(0, std::memory_order_relaxed);
+            _statistics.bytesInUse -= _remoteFreedBytes.exchange(0, std::memory_order_relaxed);
+        };
+
+
+        /// <summary>
+        /// Find the size class for an allocation size, adding it if there's still room
+        /// </summary>
+        /// <returns> The size class, or nullptr if every size class is taken </returns>
+        SizeClass* FindSizeClass(size_t size)
+        {
+            for (size_t classIndex = 0; classIndex < _sizeClassCount; classIndex++)
+            {
+                if (_sizeClasses[classIndex].size == size)
+                    return &_sizeClasses[classIndex];
+            };
+
+            if (_sizeClassCount == MAX_SIZE_CLASSES)
+                return nullptr;
+
+            SizeClass& sizeClass = _sizeClasses[_sizeClassCount];
+            sizeClass.size = size;
+
+            _sizeClassCount++;
+
+            return &sizeClass;
+        };
+
+    };
+
+};
@@ -0,0 +1,1631 @@
+#pragma once
+#include <array>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "deflate.h"
+
+
+namespace ZipExtractor
+{
+
+    /// <summary>
+    /// A decoder for Zstandard frames (zip compression method 93), as described by RFC 8878.
+    /// Implements the raw, RLE and Huffman coded literals, the FSE coded sequences and their execution, and checks the frame's content checksum.
+    /// Dictionaries aren't supported, zip has no way to pass one along with an entry.
+    /// Works on a z_stream with the same contract as inflate(Z_NO_FLUSH) on a raw stream, so it drops into any loop written for zlib:
+    /// every call consumes as much input and produces as much output as it can, and input after the end of the frame is left untouched.
+    /// A block is decoded once all of it's input arrived, so memory stays bounded by the frame's window and the 128 KiB block size
+    /// </summary>
+    class ZstdDecoder
+    {
+
+    public:
+
+        // Passed as the uncompressed size when it isn't known
+        static constexpr uint64_t UNKNOWN_SIZE = UINT64_MAX;
+
+        // Bigger windows have to be enabled on both sides with zstd's --long, the reference decoder refuses them by default as well
+        static constexpr uint64_t MAX_WINDOW_SIZE = uint64_t(1) << 27;
+
+        static constexpr size_t MAX_BLOCK_SIZE = 128 * 1024;
+
+
+    private:
+
+        static constexpr uint32_t FRAME_MAGIC = 0xFD2FB528;
+
+        // The magic number, the frame header descriptor, the window descriptor, a 4 byte dictionary id and an 8 byte content size
+        static constexpr size_t MAX_FRAME_HEADER_SIZE = 18;
+        static constexpr size_t FRAME_HEADER_START_SIZE = 5;
+
+        static constexpr size_t BLOCK_HEADER_SIZE = 3;
+        static constexpr size_t CHECKSUM_SIZE = 4;
+
+        static constexpr uint64_t MIN_WINDOW_SIZE = 1024;
+
+        // The owned history buffer keeps at least this much room for new blocks, so it isn't moved for every block of a small window
+        static constexpr size_t MIN_HISTORY_SLACK = 1024 * 1024;
+
+        // Extra room at the end of the literals, so a Huffman stream can be decoded without checking the end for every symbol
+        static constexpr size_t LITERALS_SLACK = 32;
+
+        static constexpr unsigned MAX_HUFFMAN_BITS = 11;
+        static constexpr unsigned MAX_HUFFMAN_SYMBOLS = 256;
+
+        static constexpr unsigned MAX_LITERAL_LENGTH_LOG = 9;
+        static constexpr unsigned MAX_MATCH_LENGTH_LOG = 9;
+        static constexpr unsigned MAX_OFFSET_LOG = 8;
+        static constexpr unsigned MAX_HUFFMAN_WEIGHT_LOG = 6;
+        static constexpr unsigned MAX_ACCURACY_LOG = 9;
+
+        static constexpr unsigned MAX_LITERAL_LENGTH_CODE = 35;
+        static constexpr unsigned MAX_MATCH_LENGTH_CODE = 52;
+        static constexpr unsigned MAX_OFFSET_CODE = 31;
+
+        enum class State
+        {
+            FrameHeader,
+            BlockHeader,
+            BlockData,
+            Checksum,
+            Done,
+            Error,
+        };
+
+        enum class BlockType
+        {
+            Raw = 0,
+            Rle = 1,
+            Compressed = 2,
+            Reserved = 3,
+        };
+
+        // How a sequence section codes one of it's three symbol types
+        enum class SymbolMode
+        {
+            Predefined = 0,
+            Rle = 1,
+            FseCompressed = 2,
+            Repeat = 3,
+        };
+
+        struct FseEntry
+        {
+            uint8_t symbol;
+            uint8_t bitCount;
+            uint16_t baseline;
+        };
+
+        struct FseTable
+        {
+            unsigned accuracyLog = 0;
+            std::array<FseEntry, 1 << MAX_ACCURACY_LOG> entries = {};
+        };
+
+        struct HuffmanTable
+        {
+            unsigned maxBits = 0;
+
+            // The symbol in the upper bits, the code's length in the lowest 4
+            std::array<uint16_t, 1 << MAX_HUFFMAN_BITS> entries = {};
+        };
+
+        /// <summary>
+        /// Reads a bitstream backwards, from it's last bit to it's first, like every entropy coded stream in zstd.
+        /// The last byte ends with a 1 bit that marks where the stream starts, bits before the start of the data read as zero
+        /// </summary>
+        struct BackwardBitReader
+        {
+            const uint8_t* data = nullptr;
+            size_t size = 0;
+
+            // The bits still to be read are the ones below this position
+            int64_t position = 0;
+
+            bool Initialize(const uint8_t* streamData, size_t streamSize)
+            {
+                data = streamData;
+                size = streamSize;
+
+                if ((size == 0) || (data[size - 1] == 0))
+                    return false;
+
+                position = static_cast<int64_t>(size - 1) * 8 + HighestBit(data[size - 1]);
+
+                return true;
+            };
+
+            uint64_t Peek(unsigned count) const
+            {
+                const int64_t start = position - count;
+
+                if (start >= 0)
+                    return (LoadWord(static_cast<size_t>(start >> 3)) >> (start & 7)) & BitMask(count);
+
+                // The stream ran out, the missing low bits are zeros
+                if (position <= 0)
+                    return 0;
+
+                return (LoadWord(0) & BitMask(static_cast<unsigned>(position))) << (-start);
+            };
+
+            uint64_t Read(unsigned count)
+            {
+                const uint64_t value = Peek(count);
+                position -= count;
+
+                return value;
+            };
+
+            uint64_t LoadWord(size_t byteIndex) const
+            {
+                uint64_t word = 0;
+
+                if (byteIndex + sizeof(word) <= size)
+                    return ReadUInt64(&data[byteIndex]);
+
+                for (size_t index = size; index > byteIndex; index--)
+                    word = (word << 8) | data[index - 1];
+
+                return word;
+            };
+        };
+
+
+        // Literal length and match length codes, their baselines and the number of extra bits after the code
+        static constexpr std::array<uint32_t, MAX_LITERAL_LENGTH_CODE + 1> LITERAL_LENGTH_BASELINES =
+        {
+            0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+            16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512, 1024, 2048, 4096,
+            8192, 16384, 32768, 65536
+        };
+
+        static constexpr std::array<uint8_t, MAX_LITERAL_LENGTH_CODE + 1> LITERAL_LENGTH_EXTRA_BITS =
+        {
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12,
+            13, 14, 15, 16
+        };
+
+        static constexpr std::array<uint32_t, MAX_MATCH_LENGTH_CODE + 1> MATCH_LENGTH_BASELINES =
+        {
+            3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+            19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+            35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027, 2051,
+            4099, 8195, 16387, 32771, 65539
+        };
+
+        static constexpr std::array<uint8_t, MAX_MATCH_LENGTH_CODE + 1> MATCH_LENGTH_EXTRA_BITS =
+        {
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11,
+            12, 13, 14, 15, 16
+        };
+
+        // The distributions of the predefined FSE tables
+        static constexpr std::array<int16_t, MAX_LITERAL_LENGTH_CODE + 1> LITERAL_LENGTH_DEFAULT_DISTRIBUTION =
+        {
+            4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+            2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+            -1, -1, -1, -1
+        };
+
+        static constexpr std::array<int16_t, MAX_MATCH_LENGTH_CODE + 1> MATCH_LENGTH_DEFAULT_DISTRIBUTION =
+        {
+            1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+            1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+            1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+            -1, -1, -1, -1, -1
+        };
+
+        static constexpr std::array<int16_t, 29> OFFSET_DEFAULT_DISTRIBUTION =
+        {
+            1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+            1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1
+        };
+
+
+        State _state = State::FrameHeader;
+
+        // The frame header, collected until all of it arrived
+        std::array<uint8_t, MAX_FRAME_HEADER_SIZE> _header = {};
+        size_t _headerSize = 0;
+
+        uint64_t _windowSize = 0;
+        uint64_t _contentSize = UNKNOWN_SIZE;
+        size_t _blockMaximumSize = MAX_BLOCK_SIZE;
+        bool _hasChecksum = false;
+
+        // The current block
+        bool _isLastBlock = false;
+        BlockType _blockType = BlockType::Raw;
+        size_t _blockSize = 0;
+
+        // A block's input, collected when the caller's buffer doesn't hold all of it
+        std::unique_ptr<uint8_t[]> _blockInput;
+        size_t _blockInputSize = 0;
+
+        std::array<uint8_t, CHECKSUM_SIZE> _checksumBytes = {};
+        size_t _checksumSize = 0;
+
+        // The decoded data: the history matches reach back into, followed by the decoded bytes that weren't copied out yet
+        uint8_t* _window = nullptr;
+        size_t _windowCapacity = 0;
+        size_t _writeIndex = 0;
+        size_t _flushIndex = 0;
+
+        std::unique_ptr<uint8_t[]> _ownedWindow;
+        size_t _ownedWindowCapacity = 0;
+
+        // True if the caller's output buffer is the window
+        bool _isWindowExternal = false;
+
+        uint64_t _uncompressedSize = UNKNOWN_SIZE;
+        uint64_t _frameOutputSize = 0;
+
+        // The entropy tables, repeat offsets and Huffman table carry over from block to block
+        std::array<uint32_t, 3> _repeatOffsets = {};
+
+        HuffmanTable _huffmanTable;
+        bool _hasHuffmanTable = false;
+
+        FseTable _literalLengthStorage;
+        FseTable _offsetStorage;
+        FseTable _matchLengthStorage;
+
+        const FseTable* _literalLengthTable = nullptr;
+        const FseTable* _offsetTable = nullptr;
+        const FseTable* _matchLengthTable = nullptr;
+
+        // The current block's literals, either decoded into _literalBuffer or pointing into the block's input
+        std::unique_ptr<uint8_t[]> _literalBuffer;
+        const uint8_t* _literals = nullptr;
+        size_t _literalsSize = 0;
+
+        // The XXH64 of the frame's content, of which the frame stores the lower 32 bits
+        std::array<uint64_t, 4> _hashLanes = {};
+        std::array<uint8_t, 32> _hashBuffer = {};
+        size_t _hashBufferSize = 0;
+        uint64_t _hashedSize = 0;
+
+
+    public:
+
+        ZstdDecoder() :
+            _blockInput(new uint8_t[MAX_BLOCK_SIZE]),
+            _literalBuffer(new uint8_t[MAX_BLOCK_SIZE + LITERALS_SLACK])
+        {
+        };
+
+
+        /// <summary>
+        /// Prepares the decoder for a new stream
+        /// </summary>
+        /// <param name="uncompressedSize"> The size of the decompressed data, or UNKNOWN_SIZE </param>
+        /// <param name="outputBuffer"> Optional, a buffer for the whole decompressed data that every call's next_out points into.
+        /// It's used as the window, so nothing is allocated or copied </param>
+        void Reset(uint64_t uncompressedSize, uint8_t* outputBuffer = nullptr)
+        {
+            _uncompressedSize = uncompressedSize;
+            _isWindowExternal = (outputBuffer != nullptr) && (uncompressedSize != UNKNOWN_SIZE);
+
+            if (_isWindowExternal == true)
+            {
+                _window = outputBuffer;
+                _windowCapacity = static_cast<size_t>(uncompressedSize);
+            };
+
+            _writeIndex = 0;
+            _flushIndex = 0;
+            _frameOutputSize = 0;
+
+            _state = State::FrameHeader;
+            _headerSize = 0;
+            _blockInputSize = 0;
+            _checksumSize = 0;
+
+            _repeatOffsets = { 1, 4, 8 };
+            _hasHuffmanTable = false;
+
+            _literalLengthTable = nullptr;
+            _offsetTable = nullptr;
+            _matchLengthTable = nullptr;
+
+            ResetHash();
+        };
+
+
+        /// <summary>
+        /// Decodes as much of the stream as the input and output buffers allow.
+        /// Only next_in, avail_in, total_in, next_out, avail_out and total_out of the stream are used
+        /// </summary>
+        /// <param name="stream"> The input and output buffers </param>
+        /// <returns> Z_STREAM_END once the whole frame was decoded and copied out, Z_OK after progress,
+        /// Z_BUF_ERROR if no progress was possible and Z_DATA_ERROR for an invalid stream </returns>
+        int Decode(z_stream& stream)
+        {
+            const uInt inputBefore = stream.avail_in;
+            const uInt outputBefore = stream.avail_out;
+
+            bool canContinue = true;
+
+            while (canContinue == true)
+            {
+                Flush(stream);
+
+                // A block is only decoded once the previous one was copied out, so the window never holds more than one block of output
+                if (_flushIndex != _writeIndex)
+                    break;
+
+                canContinue = Step(stream);
+            };
+
+            Flush(stream);
+
+            if (_state == State::Error)
+                return Z_DATA_ERROR;
+
+            if ((_state == State::Done) && (_flushIndex == _writeIndex))
+                return Z_STREAM_END;
+
+            if ((stream.avail_in == inputBefore) && (stream.avail_out == outputBefore))
+                return Z_BUF_ERROR;
+
+            return Z_OK;
+        };
+
+
+    private:
+
+        static constexpr uint64_t BitMask(unsigned count)
+        {
+            return (count >= 64) ? UINT64_MAX : ((uint64_t(1) << count) - 1);
+        };
+
+
+        // Little endian reads, Utilities isn't declared yet where this header is included
+        static uint16_t ReadUInt16(const uint8_t* pointer)
+        {
+            return static_cast<uint16_t>(pointer[0] | (pointer[1] << 8));
+        };
+
+        static uint32_t ReadUInt32(const uint8_t* pointer)
+        {
+            return static_cast<uint32_t>(ReadUInt16(pointer)) | (static_cast<uint32_t>(ReadUInt16(pointer + 2)) << 16);
+        };
+
+        static uint64_t ReadUInt64(const uint8_t* pointer)
+        {
+            return static_cast<uint64_t>(ReadUInt32(pointer)) | (static_cast<uint64_t>(ReadUInt32(pointer + 4)) << 32);
+        };
+
+
+        static unsigned HighestBit(uint64_t value)
+        {
+            unsigned bit = 0;
+
+            while ((value >>= 1) != 0)
+                bit++;
+
+            return bit;
+        };
+
+
+        bool Fail()
+        {
+            _state = State::Error;
+            return false;
+        };
+
+
+        /// <summary>
+        /// Collects input into a buffer until it holds the given number of bytes
+        /// </summary>
+        /// <returns> True once the buffer is complete </returns>
+        static bool Collect(z_stream& stream, uint8_t* buffer, size_t& bufferSize, size_t targetSize)
+        {
+            const size_t copySize = std::min<size_t>(targetSize - bufferSize, stream.avail_in);
+
+            memcpy(&buffer[bufferSize], stream.next_in, copySize);
+
+            stream.next_in += copySize;
+            stream.avail_in -= static_cast<uInt>(copySize);
+            stream.total_in += copySize;
+
+            bufferSize += copySize;
+
+            return (bufferSize == targetSize);
+        };
+
+
+        /// <summary>
+        /// Runs the next part of the frame
+        /// </summary>
+        /// <returns> False if more input is needed, or once the frame ended or turned out to be invalid </returns>
+        bool Step(z_stream& stream)
+        {
+            switch (_state)
+            {
+                case State::FrameHeader:
+                    return ReadFrameHeader(stream);
+
+                case State::BlockHeader:
+                {
+                    if (Collect(stream, _header.data(), _headerSize, BLOCK_HEADER_SIZE) == false)
+                        return false;
+
+                    const uint32_t blockHeader = static_cast<uint32_t>(_header[0]) | (static_cast<uint32_t>(_header[1]) << 8) | (static_cast<uint32_t>(_header[2]) << 16);
+
+                    _isLastBlock = (blockHeader & 1) != 0;
+                    _blockType = static_cast<BlockType>((blockHeader >> 1) & 3);
+                    _blockSize = blockHeader >> 3;
+
+                    _headerSize = 0;
+                    _blockInputSize = 0;
+
+                    if ((_blockType == BlockType::Reserved) || (_blockSize > _blockMaximumSize))
+                        return Fail();
+
+                    _state = State::BlockData;
+
+                    return true;
+                };
+
+                case State::BlockData:
+                    return ReadBlock(stream);
+
+                case State::Checksum:
+                {
+                    if (Collect(stream, _checksumBytes.data(), _checksumSize, CHECKSUM_SIZE) == false)
+                        return false;
+
+                    if (ReadUInt32(_checksumBytes.data()) != static_cast<uint32_t>(FinishHash()))
+                        return Fail();
+
+                    _state = State::Done;
+
+                    return false;
+                };
+
+                default:
+                    return false;
+            };
+        };
+
+
+        /// <summary>
+        /// Reads the frame header and prepares the window
+        /// </summary>
+        bool ReadFrameHeader(z_stream& stream)
+        {
+            // The header's size is only known once the descriptor arrived, the rest of it is collected afterwards
+            if ((_headerSize < FRAME_HEADER_START_SIZE) && (Collect(stream, _header.data(), _headerSize, FRAME_HEADER_START_SIZE) == false))
+                return false;
+
+            if (ReadUInt32(_header.data()) != FRAME_MAGIC)
+                return Fail();
+
+            const uint8_t descriptor = _header[4];
+
+            const unsigned contentSizeFlag = descriptor >> 6;
+            const bool isSingleSegment = (descriptor & 0x20) != 0;
+            const unsigned dictionaryIdFlag = descriptor & 3;
+
+            // The reserved bit
+            if ((descriptor & 0x08) != 0)
+                return Fail();
+
+            _hasChecksum = (descriptor & 0x04) != 0;
+
+            static constexpr std::array<size_t, 4> DICTIONARY_ID_SIZES = { 0, 1, 2, 4 };
+            static constexpr std::array<size_t, 4> CONTENT_SIZE_SIZES = { 0, 2, 4, 8 };
+
+            const size_t windowDescriptorSize = (isSingleSegment == true) ? 0 : 1;
+            const size_t dictionaryIdSize = DICTIONARY_ID_SIZES[dictionaryIdFlag];
+            const size_t contentSizeSize = ((contentSizeFlag == 0) && (isSingleSegment == true)) ? 1 : CONTENT_SIZE_SIZES[contentSizeFlag];
+
+            const size_t headerSize = FRAME_HEADER_START_SIZE + windowDescriptorSize + dictionaryIdSize + contentSizeSize;
+
+            if (Collect(stream, _header.data(), _headerSize, headerSize) == false)
+                return false;
+
+            size_t offset = FRAME_HEADER_START_SIZE;
+
+            if (isSingleSegment == false)
+            {
+                const uint8_t windowDescriptor = _header[offset++];
+
+                const unsigned exponent = windowDescriptor >> 3;
+                const unsigned mantissa = windowDescriptor & 7;
+
+                const uint64_t windowBase = uint64_t(1) << (10 + exponent);
+                _windowSize = windowBase + (windowBase / 8) * mantissa;
+            };
+
+            uint32_t dictionaryId = 0;
+
+            for (size_t index = 0; index < dictionaryIdSize; index++)
+                dictionaryId |= static_cast<uint32_t>(_header[offset++]) << (8 * index);
+
+            if (dictionaryId != 0)
+                return Fail();
+
+            _contentSize = UNKNOWN_SIZE;
+
+            if (contentSizeSize != 0)
+            {
+                _contentSize = 0;
+
+                for (size_t index = 0; index < contentSizeSize; index++)
+                    _contentSize |= static_cast<uint64_t>(_header[offset++]) << (8 * index);
+
+                if (contentSizeSize == 2)
+                    _contentSize += 256;
+            };
+
+            // A single segment frame's window is all of it's content
+            if (isSingleSegment == true)
+                _windowSize = _contentSize;
+
+            if ((_windowSize > MAX_WINDOW_SIZE) || ((_uncompressedSize != UNKNOWN_SIZE) && (_contentSize != UNKNOWN_SIZE) && (_contentSize != _uncompressedSize)))
+                return Fail();
+
+            _blockMaximumSize = static_cast<size_t>(std::min<uint64_t>(std::max<uint64_t>(_windowSize, 1), MAX_BLOCK_SIZE));
+
+            AllocateWindow();
+
+            _headerSize = 0;
+            _state = State::BlockHeader;
+
+            return true;
+        };
+
+
+        /// <summary>
+        /// Makes sure the owned window can hold the history plus room for new blocks, unless the caller's buffer is used
+        /// </summary>
+        void AllocateWindow()
+        {
+            if (_isWindowExternal == true)
+                return;
+
+            uint64_t historySize = std::max(_windowSize, MIN_WINDOW_SIZE);
+
+            uint64_t contentSize = _contentSize;
+
+            if (contentSize == UNKNOWN_SIZE)
+                contentSize = _uncompressedSize;
+
+            size_t capacity = static_cast<size_t>(historySize + std::max<uint64_t>(historySize, MIN_HISTORY_SLACK) + MAX_BLOCK_SIZE);
+
+            // The whole content fits, the window then never has to move
+            if ((contentSize != UNKNOWN_SIZE) && (contentSize < capacity))
+                capacity = static_cast<size_t>(std::max<uint64_t>(contentSize, 1));
+
+            if (_ownedWindowCapacity < capacity)
+            {
+                _ownedWindow.reset(new uint8_t[capacity]);
+                _ownedWindowCapacity = capacity;
+            };
+
+            _window = _ownedWindow.get();
+            _windowCapacity = capacity;
+        };
+
+
+        /// <summary>
+        /// Makes room for a block at the end of the window by moving the history to the front, once every decoded byte was copied out
+        /// </summary>
+        /// <returns> The room for the block </returns>
+        size_t PrepareWindow()
+        {
+            if ((_isWindowExternal == false) && (_windowCapacity - _writeIndex < _blockMaximumSize))
+            {
+                const size_t historySize = static_cast<size_t>(std::min<uint64_t>(_windowSize, _writeIndex));
+
+                memmove(_window, &_window[_writeIndex - historySize], historySize);
+
+                _writeIndex = historySize;
+                _flushIndex = historySize;
+            };
+
+            return std::min(_windowCapacity - _writeIndex, _blockMaximumSize);
+        };
+
+
+        /// <summary>
+        /// Collects a block's input and decodes it
+        /// </summary>
+        bool ReadBlock(z_stream& stream)
+        {
+            const size_t inputSize = (_blockType == BlockType::Rle) ? 1 : _blockSize;
+            const uint8_t* input = nullptr;
+
+            // Blocks are decoded straight from the caller's input when all of it is there, which is the usual case
+            if ((_blockInputSize == 0) && (stream.avail_in >= inputSize))
+            {
+                input = stream.next_in;
+
+                stream.next_in += inputSize;
+                stream.avail_in -= static_cast<uInt>(inputSize);
+                stream.total_in += inputSize;
+            }
+            else
+            {
+                if (Collect(stream, _blockInput.get(), _blockInputSize, inputSize) == false)
+                    return false;
+
+                input = _blockInput.get();
+            };
+
+            const size_t room = PrepareWindow();
+            uint8_t* const output = &_window[_writeIndex];
+            size_t outputSize = 0;
+
+            switch (_blockType)
+            {
+                case BlockType::Raw:
+                {
+                    if (_blockSize > room)
+                        return Fail();
+
+                    memcpy(output, input, _blockSize);
+                    outputSize = _blockSize;
+                    break;
+                };
+
+                case BlockType::Rle:
+                {
+                    if (_blockSize > room)
+                        return Fail();
+
+                    memset(output, input[0], _blockSize);
+                    outputSize = _blockSize;
+                    break;
+                };
+
+                default:
+                {
+                    if (DecodeCompressedBlock(input, inputSize, room, outputSize) == false)
+                        return Fail();
+
+                    break;
+                };
+            };
+
+            UpdateHash(output, outputSize);
+
+            _writeIndex += outputSize;
+            _frameOutputSize += outputSize;
+
+            _blockInputSize = 0;
+
+            if (_isLastBlock == false)
+            {
+                _state = State::BlockHeader;
+                return true;
+            };
+
+            if ((_contentSize != UNKNOWN_SIZE) && (_frameOutputSize != _contentSize))
+                return Fail();
+
+            _state = (_hasChecksum == true) ? State::Checksum : State::Done;
+
+            return (_hasChecksum == true);
+        };
+
+
+        /// <summary>
+        /// Copies as many decoded bytes as fit out of the window into the stream's output buffer
+        /// </summary>
+        void Flush(z_stream& stream)
+        {
+            const size_t flushSize = std::min<size_t>(_writeIndex - _flushIndex, stream.avail_out);
+
+            // The bytes were decoded straight into the caller's buffer, they only have to be handed over
+            if ((_isWindowExternal == false) && (flushSize != 0))
+                memcpy(stream.next_out, &_window[_flushIndex], flushSize);
+
+            stream.next_out += flushSize;
+            stream.avail_out -= static_cast<uInt>(flushSize);
+            stream.total_out += flushSize;
+
+            _flushIndex += flushSize;
+        };
+
+
+        /// <summary>
+        /// Decodes a compressed block, it's literals section followed by it's sequences section
+        /// </summary>
+        /// <param name="input"> The block's data </param>
+        /// <param name="inputSize"> The size of the block's data </param>
+        /// <param name="room"> The most bytes the block may decode to </param>
+        /// <param name="outputSizeOut"> Receives the number of decoded bytes </param>
+        /// <returns> False if the block is invalid </returns>
+        bool DecodeCompressedBlock(const uint8_t* input, size_t inputSize, size_t room, size_t& outputSizeOut)
+        {
+            size_t literalsSectionSize = 0;
+
+            if (DecodeLiterals(input, inputSize, literalsSectionSize) == false)
+                return false;
+
+            return DecodeSequences(&input[literalsSectionSize], inputSize - literalsSectionSize, room, outputSizeOut);
+        };
+
+
+        /// <summary>
+        /// Decodes a block's literals section
+        /// </summary>
+        /// <param name="input"> The block's data </param>
+        /// <param name="inputSize"> The size of the block's data </param>
+        /// <param name="sectionSizeOut"> Receives the size of the literals section </param>
+        /// <returns> False if the section is invalid </returns>
+        bool DecodeLiterals(const uint8_t* input, size_t inputSize, size_t& sectionSizeOut)
+        {
+            if (inputSize == 0)
+                return false;
+
+            const unsigned literalsType = input[0] & 3;
+            const unsigned sizeFormat = (input[0] >> 2) & 3;
+
+            // Raw and RLE literals
+            if (literalsType < 2)
+            {
+                size_t headerSize = 1;
+                size_t regeneratedSize = input[0] >> 3;
+
+                if (sizeFormat == 1)
+                {
+                    if (inputSize < 2)
+                        return false;
+
+                    headerSize = 2;
+                    regeneratedSize = (input[0] >> 4) | (static_cast<size_t>(input[1]) << 4);
+                }
+                else if (sizeFormat == 3)
+                {
+                    if (inputSize < 3)
+                        return false;
+
+                    headerSize = 3;
+                    regeneratedSize = (input[0] >> 4) | (static_cast<size_t>(input[1]) << 4) | (static_cast<size_t>(input[2]) << 12);
+                };
+
+                if (regeneratedSize > _blockMaximumSize)
+                    return false;
+
+                if (literalsType == 0)
+                {
+                    if (inputSize - headerSize < regeneratedSize)
+                        return false;
+
+                    _literals = &input[headerSize];
+                    _literalsSize = regeneratedSize;
+                    sectionSizeOut = headerSize + regeneratedSize;
+
+                    return true;
+                };
+
+                if (inputSize - headerSize < 1)
+                    return false;
+
+                memset(_literalBuffer.get(), input[headerSize], regeneratedSize);
+
+                _literals = _literalBuffer.get();
+                _literalsSize = regeneratedSize;
+                sectionSizeOut = headerSize + 1;
+
+                return true;
+            };
+
+            // Huffman coded literals, with a new tree or the previous block's
+            static constexpr std::array<size_t, 4> HEADER_SIZES = { 3, 3, 4, 5 };
+            static constexpr std::array<unsigned, 4> SIZE_BITS = { 10, 10, 14, 18 };
+
+            const size_t headerSize = HEADER_SIZES[sizeFormat];
+
+            if (inputSize < headerSize)
+                return false;
+
+            uint64_t header = 0;
+
+            for (size_t index = 0; index < headerSize; index++)
+                header |= static_cast<uint64_t>(input[index]) << (8 * index);
+
+            const unsigned sizeBits = SIZE_BITS[sizeFormat];
+            const size_t regeneratedSize = static_cast<size_t>((header >> 4) & BitMask(sizeBits));
+            const size_t compressedSize = static_cast<size_t>((header >> (4 + sizeBits)) & BitMask(sizeBits));
+            const bool isSingleStream = (sizeFormat == 0);
+
+            if ((regeneratedSize > _blockMaximumSize) || (compressedSize > inputSize - headerSize))
+                return false;
+
+            const uint8_t* data = &input[headerSize];
+            size_t dataSize = compressedSize;
+
+            if (literalsType == 2)
+            {
+                size_t treeSize = 0;
+
+                if (ReadHuffmanTable(data, dataSize, treeSize) == false)
+                    return false;
+
+                data += treeSize;
+                dataSize -= treeSize;
+
+                _hasHuffmanTable = true;
+            }
+            else if (_hasHuffmanTable == false)
+                return false;
+
+            if (DecodeHuffmanLiterals(data, dataSize, regeneratedSize, isSingleStream) == false)
+                return false;
+
+            _literals = _literalBuffer.get();
+            _literalsSize = regeneratedSize;
+            sectionSizeOut = headerSize + compressedSize;
+
+            return true;
+        };
+
+
+        /// <summary>
+        /// Reads a Huffman tree description, the weights of the symbols either as 4 bit values or FSE compressed
+        /// </summary>
+        bool ReadHuffmanTable(const uint8_t* data, size_t dataSize, size_t& treeSizeOut)
+        {
+            if (dataSize == 0)
+                return false;
+
+            const uint8_t header = data[0];
+
+            std::array<uint8_t, MAX_HUFFMAN_SYMBOLS> weights = {};
+            size_t weightCount = 0;
+
+            if (header >= 128)
+            {
+                weightCount = header - 127;
+
+                const size_t byteCount = (weightCount + 1) / 2;
+
+                if (dataSize - 1 < byteCount)
+                    return false;
+
+                for (size_t index = 0; index < weightCount; index++)
+                    weights[index] = (index % 2 == 0) ? (data[1 + index / 2] >> 4) : (data[1 + index / 2] & 0xF);
+
+                treeSizeOut = 1 + byteCount;
+            }
+            else
+            {
+                const size_t compressedSize = header;
+
+                if ((compressedSize == 0) || (dataSize - 1 < compressedSize))
+                    return false;
+
+                FseTable weightTable;
+                size_t descriptionSize = 0;
+
+                if (ReadFseTable(&data[1], compressedSize, MAX_HUFFMAN_WEIGHT_LOG, MAX_HUFFMAN_BITS + 1, weightTable, descriptionSize) == false)
+                    return false;
+
+                BackwardBitReader reader;
+
+                if (reader.Initialize(&data[1 + descriptionSize], compressedSize - descriptionSize) == false)
+                    return false;
+
+                // Two interleaved states share the stream, it ends once a state update runs past it's start
+                uint32_t state1 = static_cast<uint32_t>(reader.Read(weightTable.accuracyLog));
+                uint32_t state2 = static_cast<uint32_t>(reader.Read(weightTable.accuracyLog));
+
+                while (true)
+                {
+                    if (weightCount + 2 > MAX_HUFFMAN_SYMBOLS - 1)
+                        return false;
+
+                    const FseEntry& entry1 = weightTable.entries[state1];
+                    weights[weightCount++] = entry1.symbol;
+                    state1 = entry1.baseline + static_cast<uint32_t>(reader.Read(entry1.bitCount));
+
+                    if (reader.position < 0)
+                    {
+                        weights[weightCount++] = weightTable.entries[state2].symbol;
+                        break;
+                    };
+
+                    const FseEntry& entry2 = weightTable.entries[state2];
+                    weights[weightCount++] = entry2.symbol;
+                    state2 = entry2.baseline + static_cast<uint32_t>(reader.Read(entry2.bitCount));
+
+                    if (reader.position < 0)
+                    {
+                        weights[weightCount++] = weightTable.entries[state1].symbol;
+                        break;
+                    };
+                };
+
+                treeSizeOut = 1 + compressedSize;
+            };
+
+            return BuildHuffmanTable(weights, weightCount);
+        };
+
+
+        /// <summary>
+        /// Builds the Huffman decoding table from the weights, the last symbol's weight is implied by the others
+        /// </summary>
+        bool BuildHuffmanTable(std::array<uint8_t, MAX_HUFFMAN_SYMBOLS>& weights, size_t weightCount)
+        {
+            uint32_t weightSum = 0;
+
+            for (size_t index = 0; index < weightCount; index++)
+            {
+                if (weights[index] > MAX_HUFFMAN_BITS)
+                    return false;
+
+                if (weights[index] != 0)
+                    weightSum += uint32_t(1) << (weights[index] - 1);
+            };
+
+            if (weightSum == 0)
+                return false;
+
+            const unsigned maxBits = HighestBit(weightSum) + 1;
+
+            if (maxBits > MAX_HUFFMAN_BITS)
+                return false;
+
+            // The missing weight completes the sum to a power of two
+            const uint32_t leftover = (uint32_t(1) << maxBits) - weightSum;
+
+            if ((leftover & (leftover - 1)) != 0)
+                return false;
+
+            weights[weightCount] = static_cast<uint8_t>(HighestBit(leftover) + 1);
+
+            const size_t symbolCount = weightCount + 1;
+
+            // Codes are assigned from the longest to the shortest, every code of a length covers 2^(maxBits - length) entries
+            std::array<uint32_t, MAX_HUFFMAN_BITS + 2> lengthCounts = {};
+
+            for (size_t symbol = 0; symbol < symbolCount; symbol++)
+            {
+                if (weights[symbol] != 0)
+                    lengthCounts[maxBits + 1 - weights[symbol]]++;
+            };
+
+            std::array<uint32_t, MAX_HUFFMAN_BITS + 2> nextIndices = {};
+            uint32_t index = 0;
+
+            for (unsigned length = maxBits; length >= 1; length--)
+            {
+                nextIndices[length] = index;
+                index += lengthCounts[length] << (maxBits - length);
+            };
+
+            if (index != (uint32_t(1) << maxBits))
+                return false;
+
+            _huffmanTable.maxBits = maxBits;
+
+            for (size_t symbol = 0; symbol < symbolCount; symbol++)
+            {
+                if (weights[symbol] == 0)
+                    continue;
+
+                const unsigned length = maxBits + 1 - weights[symbol];
+                const uint32_t entryCount = uint32_t(1) << (maxBits - length);
+                const uint16_t entry = static_cast<uint16_t>((symbol << 4) | length);
+
+                std::fill_n(&_huffmanTable.entries[nextIndices[length]], entryCount, entry);
+
+                nextIndices[length] += entryCount;
+            };
+
+            return true;
+        };
+
+
+        /// <summary>
+        /// Decodes Huffman coded literals from one stream, or four streams that each hold a quarter of them
+        /// </summary>
+        bool DecodeHuffmanLiterals(const uint8_t* data, size_t dataSize, size_t regeneratedSize, bool isSingleStream)
+        {
+            uint8_t* output = _literalBuffer.get();
+
+            if (isSingleStream == true)
+                return DecodeHuffmanStream(data, dataSize, output, regeneratedSize);
+
+            // A jump table with the sizes of the first three streams
+            static constexpr size_t JUMP_TABLE_SIZE = 6;
+
+            if (dataSize < JUMP_TABLE_SIZE)
+                return false;
+
+            const size_t size1 = ReadUInt16(&data[0]);
+            const size_t size2 = ReadUInt16(&data[2]);
+            const size_t size3 = ReadUInt16(&data[4]);
+
+            if (size1 + size2 + size3 > dataSize - JUMP_TABLE_SIZE)
+                return false;
+
+            const size_t size4 = dataSize - JUMP_TABLE_SIZE - size1 - size2 - size3;
+            const size_t segmentSize = (regeneratedSize + 3) / 4;
+
+            if (segmentSize * 3 > regeneratedSize)
+                return false;
+
+            const uint8_t* stream = &data[JUMP_TABLE_SIZE];
+
+            return (DecodeHuffmanStream(stream, size1, output, segmentSize) == true) &&
+                   (DecodeHuffmanStream(stream + size1, size2, output + segmentSize, segmentSize) == true) &&
+                   (DecodeHuffmanStream(stream + size1 + size2, size3, output + 2 * segmentSize, segmentSize) == true) &&
+                   (DecodeHuffmanStream(stream + size1 + size2 + size3, size4, output + 3 * segmentSize, regeneratedSize - 3 * segmentSize) == true);
+        };
+
+
+        /// <summary>
+        /// Decodes a single Huffman coded stream, which has to end exactly with it's last symbol
+        /// </summary>
+        bool DecodeHuffmanStream(const uint8_t* data, size_t dataSize, uint8_t* output, size_t count)
+        {
+            BackwardBitReader reader;
+
+            if (reader.Initialize(data, dataSize) == false)
+                return false;
+
+            const unsigned maxBits = _huffmanTable.maxBits;
+            const uint16_t* entries = _huffmanTable.entries.data();
+
+            for (size_t index = 0; index < count; index++)
+            {
+                const uint16_t entry = entries[reader.Peek(maxBits)];
+
+                output[index] = static_cast<uint8_t>(entry >> 4);
+                reader.position -= entry & 0xF;
+            };
+
+            return (reader.position == 0);
+        };
+
+
+        /// <summary>
+        /// Reads an FSE table description, the normalized probability of every symbol, and builds the decoding table from it
+        /// </summary>
+        /// <param name="data"> The description </param>
+        /// <param name="dataSize"> The most bytes the description can take </param>
+        /// <param name="maxAccuracyLog"> The largest accuracy allowed for this kind of table </param>
+        /// <param name="maxSymbol"> The largest symbol allowed for this kind of table </param>
+        /// <param name="table"> Receives the decoding table </param>
+        /// <param name="sizeOut"> Receives the size of the description </param>
+        /// <returns> False if the description is invalid </returns>
+        static bool ReadFseTable(const uint8_t* data, size_t dataSize, unsigned maxAccuracyLog, unsigned maxSymbol, FseTable& table, size_t& sizeOut)
+        {
+            // A forward bit reader, the lowest bit of every byte first
+            size_t bitPosition = 0;
+            const uint64_t bitCount = static_cast<uint64_t>(dataSize) * 8;
+
+            const auto readBits = [&](unsigned count)
+            {
+                uint32_t value = 0;
+
+                for (unsigned bit = 0; bit < count; bit++, bitPosition++)
+                {
+                    if ((bitPosition < bitCount) && ((data[bitPosition >> 3] >> (bitPosition & 7)) & 1) != 0)
+                        value |= uint32_t(1) << bit;
+                };
+
+                return value;
+            };
+
+            const unsigned accuracyLog = readBits(4) + 5;
+
+            if (accuracyLog > maxAccuracyLog)
+                return false;
+
+            std::array<int16_t, MAX_MATCH_LENGTH_CODE + MAX_HUFFMAN_SYMBOLS> distribution = {};
+            int32_t remaining = int32_t(1) << accuracyLog;
+            unsigned symbol = 0;
+
+            while ((remaining > 0) && (symbol <= maxSymbol))
+            {
+                // The number of bits needed for every value up to remaining + 1, small values use one bit less
+                const unsigned bits = HighestBit(static_cast<uint64_t>(remaining) + 1) + 1;
+                uint32_t value = readBits(bits);
+
+                const uint32_t lowerMask = (uint32_t(1) << (bits - 1)) - 1;
+                const uint32_t threshold = (uint32_t(1) << bits) - 1 - (static_cast<uint32_t>(remaining) + 1);
+
+                if ((value & lowerMask) < threshold)
+                {
+                    bitPosition--;
+                    value &= lowerMask;
+                }
+                else if (value > lowerMask)
+                    value -= threshold;
+
+                const int16_t probability = static_cast<int16_t>(value) - 1;
+
+                remaining -= (probability < 0) ? -probability : probability;
+                distribution[symbol++] = probability;
+
+                // Zero probabilities are followed by a 2 bit count of further zeros, 3 means the count goes on
+                if (probability == 0)
+                {
+                    uint32_t repeat = readBits(2);
+
+                    while (true)
+                    {
+                        for (uint32_t index = 0; (index < repeat) && (symbol <= maxSymbol); index++)
+                            distribution[symbol++] = 0;
+
+                        if (repeat != 3)
+                            break;
+
+                        repeat = readBits(2);
+                    };
+                };
+            };
+
+            sizeOut = (bitPosition + 7) / 8;
+
+            if ((remaining != 0) || (bitPosition > bitCount))
+                return false;
+
+            return BuildFseTable(distribution.data(), symbol, accuracyLog, table);
+        };
+
+
+        /// <summary>
+        /// Spreads the symbols over the states by their probability and works out every state's successors
+        /// </summary>
+        static bool BuildFseTable(const int16_t* distribution, unsigned symbolCount, unsigned accuracyLog, FseTable& table)
+        {
+            const uint32_t tableSize = uint32_t(1) << accuracyLog;
+
+            std::array<uint16_t, MAX_MATCH_LENGTH_CODE + MAX_HUFFMAN_SYMBOLS> nextStates = {};
+            uint32_t highThreshold = tableSize;
+
+            // Symbols with a probability below 1 get a single state each, at the end of the table
+            for (unsigned symbol = 0; symbol < symbolCount; symbol++)
+            {
+                if (distribution[symbol] == -1)
+                {
+                    if (highThreshold == 0)
+                        return false;
+
+                    table.entries[--highThreshold].symbol = static_cast<uint8_t>(symbol);
+                    nextStates[symbol] = 1;
+                };
+            };
+
+            const uint32_t step = (tableSize >> 1) + (tableSize >> 3) + 3;
+            const uint32_t mask = tableSize - 1;
+            uint32_t position = 0;
+
+            for (unsigned symbol = 0; symbol < symbolCount; symbol++)
+            {
+                if (distribution[symbol] <= 0)
+                    continue;
+
+                nextStates[symbol] = static_cast<uint16_t>(distribution[symbol]);
+
+                for (int16_t count = 0; count < distribution[symbol]; count++)
+                {
+                    table.entries[position].symbol = static_cast<uint8_t>(symbol);
+
+                    do
+                    {
+                        position = (position + step) & mask;
+                    }
+                    while (position >= highThreshold);
+                };
+            };
+
+            if (position != 0)
+                return false;
+
+            for (uint32_t state = 0; state < tableSize; state++)
+            {
+                FseEntry& entry = table.entries[state];
+
+                const uint16_t nextState = nextStates[entry.symbol]++;
+
+                entry.bitCount = static_cast<uint8_t>(accuracyLog - HighestBit(nextState));
+                entry.baseline = static_cast<uint16_t>((static_cast<uint32_t>(nextState) << entry.bitCount) - tableSize);
+            };
+
+            table.accuracyLog = accuracyLog;
+
+            return true;
+        };
+
+
+        /// <summary>
+        /// Returns the predefined tables, built the first time they're needed
+        /// </summary>
+        static const std::array<FseTable, 3>& GetPredefinedTables()
+        {
+            static const std::array<FseTable, 3> tables = []()
+            {
+                std::array<FseTable, 3> predefinedTables;
+
+                BuildFseTable(LITERAL_LENGTH_DEFAULT_DISTRIBUTION.data(), static_cast<unsigned>(LITERAL_LENGTH_DEFAULT_DISTRIBUTION.size()), 6, predefinedTables[0]);
+                BuildFseTable(OFFSET_DEFAULT_DISTRIBUTION.data(), static_cast<unsigned>(OFFSET_DEFAULT_DISTRIBUTION.size()), 5, predefinedTables[1]);
+                BuildFseTable(MATCH_LENGTH_DEFAULT_DISTRIBUTION.data(), static_cast<unsigned>(MATCH_LENGTH_DEFAULT_DISTRIBUTION.size()), 6, predefinedTables[2]);
+
+                return predefinedTables;
+            }();
+
+            return tables;
+        };
+
+
+        /// <summary>
+        /// Picks the table for one of the symbol types of a sequences section
+        /// </summary>
+        /// <returns> False if the table is invalid, or repeats a table that doesn't exist </returns>
+        static bool SelectTable(SymbolMode mode, const FseTable& predefinedTable, FseTable& storage, const FseTable*& table,
+                                unsigned maxAccuracyLog, unsigned maxSymbol, const uint8_t* data, size_t dataSize, size_t& offset)
+        {
+            switch (mode)
+            {
+                case SymbolMode::Predefined:
+                {
+                    table = &predefinedTable;
+                    return true;
+                };
+
+                case SymbolMode::Rle:
+                {
+                    if ((offset >= dataSize) || (data[offset] > maxSymbol))
+                        return false;
+
+                    storage.accuracyLog = 0;
+                    storage.entries[0] = FseEntry { data[offset], 0, 0 };
+
+                    offset++;
+                    table = &storage;
+
+                    return true;
+                };
+
+                case SymbolMode::FseCompressed:
+                {
+                    size_t descriptionSize = 0;
+
+                    if (ReadFseTable(&data[offset], dataSize - offset, maxAccuracyLog, maxSymbol, storage, descriptionSize) == false)
+                        return false;
+
+                    offset += descriptionSize;
+                    table = &storage;
+
+                    return true;
+                };
+
+                default:
+                    return (table != nullptr);
+            };
+        };
+
+
+        /// <summary>
+        /// Decodes a block's sequences section and executes the sequences, each copying literals and then a match
+        /// </summary>
+        /// <param name="data"> The sequences section </param>
+        /// <param name="dataSize"> The size of the sequences section </param>
+        /// <param name="room"> The most bytes the block may decode to </param>
+        /// <param name="outputSizeOut"> Receives the number of decoded bytes </param>
+        /// <returns> False if the section is invalid </returns>
+        bool DecodeSequences(const uint8_t* data, size_t dataSize, size_t room, size_t& outputSizeOut)
+        {
+            if (dataSize == 0)
+                return false;
+
+            size_t sequenceCount = data[0];
+            size_t offset = 1;
+
+            if (sequenceCount >= 255)
+            {
+                if (dataSize < 3)
+                    return false;
+
+                sequenceCount = ReadUInt16(&data[1]) + 0x7F00;
+                offset = 3;
+            }
+            else if (sequenceCount >= 128)
+            {
+                if (dataSize < 2)
+                    return false;
+
+                sequenceCount = ((sequenceCount - 128) << 8) + data[1];
+                offset = 2;
+            };
+
+            uint8_t* const output = &_window[_writeIndex];
+            const uint8_t* literals = _literals;
+            size_t literalsRemaining = _literalsSize;
+            size_t outputSize = 0;
+
+            if (sequenceCount != 0)
+            {
+                if (offset >= dataSize)
+                    return false;
+
+                const uint8_t modes = data[offset++];
+
+                if ((modes & 3) != 0)
+                    return false;
+
+                const std::array<FseTable, 3>& predefinedTables = GetPredefinedTables();
+
+                if ((SelectTable(static_cast<SymbolMode>(modes >> 6), predefinedTables[0], _literalLengthStorage, _literalLengthTable,
+                                 MAX_LITERAL_LENGTH_LOG, MAX_LITERAL_LENGTH_CODE, data, dataSize, offset) == false) ||
+                    (SelectTable(static_cast<SymbolMode>((modes >> 4) & 3), predefinedTables[1], _offsetStorage, _offsetTable,
+                                 MAX_OFFSET_LOG, MAX_OFFSET_CODE, data, dataSize, offset) == false) ||
+                    (SelectTable(static_cast<SymbolMode>((modes >> 2) & 3), predefinedTables[2], _matchLengthStorage, _matchLengthTable,
+                                 MAX_MATCH_LENGTH_LOG, MAX_MATCH_LENGTH_CODE, data, dataSize, offset) == false))
+                    return false;
+
+                BackwardBitReader reader;
+
+                if ((offset >= dataSize) || (reader.Initialize(&data[offset], dataSize - offset) == false))
+                    return false;
+
+                const FseEntry* literalLengthEntries = _literalLengthTable->entries.data();
+                const FseEntry* offsetEntries = _offsetTable->entries.data();
+                const FseEntry* matchLengthEntries = _matchLengthTable->entries.data();
+
+                uint32_t literalLengthState = static_cast<uint32_t>(reader.Read(_literalLengthTable->accuracyLog));
+                uint32_t offsetState = static_cast<uint32_t>(reader.Read(_offsetTable->accuracyLog));
+                uint32_t matchLengthState = static_cast<uint32_t>(reader.Read(_matchLengthTable->accuracyLog));
+
+                // The history before this block, matches can reach into it
+                const size_t historySize = static_cast<size_t>(std::min<uint64_t>(_windowSize, _writeIndex));
+
+                for (size_t sequence = 0; sequence < sequenceCount; sequence++)
+                {
+                    const FseEntry& literalLengthEntry = literalLengthEntries[literalLengthState];
+                    const FseEntry& offsetEntry = offsetEntries[offsetState];
+                    const FseEntry& matchLengthEntry = matchLengthEntries[matchLengthState];
+
+                    const unsigned offsetCode = offsetEntry.symbol;
+                    const unsigned matchLengthCode = matchLengthEntry.symbol;
+                    const unsigned literalLengthCode = literalLengthEntry.symbol;
+
+                    // The extra bits come in the order offset, match length, literal length
+                    const uint32_t offsetValue = (uint32_t(1) << offsetCode) + static_cast<uint32_t>(reader.Read(offsetCode));
+                    const size_t matchLength = MATCH_LENGTH_BASELINES[matchLengthCode] + static_cast<size_t>(reader.Read(MATCH_LENGTH_EXTRA_BITS[matchLengthCode]));
+                    const size_t literalLength = LITERAL_LENGTH_BASELINES[literalLengthCode] + static_cast<size_t>(reader.Read(LITERAL_LENGTH_EXTRA_BITS[literalLengthCode]));
+
+                    // The last sequence doesn't update the states
+                    if (sequence + 1 < sequenceCount)
+                    {
+                        literalLengthState = literalLengthEntry.baseline + static_cast<uint32_t>(reader.Read(literalLengthEntry.bitCount));
+                        matchLengthState = matchLengthEntry.baseline + static_cast<uint32_t>(reader.Read(matchLengthEntry.bitCount));
+                        offsetState = offsetEntry.baseline + static_cast<uint32_t>(reader.Read(offsetEntry.bitCount));
+                    };
+
+                    const size_t matchOffset = ResolveOffset(offsetValue, literalLength);
+
+                    if ((literalLength > literalsRemaining) || (literalLength + matchLength > room - outputSize))
+                        return false;
+
+                    memcpy(&output[outputSize], literals, literalLength);
+
+                    literals += literalLength;
+                    literalsRemaining -= literalLength;
+                    outputSize += literalLength;
+
+                    if ((matchOffset == 0) || (matchOffset > historySize + outputSize))
+                        return false;
+
+                    CopyMatch(&output[outputSize], matchOffset, matchLength);
+
+                    outputSize += matchLength;
+                };
+
+                // Every bit of the stream has to be used
+                if (reader.position != 0)
+                    return false;
+            }
+            else if (offset != dataSize)
+                return false;
+
+            // The literals after the last sequence
+            if (literalsRemaining > room - outputSize)
+                return false;
+
+            memcpy(&output[outputSize], literals, literalsRemaining);
+            outputSize += literalsRemaining;
+
+            outputSizeOut = outputSize;
+
+            return true;
+        };
+
+
+        /// <summary>
+        /// Turns a sequence's offset value into a match offset, values 1 to 3 pick one of the repeat offsets
+        /// </summary>
+        size_t ResolveOffset(uint32_t offsetValue, size_t literalLength)
+        {
+            if (offsetValue > 3)
+            {
+                const uint32_t matchOffset = offsetValue - 3;
+
+                _repeatOffsets[2] = _repeatOffsets[1];
+                _repeatOffsets[1] = _repeatOffsets[0];
+                _repeatOffsets[0] = matchOffset;
+
+                return matchOffset;
+            };
+
+            // Without literals the repeat offsets shift by one, the first one would just continue the previous match
+            const unsigned index = offsetValue - 1 + ((literalLength == 0) ? 1 : 0);
+
+            if (index == 0)
+                return _repeatOffsets[0];
+
+            const uint32_t matchOffset = (index < 3) ? _repeatOffsets[index] : (_repeatOffsets[0] - 1);
+
+            if (index > 1)
+                _repeatOffsets[2] = _repeatOffsets[1];
+
+            _repeatOffsets[1] = _repeatOffsets[0];
+            _repeatOffsets[0] = matchOffset;
+
+            return matchOffset;
+        };
+
+
+        /// <summary>
+        /// Copies a match, that can overlap itself when it's offset is smaller than it's length
+        /// </summary>
+        static void CopyMatch(uint8_t* destination, size_t offset, size_t length)
+        {
+            if (offset >= length)
+            {
+                memcpy(destination, destination - offset, length);
+                return;
+            };
+
+            // The match repeats the last offset bytes, copied in pieces of a growing multiple of offset so no piece overlaps itself
+            size_t copied = 0;
+            size_t distance = offset;
+
+            while (copied < length)
+            {
+                const size_t copySize = std::min(distance, length - copied);
+
+                memcpy(&destination[copied], &destination[copied] - distance, copySize);
+
+                copied += copySize;
+                distance = ((copied + offset) / offset) * offset;
+            };
+        };
+
+
+        static uint64_t RotateLeft(uint64_t value, unsigned count)
+        {
+            return (value << count) | (value >> (64 - count));
+        };
+
+
+        static constexpr uint64_t HASH_PRIME_1 = 11400714785074694791ULL;
+        static constexpr uint64_t HASH_PRIME_2 = 14029467366897019727ULL;
+        static constexpr uint64_t HASH_PRIME_3 = 1609587929392839161ULL;
+        static constexpr uint64_t HASH_PRIME_4 = 9650029242287828579ULL;
+        static constexpr uint64_t HASH_PRIME_5 = 2870177450012600261ULL;
+
+
+        static uint64_t HashRound(uint64_t accumulator, uint64_t input)
+        {
+            accumulator += input * HASH_PRIME_2;
+            accumulator = RotateLeft(accumulator, 31);
+
+            return accumulator * HASH_PRIME_1;
+        };
+
+
+        void ResetHash()
+        {
+            _hashLanes = { HASH_PRIME_1 + HASH_PRIME_2, HASH_PRIME_2, 0, 0 - HASH_PRIME_1 };
+            _hashBufferSize = 0;
+            _hashedSize = 0;
+        };
+
+
+        /// <summary>
+        /// Adds decoded data to the XXH64 of the frame's content, in stripes of 32 bytes
+        /// </summary>
+        void UpdateHash(const uint8_t* data, size_t size)
+        {
+            if (_hasChecksum == false)
+                return;
+
+            _hashedSize += size;
+
+            if (_hashBufferSize != 0)
+            {
+                const size_t copySize = std::min(size, _hashBuffer.size() - _hashBufferSize);
+
+                memcpy(&_hashBuffer[_hashBufferSize], data, copySize);
+
+                _hashBufferSize += copySize;
+                data += copySize;
+                size -= copySize;
+
+                if (_hashBufferSize < _hashBuffer.size())
+                    return;
+
+                HashStripe(_hashBuffer.data());
+                _hashBufferSize = 0;
+            };
+
+            while (size >= _hashBuffer.size())
+            {
+                HashStripe(data);
+
+                data += _hashBuffer.size();
+                size -= _hashBuffer.size();
+            };
+
+            memcpy(_hashBuffer.data(), data, size);
+            _hashBufferSize = size;
+        };
+
+
+        void HashStripe(const uint8_t* data)
+        {
+            for (size_t lane = 0; lane < 4; lane++)
+                _hashLanes[lane] = HashRound(_hashLanes[lane], ReadUInt64(&data[lane * 8]));
+        };
+
+
+        uint64_t FinishHash() const
+        {
+            uint64_t hash = 0;
+
+            if (_hashedSize >= _hashBuffer.size())
+            {
+                hash = RotateLeft(_hashLanes[0], 1) + RotateLeft(_hashLanes[1], 7) + RotateLeft(_hashLanes[2], 12) + RotateLeft(_hashLanes[3], 18);
+
+                for (size_t lane = 0; lane < 4; lane++)
+                    hash = (hash ^ HashRound(0, _hashLanes[lane])) * HASH_PRIME_1 + HASH_PRIME_4;
+            }
+            else
+                hash = HASH_PRIME_5;
+
+            hash += _hashedSize;
+
+            size_t index = 0;
+
+            for (; index + 8 <= _hashBufferSize; index += 8)
+                hash = RotateLeft(hash ^ HashRound(0, ReadUInt64(&_hashBuffer[index])), 27) * HASH_PRIME_1 + HASH_PRIME_4;
+
+            if (index + 4 <= _hashBufferSize)
+            {
+                hash = RotateLeft(hash ^ (static_cast<uint64_t>(ReadUInt32(&_hashBuffer[index])) * HASH_PRIME_1), 23) * HASH_PRIME_2 + HASH_PRIME_3;
+                index += 4;
+            };
+
+            for (; index < _hashBufferSize; index++)
+                hash = RotateLeft(hash ^ (_hashBuffer[index] * HASH_PRIME_5), 11) * HASH_PRIME_1;
+
+            hash ^= hash >> 33;
+            hash *= HASH_PRIME_2;
+            hash ^= hash >> 29;
+            hash *= HASH_PRIME_3;
+            hash ^= hash >> 32;
+
+            return hash;
+        };
+
+    };
+
+};